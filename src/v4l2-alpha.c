@@ -32,6 +32,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
 #include <linux/fb.h>
 
 #include "xf86.h"
@@ -43,23 +44,90 @@
 #include "regionstr.h"
 #include "inputstr.h"
 #include "mipointrst.h"
+#include "propertyst.h"
+#include "windowstr.h"
 #include "xf86str.h"
 #include "gcstruct.h"
 #include "shadow.h"
 #include "fb.h"
 #include "v4l2.h"
+#include "v4l2-blit.h"
+#include "v4l2-tiles.h"
+#include "v4l2-compose.h"
+#include "v4l2-update.h"
+#include "v4l2-convert.h"
+
+#ifndef FBIO_WAITFORVSYNC
+#  define FBIO_WAITFORVSYNC _IOW('F', 0x20, __u32)
+#endif
 
-static Bool alpha = FALSE;
+static Bool alpha = FALSE;      /* screens set up */
+static Bool argb = FALSE;       /* .. with an alpha channel */
 
-/* track the clip associated with each xv port indexed by pPPriv->nr
+/* track the clip associated with each xv port indexed by pPPriv->nr.
+ * Every update goes through what is at the start of each port's entry, so
+ * entries start on a cache line, and that part of it fits in one (on 32
+ * bit):
  */
-static struct {
+typedef struct {
+    Bool enabled;           /* port set up for alpha, or composited */
+    Bool composite;         /* .. the latter, see below */
     RegionPtr clip;
-    Bool updated;
-} * regions = NULL;
+    ScreenPtr pScreen;
+    int updated;            /* pages the hole still has to be punched in */
+    V4L2TileMask mask;      /* tiles covered by clip */
+
+    /* video drawn into the hole by us (see V4L2SetupComposite()): */
+    V4L2ScaleImage frame;   /* latest frame, none if 0 wide */
+    int matrix;             /* V4L2_MATRIX_* */
+    short x, y;             /* screen position of the frame */
+    Bool fresh;             /* not drawn yet */
+} V4L2_CACHE_ALIGNED V4L2Region;
+
+static V4L2Region *regions = NULL;
+
+/* per update scratch (see v4l2-update.c): the clips of the ports, those
+ * masked out of the damage and the union of their masks when there is more
+ * than one, and the compose inputs of a single pass update
+ */
+static V4L2UpdateClip *updateClips = NULL;
+static V4L2TileBoxList *clipLists = NULL;
+static V4L2TileMask clipMask[MAXSCREENS];
+static V4L2ComposeInput *composeInputs = NULL;
 
 static int numRegions = 0;
 static int activeClips = 0;
+static int compositeClips = 0;
+
+/* with the framebuffer rotated, the solid and transparent spans side by
+ * side in a band of a single pass update, drawn in one walk down the
+ * framebuffer's rows once the band moves on (see V4L2RunAdd()), rather
+ * than as a strip each:
+ */
+#define RUN_MAX_HOLES   8
+
+static struct {
+    Bool enabled, pending;
+    BoxRec box;
+    BoxRec holes[RUN_MAX_HOLES];
+    int nholes;
+} run;
+
+/* where the video goes on its way to the framebuffer, when the cursor has
+ * to be blended over it or the framebuffer is rotated:
+ */
+static uint32_t *compositeScratch = NULL;
+static int compositeScratchSize = 0;
+
+/* windows whose per-pixel alpha is passed through to the framebuffer, so
+ * the display controller blends them over the video (see OSDAlpha option)
+ */
+static WindowPtr *osdWindows = NULL;
+static int numOsdWindows = 0;
+static Atom osdAtom = None;
+
+static DestroyWindowProcPtr savedDestroyWindow[MAXSCREENS];
+static CreateWindowProcPtr savedCreateWindow[MAXSCREENS];
 
 /* ---------------------------------------------------------------------- */
 /* For alpha blending, we want the alpha channel value to be 1's for 100%
@@ -69,10 +137,6 @@ static int activeClips = 0;
  * framebuffer to framebuffer.
  */
 
-#define WEAK __attribute__((weak))
-#define LIKELY(x)      __builtin_expect(!!(x), 1)
-#define UNLIKELY(x)    __builtin_expect(!!(x), 0)
-
 static DevPrivateKey miPointerPrivKey = &miPointerPrivKey;
 
 #define MIPOINTER(dev) \
@@ -80,54 +144,324 @@ static DevPrivateKey miPointerPrivKey = &miPointerPrivKey;
 #define DevHasCursor(pDev) \
     ((pDev)->spriteInfo && (pDev)->spriteInfo->spriteOwner)
 
-#define SPRITE_PAD  8
+static const void *opTransparent=(void *)1, *opSolid=(void *)3, *opOsd=(void *)5;
+
+/* what was last drawn for the cursor, per page: */
+static RegionPtr cursorRegion[2];
+
+/* double buffering (see PageFlip option).  Updates are drawn into the page
+ * that isn't shown, which is then panned to at vblank.  Each page has to
+ * catch up with the damage the other page got since it was last drawn:
+ */
+static struct {
+    Bool flip;
+    int fd;
+    int page;                   /* page being drawn */
+    int rows;                   /* rows per page (yres) */
+    unsigned long frameUsec;    /* refresh period */
+    uint64_t panTime;           /* when the last pan was requested */
+    unsigned long waitUsec;     /* waited for it before drawing again */
+    RegionPtr pending[2];       /* damage not yet drawn into each page */
+    struct fb_var_screeninfo var;
+} pages[MAXSCREENS];
+
+#define PAGE_MASK(pScreen)  (pages[(pScreen)->myNum].flip ? 0x3 : 0x1)
+
+/* content hashes of the framebuffer, per 64x64 tile (see TileHash option).
+ * A tile's hash is that of the shadow when it was last written solid, and
+ * is cleared (0) when anything else is written into the tile, so that a
+ * solid write is only skipped when the tile would end up the same anyway.
+ */
+#define HASH_SHIFT  6
+#define HASH_SIZE   (1 << HASH_SHIFT)
+
+static struct {
+    int cols, rows;
+    uint64_t *hash[2];          /* per page */
+    uint32_t *stamp;            /* update the tile was last hashed in */
+    uint8_t *changed;           /* .. and whether it had changed */
+    uint32_t seq;               /* current update */
+    xf86EnterVTProc *EnterVT;
+} hashTiles[MAXSCREENS];
+
+/* damage held back by the update budget (see UpdateBudget option), by the
+ * number of updates it has waited less one.  The oldest is drawn regardless
+ * of the budget.  A timer brings the held back damage back into the shadow
+ * damage, so that it gets drawn even if nothing else changes.  The timer
+ * doesn't outlive the screen, nor run while switched away:
+ */
+#define BUDGET_AGES         4
+#define V4L2_BUDGET_MSEC    16
+
+static struct {
+    RegionPtr deferred[BUDGET_AGES];
+    shadowBufPtr pBuf;          /* of the last update */
+    OsTimerPtr timer;
+    CloseScreenProcPtr CloseScreen;
+    xf86LeaveVTProc *LeaveVT;
+} budgets[MAXSCREENS];
+
+typedef struct {
+    BoxRec box;
+    int age;                    /* updates waited so far */
+    int dest;                   /* -1 to draw now, else deferred[] index */
+    unsigned long dist;         /* squared, from the cursor hot spot */
+} V4L2BudgetBox;
+
+static V4L2BudgetBox *budgetBoxes = NULL;
+static BoxPtr budgetRects = NULL;
+static int budgetSize = 0;
+
+/* rendering straight into the framebuffer, without a shadow (see
+ * DirectRender option).  The damage is tracked the way the shadow layer
+ * would, and fixed up in place from the block handler through a shadowBufRec
+ * of our own whose shadow is the framebuffer itself, so that the update
+ * path stays the same.  Until the block handler runs, what X has drawn has
+ * alpha 0, and the video (or background) shows through it:
+ */
+enum { DIRECT_OFF, DIRECT_PENDING, DIRECT_ACTIVE };
+
+static struct {
+    int state;
+    shadowBufRec buf;
+    ScreenBlockHandlerProcPtr BlockHandler;
+} direct[MAXSCREENS];
 
-static const void *opTransparent=(void *)1, *opSolid=(void *)3;
+#define DIRECT(pScreen)  (direct[(pScreen)->myNum].state == DIRECT_ACTIVE)
 
-static RegionPtr cursorRegion;
+/* set once the shadow layer asks for our update function: */
+static Bool shadowUsed = FALSE;
 
-WEAK void
-V4L2ShadowBlitTransparentARGB32(void *winBase, int winStride, int w, int h)
+/* the shadow moved into memory of our own (see HugeShadow option), which
+ * is moved again if the pixmap is pointed elsewhere, as it is for a new
+ * server generation:
+ */
+static struct {
+    void *mem;
+    size_t size;
+    Bool failed;
+} hugeShadows[MAXSCREENS];
+
+/* count region allocations against the screen they are made for: */
+#define V4L2RegionCreate(pScreen, rect, size)                               \
+    (V4L2_STAT_ADD(v4l2ScreenStats[(pScreen)->myNum].regionAllocs, 1),      \
+     RegionCreate(rect, size))
+
+static inline int
+V4L2OpIndex(const void *op)
 {
-    while (h--) {
-        memset (winBase, 0x00, w * sizeof(FbBits));
-        winBase += winStride;
-    }
+    if (op == opSolid)
+        return V4L2_OP_SOLID;
+    if (op == opTransparent)
+        return V4L2_OP_TRANSPARENT;
+    if (op == opOsd)
+        return V4L2_OP_OSD;
+    return V4L2_OP_CURSOR;
 }
 
-WEAK void
-V4L2ShadowBlitSolidARGB32(void *winBase, int winStride,
-        void *shaBase, int shaStride, int w, int h)
+/* orientation of the framebuffer relative to the screen, as the shadow
+ * layer's randr bits (see shadowUpdateRotatePackedWeak()), or 0 if it is
+ * the same:
+ */
+static int rotation[MAXSCREENS];
+
+/* framebuffer coordinates of a screen pixel.  Reflection is applied first,
+ * then rotation, as in the shadow layer's own rotated updater:
+ */
+static inline void
+V4L2RotatePoint(ScreenPtr pScreen, int x, int y, int *fx, int *fy)
 {
-    while (h--) {
-        FbBits *win = winBase;
-        FbBits *sha = shaBase;
-        int i = w;
-        while (i--)
-            *win++ = 0xff000000 | *sha++;
-        winBase += winStride;
-        shaBase += shaStride;
+    int randr = rotation[pScreen->myNum];
+    int w = pScreen->width, h = pScreen->height;
+
+    if (randr & SHADOW_REFLECT_X)
+        x = w - 1 - x;
+    if (randr & SHADOW_REFLECT_Y)
+        y = h - 1 - y;
+
+    switch (randr & SHADOW_ROTATE_ALL) {
+    case SHADOW_ROTATE_90:      /* upper right of screen at upper left */
+        *fx = y;
+        *fy = w - 1 - x;
+        break;
+    case SHADOW_ROTATE_180:     /* lower right of screen at upper left */
+        *fx = w - 1 - x;
+        *fy = h - 1 - y;
+        break;
+    case SHADOW_ROTATE_270:     /* lower left of screen at upper left */
+        *fx = h - 1 - y;
+        *fy = x;
+        break;
+    default:
+        *fx = x;
+        *fy = y;
+        break;
     }
 }
 
+/* .. and the other way around: */
 static inline void
-V4L2ShadowBlitCursorARGB32(void *winBase, int winStride,
-        void *curBase, int curStride, int w, int h)
+V4L2RotatePointBack(ScreenPtr pScreen, int fx, int fy, int *x, int *y)
+{
+    int randr = rotation[pScreen->myNum];
+    int w = pScreen->width, h = pScreen->height;
+
+    switch (randr & SHADOW_ROTATE_ALL) {
+    case SHADOW_ROTATE_90:
+        *x = w - 1 - fy;
+        *y = fx;
+        break;
+    case SHADOW_ROTATE_180:
+        *x = w - 1 - fx;
+        *y = h - 1 - fy;
+        break;
+    case SHADOW_ROTATE_270:
+        *x = fy;
+        *y = h - 1 - fx;
+        break;
+    default:
+        *x = fx;
+        *y = fy;
+        break;
+    }
+
+    if (randr & SHADOW_REFLECT_X)
+        *x = w - 1 - *x;
+    if (randr & SHADOW_REFLECT_Y)
+        *y = h - 1 - *y;
+}
+
+/**
+ * Transform a box in screen coordinates into framebuffer coordinates.
+ * Returns FALSE (leaving the box alone) if they are the same.
+ */
+Bool
+V4L2RotateBox(ScreenPtr pScreen, BoxPtr pbox)
+{
+    int x1, y1, x2, y2;
+
+    if (LIKELY (!rotation[pScreen->myNum]))
+        return FALSE;
+
+    V4L2RotatePoint(pScreen, pbox->x1, pbox->y1, &x1, &y1);
+    V4L2RotatePoint(pScreen, pbox->x2 - 1, pbox->y2 - 1, &x2, &y2);
+
+    pbox->x1 = MIN(x1, x2);
+    pbox->y1 = MIN(y1, y2);
+    pbox->x2 = MAX(x1, x2) + 1;
+    pbox->y2 = MAX(y1, y2) + 1;
+
+    return TRUE;
+}
+
+/**
+ * How the video has to be rotated (clockwise, in degrees) and flipped by
+ * the overlay to match the framebuffer.  Returns FALSE if not at all.
+ */
+Bool
+V4L2RotateVideo(ScreenPtr pScreen, int *degrees, int *hflip, int *vflip)
+{
+    int randr = rotation[pScreen->myNum];
+
+    if (LIKELY (!randr))
+        return FALSE;
+
+    switch (randr & SHADOW_ROTATE_ALL) {
+    case SHADOW_ROTATE_90:  *degrees = 270; break;
+    case SHADOW_ROTATE_180: *degrees = 180; break;
+    case SHADOW_ROTATE_270: *degrees = 90;  break;
+    default:                *degrees = 0;   break;
+    }
+
+    *hflip = !!(randr & SHADOW_REFLECT_X);
+    *vflip = !!(randr & SHADOW_REFLECT_Y);
+
+    return TRUE;
+}
+
+/* blit of a box with the framebuffer in another orientation than the
+ * screen: the box is transformed, and the source walked accordingly, so
+ * that the kernels still write the framebuffer row by row.  The holes of
+ * a solid box (in screen coordinates, within it) are made transparent on
+ * the way:
+ */
+static void
+V4l2ShadowBlitRotated(ScreenPtr pScreen, void *winBase, int winStride,
+        void *shaBase, int shaStride, BoxPtr pbox, const void *op,
+        const BoxRec *holes, int nholes)
 {
-    while (h--) {
-        memcpy(winBase, curBase, w * sizeof(FbBits));
-        winBase += winStride;
-        curBase += curStride;
+    V4L2TileBox fbHoles[RUN_MAX_HOLES];
+    BoxRec fb = *pbox;
+    int x, y, xx, xy, yx, yy, w, h, i;
+
+    V4L2RotateBox(pScreen, &fb);
+
+    w = fb.x2 - fb.x1;
+    h = fb.y2 - fb.y1;
+    winBase += (winStride * fb.y1) + (fb.x1 * 4);
+
+    /* screen pixel of the first framebuffer pixel, and how the screen
+     * coordinates change along framebuffer x and y:
+     */
+    V4L2RotatePointBack(pScreen, fb.x1, fb.y1, &x, &y);
+    V4L2RotatePointBack(pScreen, fb.x1 + 1, fb.y1, &xx, &xy);
+    V4L2RotatePointBack(pScreen, fb.x1, fb.y1 + 1, &yx, &yy);
+    xx -= x;
+    xy -= y;
+    yx -= x;
+    yy -= y;
+
+    if (op == opTransparent) {
+        V4L2ShadowBlitTransparentARGB32(winBase, winStride, w, h);
+    } else if ((op == opSolid) || (op == opOsd)) {
+        int mode = argb ? V4L2_GATHER_OPAQUE : V4L2_GATHER_COPY;
+        if (op == opOsd) {
+            mode = (config.osdAlpha == V4L2_OSD_ALPHA_STRAIGHT) ?
+                    V4L2_GATHER_UNPREMULTIPLY : V4L2_GATHER_COPY;
+        }
+        for (i = 0; i < nholes; i++) {
+            BoxRec hole = holes[i];
+            V4L2RotateBox(pScreen, &hole);
+            fbHoles[i].x1 = hole.x1 - fb.x1;
+            fbHoles[i].y1 = hole.y1 - fb.y1;
+            fbHoles[i].x2 = hole.x2 - fb.x1;
+            fbHoles[i].y2 = hole.y2 - fb.y1;
+        }
+        V4L2ShadowBlitGatherHolesARGB32(winBase, winStride,
+                shaBase + (y * shaStride) + (x * 4),
+                (xx * 4) + (xy * shaStride), (yx * 4) + (yy * shaStride),
+                w, h, mode, fbHoles, nholes);
+    } else {
+        miPointerPtr pPointer = (miPointerPtr)op;
+        CursorBitsPtr bits = pPointer->pCursor->bits;
+        if (bits->argb) {
+            void *curBase = bits->argb;
+            int curStride = bits->width * sizeof(FbBits);
+            x -= pPointer->x - bits->xhot;
+            y -= pPointer->y - bits->yhot;
+            V4L2ShadowBlitGatherARGB32(winBase, winStride,
+                    curBase + (y * curStride) + (x * 4),
+                    (xx * 4) + (xy * curStride), (yx * 4) + (yy * curStride),
+                    w, h, V4L2_GATHER_COPY);
+        }
     }
 }
 
 static inline void
-V4l2ShadowBlit(void *winBase, int winStride,
+V4l2ShadowBlit(ScreenPtr pScreen, void *winBase, int winStride,
         void *shaBase, int shaStride, int shaBpp,
         BoxPtr pbox, const void *op)
 {
     int w, h;
 
+    if (UNLIKELY (rotation[pScreen->myNum])) {
+        if ((pbox->x2 > pbox->x1) && (pbox->y2 > pbox->y1)) {
+            V4l2ShadowBlitRotated(pScreen, winBase, winStride,
+                    shaBase, shaStride, pbox, op, NULL, 0);
+        }
+        return;
+    }
+
     w = (pbox->x2 - pbox->x1) * shaBpp / 32;     /* width in words */
     h = pbox->y2 - pbox->y1;                     /* height in rows */
 
@@ -137,10 +471,36 @@ V4l2ShadowBlit(void *winBase, int winStride,
     winBase += (winStride * pbox->y1) + (pbox->x1 * shaBpp / 8);
     shaBase += (shaStride * pbox->y1) + (pbox->x1 * shaBpp / 8);
 
+    /* full width rows follow on from each other in both the shadow and the
+     * framebuffer if their strides match, so are one long row:
+     */
+    if ((w * 4 == winStride) && (winStride == shaStride) &&
+            ((op == opSolid) || (op == opTransparent) || (op == opOsd))) {
+        w *= h;
+        h = 1;
+    }
+
     if (op == opTransparent) {
         V4L2ShadowBlitTransparentARGB32(winBase, winStride, w, h);
     } else if (op == opSolid) {
-        V4L2ShadowBlitSolidARGB32(winBase, winStride, shaBase, shaStride, w, h);
+        /* without an alpha channel, the alpha byte of the framebuffer is
+         * ignored, so solid pixels are copied as they are:
+         */
+        if (argb) {
+            V4L2ShadowBlitSolidARGB32(winBase, winStride,
+                    shaBase, shaStride, w, h);
+        } else if (winBase != shaBase) {
+            V4L2ShadowBlitCopyARGB32(winBase, winStride,
+                    shaBase, shaStride, w, h);
+        }
+    } else if (op == opOsd) {
+        if (config.osdAlpha == V4L2_OSD_ALPHA_STRAIGHT) {
+            V4L2ShadowBlitUnpremultiplyARGB32(winBase, winStride,
+                    shaBase, shaStride, w, h);
+        } else if (winBase != shaBase) {
+            V4L2ShadowBlitCopyARGB32(winBase, winStride,
+                    shaBase, shaStride, w, h);
+        }
     } else {
         miPointerPtr pPointer = (miPointerPtr)op;
         CursorBitsPtr bits = pPointer->pCursor->bits;
@@ -157,264 +517,1779 @@ V4l2ShadowBlit(void *winBase, int winStride,
     }
 }
 
-static inline void
-V4L2ShadowBlitRegions(ScreenPtr pScreen, shadowBufPtr pBuf,
-        RegionPtr damage, const void *op)
+/* forget the hashes of all tiles touched by a box, in the given pages: */
+static void
+V4L2TileInvalidate(ScreenPtr pScreen, BoxPtr pbox, int pageMask)
 {
-    PixmapPtr pShadow = pBuf->pPixmap;
-    BoxPtr pbox;
-    int nbox, shaBpp, shaXoff, shaYoff;
-    FbBits *shaBase, *winBase;
-    CARD32 shaStride, winStride;
+    int n = pScreen->myNum, tx, ty;
+    int x1 = MAX(pbox->x1, 0) >> HASH_SHIFT;
+    int y1 = MAX(pbox->y1, 0) >> HASH_SHIFT;
+    int x2 = MIN((pbox->x2 + HASH_SIZE - 1) >> HASH_SHIFT, hashTiles[n].cols);
+    int y2 = MIN((pbox->y2 + HASH_SIZE - 1) >> HASH_SHIFT, hashTiles[n].rows);
+
+    for (ty = y1; ty < y2; ty++) {
+        for (tx = x1; tx < x2; tx++) {
+            int t = ty * hashTiles[n].cols + tx;
+            if (pageMask & 0x1)
+                hashTiles[n].hash[0][t] = 0;
+            if (pageMask & 0x2)
+                hashTiles[n].hash[1][t] = 0;
+            hashTiles[n].changed[t] = TRUE;
+        }
+    }
+}
+
+static void
+V4L2TileInvalidateRegion(ScreenPtr pScreen, RegionPtr region, int pageMask)
+{
+    int nbox = RegionNumRects(region);
+    BoxPtr pbox = RegionRects(region);
+
+    if (!hashTiles[pScreen->myNum].stamp)
+        return;
 
-    fbGetDrawable(&pShadow->drawable, shaBase, shaStride, shaBpp, shaXoff, shaYoff);
-    shaStride *= sizeof(FbBits);                 /* convert into byte-stride */
+    while (nbox--)
+        V4L2TileInvalidate(pScreen, pbox++, pageMask);
+}
 
-    winBase =
-        pBuf->window(pScreen, 0, 0, SHADOW_WINDOW_WRITE, &winStride, pBuf->closure);
+/* solid blit of a box, skipping the tiles whose content didn't change since
+ * they were last written.  Each tile is hashed (in full) at most once per
+ * update.  Returns the number of bytes skipped.
+ *
+ * Rendering straight into the framebuffer, the hash would be of the pixels
+ * as X left them, before their alpha is fixed up: X redrawing the same RGB
+ * (with alpha 0) would then look unchanged, and be left transparent.  The
+ * fix-up is needed wherever X has drawn, so nothing is skipped there.
+ */
+static unsigned long
+V4L2ShadowBlitTiles(ScreenPtr pScreen, void *winBase, int winStride,
+        void *shaBase, int shaStride, int shaBpp, BoxPtr pbox)
+{
+    int n = pScreen->myNum, page = pages[n].page, tx, ty;
+    unsigned long skipped = 0;
+
+    if (winBase == shaBase) {
+        V4L2TileInvalidate(pScreen, pbox, 1 << page);
+        V4l2ShadowBlit(pScreen, winBase, winStride, shaBase, shaStride,
+                shaBpp, pbox, opSolid);
+        return 0;
+    }
 
-    nbox = RegionNumRects(damage);
-    pbox = RegionRects(damage);
+    for (ty = pbox->y1 >> HASH_SHIFT; ty <= (pbox->y2 - 1) >> HASH_SHIFT; ty++) {
+        for (tx = pbox->x1 >> HASH_SHIFT; tx <= (pbox->x2 - 1) >> HASH_SHIFT; tx++) {
+            int t = ty * hashTiles[n].cols + tx;
+            BoxRec tile, sub;
+
+            tile.x1 = tx << HASH_SHIFT;
+            tile.y1 = ty << HASH_SHIFT;
+            tile.x2 = MIN(tile.x1 + HASH_SIZE, pScreen->width);
+            tile.y2 = MIN(tile.y1 + HASH_SIZE, pScreen->height);
+
+            sub.x1 = MAX(pbox->x1, tile.x1);
+            sub.y1 = MAX(pbox->y1, tile.y1);
+            sub.x2 = MIN(pbox->x2, tile.x2);
+            sub.y2 = MIN(pbox->y2, tile.y2);
+
+            if (hashTiles[n].stamp[t] != hashTiles[n].seq) {
+                uint64_t hash = V4L2TileHashARGB32(
+                        shaBase + (tile.y1 * shaStride) + (tile.x1 * shaBpp / 8),
+                        shaStride, tile.x2 - tile.x1, tile.y2 - tile.y1);
+                hash |= !hash;          /* 0 means unknown */
+                hashTiles[n].changed[t] = (hash != hashTiles[n].hash[page][t]);
+                hashTiles[n].hash[page][t] = hash;
+                hashTiles[n].stamp[t] = hashTiles[n].seq;
+                V4L2_STAT_ADD(v4l2ScreenStats[n].hashedTiles, 1);
+            }
 
-    while (nbox--) {
-        V4l2ShadowBlit(winBase, winStride, shaBase, shaStride, shaBpp, pbox, op);
-        pbox++;
+            if (hashTiles[n].changed[t]) {
+                V4l2ShadowBlit(pScreen, winBase, winStride, shaBase, shaStride,
+                        shaBpp, &sub, opSolid);
+            } else {
+                skipped += (sub.x2 - sub.x1) * (sub.y2 - sub.y1) * shaBpp / 8;
+            }
+        }
     }
 
+    return skipped;
 }
 
+/* state for a sequence of blits of one op, to the current page: */
+typedef struct {
+    ScreenPtr pScreen;
+    const void *op;
+    FbBits *shaBase, *winBase;
+    CARD32 shaStride, winStride;
+    int shaBpp;
+    int nbox;
+    unsigned long bytes, skipped;
+} V4L2BlitRec, *V4L2BlitPtr;
+
 static inline void
-V4L2DrawCursor(ScreenPtr pScreen, shadowBufPtr pBuf, miPointerPtr pPointer)
+V4L2BlitBegin(V4L2BlitPtr blit, ScreenPtr pScreen, shadowBufPtr pBuf,
+        const void *op)
 {
-    int i;
-    int x = pPointer->x - pPointer->pCursor->bits->xhot;
-    int y = pPointer->y - pPointer->pCursor->bits->yhot;
-    BoxRec cursorRect;
-
-    cursorRect.x1 = x;
-    cursorRect.y1 = y;
-    cursorRect.x2 = x + pPointer->pCursor->bits->width;
-    cursorRect.y2 = y + pPointer->pCursor->bits->height;
+    PixmapPtr pShadow = pBuf->pPixmap;
+    int shaXoff, shaYoff;
 
-    for (i = 0; i < numRegions; i++) {
-        if (regions[i].clip &&
-                RegionContainsRect(regions[i].clip, &cursorRect)) {
-            /* cursor at least partially intersects:
-             */
-            RegionPtr bounds, paddedBounds;
+    fbGetDrawable(&pShadow->drawable, blit->shaBase, blit->shaStride,
+            blit->shaBpp, shaXoff, shaYoff);
+    blit->shaStride *= sizeof(FbBits);           /* convert into byte-stride */
 
-            bounds = RegionCreate(&cursorRect, 1);
-            RegionIntersect(bounds, bounds, regions[i].clip);
+    blit->winBase = pBuf->window(pScreen,
+            pages[pScreen->myNum].page * pages[pScreen->myNum].rows, 0,
+            SHADOW_WINDOW_WRITE, &blit->winStride, pBuf->closure);
 
-            /* we have to first clear the padded bounds (or at least what is
-             * in the padded bounds but not in the actual cursor bounds to
-             * compensate for the for the software cursor/spite code which
-             * saves/restores a slightly larger area and messes up our nice
-             * transparent pixels (see miSpriteComputeSaved() in misprite.c)
-             */
-            cursorRect.x1 -= SPRITE_PAD;
-            cursorRect.y1 -= SPRITE_PAD;
-            cursorRect.x2 += 2 * SPRITE_PAD;
-            cursorRect.y2 += 2 * SPRITE_PAD;
-            paddedBounds = RegionCreate(&cursorRect, 1);
-            RegionIntersect(paddedBounds, paddedBounds, regions[i].clip);
+    blit->pScreen = pScreen;
+    blit->op = op;
+    blit->nbox = 0;
+    blit->bytes = blit->skipped = 0;
+}
 
-            V4L2ShadowBlitRegions(pScreen, pBuf, paddedBounds, opTransparent);
-            V4L2ShadowBlitRegions(pScreen, pBuf, bounds, pPointer);
+static Bool V4L2CompositeBox(V4L2BlitPtr blit, BoxPtr pbox);
 
-            RegionUnion(cursorRegion, cursorRegion, paddedBounds);
+static inline void
+V4L2BlitBox(V4L2BlitPtr blit, BoxPtr pbox)
+{
+    /* holes, and cursors over them, in composited clips get the video: */
+    if (UNLIKELY (compositeClips > 0) && (blit->op != opSolid) &&
+            (blit->op != opOsd) && V4L2CompositeBox(blit, pbox)) {
+        return;
+    }
 
-            RegionUninit(bounds);
-            RegionUninit(paddedBounds);
+    if (hashTiles[blit->pScreen->myNum].stamp) {
+        if (blit->op == opSolid) {
+            blit->skipped += V4L2ShadowBlitTiles(blit->pScreen,
+                    blit->winBase, blit->winStride,
+                    blit->shaBase, blit->shaStride, blit->shaBpp, pbox);
+        } else {
+            V4L2TileInvalidate(blit->pScreen, pbox,
+                    1 << pages[blit->pScreen->myNum].page);
+            V4l2ShadowBlit(blit->pScreen, blit->winBase, blit->winStride, blit->shaBase,
+                    blit->shaStride, blit->shaBpp, pbox, blit->op);
         }
+    } else {
+        V4l2ShadowBlit(blit->pScreen, blit->winBase, blit->winStride, blit->shaBase,
+                blit->shaStride, blit->shaBpp, pbox, blit->op);
+    }
+
+    blit->bytes += (pbox->x2 - pbox->x1) * (pbox->y2 - pbox->y1) * blit->shaBpp / 8;
+    blit->nbox++;
+}
+
+static uint32_t *
+V4L2CompositeScratch(int size)
+{
+    if (size > compositeScratchSize) {
+        uint32_t *scratch = realloc(compositeScratch, size * sizeof(uint32_t));
+        if (!scratch)
+            return NULL;
+        compositeScratch = scratch;
+        compositeScratchSize = size;
     }
+
+    return compositeScratch;
 }
 
+/* the video under a box of the clip of composited port nr, and the cursor
+ * over it if op is a pointer.  The frame is converted straight into the
+ * framebuffer, except under the cursor or with the framebuffer rotated,
+ * where it goes through a scratch buffer first.  Either way, each pixel is
+ * written to the framebuffer once:
+ */
 static void
-V4L2ShadowUpdatePacked(ScreenPtr pScreen, shadowBufPtr pBuf)
+V4L2CompositeFrame(V4L2BlitPtr blit, int nr, BoxPtr pbox)
 {
-    int i;
-    RegionPtr damage = DamageRegion(pBuf->pDamage);
-    RegionPtr tofree = NULL;
-    DeviceIntPtr pDev;
+    ScreenPtr pScreen = blit->pScreen;
+    V4L2ScreenStats *stats = &v4l2ScreenStats[pScreen->myNum];
+    const V4L2ScaleImage *frame = &regions[nr].frame;
+    miPointerPtr pPointer = NULL;
+    uint32_t *scratch;
+    BoxRec box;
+    int w, h;
 
-    if (UNLIKELY (activeClips > 0)) {
-        /* subtract active regions from damaged regions so they aren't
-         * blit to screen:
-         */
-        for (i = 0; i < numRegions; i++) {
-            if (regions[i].clip && regions[i].updated) {
-                if (!tofree) {
-                    tofree = RegionCreate(NULL, 0);
-                }
-                RegionSubtract(tofree, damage, regions[i].clip);
-                damage = tofree;
-            }
-        }
+    if (blit->op != opTransparent) {
+        pPointer = (miPointerPtr)blit->op;
+        if (!pPointer->pCursor->bits->argb)
+            pPointer = NULL;
     }
 
-    /* blit non-video damaged areas to screen:
-     */
-    V4L2ShadowBlitRegions(pScreen, pBuf, damage, opSolid);
-
-    if (UNLIKELY (activeClips > 0)) {
-        Bool overlap;
-        RegionPtr prevCursorRegion = cursorRegion;
+    if (hashTiles[pScreen->myNum].stamp) {
+        V4L2TileInvalidate(pScreen, pbox, 1 << pages[pScreen->myNum].page);
+    }
 
-        cursorRegion = RegionCreate(NULL, 0);
+    /* the part of the box the frame covers.  The frame is the size of the
+     * window, the rest is only there until the next frame comes:
+     */
+    box.x1 = MAX(pbox->x1, regions[nr].x);
+    box.y1 = MAX(pbox->y1, regions[nr].y);
+    box.x2 = MIN(pbox->x2, regions[nr].x + frame->width);
+    box.y2 = MIN(pbox->y2, regions[nr].y + frame->height);
+    w = box.x2 - box.x1;
+    h = box.y2 - box.y1;
+
+    if ((w <= 0) || (h <= 0)) {
+        V4l2ShadowBlit(pScreen, blit->winBase, blit->winStride, blit->shaBase,
+                blit->shaStride, blit->shaBpp, pbox, opTransparent);
+        return;
+    }
 
-        /* fill updated video regions with transparent pixels:
-         */
-        for (i = 0; i < numRegions; i++) {
-            if (regions[i].clip && regions[i].updated) {
-                V4L2ShadowBlitRegions(pScreen, pBuf, regions[i].clip, opTransparent);
-                regions[i].updated = FALSE;
-            }
-        }
+    if ((box.x1 != pbox->x1) || (box.y1 != pbox->y1) ||
+            (box.x2 != pbox->x2) || (box.y2 != pbox->y2)) {
+        RegionRec rest, covered;
+        int i;
 
-        if (tofree) {
-            RegionUninit(tofree);
+        RegionInit(&rest, pbox, 1);
+        RegionInit(&covered, &box, 1);
+        RegionSubtract(&rest, &rest, &covered);
+        for (i = 0; i < RegionNumRects(&rest); i++) {
+            V4l2ShadowBlit(pScreen, blit->winBase, blit->winStride,
+                    blit->shaBase, blit->shaStride, blit->shaBpp,
+                    RegionRects(&rest) + i, opTransparent);
         }
+        RegionUninit(&rest);
+        RegionUninit(&covered);
+    }
 
-        /* handle any cursors that are over an active region:
-         */
-        for(pDev = inputInfo.devices; pDev; pDev = pDev->next) {
-            miPointerPtr pPointer;
-            if (DevHasCursor(pDev) && (pPointer = MIPOINTER(pDev)) &&
-                    (pPointer->pScreen == pScreen) &&
-                    pPointer->pCursor && pPointer->pCursor->bits) {
-                V4L2DrawCursor(pScreen, pBuf, pPointer);
-            }
-        }
+    V4L2_STAT_ADD(stats->boxes[V4L2_OP_VIDEO], 1);
+    V4L2_STAT_ADD(stats->bytes[V4L2_OP_VIDEO], w * h * 4);
 
-        if (prevCursorRegion) {
-            /* subtract current cursor region:
-             */
-            RegionSubtract(prevCursorRegion, prevCursorRegion, cursorRegion);
+    if (LIKELY (!pPointer && !rotation[pScreen->myNum])) {
+        V4L2ConvertARGB32((void *)blit->winBase +
+                (box.y1 * blit->winStride) + (box.x1 * 4), blit->winStride,
+                frame, box.x1 - regions[nr].x, box.y1 - regions[nr].y,
+                w, h, regions[nr].matrix);
+        return;
+    }
 
-            /* clip prevCursorRegion to current video regions:
-             */
-            for (i = 0; i < numRegions; i++) {
-                if (regions[i].clip) {
-                    RegionIntersect(prevCursorRegion,
-                            prevCursorRegion, regions[i].clip);
-                }
-            }
+    if (!(scratch = V4L2CompositeScratch(w * h)))
+        return;
 
-            /* fill what remains with transparent pixels to clean up after
-             * previous cursor:
-             */
-            V4L2ShadowBlitRegions(pScreen, pBuf, prevCursorRegion, opTransparent);
+    V4L2ConvertARGB32(scratch, w * 4, frame,
+            box.x1 - regions[nr].x, box.y1 - regions[nr].y,
+            w, h, regions[nr].matrix);
 
-            RegionUninit(prevCursorRegion);
+    if (pPointer) {
+        CursorBitsPtr bits = pPointer->pCursor->bits;
+        int cx = pPointer->x - bits->xhot, cy = pPointer->y - bits->yhot;
+        int x1 = MAX(box.x1, cx), y1 = MAX(box.y1, cy);
+        int x2 = MIN(box.x2, cx + bits->width), y2 = MIN(box.y2, cy + bits->height);
+        if ((x2 > x1) && (y2 > y1)) {
+            V4L2ShadowBlitCursorOverARGB32(
+                    scratch + ((y1 - box.y1) * w) + (x1 - box.x1), w * 4,
+                    (void *)bits->argb + ((y1 - cy) * bits->width * 4) +
+                    ((x1 - cx) * 4), bits->width * 4, x2 - x1, y2 - y1);
         }
     }
+
+    if (rotation[pScreen->myNum]) {
+        /* addressed in screen coordinates, like the shadow: */
+        V4l2ShadowBlitRotated(pScreen, blit->winBase, blit->winStride,
+                (void *)scratch - (box.y1 * w * 4) - (box.x1 * 4), w * 4,
+                &box, opSolid, NULL, 0);
+    } else {
+        V4L2ShadowBlitCopyARGB32((void *)blit->winBase +
+                (box.y1 * blit->winStride) + (box.x1 * 4), blit->winStride,
+                scratch, w * 4, w, h);
+    }
 }
 
-/**
- * overload shadow update fxn and handle alpha pixels inline with copy to
- * framebuffer
+/* if a box is (partly) in the clip of a composited port, draw the video
+ * there, and the rest of the box as usual.  Returns FALSE if the box is
+ * in none of them:
  */
-shadowUpdateProc
-shadowUpdatePackedWeak(void)
+static Bool
+V4L2CompositeBox(V4L2BlitPtr blit, BoxPtr pbox)
 {
-    return V4L2ShadowUpdatePacked;
+    RegionRec part, rest;
+    int i, j;
+
+    for (i = 0; i < numRegions; i++) {
+        if (!regions[i].composite || !regions[i].clip ||
+                (regions[i].pScreen != blit->pScreen))
+            continue;
+
+        switch (RegionContainsRect(regions[i].clip, pbox)) {
+        case rgnIN:
+            V4L2CompositeFrame(blit, i, pbox);
+            return TRUE;
+        case rgnPART:
+            RegionInit(&part, pbox, 1);
+            RegionInit(&rest, pbox, 1);
+            RegionIntersect(&part, &part, regions[i].clip);
+            RegionSubtract(&rest, &rest, regions[i].clip);
+            for (j = 0; j < RegionNumRects(&part); j++)
+                V4L2CompositeFrame(blit, i, RegionRects(&part) + j);
+            for (j = 0; j < RegionNumRects(&rest); j++)
+                V4L2BlitBox(blit, RegionRects(&rest) + j);
+            RegionUninit(&part);
+            RegionUninit(&rest);
+            return TRUE;
+        }
+    }
+
+    return FALSE;
 }
 
-static Bool
-V4L2SetupScreen(ScreenPtr pScreen)
+static inline void
+V4L2BlitEnd(V4L2BlitPtr blit)
 {
-    int fd;
+    V4L2ScreenStats *stats = &v4l2ScreenStats[blit->pScreen->myNum];
+    int op = V4L2OpIndex(blit->op);
+
+    V4L2_STAT_ADD(stats->boxes[op], blit->nbox);
+    V4L2_STAT_ADD(stats->bytes[op], blit->bytes - blit->skipped);
+    if (blit->skipped)
+        V4L2_STAT_ADD(stats->skippedBytes, blit->skipped);
+    V4L2_TRACE(BLIT, 0, op, blit->nbox, blit->bytes - blit->skipped, 0);
+}
 
-    DEBUG("SetupScreen, pScreen=%p", pScreen);
+/* draw the pending run, as one solid blit with its holes, unless it is
+ * all solid or all hole:
+ */
+static void
+V4L2RunFlush(V4L2BlitRec *blits)
+{
+    V4L2BlitPtr solid = &blits[V4L2_UPDATE_SOLID];
+    V4L2BlitPtr hole = &blits[V4L2_UPDATE_HOLE];
+    BoxPtr pbox = &run.box;
+    unsigned long bytes, holeBytes = 0;
+    int i;
 
-    /* configure the corresponding framebuffer for ARGB: */
-    fd = fbdevHWGetFD(xf86Screens[pScreen->myNum]);
-    if (fd) {
-        struct fb_var_screeninfo var;
+    if (!run.pending)
+        return;
+    run.pending = FALSE;
+
+    if (run.nholes == 0) {
+        V4L2BlitBox(solid, pbox);
+        return;
+    }
+    if ((run.nholes == 1) && (run.holes[0].x1 == pbox->x1) &&
+            (run.holes[0].x2 == pbox->x2)) {
+        V4L2BlitBox(hole, pbox);
+        return;
+    }
 
-        DEBUG("reconfiguring fb dev %d to ARGB..", fd);
+    V4l2ShadowBlitRotated(solid->pScreen, solid->winBase, solid->winStride,
+            solid->shaBase, solid->shaStride, pbox, opSolid,
+            run.holes, run.nholes);
 
-        if (-1 == ioctl(fd, FBIOGET_VSCREENINFO, &var)) {
-            perror("ioctl FBIOGET_VSCREENINFO");
-        }
+    for (i = 0; i < run.nholes; i++)
+        holeBytes += (run.holes[i].x2 - run.holes[i].x1) *
+                (run.holes[i].y2 - run.holes[i].y1) * solid->shaBpp / 8;
+    bytes = (pbox->x2 - pbox->x1) * (pbox->y2 - pbox->y1) * solid->shaBpp / 8;
 
-        /* @todo support other color formats than ARGB */
-        var.transp.length = 8;
-        var.transp.offset = 24;
+    solid->bytes += bytes - holeBytes;
+    solid->nbox++;
+    hole->bytes += holeBytes;
+    hole->nbox += run.nholes;
+}
 
-        if (-1 == ioctl(fd, FBIOPUT_VSCREENINFO, &var)) {
-            perror("ioctl FBIOPUT_VSCREENINFO");
-        }
+/* add a solid or transparent span to the run, which is drawn first if the
+ * span doesn't carry on from it, in the same band:
+ */
+static void
+V4L2RunAdd(V4L2BlitRec *blits, int layer, BoxPtr pbox)
+{
+    if (run.pending && ((pbox->y1 != run.box.y1) ||
+            (pbox->y2 != run.box.y2) || (pbox->x1 != run.box.x2) ||
+            ((layer == V4L2_UPDATE_HOLE) && (run.nholes == RUN_MAX_HOLES)))) {
+        V4L2RunFlush(blits);
     }
 
-    return TRUE;
+    if (!run.pending) {
+        run.pending = TRUE;
+        run.box = *pbox;
+        run.nholes = 0;
+    } else {
+        run.box.x2 = pbox->x2;
+    }
+
+    if (layer == V4L2_UPDATE_HOLE)
+        run.holes[run.nholes++] = *pbox;
 }
 
-/**
- * Setup alpha blending for a new port.
- */
-void
-V4L2SetupAlpha(PortPrivPtr pPPriv)
+static void
+V4L2UpdateEmit(void *closure, int layer, const V4L2TileBox *box)
 {
-    if (!alpha) {
-        int i;
+    V4L2BlitRec *blits = closure;
 
-        for (i = 0; i < screenInfo.numScreens; i++) {
-            V4L2SetupScreen(screenInfo.screens[i]);
+    if (UNLIKELY (run.enabled)) {
+        if ((layer == V4L2_UPDATE_SOLID) || (layer == V4L2_UPDATE_HOLE)) {
+            V4L2RunAdd(blits, layer, (BoxPtr)box);
+            return;
         }
-
-        alpha = TRUE;
+        /* anything else may be drawn over the run: */
+        V4L2RunFlush(blits);
     }
 
-    if (pPPriv->nr >= numRegions) {
-        /* grow array of per-port info */
-        regions = realloc(regions, sizeof(regions[0]) * (pPPriv->nr + 1));
+    V4L2BlitBox(&blits[layer], (BoxPtr)box);
+}
 
-        while (numRegions <= pPPriv->nr) {
-            regions[numRegions].clip = NULL;
-            regions[numRegions].updated = FALSE;
-            numRegions++;
+/* a solid span may have been hashed after something else was written
+ * into the same tile, so forget those tiles again:
+ */
+static void
+V4L2UpdateOverlaid(void *closure, const V4L2TileBox *box)
+{
+    V4L2BlitRec *blits = closure;
+    ScreenPtr pScreen = blits[V4L2_UPDATE_SOLID].pScreen;
+
+    V4L2TileInvalidate(pScreen, (BoxPtr)box, 1 << pages[pScreen->myNum].page);
+}
+
+/* the cursor images on a screen, up to max of them, and the pointers they
+ * are of (unless pointers is NULL):
+ */
+static int
+V4L2Cursors(ScreenPtr pScreen, BoxPtr boxes, miPointerPtr *pointers, int max)
+{
+    DeviceIntPtr pDev;
+    int n = 0;
+
+    for(pDev = inputInfo.devices; pDev && (n < max); pDev = pDev->next) {
+        miPointerPtr pPointer;
+        if (DevHasCursor(pDev) && (pPointer = MIPOINTER(pDev)) &&
+                (pPointer->pScreen == pScreen) &&
+                pPointer->pCursor && pPointer->pCursor->bits) {
+            CursorBitsPtr bits = pPointer->pCursor->bits;
+            boxes[n].x1 = pPointer->x - bits->xhot;
+            boxes[n].y1 = pPointer->y - bits->yhot;
+            boxes[n].x2 = boxes[n].x1 + bits->width;
+            boxes[n].y2 = boxes[n].y1 + bits->height;
+            if (pointers)
+                pointers[n] = pPointer;
+            n++;
         }
     }
+
+    return n;
 }
 
-/**
- * called by core part of xf86-video-v4l2 driver module when he wants to paint
- * pixels with alpha enabled.
+/* the part of an OSD window that is visible on screen.  Not borderClip,
+ * because windows redirected by the Composite extension (as ARGB visual
+ * windows are) aren't clipped by the windows stacked above them:
  */
-void
-V4L2SetClip(PortPrivPtr pPPriv, DrawablePtr pDraw, RegionPtr clipBoxes)
+static void
+V4L2OSDWindowRegion(WindowPtr pWin, RegionPtr region)
 {
-    if (alpha) {
-        V4L2ClearClip(pPPriv);
+    WindowPtr pChild, pSib;
 
-        DEBUG("Xv/SC: %d", pPPriv->nr);
-
-        regions[pPPriv->nr].clip = RegionCreate(NULL, 0);
-        RegionCopy(regions[pPPriv->nr].clip, clipBoxes);
-        regions[pPPriv->nr].updated = TRUE;
-        activeClips++;
+    RegionCopy(region, &pWin->borderSize);
 
-        /* we don't actually have to fill the color key.. just register it as
-         * dirty so that our shadow-update function gets run
-         */
-        DamageRegionAppend(pDraw, clipBoxes);
-    } else {
-        xf86XVFillKeyHelper(pDraw->pScreen, pPPriv->colorKey, clipBoxes);
+    for (pChild = pWin; pChild->parent; pChild = pChild->parent) {
+        RegionIntersect(region, region, &pChild->parent->winSize);
+        for (pSib = pChild->prevSib; pSib; pSib = pSib->prevSib) {
+            if (pSib->viewable) {
+                RegionSubtract(region, region, &pSib->borderSize);
+            }
+        }
     }
 }
 
-void
-V4L2ClearClip(PortPrivPtr pPPriv)
+/* the damaged part of the OSD windows on a screen, or NULL if none: */
+static RegionPtr
+V4L2OSDDamage(ScreenPtr pScreen, RegionPtr damage)
 {
-    if (alpha) {
-        DEBUG("Xv/CC: %d", pPPriv->nr);
+    RegionPtr osd = NULL;
+    RegionRec win;
+    int i;
+
+    RegionNull(&win);
+
+    for (i = 0; i < numOsdWindows; i++) {
+        WindowPtr pWin = osdWindows[i];
+
+        if (!pWin->viewable || (pWin->drawable.pScreen != pScreen))
+            continue;
+
+        V4L2OSDWindowRegion(pWin, &win);
+        RegionIntersect(&win, &win, damage);
+
+        if (RegionNotEmpty(&win)) {
+            if (!osd) {
+                osd = V4L2RegionCreate(pScreen, NULL, 0);
+            }
+            RegionUnion(osd, osd, &win);
+        }
+    }
+
+    RegionUninit(&win);
+
+    return osd;
+}
+
+/* wait until the page we are about to draw into is no longer scanned out,
+ * which it is until the vblank after it was panned away from:
+ */
+static void
+V4L2FlipWait(ScreenPtr pScreen)
+{
+    V4L2ScreenStats *stats = &v4l2ScreenStats[pScreen->myNum];
+    uint64_t now = V4L2StatsNow();
+    unsigned long since = now - pages[pScreen->myNum].panTime;
+    CARD32 crtc = 0;
+
+    pages[pScreen->myNum].waitUsec = 0;
+
+    if (since >= pages[pScreen->myNum].frameUsec)
+        return;
+
+    V4L2_STAT_ADD(stats->vsyncWaits, 1);
+
+    if (-1 == ioctl(pages[pScreen->myNum].fd, FBIO_WAITFORVSYNC, &crtc)) {
+        usleep(pages[pScreen->myNum].frameUsec - since);
+    }
+
+    pages[pScreen->myNum].waitUsec = V4L2StatsNow() - now;
+}
+
+static void V4L2ShadowUpdateRegion(ScreenPtr pScreen, shadowBufPtr pBuf,
+        RegionPtr damage);
+
+/* if the display doesn't pan after all (for example because the mode was
+ * reset behind our back), go back to drawing into the first page, which
+ * is then redrawn completely:
+ */
+static void
+V4L2FlipDisable(ScreenPtr pScreen, shadowBufPtr pBuf)
+{
+    RegionRec screen;
+    BoxRec box = { 0, 0, pScreen->width, pScreen->height };
+    int i;
+
+    xf86Msg(X_WARNING, "v4l2: panning failed, disabling page flipping\n");
+
+    pages[pScreen->myNum].flip = FALSE;
+    pages[pScreen->myNum].page = 0;
+    RegionDestroy(pages[pScreen->myNum].pending[0]);
+    RegionDestroy(pages[pScreen->myNum].pending[1]);
+
+    for (i = 0; i < numRegions; i++) {
+        regions[i].updated = regions[i].clip ? 0x1 : 0;
+    }
+
+    RegionInit(&screen, &box, 1);
+    V4L2TileInvalidateRegion(pScreen, &screen, 0x3);
+    V4L2ShadowUpdateRegion(pScreen, pBuf, &screen);
+    RegionUninit(&screen);
+}
+
+static void
+V4L2Flip(ScreenPtr pScreen, shadowBufPtr pBuf)
+{
+    int page = pages[pScreen->myNum].page;
+    struct fb_var_screeninfo *var = &pages[pScreen->myNum].var;
+    uint64_t start = V4L2StatsNow();
+
+    var->yoffset = page * pages[pScreen->myNum].rows;
+    var->activate = FB_ACTIVATE_VBL;
+
+    if (-1 == ioctl(pages[pScreen->myNum].fd, FBIOPAN_DISPLAY, var)) {
+        V4L2FlipDisable(pScreen, pBuf);
+        return;
+    }
+
+    pages[pScreen->myNum].panTime = V4L2StatsNow();
+    pages[pScreen->myNum].page = !page;
+
+    V4L2_STAT_ADD(v4l2ScreenStats[pScreen->myNum].flips, 1);
+    V4L2_TRACE(FLIP, 0, pScreen->myNum, page,
+            pages[pScreen->myNum].waitUsec,
+            pages[pScreen->myNum].panTime - start);
+}
+
+/* X renders straight into the video holes when there is no shadow (see
+ * DirectRender option), so the damage in them has to be made transparent
+ * again, unless the whole clip is filled anyway.  NULL if none:
+ */
+static RegionPtr
+V4L2DirectHoles(ScreenPtr pScreen, RegionPtr damage, int pageBit)
+{
+    RegionPtr holes = NULL;
+    RegionRec tmp;
+    int i;
+
+    if (LIKELY (!DIRECT(pScreen)))
+        return NULL;
+
+    RegionNull(&tmp);
+
+    for (i = 0; i < numRegions; i++) {
+        if (regions[i].clip && !(regions[i].updated & pageBit)) {
+            RegionIntersect(&tmp, damage, regions[i].clip);
+            if (RegionNotEmpty(&tmp)) {
+                if (!holes) {
+                    holes = V4L2RegionCreate(pScreen, NULL, 0);
+                }
+                RegionUnion(holes, holes, &tmp);
+            }
+        }
+    }
+
+    RegionUninit(&tmp);
+
+    return holes;
+}
+
+/* draw damage into the current page (see v4l2-update.c): */
+static void
+V4L2ShadowUpdateRegion(ScreenPtr pScreen, shadowBufPtr pBuf, RegionPtr damage)
+{
+    int i, page = pages[pScreen->myNum].page;
+    int pageBit = 1 << page;
+    BoxRec cursors[V4L2_UPDATE_MAX_CURSORS];
+    miPointerPtr pointers[V4L2_UPDATE_MAX_CURSORS];
+    V4L2BlitRec blits[V4L2_UPDATE_LAYERS];
+    V4L2UpdateRec update;
+
+    hashTiles[pScreen->myNum].seq++;
+
+    memset(&update, 0x00, sizeof(update));
+    update.damage = damage;
+    update.cursors = cursors;
+    update.fused = config.fusedCompose;
+    update.clipLists = clipLists;
+    update.clipMask = &clipMask[pScreen->myNum];
+    update.width = pScreen->width;
+    update.height = pScreen->height;
+    update.inputs = composeInputs;
+
+    /* OSD windows keep their own alpha:
+     */
+    if (UNLIKELY (numOsdWindows > 0)) {
+        update.osd = V4L2OSDDamage(pScreen, damage);
+    }
+
+    if (UNLIKELY (activeClips > 0)) {
+        update.holes = V4L2DirectHoles(pScreen, damage, pageBit);
+
+        /* updated video regions are made transparent, and masked out of
+         * the damage so they aren't blit to screen.  Without a shadow, all
+         * of them are masked out:
+         */
+        for (i = 0; i < numRegions; i++) {
+            updateClips[i].clip = regions[i].clip;
+            updateClips[i].mask = &regions[i].mask;
+            updateClips[i].filled = regions[i].clip &&
+                    (regions[i].updated & pageBit);
+            updateClips[i].masked = updateClips[i].filled || DIRECT(pScreen);
+        }
+        update.clips = updateClips;
+        update.nclips = numRegions;
+
+        update.ncursors = V4L2Cursors(pScreen, cursors, pointers,
+                V4L2_UPDATE_MAX_CURSORS);
+
+        if (!cursorRegion[page]) {
+            cursorRegion[page] = V4L2RegionCreate(pScreen, NULL, 0);
+        }
+        update.cursorRegion = cursorRegion[page];
+
+        if (hashTiles[pScreen->myNum].stamp) {
+            update.overlaid = V4L2UpdateOverlaid;
+        }
+    }
+
+    V4L2BlitBegin(&blits[V4L2_UPDATE_SOLID], pScreen, pBuf, opSolid);
+    if (update.osd)
+        V4L2BlitBegin(&blits[V4L2_UPDATE_OSD], pScreen, pBuf, opOsd);
+    if (update.nclips)
+        V4L2BlitBegin(&blits[V4L2_UPDATE_HOLE], pScreen, pBuf, opTransparent);
+    for (i = 0; i < update.ncursors; i++)
+        V4L2BlitBegin(&blits[V4L2_UPDATE_CURSOR + i], pScreen, pBuf,
+                pointers[i]);
+
+    /* the runs are drawn without the tile hashes, or the video of
+     * composited clips:
+     */
+    run.enabled = rotation[pScreen->myNum] && update.fused &&
+            (update.nclips > 0) && !hashTiles[pScreen->myNum].stamp &&
+            (compositeClips == 0) && !DIRECT(pScreen);
+
+    V4L2UpdateDraw(&update, V4L2UpdateEmit, blits);
+
+    if (run.enabled) {
+        V4L2RunFlush(blits);
+        run.enabled = FALSE;
+    }
+
+    V4L2BlitEnd(&blits[V4L2_UPDATE_SOLID]);
+    if (update.osd)
+        V4L2BlitEnd(&blits[V4L2_UPDATE_OSD]);
+    if (update.nclips)
+        V4L2BlitEnd(&blits[V4L2_UPDATE_HOLE]);
+    for (i = 0; i < update.ncursors; i++)
+        V4L2BlitEnd(&blits[V4L2_UPDATE_CURSOR + i]);
+
+    for (i = 0; i < update.nclips; i++) {
+        if (updateClips[i].filled) {
+            regions[i].updated &= ~pageBit;
+            regions[i].fresh = FALSE;
+        }
+    }
+
+    if (update.osd) {
+        RegionDestroy(update.osd);
+    }
+
+    if (update.holes) {
+        RegionDestroy(update.holes);
+    }
+}
+
+/* where the budget is spent first, after the damage that has waited
+ * longest.  The first pointer on the screen will do:
+ */
+static Bool
+V4L2CursorPosition(ScreenPtr pScreen, int *x, int *y)
+{
+    DeviceIntPtr pDev;
+
+    for(pDev = inputInfo.devices; pDev; pDev = pDev->next) {
+        miPointerPtr pPointer;
+        if (DevHasCursor(pDev) && (pPointer = MIPOINTER(pDev)) &&
+                (pPointer->pScreen == pScreen)) {
+            *x = pPointer->x;
+            *y = pPointer->y;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static int
+V4L2BudgetCompare(const void *a, const void *b)
+{
+    const V4L2BudgetBox *ba = a, *bb = b;
+
+    if (ba->age != bb->age)
+        return bb->age - ba->age;
+    return (ba->dist > bb->dist) - (ba->dist < bb->dist);
+}
+
+static void
+V4L2BudgetAdd(int *n, RegionPtr region, int age, int x, int y)
+{
+    int nbox = RegionNumRects(region);
+    BoxPtr pbox = RegionRects(region);
+
+    while (nbox--) {
+        V4L2BudgetBox *b = &budgetBoxes[(*n)++];
+        long dx = MAX(0, MAX(pbox->x1 - x, x - pbox->x2));
+        long dy = MAX(0, MAX(pbox->y1 - y, y - pbox->y2));
+
+        b->box = *pbox++;
+        b->age = age;
+        b->dest = MIN(age, BUDGET_AGES - 1);
+        b->dist = (dx * dx) + (dy * dy);
+    }
+}
+
+/* the boxes going to dest, as a region: */
+static void
+V4L2BudgetRegion(RegionPtr region, int n, int dest)
+{
+    int i, nrects = 0;
+
+    for (i = 0; i < n; i++) {
+        if (budgetBoxes[i].dest == dest)
+            budgetRects[nrects++] = budgetBoxes[i].box;
+    }
+
+    RegionInitBoxes(region, budgetRects, nrects);
+}
+
+static CARD32
+V4L2BudgetTimer(OsTimerPtr timer, CARD32 now, pointer arg)
+{
+    ScreenPtr pScreen = arg;
+    DrawablePtr pDraw = &budgets[pScreen->myNum].pBuf->pPixmap->drawable;
+    RegionRec all;
+    int i;
+
+    RegionNull(&all);
+    for (i = 0; i < BUDGET_AGES; i++)
+        RegionUnion(&all, &all, budgets[pScreen->myNum].deferred[i]);
+
+    if (RegionNotEmpty(&all)) {
+        DamageRegionAppend(pDraw, &all);
+        DamageRegionProcessPending(pDraw);
+    }
+
+    RegionUninit(&all);
+
+    return 0;
+}
+
+/* what is held back is handed back to the damage right away, to be drawn
+ * once switched back:
+ */
+static void
+V4L2BudgetLeaveVT(int scrnIndex, int flags)
+{
+    ScrnInfoPtr pScrn = xf86Screens[scrnIndex];
+
+    if (budgets[scrnIndex].timer) {
+        TimerCancel(budgets[scrnIndex].timer);
+        V4L2BudgetTimer(budgets[scrnIndex].timer, 0,
+                screenInfo.screens[scrnIndex]);
+    }
+
+    pScrn->LeaveVT = budgets[scrnIndex].LeaveVT;
+    (*pScrn->LeaveVT)(scrnIndex, flags);
+    pScrn->LeaveVT = V4L2BudgetLeaveVT;
+}
+
+static Bool
+V4L2BudgetCloseScreen(int scrnIndex, ScreenPtr pScreen)
+{
+    ScrnInfoPtr pScrn = xf86Screens[scrnIndex];
+    int i;
+
+    if (budgets[scrnIndex].timer) {
+        TimerFree(budgets[scrnIndex].timer);
+        budgets[scrnIndex].timer = NULL;
+    }
+
+    for (i = 0; i < BUDGET_AGES; i++) {
+        RegionDestroy(budgets[scrnIndex].deferred[i]);
+        budgets[scrnIndex].deferred[i] = NULL;
+    }
+    budgets[scrnIndex].pBuf = NULL;
+
+    pScrn->LeaveVT = budgets[scrnIndex].LeaveVT;
+    pScreen->CloseScreen = budgets[scrnIndex].CloseScreen;
+    return (*pScreen->CloseScreen)(scrnIndex, pScreen);
+}
+
+/**
+ * Limit what an update writes while video is shown (see UpdateBudget
+ * option).  Damage that has waited longest goes first, then what is closest
+ * to the cursor, until the budget is spent; the rest is held back for later
+ * updates.  Returns FALSE if the whole damage should be drawn as is, else
+ * draw is set to what should be drawn now.
+ */
+static Bool
+V4L2BudgetDamage(ScreenPtr pScreen, shadowBufPtr pBuf, RegionPtr damage,
+        RegionPtr draw)
+{
+    int sn = pScreen->myNum;
+    RegionPtr *deferred = budgets[sn].deferred;
+    RegionRec fresh;
+    long budget = config.updateBudget * 1024L;
+    int bpp = pBuf->pPixmap->drawable.bitsPerPixel;
+    unsigned long heldBytes = 0;
+    int i, n = 0, nbox, x = 0, y = 0;
+    Bool held = FALSE;
+
+    if (LIKELY (!config.updateBudget))
+        return FALSE;
+
+    if (!deferred[0]) {
+        ScrnInfoPtr pScrn = xf86Screens[sn];
+
+        for (i = 0; i < BUDGET_AGES; i++)
+            deferred[i] = V4L2RegionCreate(pScreen, NULL, 0);
+
+        budgets[sn].CloseScreen = pScreen->CloseScreen;
+        pScreen->CloseScreen = V4L2BudgetCloseScreen;
+        budgets[sn].LeaveVT = pScrn->LeaveVT;
+        pScrn->LeaveVT = V4L2BudgetLeaveVT;
+    }
+
+    /* the shadow (or direct) buffer can change between updates: */
+    budgets[sn].pBuf = pBuf;
+
+    for (i = 0; i < BUDGET_AGES; i++)
+        held |= RegionNotEmpty(deferred[i]);
+
+    if (LIKELY (activeClips == 0)) {
+        if (!held)
+            return FALSE;
+
+        /* no more video to protect, catch up on everything: */
+        RegionNull(draw);
+        RegionCopy(draw, damage);
+        for (i = 0; i < BUDGET_AGES; i++) {
+            RegionUnion(draw, draw, deferred[i]);
+            RegionEmpty(deferred[i]);
+        }
+        return TRUE;
+    }
+
+    /* the damage which is already held back keeps its age: */
+    RegionNull(&fresh);
+    RegionCopy(&fresh, damage);
+    for (i = 0; i < BUDGET_AGES; i++)
+        RegionSubtract(&fresh, &fresh, deferred[i]);
+
+    nbox = RegionNumRects(&fresh);
+    for (i = 0; i < BUDGET_AGES; i++)
+        nbox += RegionNumRects(deferred[i]);
+
+    /* room for the boxes split by rows, too: */
+    nbox *= 2;
+
+    if (nbox > budgetSize) {
+        V4L2BudgetBox *boxes = realloc(budgetBoxes, nbox * sizeof(*boxes));
+        BoxPtr rects = realloc(budgetRects, nbox * sizeof(*rects));
+        if (boxes)
+            budgetBoxes = boxes;
+        if (rects)
+            budgetRects = rects;
+        if (!boxes || !rects) {
+            RegionUninit(&fresh);
+            return FALSE;
+        }
+        budgetSize = nbox;
+    }
+
+    V4L2CursorPosition(pScreen, &x, &y);
+
+    V4L2BudgetAdd(&n, &fresh, 0, x, y);
+    for (i = 0; i < BUDGET_AGES; i++)
+        V4L2BudgetAdd(&n, deferred[i], i + 1, x, y);
+
+    qsort(budgetBoxes, n, sizeof(budgetBoxes[0]), V4L2BudgetCompare);
+
+    /* spend the budget, splitting the box it runs out in by rows.  The
+     * rows left over go to the end, and get deferred:
+     */
+    for (i = 0; i < n; i++) {
+        V4L2BudgetBox *b = &budgetBoxes[i];
+        long rowBytes = (b->box.x2 - b->box.x1) * bpp / 8;
+        long bytes = rowBytes * (b->box.y2 - b->box.y1);
+
+        if ((b->age >= BUDGET_AGES) || (bytes <= budget)) {
+            b->dest = -1;
+            budget = MAX(0, budget - bytes);
+        } else if ((budget >= rowBytes) && (n < budgetSize)) {
+            int rows = budget / rowBytes;
+            budgetBoxes[n] = *b;
+            budgetBoxes[n].box.y1 += rows;
+            b->box.y2 = budgetBoxes[n].box.y1;
+            b->dest = -1;
+            budget -= rows * rowBytes;
+            n++;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        BoxPtr pbox = &budgetBoxes[i].box;
+        if (budgetBoxes[i].dest >= 0)
+            heldBytes += (pbox->x2 - pbox->x1) * (pbox->y2 - pbox->y1) *
+                    bpp / 8;
+    }
+
+    V4L2BudgetRegion(draw, n, -1);
+    for (i = 0; i < BUDGET_AGES; i++) {
+        RegionUninit(deferred[i]);
+        V4L2BudgetRegion(deferred[i], n, i);
+    }
+
+    RegionUninit(&fresh);
+
+    if (heldBytes) {
+        V4L2_STAT_ADD(v4l2ScreenStats[sn].deferredBytes, heldBytes);
+        budgets[sn].timer = TimerSet(budgets[sn].timer, 0, V4L2_BUDGET_MSEC,
+                V4L2BudgetTimer, pScreen);
+    }
+
+    return TRUE;
+}
+
+/* move the shadow pixmap's pixels into huge pages, with padded rows.  The
+ * shadow allocated by the fbdev driver stays allocated, as it is the
+ * driver's to free:
+ */
+static void
+V4L2HugeShadowSetup(ScreenPtr pScreen, shadowBufPtr pBuf)
+{
+    static const char *kinds[] = { "no", "transparent", "hugetlb" };
+    PixmapPtr pPixmap = pBuf->pPixmap;
+    int n = pScreen->myNum;
+    int width = pPixmap->drawable.width;
+    int height = pPixmap->drawable.height;
+    int stride, huge, y;
+    size_t size;
+    void *mem;
+
+    /* left over from a previous server generation: */
+    V4L2ShadowFree(hugeShadows[n].mem, hugeShadows[n].size);
+    hugeShadows[n].mem = NULL;
+
+    if (pPixmap->drawable.bitsPerPixel != 32) {
+        xf86Msg(X_WARNING, "v4l2: HugeShadow needs a 32bpp shadow\n");
+        hugeShadows[n].failed = TRUE;
+        return;
+    }
+
+    mem = V4L2ShadowAlloc(width, height, &stride, &size, &huge);
+    if (!mem) {
+        xf86Msg(X_WARNING, "v4l2: HugeShadow could not map %dx%d\n",
+                width, height);
+        hugeShadows[n].failed = TRUE;
+        return;
+    }
+
+    for (y = 0; y < height; y++) {
+        memcpy(mem + (y * stride),
+                (CARD8 *)pPixmap->devPrivate.ptr + (y * pPixmap->devKind),
+                width * 4);
+    }
+
+    if (!pScreen->ModifyPixmapHeader(pPixmap, 0, 0, 0, 0, stride, mem)) {
+        V4L2ShadowFree(mem, size);
+        hugeShadows[n].failed = TRUE;
+        return;
+    }
+
+    hugeShadows[n].mem = mem;
+    hugeShadows[n].size = size;
+
+    xf86Msg(X_INFO, "v4l2: shadow moved to %zu KB with %s huge pages, "
+            "stride %d\n", size >> 10, kinds[huge], stride);
+}
+
+static void
+V4L2ShadowUpdatePacked(ScreenPtr pScreen, shadowBufPtr pBuf)
+{
+    RegionPtr damage = DamageRegion(pBuf->pDamage);
+    V4L2ScreenStats *stats = &v4l2ScreenStats[pScreen->myNum];
+    uint64_t start = V4L2StatsNow();
+    unsigned long usec;
+    RegionRec budgeted;
+
+    if (UNLIKELY (config.hugeShadow) && !DIRECT(pScreen) &&
+            !hugeShadows[pScreen->myNum].failed &&
+            pBuf->pPixmap->devPrivate.ptr &&        /* not while VT is away */
+            (pBuf->pPixmap->devPrivate.ptr != hugeShadows[pScreen->myNum].mem)) {
+        V4L2HugeShadowSetup(pScreen, pBuf);
+    }
+
+    /* exports are after everything that changed, budget or not: */
+    if (UNLIKELY (v4l2Exporting)) {
+        V4L2ExportDamage(pScreen, damage);
+    }
+
+    V4L2_TRACE(UPDATE_BEGIN, 0, pScreen->myNum,
+            RegionNumRects(damage), activeClips, 0);
+
+    /* the cursors go first, so that they are replayed with the damage
+     * they are drawn with:
+     */
+    if (UNLIKELY (v4l2Recording)) {
+        BoxRec cursors[V4L2_UPDATE_MAX_CURSORS];
+        int i, n = V4L2Cursors(pScreen, cursors, NULL,
+                V4L2_UPDATE_MAX_CURSORS);
+        for (i = 0; i < n; i++) {
+            V4L2_RECORD(CURSOR, 0, cursors[i].x1, cursors[i].y1,
+                    cursors[i].x2 - cursors[i].x1,
+                    cursors[i].y2 - cursors[i].y1, NULL);
+        }
+    }
+    V4L2_RECORD(DAMAGE, 0, pScreen->myNum, 0, 0, 0, damage);
+
+    /* with page flipping, only the new damage counts against the budget: */
+    if (UNLIKELY (V4L2BudgetDamage(pScreen, pBuf, damage, &budgeted))) {
+        damage = &budgeted;
+    }
+
+    if (UNLIKELY (pages[pScreen->myNum].flip)) {
+        int page = pages[pScreen->myNum].page;
+        RegionPtr *pending = pages[pScreen->myNum].pending;
+
+        V4L2FlipWait(pScreen);
+
+        /* the other page needs this damage the next time it is drawn,
+         * this page also needs what the other page got last time:
+         */
+        RegionUnion(pending[!page], pending[!page], damage);
+        RegionUnion(pending[page], pending[page], damage);
+
+        V4L2ShadowUpdateRegion(pScreen, pBuf, pending[page]);
+        RegionEmpty(pending[page]);
+
+        V4L2Flip(pScreen, pBuf);
+    } else {
+        V4L2ShadowUpdateRegion(pScreen, pBuf, damage);
+    }
+
+    if (damage == &budgeted) {
+        RegionPtr *deferred = budgets[pScreen->myNum].deferred;
+        int i;
+
+        /* the tiles drawn were hashed in full, including what is held
+         * back in them, which would then look up to date when drawn:
+         */
+        for (i = 0; i < BUDGET_AGES; i++)
+            V4L2TileInvalidateRegion(pScreen, deferred[i], 0x3);
+
+        RegionUninit(&budgeted);
+    }
+
+    usec = V4L2StatsNow() - start;
+    V4L2_STAT_ADD(stats->updates, 1);
+    V4L2_STAT_ADD(stats->updateUsec, usec);
+    V4L2_TRACE(UPDATE_END, 0, pScreen->myNum, usec, 0, 0);
+}
+
+/**
+ * overload shadow update fxn and handle alpha pixels inline with copy to
+ * framebuffer
+ */
+shadowUpdateProc
+shadowUpdatePackedWeak(void)
+{
+    shadowUsed = TRUE;
+    return V4L2ShadowUpdatePacked;
+}
+
+static void
+V4L2ShadowUpdateRotatePacked(ScreenPtr pScreen, shadowBufPtr pBuf)
+{
+    int randr = pBuf->randr & (SHADOW_ROTATE_ALL | SHADOW_REFLECT_ALL);
+
+    if (randr == SHADOW_ROTATE_0)
+        randr = 0;
+
+    rotation[pScreen->myNum] = randr;
+
+    V4L2ShadowUpdatePacked(pScreen, pBuf);
+}
+
+/**
+ * same for rotated (and/or reflected) framebuffers: the updates take the
+ * same path, just with the boxes transformed on the way to the kernels
+ */
+shadowUpdateProc
+shadowUpdateRotatePackedWeak(void)
+{
+    shadowUsed = TRUE;
+    return V4L2ShadowUpdateRotatePacked;
+}
+
+/* the "shadow" of the direct mode is the framebuffer itself: */
+static void *
+V4L2DirectWindow(ScreenPtr pScreen, CARD32 row, CARD32 offset, int mode,
+        CARD32 *size, void *closure)
+{
+    PixmapPtr pPixmap = closure;
+
+    *size = pPixmap->devKind;
+
+    return (CARD8 *)pPixmap->devPrivate.ptr + (row * pPixmap->devKind) + offset;
+}
+
+/* redraw all of a screen, such as once solid pixels need alpha, having
+ * been copied without it:
+ */
+static void
+V4L2DamageScreen(ScreenPtr pScreen)
+{
+    PixmapPtr pPixmap = pScreen->GetScreenPixmap(pScreen);
+    RegionRec region;
+    BoxRec box;
+
+    /* set up before the screen resources, there is nothing drawn yet: */
+    if (!pPixmap)
+        return;
+
+    box.x1 = 0;
+    box.y1 = 0;
+    box.x2 = pScreen->width;
+    box.y2 = pScreen->height;
+    RegionInit(&region, &box, 1);
+    DamageRegionAppend(&pPixmap->drawable, &region);
+    DamageRegionProcessPending(&pPixmap->drawable);
+    RegionUninit(&region);
+}
+
+/* done on the first block handler rather than from V4L2SetupScreen(), as
+ * the screen pixmap, and whether the shadow layer is in use, are only
+ * known once the screen resources are created:
+ */
+static Bool
+V4L2DirectSetup(ScreenPtr pScreen)
+{
+    shadowBufPtr pBuf = &direct[pScreen->myNum].buf;
+    PixmapPtr pPixmap = pScreen->GetScreenPixmap(pScreen);
+
+    if (shadowUsed) {
+        xf86Msg(X_WARNING, "v4l2: DirectRender ignored, the shadow "
+                "framebuffer is in use (see the fbdev ShadowFB option)\n");
+        return FALSE;
+    }
+
+    pBuf->pDamage = DamageCreate(NULL, NULL, DamageReportNone, TRUE,
+            pScreen, pScreen);
+    if (!pBuf->pDamage) {
+        xf86Msg(X_WARNING, "v4l2: DirectRender could not create damage\n");
+        return FALSE;
+    }
+
+    DamageRegister(&pPixmap->drawable, pBuf->pDamage);
+
+    pBuf->pPixmap = pPixmap;
+    pBuf->update = V4L2ShadowUpdatePacked;
+    pBuf->window = V4L2DirectWindow;
+    pBuf->closure = pPixmap;
+
+    /* whatever was rendered so far has no alpha yet: */
+    V4L2DamageScreen(pScreen);
+
+    xf86Msg(X_INFO, "v4l2: rendering directly into the framebuffer\n");
+
+    return TRUE;
+}
+
+static void
+V4L2DirectBlockHandler(int i, pointer blockData, pointer pTimeout,
+        pointer pReadmask)
+{
+    ScreenPtr pScreen = screenInfo.screens[i];
+    shadowBufPtr pBuf = &direct[i].buf;
+
+    if (UNLIKELY (direct[i].state == DIRECT_PENDING)) {
+        direct[i].state = V4L2DirectSetup(pScreen) ? DIRECT_ACTIVE : DIRECT_OFF;
+    }
+
+    if (DIRECT(pScreen) && RegionNotEmpty(DamageRegion(pBuf->pDamage))) {
+        V4L2ShadowUpdatePacked(pScreen, pBuf);
+        DamageEmpty(pBuf->pDamage);
+    }
+
+    pScreen->BlockHandler = direct[i].BlockHandler;
+    (*pScreen->BlockHandler)(i, blockData, pTimeout, pReadmask);
+    pScreen->BlockHandler = V4L2DirectBlockHandler;
+}
+
+/* check whether the display can pan between two pages, as configured by
+ * V4L2SetupScreen(), and if so start flipping:
+ */
+static void
+V4L2FlipSetup(ScreenPtr pScreen, int fd)
+{
+    struct fb_var_screeninfo *var = &pages[pScreen->myNum].var;
+    struct fb_fix_screeninfo fix;
+    unsigned long htotal, vtotal;
+    BoxRec box = { 0, 0, pScreen->width, pScreen->height };
+
+    if ((-1 == ioctl(fd, FBIOGET_VSCREENINFO, var)) ||
+            (-1 == ioctl(fd, FBIOGET_FSCREENINFO, &fix))) {
+        perror("ioctl FBIOGET_*SCREENINFO");
+        return;
+    }
+
+    if ((var->yres_virtual < 2 * var->yres) || (fix.ypanstep == 0) ||
+            (fix.smem_len < 2 * var->yres * fix.line_length)) {
+        xf86Msg(X_WARNING, "v4l2: framebuffer can't pan between two "
+                "pages, not enabling page flipping\n");
+        return;
+    }
+
+    /* refresh period, for knowing whether the last flip happened yet: */
+    htotal = var->xres + var->left_margin + var->right_margin + var->hsync_len;
+    vtotal = var->yres + var->upper_margin + var->lower_margin + var->vsync_len;
+    if (var->pixclock) {
+        pages[pScreen->myNum].frameUsec =
+                (unsigned long long)var->pixclock * htotal * vtotal / 1000000;
+    } else {
+        pages[pScreen->myNum].frameUsec = 1000000 / 60;
+    }
+
+    pages[pScreen->myNum].fd = fd;
+    pages[pScreen->myNum].rows = var->yres;
+    pages[pScreen->myNum].page = (var->yoffset < var->yres) ? 1 : 0;
+    pages[pScreen->myNum].pending[0] = V4L2RegionCreate(pScreen, &box, 1);
+    pages[pScreen->myNum].pending[1] = V4L2RegionCreate(pScreen, &box, 1);
+    pages[pScreen->myNum].flip = TRUE;
+
+    xf86Msg(X_INFO, "v4l2: page flipping enabled, %d rows per page, "
+            "%lu usec per frame\n", var->yres, pages[pScreen->myNum].frameUsec);
+}
+
+/* the framebuffer contents are lost while switched away, so the tile
+ * hashes can't be trusted after switching back:
+ */
+static Bool
+V4L2EnterVT(int scrnIndex, int flags)
+{
+    ScreenPtr pScreen = screenInfo.screens[scrnIndex];
+    BoxRec box = { 0, 0, pScreen->width, pScreen->height };
+
+    V4L2TileInvalidate(pScreen, &box, 0x3);
+
+    return hashTiles[scrnIndex].EnterVT(scrnIndex, flags);
+}
+
+static void
+V4L2TileSetup(ScreenPtr pScreen)
+{
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    int n = pScreen->myNum, count;
+
+    hashTiles[n].cols = (pScreen->width + HASH_SIZE - 1) >> HASH_SHIFT;
+    hashTiles[n].rows = (pScreen->height + HASH_SIZE - 1) >> HASH_SHIFT;
+    count = hashTiles[n].cols * hashTiles[n].rows;
+
+    hashTiles[n].hash[0] = calloc(count, sizeof(uint64_t));
+    hashTiles[n].hash[1] = calloc(count, sizeof(uint64_t));
+    hashTiles[n].changed = calloc(count, sizeof(uint8_t));
+    hashTiles[n].stamp   = calloc(count, sizeof(uint32_t));
+
+    if (!hashTiles[n].hash[0] || !hashTiles[n].hash[1] || !hashTiles[n].changed ||
+            !hashTiles[n].stamp) {
+        free(hashTiles[n].hash[0]);
+        free(hashTiles[n].hash[1]);
+        free(hashTiles[n].changed);
+        free(hashTiles[n].stamp);
+        hashTiles[n].stamp = NULL;
+        return;
+    }
+
+    hashTiles[n].EnterVT = pScrn->EnterVT;
+    pScrn->EnterVT = V4L2EnterVT;
+
+    xf86Msg(X_INFO, "v4l2: tile hashing enabled, %dx%d tiles\n",
+            hashTiles[n].cols, hashTiles[n].rows);
+}
+
+/* repaint (the visible part of) a window whose OSD state changed: */
+static void
+V4L2OSDRepaint(WindowPtr pWin)
+{
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+    RegionRec region;
+
+    if (!pWin->viewable)
+        return;
+
+    RegionNull(&region);
+    V4L2OSDWindowRegion(pWin, &region);
+    DamageRegionAppend(&pScreen->root->drawable, &region);
+    RegionUninit(&region);
+}
+
+static void
+V4L2OSDAdd(WindowPtr pWin)
+{
+    int i;
+
+    for (i = 0; i < numOsdWindows; i++)
+        if (osdWindows[i] == pWin)
+            return;
+
+    osdWindows = realloc(osdWindows, sizeof(osdWindows[0]) * (numOsdWindows + 1));
+    osdWindows[numOsdWindows++] = pWin;
+
+    DEBUG("OSD window 0x%lx added", (unsigned long)pWin->drawable.id);
+}
+
+static void
+V4L2OSDRemove(WindowPtr pWin)
+{
+    int i;
+
+    for (i = 0; i < numOsdWindows; i++) {
+        if (osdWindows[i] == pWin) {
+            osdWindows[i] = osdWindows[--numOsdWindows];
+            DEBUG("OSD window 0x%lx removed", (unsigned long)pWin->drawable.id);
+            return;
+        }
+    }
+}
+
+/* a window is marked as OSD by setting the _V4L2_OSD_ALPHA property (of
+ * type CARDINAL) to a non-zero value, and unmarked by deleting it or
+ * setting it to zero:
+ */
+static void
+V4L2OSDPropertyCallback(CallbackListPtr *pcbl, pointer closure, pointer data)
+{
+    PropertyStateRec *rec = data;
+    PropertyPtr pProp = rec->prop;
+
+    if (pProp->propertyName != osdAtom)
+        return;
+
+    if ((rec->state == PropertyNewValue) && (pProp->format == 32) &&
+            (pProp->size >= 1) && *(CARD32 *)pProp->data) {
+        V4L2OSDAdd(rec->win);
+    } else {
+        V4L2OSDRemove(rec->win);
+    }
+
+    V4L2OSDRepaint(rec->win);
+}
+
+/* windows with an ARGB visual are OSD windows without having to be marked.
+ * The server composites them into the screen pixmap with a plain copy,
+ * alpha included, so the alpha is already in the shadow:
+ */
+static Bool
+V4L2CreateWindow(WindowPtr pWin)
+{
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+    Bool ret;
+
+    pScreen->CreateWindow = savedCreateWindow[pScreen->myNum];
+    ret = (*pScreen->CreateWindow)(pWin);
+    savedCreateWindow[pScreen->myNum] = pScreen->CreateWindow;
+    pScreen->CreateWindow = V4L2CreateWindow;
+
+    if (ret && (pWin->drawable.depth == 32) && pWin->parent &&
+            (pWin->parent->drawable.depth != 32)) {
+        V4L2OSDAdd(pWin);
+    }
+
+    return ret;
+}
+
+static Bool
+V4L2DestroyWindow(WindowPtr pWin)
+{
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+    Bool ret;
+
+    V4L2OSDRemove(pWin);
+
+    pScreen->DestroyWindow = savedDestroyWindow[pScreen->myNum];
+    ret = (*pScreen->DestroyWindow)(pWin);
+    savedDestroyWindow[pScreen->myNum] = pScreen->DestroyWindow;
+    pScreen->DestroyWindow = V4L2DestroyWindow;
+
+    return ret;
+}
+
+/* configure the framebuffer of a screen for ARGB, if it wasn't already
+ * when the screen was set up:
+ */
+static void
+V4L2SetupARGB(ScreenPtr pScreen)
+{
+    int fd = fbdevHWGetFD(xf86Screens[pScreen->myNum]);
+    struct fb_var_screeninfo var;
+
+    if (!fd)
+        return;
+
+    DEBUG("reconfiguring fb dev %d to ARGB..", fd);
+
+    if (-1 == ioctl(fd, FBIOGET_VSCREENINFO, &var)) {
+        perror("ioctl FBIOGET_VSCREENINFO");
+        return;
+    }
+
+    var.transp.length = 8;
+    var.transp.offset = 24;
+
+    if (-1 == ioctl(fd, FBIOPUT_VSCREENINFO, &var)) {
+        perror("ioctl FBIOPUT_VSCREENINFO");
+    } else if (pages[pScreen->myNum].flip) {
+        pages[pScreen->myNum].var.transp = var.transp;
+    }
+}
+
+static Bool
+V4L2SetupScreen(ScreenPtr pScreen, Bool argb)
+{
+    int fd;
+
+    DEBUG("SetupScreen, pScreen=%p", pScreen);
+
+    /* configure the corresponding framebuffer for ARGB (not needed if the
+     * video is only composited), and for page flipping:
+     */
+    fd = fbdevHWGetFD(xf86Screens[pScreen->myNum]);
+    if (fd) {
+        struct fb_var_screeninfo var;
+
+        DEBUG("reconfiguring fb dev %d%s..", fd, argb ? " to ARGB" : "");
+
+        if (-1 == ioctl(fd, FBIOGET_VSCREENINFO, &var)) {
+            perror("ioctl FBIOGET_VSCREENINFO");
+        }
+
+        /* @todo support other color formats than ARGB */
+        if (argb) {
+            var.transp.length = 8;
+            var.transp.offset = 24;
+        }
+
+        /* room for a second page to flip to.  Not when rendering directly,
+         * as X only knows about the first page:
+         */
+        if (config.pageFlip && !config.directRender) {
+            var.yres_virtual = 2 * var.yres;
+        }
+
+        if (-1 == ioctl(fd, FBIOPUT_VSCREENINFO, &var)) {
+            perror("ioctl FBIOPUT_VSCREENINFO");
+        }
+
+        if (config.pageFlip && !config.directRender) {
+            V4L2FlipSetup(pScreen, fd);
+        }
+    }
+
+    if (config.directRender) {
+        direct[pScreen->myNum].state = DIRECT_PENDING;
+        direct[pScreen->myNum].BlockHandler = pScreen->BlockHandler;
+        pScreen->BlockHandler = V4L2DirectBlockHandler;
+    }
+
+    if (config.tileHash) {
+        V4L2TileSetup(pScreen);
+    }
+
+    if (config.osdAlpha != V4L2_OSD_ALPHA_OFF) {
+        savedCreateWindow[pScreen->myNum] = pScreen->CreateWindow;
+        pScreen->CreateWindow = V4L2CreateWindow;
+        savedDestroyWindow[pScreen->myNum] = pScreen->DestroyWindow;
+        pScreen->DestroyWindow = V4L2DestroyWindow;
+    }
+
+    return TRUE;
+}
+
+static void
+V4L2SetupScreens(Bool withAlpha)
+{
+    int i;
+
+    if (alpha) {
+        /* the first port may have been a composited one: */
+        if (withAlpha && !argb) {
+            argb = TRUE;
+            for (i = 0; i < screenInfo.numScreens; i++) {
+                V4L2SetupARGB(screenInfo.screens[i]);
+                V4L2DamageScreen(screenInfo.screens[i]);
+            }
+        }
+        return;
+    }
+
+    for (i = 0; i < screenInfo.numScreens; i++) {
+        V4L2SetupScreen(screenInfo.screens[i], withAlpha);
+    }
+
+    if (config.osdAlpha != V4L2_OSD_ALPHA_OFF) {
+        static const char name[] = "_V4L2_OSD_ALPHA";
+        osdAtom = MakeAtom(name, sizeof(name) - 1, TRUE);
+        AddCallback(&PropertyStateCallback, V4L2OSDPropertyCallback, NULL);
+    }
+
+    alpha = TRUE;
+    argb = withAlpha;
+
+    /* what was copied so far went without setting alpha: */
+    if (argb) {
+        for (i = 0; i < screenInfo.numScreens; i++) {
+            V4L2DamageScreen(screenInfo.screens[i]);
+        }
+    }
+}
+
+static void
+V4L2AddRegion(PortPrivPtr pPPriv)
+{
+    if (pPPriv->nr >= numRegions) {
+        V4L2Region *grown;
+
+        /* grow array of per-port info (aligned, as realloc() wouldn't
+         * keep it):
+         */
+        if (posix_memalign((void **)&grown, V4L2_CACHE_LINE,
+                sizeof(regions[0]) * (pPPriv->nr + 1)))
+            return;
+        if (numRegions)
+            memcpy(grown, regions, sizeof(regions[0]) * numRegions);
+        free(regions);
+        regions = grown;
+
+        updateClips = realloc(updateClips,
+                sizeof(updateClips[0]) * (pPPriv->nr + 1));
+        clipLists = realloc(clipLists, sizeof(clipLists[0]) * (pPPriv->nr + 1));
+        composeInputs = realloc(composeInputs, sizeof(composeInputs[0]) *
+                V4L2_UPDATE_MAX_INPUTS(pPPriv->nr + 1));
+
+        while (numRegions <= pPPriv->nr) {
+            memset(&regions[numRegions], 0, sizeof(regions[numRegions]));
+            numRegions++;
+        }
+    }
+
+    regions[pPPriv->nr].enabled = TRUE;
+}
+
+/**
+ * Setup alpha blending for a new port.
+ */
+void
+V4L2SetupAlpha(PortPrivPtr pPPriv)
+{
+    V4L2SetupScreens(TRUE);
+    V4L2AddRegion(pPPriv);
+}
+
+/**
+ * Setup a port whose device can neither blend the video with the
+ * framebuffer nor key it.  Its video is composited into the framebuffer
+ * by the CPU instead, through the same update path as the holes of alpha
+ * mode: the frames handed over with V4L2SetFrame() are converted to ARGB
+ * straight into the clip, and the cursor blended over them.
+ */
+void
+V4L2SetupComposite(PortPrivPtr pPPriv)
+{
+    V4L2SetupScreens(FALSE);
+    V4L2AddRegion(pPPriv);
+    regions[pPPriv->nr].composite = TRUE;
+}
+
+/**
+ * Hand the latest frame of a composited port over, to be drawn at the
+ * next update, or NULL to take it back.  The frame has to stay as it is
+ * until then.  A frame replaced before it was drawn is dropped rather than
+ * drawn late, so a source faster than the updates costs no more than one
+ * conversion per update.
+ */
+void
+V4L2SetFrame(PortPrivPtr pPPriv, const V4L2ScaleImage *frame, int matrix)
+{
+    int nr = pPPriv->nr;
+    static Bool warned = FALSE;
+
+    if (!alpha || (nr >= numRegions) || !regions[nr].composite)
+        return;
+
+    if (!frame) {
+        regions[nr].frame.width = 0;
+        regions[nr].fresh = FALSE;
+        return;
+    }
+
+    if (!shadowUsed && !config.directRender && !warned) {
+        xf86Msg(X_WARNING, "v4l2: no shadow framebuffer, video can't be "
+                "composited (see ShadowFB option)\n");
+        warned = TRUE;
+    }
+
+    if (regions[nr].fresh)
+        V4L2_STAT_ADD(pPPriv->stats.dropped, 1);
+    V4L2_STAT_ADD(pPPriv->stats.frames, 1);
+
+    regions[nr].frame = *frame;
+    regions[nr].matrix = matrix;
+    regions[nr].fresh = TRUE;
+
+    if (regions[nr].clip) {
+        DrawablePtr pDraw = &regions[nr].pScreen->root->drawable;
+        regions[nr].updated = PAGE_MASK(regions[nr].pScreen);
+        DamageRegionAppend(pDraw, regions[nr].clip);
+        DamageRegionProcessPending(pDraw);
+    }
+}
+
+/**
+ * Where the frames of a composited port go on screen, their top left.
+ */
+void
+V4L2SetFramePosition(PortPrivPtr pPPriv, short x, short y)
+{
+    if (alpha && (pPPriv->nr < numRegions)) {
+        regions[pPPriv->nr].x = x;
+        regions[pPPriv->nr].y = y;
+    }
+}
+
+/**
+ * Rebuild the tile mask of a video clip.  The clip changes much less often
+ * than the damage, so this is where the cost of classifying tiles goes.  On
+ * failure the mask is left empty, and the update falls back to region
+ * arithmetic.
+ */
+static void
+V4L2ClipMaskUpdate(int nr, ScreenPtr pScreen, RegionPtr clip)
+{
+    V4L2TileMask *mask = &regions[nr].mask;
+
+    if (mask->full && ((mask->width != pScreen->width) ||
+            (mask->height != pScreen->height))) {
+        V4L2TileMaskFini(mask);
+    }
+
+    if (!mask->full &&
+            V4L2TileMaskInit(mask, pScreen->width, pScreen->height)) {
+        xf86Msg(X_WARNING, "v4l2: could not allocate tile mask\n");
+        return;
+    }
+
+    V4L2TileMaskClear(mask);
+    V4L2TileMaskAdd(mask, (V4L2TileBox *)RegionRects(clip),
+            RegionNumRects(clip));
+}
+
+/**
+ * called by core part of xf86-video-v4l2 driver module when he wants to paint
+ * pixels with alpha enabled.
+ */
+void
+V4L2SetClip(PortPrivPtr pPPriv, DrawablePtr pDraw, RegionPtr clipBoxes)
+{
+    if (alpha && (pPPriv->nr < numRegions) && regions[pPPriv->nr].enabled) {
+        /* a video that is playing sets the same clip every frame: */
+        Bool sameClip = regions[pPPriv->nr].clip &&
+                RegionEqual(regions[pPPriv->nr].clip, clipBoxes);
+
+        V4L2ClearClip(pPPriv);
+
+        /* none of the video is visible, the updates can ignore the port: */
+        if (!RegionNotEmpty(clipBoxes))
+            return;
+
+        V4L2_TRACE(SET_CLIP, pPPriv->nr, RegionNumRects(clipBoxes),
+                V4L2_TRACE_XY(clipBoxes->extents.x1, clipBoxes->extents.y1),
+                V4L2_TRACE_XY(clipBoxes->extents.x2, clipBoxes->extents.y2), 0);
+
+        regions[pPPriv->nr].clip = V4L2RegionCreate(pDraw->pScreen, NULL, 0);
+        RegionCopy(regions[pPPriv->nr].clip, clipBoxes);
+        regions[pPPriv->nr].updated = PAGE_MASK(pDraw->pScreen);
+        regions[pPPriv->nr].pScreen = pDraw->pScreen;
+
+        if (!sameClip)
+            V4L2ClipMaskUpdate(pPPriv->nr, pDraw->pScreen, clipBoxes);
+        activeClips++;
+        if (regions[pPPriv->nr].composite)
+            compositeClips++;
+
+        /* we don't actually have to fill the color key.. just register it as
+         * dirty so that our shadow-update function gets run
+         */
+        DamageRegionAppend(pDraw, clipBoxes);
+    } else {
+        xf86XVFillKeyHelper(pDraw->pScreen, pPPriv->colorKey, clipBoxes);
+    }
+}
+
+void
+V4L2ClearClip(PortPrivPtr pPPriv)
+{
+    /* with DeferSetup, a port may be stopped before it was ever set up: */
+    if (alpha && (pPPriv->nr < numRegions) && regions[pPPriv->nr].enabled) {
+        V4L2_TRACE(CLEAR_CLIP, pPPriv->nr, 0, 0, 0, 0);
 
         if (regions[pPPriv->nr].clip) {
+            /* the hole is still there, in whichever pages it was punched: */
+            V4L2TileInvalidateRegion(regions[pPPriv->nr].pScreen,
+                    regions[pPPriv->nr].clip, 0x3);
             RegionUninit(regions[pPPriv->nr].clip);
             regions[pPPriv->nr].clip = NULL;
             activeClips--;
+            if (regions[pPPriv->nr].composite)
+                compositeClips--;
         }
     }
 }
@@ -0,0 +1,87 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: device access backends
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "xf86.h"
+#include "xf86_OSproc.h"
+#include "xf86xv.h"
+#include "v4l2.h"
+
+static int
+V4L2KernelOpen(const char *name, int flags)
+{
+    return open(name, flags, 0);
+}
+
+static int
+V4L2KernelIoctl(int fd, unsigned long request, void *arg)
+{
+    return ioctl(fd, request, arg);
+}
+
+static void *
+V4L2KernelMmap(int fd, size_t length, int prot, off_t offset)
+{
+    return mmap(NULL, length, prot, MAP_SHARED, fd, offset);
+}
+
+const V4L2Backend v4l2KernelBackend = {
+        .prefix = NULL,
+        .open   = V4L2KernelOpen,
+        .close  = close,
+        .ioctl  = V4L2KernelIoctl,
+        .mmap   = V4L2KernelMmap,
+        .munmap = munmap,
+};
+
+static const V4L2Backend *backends[] = {
+        &v4l2FakeBackend,
+        NULL
+};
+
+/**
+ * Pick the backend for a device name, for example "fake:0" is handled by
+ * the fake backend and anything without a known prefix is a kernel device.
+ */
+const V4L2Backend *
+V4L2FindBackend(const char *name)
+{
+    int i;
+
+    for (i = 0; backends[i]; i++) {
+        const char *prefix = backends[i]->prefix;
+        if (!strncmp(name, prefix, strlen(prefix)))
+            return backends[i];
+    }
+
+    return &v4l2KernelBackend;
+}
@@ -0,0 +1,401 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: generic C pixel kernels for the alpha path
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "v4l2-blit.h"
+
+#define WEAK __attribute__((weak))
+
+#ifndef MIN
+#  define MIN(a,b) ((a) > (b) ? (b) : (a))
+#endif
+#ifndef MAX
+#  define MAX(a,b) ((a) > (b) ? (a) : (b))
+#endif
+
+WEAK void
+V4L2ShadowBlitTransparentARGB32(void *winBase, int winStride, int w, int h)
+{
+    while (h--) {
+        memset (winBase, 0x00, w * sizeof(uint32_t));
+        winBase += winStride;
+    }
+}
+
+WEAK void
+V4L2ShadowBlitSolidARGB32(void *winBase, int winStride,
+        void *shaBase, int shaStride, int w, int h)
+{
+    while (h--) {
+        uint32_t *win = winBase;
+        uint32_t *sha = shaBase;
+        int i = w;
+        while (i--)
+            *win++ = 0xff000000 | *sha++;
+        winBase += winStride;
+        shaBase += shaStride;
+    }
+}
+
+WEAK void
+V4L2ShadowBlitCursorARGB32(void *winBase, int winStride,
+        void *curBase, int curStride, int w, int h)
+{
+    while (h--) {
+        memcpy(winBase, curBase, w * sizeof(uint32_t));
+        winBase += winStride;
+        curBase += curStride;
+    }
+}
+
+/* premultiplied over, with x / 255 as (x + 1 + (x >> 8)) >> 8: */
+WEAK void
+V4L2ShadowBlitCursorOverARGB32(void *winBase, int winStride,
+        void *curBase, int curStride, int w, int h)
+{
+    while (h--) {
+        uint32_t *win = winBase;
+        uint32_t *cur = curBase;
+        int i;
+        for (i = 0; i < w; i++) {
+            uint32_t s = cur[i], d = win[i], ia = 255 - (s >> 24);
+            uint32_t rb, ag;
+            if (ia == 0) {
+                win[i] = s;
+                continue;
+            }
+            if (ia == 255)
+                continue;
+            rb = ((d & 0x00ff00ff) * ia) + 0x00800080;
+            rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+            ag = (((d >> 8) & 0x00ff00ff) * ia) + 0x00800080;
+            ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+            win[i] = s + (rb | ag);
+        }
+        winBase += winStride;
+        curBase += curStride;
+    }
+}
+
+WEAK void
+V4L2ShadowBlitCopyARGB32(void *winBase, int winStride,
+        void *shaBase, int shaStride, int w, int h)
+{
+    while (h--) {
+        memcpy(winBase, shaBase, w * sizeof(uint32_t));
+        winBase += winStride;
+        shaBase += shaStride;
+    }
+}
+
+/* 255/a in 16.16 fixed point, so un-premultiplying is a multiply per
+ * channel rather than a divide:
+ */
+static uint32_t unpremultiply[256];
+
+static void
+UnpremultiplyInit(void)
+{
+    if (!unpremultiply[1]) {
+        int a;
+        for (a = 1; a < 256; a++)
+            unpremultiply[a] = ((255 << 16) + (a / 2)) / a;
+    }
+}
+
+static inline uint32_t
+Unpremultiply(uint32_t p)
+{
+    uint32_t a = p >> 24;
+    uint32_t m, r, g, b;
+
+    if (a == 0xff)
+        return p;
+    if (a == 0)
+        return 0;
+
+    m = unpremultiply[a];
+    r = ((((p >> 16) & 0xff) * m) + 0x8000) >> 16;
+    g = ((((p >>  8) & 0xff) * m) + 0x8000) >> 16;
+    b = ((((p >>  0) & 0xff) * m) + 0x8000) >> 16;
+
+    return (a << 24) | (MIN(r, 0xff) << 16) | (MIN(g, 0xff) << 8) | MIN(b, 0xff);
+}
+
+/* LANES pixels at a time with the compiler's generic vectors (NEON or SSE
+ * registers), the factors still looked up one by one.  Unsigned, as a
+ * channel times its factor takes all 32 bits.  With unpremultiply[0] = 0
+ * and unpremultiply[255] = 1.0, neither alpha needs a case of its own, and
+ * it is bit for bit what Unpremultiply() does:
+ */
+#define LANES   4
+
+typedef uint32_t Vec __attribute__((vector_size(LANES * sizeof(uint32_t))));
+
+/* MIN(c, 0xff), without compares, which generic vectors only have in C++: */
+static inline Vec
+ClampVec(Vec c)
+{
+    return (c | -((0xff - c) >> 31)) & 0xff;
+}
+
+static inline Vec
+UnpremultiplyVec(Vec p)
+{
+    Vec a = p >> 24, m, r, g, b;
+    int j;
+
+    for (j = 0; j < LANES; j++)
+        m[j] = unpremultiply[a[j]];
+
+    r = ((((p >> 16) & 0xff) * m) + 0x8000) >> 16;
+    g = ((((p >>  8) & 0xff) * m) + 0x8000) >> 16;
+    b = ((((p >>  0) & 0xff) * m) + 0x8000) >> 16;
+
+    return (a << 24) | (ClampVec(r) << 16) | (ClampVec(g) << 8) | ClampVec(b);
+}
+
+WEAK void
+V4L2ShadowBlitUnpremultiplyARGB32(void *winBase, int winStride,
+        void *shaBase, int shaStride, int w, int h)
+{
+    UnpremultiplyInit();
+
+    while (h--) {
+        uint32_t *win = winBase;
+        uint32_t *sha = shaBase;
+        int i;
+        for (i = 0; i + LANES <= w; i += LANES) {
+            Vec p;
+            memcpy(&p, sha + i, sizeof(p));
+            p = UnpremultiplyVec(p);
+            memcpy(win + i, &p, sizeof(p));
+        }
+        for (; i < w; i++)
+            win[i] = Unpremultiply(sha[i]);
+        winBase += winStride;
+        shaBase += shaStride;
+    }
+}
+
+/* Rotated, the source is walked across its lines, a pixel from each.  In
+ * blocks small enough that the source lines stay in the cache from one
+ * destination row to the next, the source is still only read from memory
+ * once.
+ */
+#define GATHER_BLOCK  32
+
+static inline void
+GatherRow(uint32_t *win, const void *src, int srcXStep, int n, int mode)
+{
+    int i;
+
+    switch (mode) {
+    case V4L2_GATHER_OPAQUE:
+        for (i = 0; i < n; i++, src += srcXStep)
+            *win++ = 0xff000000 | *(const uint32_t *)src;
+        break;
+    case V4L2_GATHER_UNPREMULTIPLY:
+        for (i = 0; i + LANES <= n; i += LANES) {
+            Vec p;
+            int j;
+            for (j = 0; j < LANES; j++, src += srcXStep)
+                p[j] = *(const uint32_t *)src;
+            p = UnpremultiplyVec(p);
+            memcpy(win, &p, sizeof(p));
+            win += LANES;
+        }
+        for (; i < n; i++, src += srcXStep)
+            *win++ = Unpremultiply(*(const uint32_t *)src);
+        break;
+    default:
+        for (i = 0; i < n; i++, src += srcXStep)
+            *win++ = *(const uint32_t *)src;
+        break;
+    }
+}
+
+/* the first hole on row y that ends after x, or NULL: */
+static inline const V4L2TileBox *
+NextHole(const V4L2TileBox *holes, int nholes, int x, int y)
+{
+    const V4L2TileBox *next = NULL;
+    int i;
+
+    for (i = 0; i < nholes; i++) {
+        if ((holes[i].y1 <= y) && (y < holes[i].y2) && (holes[i].x2 > x) &&
+                (!next || (holes[i].x1 < next->x1)))
+            next = &holes[i];
+    }
+
+    return next;
+}
+
+WEAK void
+V4L2ShadowBlitGatherHolesARGB32(void *winBase, int winStride,
+        const void *srcBase, int srcXStep, int srcYStep, int w, int h,
+        int mode, const V4L2TileBox *holes, int nholes)
+{
+    int bx, by, y;
+
+    if (mode == V4L2_GATHER_UNPREMULTIPLY)
+        UnpremultiplyInit();
+
+    for (by = 0; by < h; by += GATHER_BLOCK) {
+        int bh = MIN(GATHER_BLOCK, h - by);
+        for (bx = 0; bx < w; bx += GATHER_BLOCK) {
+            int bw = MIN(GATHER_BLOCK, w - bx);
+            for (y = by; y < by + bh; y++) {
+                uint32_t *win = (uint32_t *)(winBase + (y * winStride));
+                const void *src = srcBase + (y * srcYStep);
+                int x = bx, x2 = bx + bw;
+
+                /* the pixels up to each hole, then the hole: */
+                while (x < x2) {
+                    const V4L2TileBox *hole = NextHole(holes, nholes, x, y);
+                    int end = hole ? MIN(MAX(hole->x1, x), x2) : x2;
+
+                    GatherRow(win + x, src + (x * srcXStep), srcXStep,
+                            end - x, mode);
+                    if (!hole)
+                        break;
+
+                    x = MIN(hole->x2, x2);
+                    memset(win + end, 0x00, (x - end) * sizeof(uint32_t));
+                }
+            }
+        }
+    }
+}
+
+WEAK void
+V4L2ShadowBlitGatherARGB32(void *winBase, int winStride,
+        const void *srcBase, int srcXStep, int srcYStep, int w, int h,
+        int mode)
+{
+    V4L2ShadowBlitGatherHolesARGB32(winBase, winStride, srcBase,
+            srcXStep, srcYStep, w, h, mode, NULL, 0);
+}
+
+/* Four independent 32-bit lanes, to not be bound by multiply latency.  Each
+ * step is a bijection of the lane state, so a single changed pixel always
+ * changes the hash.
+ */
+#define ROTL32(x, n)  (((x) << (n)) | ((x) >> (32 - (n))))
+#define HASH_STEP(lane, k, p) do {                                   \
+        lane ^= (p);                                                 \
+        lane *= (k);                                                 \
+        lane = ROTL32(lane, 15);                                     \
+    } while (0)
+
+WEAK uint64_t
+V4L2TileHashARGB32(const void *base, int stride, int w, int h)
+{
+    uint32_t a = 0x6a09e667, b = 0xbb67ae85, c = 0x3c6ef372, d = 0xa54ff53a;
+    uint64_t hash;
+
+    while (h--) {
+        const uint32_t *p = base;
+        int i = 0;
+        for (; i + 4 <= w; i += 4) {
+            HASH_STEP(a, 0x9e3779b1, p[i + 0]);
+            HASH_STEP(b, 0x85ebca77, p[i + 1]);
+            HASH_STEP(c, 0xc2b2ae3d, p[i + 2]);
+            HASH_STEP(d, 0x27d4eb2f, p[i + 3]);
+        }
+        for (; i < w; i++) {
+            HASH_STEP(a, 0x9e3779b1, p[i]);
+        }
+        base += stride;
+    }
+
+    hash = ((uint64_t)(a ^ ROTL32(c, 7)) << 32) | (b ^ ROTL32(d, 11));
+
+    /* final avalanche (from MurmurHash3): */
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+/* rows whose stride is a multiple of this share cache sets every few rows
+ * (every 4 rows or less for an 8 KB cache way), so a tall narrow box
+ * evicts its own lines:
+ */
+#define ALIAS_SIZE  2048
+
+void *
+V4L2ShadowAlloc(int width, int height, int *stride, size_t *size, int *huge)
+{
+    size_t len;
+    uint8_t *mem, *aligned;
+
+    *stride = ((width * 4) + V4L2_CACHE_LINE - 1) & ~(V4L2_CACHE_LINE - 1);
+    if (!(*stride % ALIAS_SIZE))
+        *stride += V4L2_CACHE_LINE;
+
+    len = ((size_t)*stride * height + V4L2_HUGE_PAGE - 1) &
+            ~(size_t)(V4L2_HUGE_PAGE - 1);
+
+#ifdef MAP_HUGETLB
+    mem = mmap(NULL, len, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mem != MAP_FAILED) {
+        *size = len;
+        *huge = V4L2_HUGE_EXPLICIT;
+        return mem;
+    }
+#endif
+
+    /* transparent huge pages only back whole aligned huge pages, so map
+     * one more and trim the mapping to the aligned part:
+     */
+    mem = mmap(NULL, len + V4L2_HUGE_PAGE, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return NULL;
+
+    aligned = (uint8_t *)(((uintptr_t)mem + V4L2_HUGE_PAGE - 1) &
+            ~(uintptr_t)(V4L2_HUGE_PAGE - 1));
+    if (aligned > mem)
+        munmap(mem, aligned - mem);
+    munmap(aligned + len, (mem + len + V4L2_HUGE_PAGE) - (aligned + len));
+
+    *size = len;
+    *huge = V4L2_HUGE_NONE;
+#ifdef MADV_HUGEPAGE
+    if (!madvise(aligned, len, MADV_HUGEPAGE))
+        *huge = V4L2_HUGE_TRANSPARENT;
+#endif
+
+    return aligned;
+}
+
+void
+V4L2ShadowFree(void *mem, size_t size)
+{
+    if (mem)
+        munmap(mem, size);
+}
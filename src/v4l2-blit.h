@@ -0,0 +1,88 @@
+/*
+ * v4l2-blit.h
+ *
+ * Pixel kernels for the alpha path.  These have no X server dependencies,
+ * so that the offline tools can be built with the very same code.  The C
+ * versions are weak symbols, so optimized versions (see armv7.s) take
+ * precedence at link time.
+ */
+
+#ifndef __V4L2_BLIT_H__
+#define __V4L2_BLIT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "v4l2-tiles.h"
+
+void V4L2ShadowBlitTransparentARGB32(void *winBase, int winStride,
+        int w, int h);
+void V4L2ShadowBlitSolidARGB32(void *winBase, int winStride,
+        void *shaBase, int shaStride, int w, int h);
+void V4L2ShadowBlitCursorARGB32(void *winBase, int winStride,
+        void *curBase, int curStride, int w, int h);
+
+/* the cursor blended over what is already there, for video composited by
+ * the CPU rather than blended by the display controller:
+ */
+void V4L2ShadowBlitCursorOverARGB32(void *winBase, int winStride,
+        void *curBase, int curStride, int w, int h);
+
+/* OSD windows, alpha is passed through either as is (premultiplied, like
+ * X keeps it) or converted to straight alpha:
+ */
+void V4L2ShadowBlitCopyARGB32(void *winBase, int winStride,
+        void *shaBase, int shaStride, int w, int h);
+void V4L2ShadowBlitUnpremultiplyARGB32(void *winBase, int winStride,
+        void *shaBase, int shaStride, int w, int h);
+
+/* rotated and/or reflected blits, for when the framebuffer is not in the
+ * orientation of the screen: the source pixel for destination pixel (x, y)
+ * is at srcBase + (x * srcXStep) + (y * srcYStep), in bytes.  The source is
+ * the shadow (solid, with alpha set, or OSD, as is or un-premultiplied) or
+ * the cursor image (as is):
+ */
+enum {
+    V4L2_GATHER_COPY,
+    V4L2_GATHER_OPAQUE,
+    V4L2_GATHER_UNPREMULTIPLY,
+};
+
+void V4L2ShadowBlitGatherARGB32(void *winBase, int winStride,
+        const void *srcBase, int srcXStep, int srcYStep, int w, int h,
+        int mode);
+
+/* the same, with the pixels in holes (boxes that don't overlap, relative
+ * to winBase) made transparent in the same walk rather than gathered:
+ */
+void V4L2ShadowBlitGatherHolesARGB32(void *winBase, int winStride,
+        const void *srcBase, int srcXStep, int srcYStep, int w, int h,
+        int mode, const V4L2TileBox *holes, int nholes);
+
+/* content hash of a w x h block of pixels, for change detection only, it
+ * is not meant to resist deliberate collisions:
+ */
+uint64_t V4L2TileHashARGB32(const void *base, int stride, int w, int h);
+
+/* memory for a shadow framebuffer of width x height ARGB32 pixels that
+ * the kernels read well from (see HugeShadow option): rows start on cache
+ * lines, and are padded so that they don't all map to the same cache sets,
+ * and the mapping is backed by huge pages if the kernel has any, so that
+ * a screen is a few TLB entries rather than thousands.  Returns NULL if
+ * it can't be mapped, else sets *stride, *size (for V4L2ShadowFree()) and
+ * *huge to how it is backed:
+ */
+#define V4L2_CACHE_LINE     64
+#define V4L2_HUGE_PAGE      (2 << 20)
+
+enum {
+    V4L2_HUGE_NONE,
+    V4L2_HUGE_TRANSPARENT,      /* asked for with madvise() */
+    V4L2_HUGE_EXPLICIT,         /* from the hugetlb pool */
+};
+
+void *V4L2ShadowAlloc(int width, int height, int *stride, size_t *size,
+        int *huge);
+void V4L2ShadowFree(void *mem, size_t size);
+
+#endif /* __V4L2_BLIT_H__ */
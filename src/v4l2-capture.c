@@ -0,0 +1,790 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: Xv video from capture devices, composited
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+#include "xf86.h"
+#include "xf86_OSproc.h"
+#include "xf86xv.h"
+#include "v4l2.h"
+#include "v4l2-scale.h"
+#include "v4l2-convert.h"
+
+/* Capture devices (USB grabbers, vivid, v4l2loopback..) have no overlay of
+ * their own, so XvPutVideo on one streams its frames into mmap'ed buffers
+ * and hands them to the compositor (see V4L2SetupComposite()), which draws
+ * them into the clip of the window.
+ *
+ * The capture queue is serviced by a thread of its own, which sleeps in
+ * poll() until a frame is ready, so a port costs nothing between frames.
+ * It dequeues whatever is ready, keeps only the latest, and turns it into a
+ * frame the size of the window: as it is if it already is one (the buffer
+ * then stays out of the queue until the next frame replaces it), else
+ * deinterlaced and/or scaled into memory of our own.  Frames are passed to
+ * the server through three slots:
+ *
+ *   worker --> writing --> ready --pipe--> server --> shown
+ *
+ * A frame still ready when the next one is is dropped, so when the source
+ * is faster than the server draws, frames are dropped rather than queued
+ * up, and the latency stays at a frame.
+ */
+
+#define V4L2_CAPTURE_BUFS   4
+#define V4L2_CAPTURE_SLOTS  3
+
+typedef struct {
+    V4L2ScaleImage              img;
+    int                         buf;        /* capture buffer shown, or -1 */
+    uint8_t                     *mem;       /* else our own */
+    size_t                      size;
+} V4L2CaptureSlot;
+
+struct _V4L2Capture {
+    PortPrivPtr                 pPPriv;
+    const V4L2Backend           *backend;
+    int                         fd, flags;  /* fd's own O_* flags */
+
+    struct v4l2_pix_format      pix;        /* as captured */
+    int                         format;     /* V4L2_SCALE_* */
+    Bool                        swapUV;     /* YVU420 */
+    int                         matrix;     /* V4L2_MATRIX_* */
+
+    int                         nbufs;
+    struct {
+        void                    *mem;
+        size_t                  length;
+    } bufs[V4L2_CAPTURE_BUFS];
+    Bool                        streaming;
+
+    pthread_t                   thread;
+    Bool                        running;
+    Bool                        still;      /* one frame only */
+    int                         stop[2];    /* server -> worker */
+    int                         notify[2];  /* worker -> server */
+
+    /* the slots and window size are shared with the worker: */
+    pthread_mutex_t             lock;
+    short                       drw_w, drw_h;
+    V4L2CaptureSlot             slots[V4L2_CAPTURE_SLOTS];
+    int                         writing, ready, shown;
+};
+
+static const struct {
+    CARD32                      fourcc;
+    int                         scale;      /* V4L2_SCALE_* */
+} captureFormats[] = {
+        { V4L2_PIX_FMT_YUYV,   V4L2_SCALE_YUYV },
+        { V4L2_PIX_FMT_UYVY,   V4L2_SCALE_UYVY },
+        { V4L2_PIX_FMT_NV12,   V4L2_SCALE_NV12 },
+        { V4L2_PIX_FMT_YUV420, V4L2_SCALE_YUV420 },
+        { V4L2_PIX_FMT_YVU420, V4L2_SCALE_YUV420 },
+};
+
+#define NUM_CAPTURE_FORMATS (sizeof(captureFormats) / sizeof(captureFormats[0]))
+
+/* ---------------------------------------------------------------------- */
+
+static int
+FormatIndex(CARD32 fourcc)
+{
+    int i;
+
+    for (i = 0; i < NUM_CAPTURE_FORMATS; i++)
+        if (captureFormats[i].fourcc == fourcc)
+            return i;
+
+    return -1;
+}
+
+/* ioctls on behalf of a port are counted in its statistics, also those
+ * made by the worker (the counters are atomic):
+ */
+static int
+CaptureIoctl(V4L2Capture *cap, unsigned long request, void *arg)
+{
+    uint64_t start = V4L2StatsNow();
+    int ret = cap->backend->ioctl(cap->fd, request, arg);
+    unsigned long usec = V4L2StatsNow() - start;
+    V4L2StatsIoctl(&cap->pPPriv->stats, usec);
+    V4L2_TRACE(IOCTL, cap->pPPriv->nr, request, ret, usec, 0);
+    return ret;
+}
+
+static int
+CaptureQueue(V4L2Capture *cap, int index)
+{
+    struct v4l2_buffer buf;
+
+    memset(&buf, 0x00, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = index;
+
+    return CaptureIoctl(cap, VIDIOC_QBUF, &buf);
+}
+
+/* a filled buffer, or -1 if there is none (the fd is non-blocking): */
+static int
+CaptureDequeue(V4L2Capture *cap)
+{
+    struct v4l2_buffer buf;
+
+    memset(&buf, 0x00, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+
+    if (-1 == CaptureIoctl(cap, VIDIOC_DQBUF, &buf))
+        return -1;
+
+    /* a corrupted frame isn't worth showing: */
+    if (buf.flags & V4L2_BUF_FLAG_ERROR) {
+        CaptureQueue(cap, buf.index);
+        V4L2_STAT_ADD(cap->pPPriv->stats.dropped, 1);
+        return CaptureDequeue(cap);
+    }
+
+    return buf.index;
+}
+
+/* the frame in a capture buffer, or with field, just its first field (in
+ * time) if the frame is interlaced.  Returns whether it is:
+ */
+static Bool
+CaptureImage(V4L2Capture *cap, V4L2ScaleImage *img, void *mem, Bool field)
+{
+    int bpl = cap->pix.bytesperline, h = cap->pix.height;
+    Bool interlaced = FALSE, sequential = FALSE, alternate = FALSE;
+    int i;
+
+    memset(img, 0x00, sizeof(*img));
+    img->format = cap->format;
+    img->width = cap->pix.width & ~1;
+    img->planes[0] = mem;
+    img->strides[0] = bpl;
+
+    /* ALTERNATE buffers hold one field (TOP and BOTTOM ones too, but
+     * those are shown as they are).  INTERLACED frames hold both, every
+     * other line, and SEQ_* frames one after the other:
+     */
+    switch (cap->pix.field) {
+    case V4L2_FIELD_ALTERNATE:
+        h /= 2;
+        interlaced = alternate = TRUE;
+        break;
+    case V4L2_FIELD_INTERLACED:
+    case V4L2_FIELD_INTERLACED_TB:
+    case V4L2_FIELD_INTERLACED_BT:
+        interlaced = TRUE;
+        break;
+    case V4L2_FIELD_SEQ_TB:
+    case V4L2_FIELD_SEQ_BT:
+        interlaced = sequential = TRUE;
+        break;
+    }
+
+    if (cap->format == V4L2_SCALE_NV12) {
+        img->planes[1] = img->planes[0] + (bpl * h);
+        img->strides[1] = bpl;
+    } else if (cap->format == V4L2_SCALE_YUV420) {
+        img->planes[1] = img->planes[0] + (bpl * h);
+        img->planes[2] = img->planes[1] + ((bpl >> 1) * (h >> 1));
+        img->strides[1] = img->strides[2] = bpl >> 1;
+        if (cap->swapUV) {
+            uint8_t *plane = img->planes[1];
+            img->planes[1] = img->planes[2];
+            img->planes[2] = plane;
+        }
+    }
+
+    if (field && interlaced && !alternate) {
+        h /= 2;
+        for (i = 0; !sequential && (i < 3); i++) {
+            if (img->planes[i] && (cap->pix.field == V4L2_FIELD_INTERLACED_BT))
+                img->planes[i] += img->strides[i];
+            img->strides[i] *= 2;
+        }
+    }
+
+    img->height = h & ~1;
+
+    return interlaced;
+}
+
+static int
+SlotAlloc(V4L2CaptureSlot *s, int format, int w, int h)
+{
+    size_t size = w * h * 2;
+
+    if (size > s->size) {
+        uint8_t *mem = realloc(s->mem, size);
+        if (!mem)
+            return -1;
+        s->mem = mem;
+        s->size = size;
+    }
+
+    memset(&s->img, 0x00, sizeof(s->img));
+    s->img.format = format;
+    s->img.width = w;
+    s->img.height = h;
+    s->img.planes[0] = s->mem;
+
+    switch (format) {
+    case V4L2_SCALE_YUYV:
+    case V4L2_SCALE_UYVY:
+        s->img.strides[0] = w * 2;
+        break;
+    case V4L2_SCALE_NV12:
+        s->img.strides[0] = s->img.strides[1] = w;
+        s->img.planes[1] = s->mem + (w * h);
+        break;
+    default:
+        s->img.strides[0] = w;
+        s->img.strides[1] = s->img.strides[2] = w / 2;
+        s->img.planes[1] = s->mem + (w * h);
+        s->img.planes[2] = s->img.planes[1] + (w * h / 4);
+        break;
+    }
+
+    return 0;
+}
+
+/* make the writing slot the frame of capture buffer index, at the size of
+ * the window.  Returns 1 if the slot took the buffer itself, which then
+ * mustn't be queued again until the slot lets go of it, 0 if the frame was
+ * copied, and -1 if there is nothing to show:
+ */
+static int
+CaptureFrame(V4L2Capture *cap, int index)
+{
+    V4L2CaptureSlot *s = &cap->slots[cap->writing];
+    V4L2ScaleImage frame, field;
+    int w, h;
+
+    pthread_mutex_lock(&cap->lock);
+    w = cap->drw_w & ~1;
+    h = cap->drw_h & ~1;
+    pthread_mutex_unlock(&cap->lock);
+
+    s->buf = -1;
+
+    if (!CaptureImage(cap, &frame, cap->bufs[index].mem, FALSE)) {
+        if ((w <= 0) || (h <= 0) ||
+                ((frame.width == w) && (frame.height == h))) {
+            s->img = frame;
+            s->buf = index;
+            return 1;
+        }
+        if ((w < 4) || (h < 4) || SlotAlloc(s, cap->format, w, h))
+            return -1;
+        V4L2Scale(&frame, &s->img, 1);
+        return 0;
+    }
+
+    /* interlaced, so the frame is made from one field, doubled up: */
+    CaptureImage(cap, &field, cap->bufs[index].mem, TRUE);
+    if ((w <= 0) || (h <= 0)) {
+        w = field.width;
+        h = 2 * field.height;
+    }
+    if ((w < 4) || (h < 4) || SlotAlloc(s, cap->format, w, h))
+        return -1;
+
+    /* which the scaler does just as well (bilinear, or boxed), if the
+     * window isn't the size of the frame anyway:
+     */
+    if ((field.width == w) && ((2 * field.height) == h))
+        V4L2Deinterlace(&field, &s->img, config.deinterlace);
+    else
+        V4L2Scale(&field, &s->img, 1);
+
+    return 0;
+}
+
+/* publish the writing slot, dropping a frame the server hasn't taken yet: */
+static void
+CaptureHandOver(V4L2Capture *cap)
+{
+    int dropped, requeue = -1, i;
+
+    pthread_mutex_lock(&cap->lock);
+
+    dropped = cap->ready;
+    if (dropped >= 0) {
+        requeue = cap->slots[dropped].buf;
+        cap->slots[dropped].buf = -1;
+    }
+
+    cap->ready = cap->writing;
+    for (i = 0; i < V4L2_CAPTURE_SLOTS; i++)
+        if ((i != cap->ready) && (i != cap->shown))
+            cap->writing = i;
+
+    pthread_mutex_unlock(&cap->lock);
+
+    if (dropped < 0) {
+        /* the server has taken everything so far, wake it: */
+        while ((write(cap->notify[1], "", 1) < 0) && (errno == EINTR))
+            ;
+    } else {
+        V4L2_STAT_ADD(cap->pPPriv->stats.dropped, 1);
+        if (requeue >= 0)
+            CaptureQueue(cap, requeue);
+    }
+}
+
+static void *
+CaptureWorker(void *arg)
+{
+    V4L2Capture *cap = arg;
+    struct pollfd fds[2];
+
+    fds[0].fd = cap->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = cap->stop[0];
+    fds[1].events = POLLIN;
+
+    while (1) {
+        int index, latest = -1;
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[1].revents || (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)))
+            break;
+
+        /* only the latest frame is worth showing: */
+        while ((index = CaptureDequeue(cap)) >= 0) {
+            if (latest >= 0) {
+                CaptureQueue(cap, latest);
+                V4L2_STAT_ADD(cap->pPPriv->stats.dropped, 1);
+            }
+            latest = index;
+        }
+
+        if (latest < 0)
+            continue;
+
+        switch (CaptureFrame(cap, latest)) {
+        case 1:
+            CaptureHandOver(cap);
+            break;
+        case 0:
+            CaptureQueue(cap, latest);
+            CaptureHandOver(cap);
+            break;
+        default:
+            CaptureQueue(cap, latest);
+            continue;
+        }
+
+        if (cap->still)
+            break;
+    }
+
+    return NULL;
+}
+
+/* the server's side of the pipe: */
+static void
+CaptureWakeup(pointer data, int result, pointer pReadmask)
+{
+    V4L2Capture *cap = data;
+    int requeue = -1, shown = -1;
+    char buf[16];
+
+    if ((result <= 0) || !FD_ISSET(cap->notify[0], (fd_set *)pReadmask))
+        return;
+
+    while (read(cap->notify[0], buf, sizeof(buf)) > 0)
+        ;
+
+    pthread_mutex_lock(&cap->lock);
+    if (cap->ready >= 0) {
+        if (cap->shown >= 0) {
+            requeue = cap->slots[cap->shown].buf;
+            cap->slots[cap->shown].buf = -1;
+        }
+        shown = cap->shown = cap->ready;
+        cap->ready = -1;
+    }
+    pthread_mutex_unlock(&cap->lock);
+
+    if (shown < 0)
+        return;
+
+    /* the slot is ours until the next frame, as the compositor wants: */
+    V4L2SetFrame(cap->pPPriv, &cap->slots[shown].img, cap->matrix);
+
+    if (requeue >= 0)
+        CaptureQueue(cap, requeue);
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* keep what the device is set up for (size, standard..), but in a format
+ * we can composite, if it isn't already:
+ */
+static int
+CaptureSetFormat(V4L2Capture *cap, const V4L2DeviceInfo *info)
+{
+    struct v4l2_format format;
+    int fmt, i;
+
+    memset(&format, 0x00, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    if (-1 == CaptureIoctl(cap, VIDIOC_G_FMT, &format)) {
+        perror("ioctl VIDIOC_G_FMT");
+        return -1;
+    }
+
+    fmt = FormatIndex(format.fmt.pix.pixelformat);
+    for (i = 0; (fmt < 0) && (i < info->nformats); i++) {
+        if (FormatIndex(info->formats[i]) < 0)
+            continue;
+        format.fmt.pix.pixelformat = info->formats[i];
+        format.fmt.pix.bytesperline = 0;
+        if (-1 == CaptureIoctl(cap, VIDIOC_S_FMT, &format)) {
+            perror("ioctl VIDIOC_S_FMT");
+            return -1;
+        }
+        fmt = FormatIndex(format.fmt.pix.pixelformat);
+    }
+
+    if ((fmt < 0) || (format.fmt.pix.width < 4) || (format.fmt.pix.height < 4)) {
+        xf86Msg(X_WARNING, "v4l2: can't composite the %dx%d frames of "
+                "format %08x captured by %s\n", format.fmt.pix.width,
+                format.fmt.pix.height, format.fmt.pix.pixelformat, info->card);
+        return -1;
+    }
+
+    cap->pix = format.fmt.pix;
+    cap->format = captureFormats[fmt].scale;
+    cap->swapUV = (cap->pix.pixelformat == V4L2_PIX_FMT_YVU420);
+    if (!cap->pix.bytesperline) {
+        cap->pix.bytesperline = cap->pix.width *
+                ((cap->format == V4L2_SCALE_YUYV) ||
+                 (cap->format == V4L2_SCALE_UYVY) ? 2 : 1);
+    }
+
+    switch (cap->pix.colorspace) {
+    case V4L2_COLORSPACE_REC709:
+        cap->matrix = V4L2_MATRIX_BT709;
+        break;
+    case V4L2_COLORSPACE_SMPTE170M:
+    case V4L2_COLORSPACE_470_SYSTEM_M:
+    case V4L2_COLORSPACE_470_SYSTEM_BG:
+        cap->matrix = V4L2_MATRIX_BT601;
+        break;
+    default:
+        /* no say, go by the usual convention: */
+        cap->matrix = (cap->pix.height >= 720) ?
+                V4L2_MATRIX_BT709 : V4L2_MATRIX_BT601;
+        break;
+    }
+
+    return 0;
+}
+
+static void
+CaptureFree(V4L2Capture *cap)
+{
+    struct v4l2_requestbuffers req;
+    int i, type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    if (cap->streaming) {
+        CaptureIoctl(cap, VIDIOC_STREAMOFF, &type);
+        cap->streaming = FALSE;
+    }
+
+    for (i = 0; i < cap->nbufs; i++) {
+        if (cap->bufs[i].mem)
+            cap->backend->munmap(cap->bufs[i].mem, cap->bufs[i].length);
+        cap->bufs[i].mem = NULL;
+    }
+
+    if (cap->nbufs) {
+        memset(&req, 0x00, sizeof(req));
+        req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        req.memory = V4L2_MEMORY_MMAP;
+        req.count = 0;
+        CaptureIoctl(cap, VIDIOC_REQBUFS, &req);
+    }
+
+    cap->nbufs = 0;
+}
+
+static int
+CaptureAlloc(V4L2Capture *cap)
+{
+    struct v4l2_requestbuffers req;
+    int i;
+
+    memset(&req, 0x00, sizeof(req));
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    req.count = V4L2_CAPTURE_BUFS;
+
+    if (-1 == CaptureIoctl(cap, VIDIOC_REQBUFS, &req)) {
+        perror("ioctl VIDIOC_REQBUFS");
+        return -1;
+    }
+
+    /* up to two are held for the server, the device needs the rest: */
+    cap->nbufs = MIN(req.count, V4L2_CAPTURE_BUFS);
+    if (cap->nbufs < 3) {
+        CaptureFree(cap);
+        return -1;
+    }
+
+    for (i = 0; i < cap->nbufs; i++) {
+        struct v4l2_buffer buf;
+
+        memset(&buf, 0x00, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+
+        if (-1 == CaptureIoctl(cap, VIDIOC_QUERYBUF, &buf)) {
+            perror("ioctl VIDIOC_QUERYBUF");
+            CaptureFree(cap);
+            return -1;
+        }
+
+        cap->bufs[i].length = buf.length;
+        cap->bufs[i].mem = cap->backend->mmap(cap->fd, buf.length,
+                PROT_READ, buf.m.offset);
+        if (cap->bufs[i].mem == MAP_FAILED) {
+            perror("mmap");
+            cap->bufs[i].mem = NULL;
+            CaptureFree(cap);
+            return -1;
+        }
+
+        if (buf.length < cap->pix.sizeimage) {
+            DEBUG("Xv/PV: buffer %d too small, %u bytes", i, buf.length);
+            CaptureFree(cap);
+            return -1;
+        }
+    }
+
+    for (i = 0; i < cap->nbufs; i++) {
+        if (-1 == CaptureQueue(cap, i)) {
+            perror("ioctl VIDIOC_QBUF");
+            CaptureFree(cap);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void
+CaptureStop(V4L2Capture *cap)
+{
+    int i;
+
+    if (cap->running) {
+        while ((write(cap->stop[1], "", 1) < 0) && (errno == EINTR))
+            ;
+        pthread_join(cap->thread, NULL);
+        cap->running = FALSE;
+
+        RemoveBlockAndWakeupHandlers((BlockHandlerProcPtr)NoopDDA,
+                CaptureWakeup, cap);
+        RemoveGeneralSocket(cap->notify[0]);
+    }
+
+    /* the compositor lets go of the frame before its memory goes: */
+    V4L2SetFrame(cap->pPPriv, NULL, 0);
+    CaptureFree(cap);
+
+    for (i = 0; i < 2; i++) {
+        if (cap->stop[i] != -1)
+            close(cap->stop[i]);
+        if (cap->notify[i] != -1)
+            close(cap->notify[i]);
+        cap->stop[i] = cap->notify[i] = -1;
+    }
+
+    for (i = 0; i < V4L2_CAPTURE_SLOTS; i++)
+        cap->slots[i].buf = -1;
+    cap->writing = 0;
+    cap->ready = cap->shown = -1;
+
+    if (cap->fd != -1) {
+        fcntl(cap->fd, F_SETFL, cap->flags);
+        cap->fd = -1;
+    }
+}
+
+static int
+CaptureStart(V4L2Capture *cap, const V4L2DeviceInfo *info)
+{
+    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    sigset_t all, old;
+    int ret;
+
+    if (CaptureSetFormat(cap, info) || CaptureAlloc(cap))
+        return -1;
+
+    if (pipe(cap->stop) || pipe(cap->notify)) {
+        perror("pipe");
+        return -1;
+    }
+    fcntl(cap->notify[0], F_SETFL, O_NONBLOCK);
+    fcntl(cap->notify[1], F_SETFL, O_NONBLOCK);
+
+    /* the worker drains the queue until VIDIOC_DQBUF fails: */
+    fcntl(cap->fd, F_SETFL, cap->flags | O_NONBLOCK);
+
+    if (-1 == CaptureIoctl(cap, VIDIOC_STREAMON, &type)) {
+        perror("ioctl VIDIOC_STREAMON");
+        return -1;
+    }
+    cap->streaming = TRUE;
+
+    /* the worker must not take the server's signals: */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    ret = pthread_create(&cap->thread, NULL, CaptureWorker, cap);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret)
+        return -1;
+    cap->running = TRUE;
+
+    AddGeneralSocket(cap->notify[0]);
+    RegisterBlockAndWakeupHandlers((BlockHandlerProcPtr)NoopDDA,
+            CaptureWakeup, cap);
+
+    DEBUG("Xv/PV: capturing %dx%d %08x, field %d", cap->pix.width,
+            cap->pix.height, cap->pix.pixelformat, cap->pix.field);
+
+    return 0;
+}
+
+/**
+ * Whether XvPutVideo on a device shows what it captures.  Only the single
+ * planar API is used.  Memory to memory devices capture only what they are
+ * given, so don't count.
+ */
+Bool
+V4L2CaptureSupported(const V4L2DeviceInfo *info)
+{
+    return (info->capabilities & V4L2_CAP_VIDEO_CAPTURE) &&
+            (info->capabilities & V4L2_CAP_STREAMING) &&
+            !(info->capabilities & V4L2_CAP_VIDEO_M2M);
+}
+
+/**
+ * Start showing what the port's device captures, in a window of drw_w x
+ * drw_h, or just change the size of the window if already started.  With
+ * still, only the first frame is shown.
+ */
+int
+V4L2CapturePut(PortPrivPtr pPPriv, const V4L2Backend *backend, int fd,
+        const V4L2DeviceInfo *info, short drw_w, short drw_h, Bool still)
+{
+    V4L2Capture *cap = pPPriv->capture;
+    int i;
+
+    if (!cap) {
+        cap = calloc(1, sizeof(*cap));
+        if (!cap)
+            return BadAlloc;
+        pthread_mutex_init(&cap->lock, NULL);
+        cap->pPPriv = pPPriv;
+        cap->fd = -1;
+        for (i = 0; i < 2; i++)
+            cap->stop[i] = cap->notify[i] = -1;
+        for (i = 0; i < V4L2_CAPTURE_SLOTS; i++)
+            cap->slots[i].buf = -1;
+        cap->ready = cap->shown = -1;
+        pPPriv->capture = cap;
+    }
+
+    pthread_mutex_lock(&cap->lock);
+    cap->drw_w = drw_w;
+    cap->drw_h = drw_h;
+    pthread_mutex_unlock(&cap->lock);
+
+    if (cap->running && (cap->still == still))
+        return Success;
+
+    CaptureStop(cap);
+
+    cap->backend = backend;
+    cap->fd = fd;
+    cap->flags = fcntl(fd, F_GETFL);
+    cap->still = still;
+
+    if (CaptureStart(cap, info)) {
+        CaptureStop(cap);
+        return BadAlloc;
+    }
+
+    return Success;
+}
+
+/**
+ * Stop capturing, and on shutdown (before the device is closed) also free
+ * what's left.
+ */
+void
+V4L2CaptureStop(PortPrivPtr pPPriv, Bool shutdown)
+{
+    V4L2Capture *cap = pPPriv->capture;
+    int i;
+
+    if (!cap)
+        return;
+
+    CaptureStop(cap);
+
+    if (shutdown) {
+        for (i = 0; i < V4L2_CAPTURE_SLOTS; i++)
+            free(cap->slots[i].mem);
+        pthread_mutex_destroy(&cap->lock);
+        free(cap);
+        pPPriv->capture = NULL;
+    }
+}
@@ -0,0 +1,200 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: single pass compositing of overlapping layers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <limits.h>
+
+#include "v4l2-compose.h"
+
+#ifndef MAX
+#  define MAX(a,b) ((a) > (b) ? (a) : (b))
+#endif
+#ifndef MIN
+#  define MIN(a,b) ((a) > (b) ? (b) : (a))
+#endif
+
+typedef struct {
+    const V4L2TileBox *b, *end;     /* first box not above the walk */
+    const V4L2TileBox *bandEnd;     /* b..bandEnd is the current band */
+    const V4L2TileBox *p;           /* sweep position within the band */
+    int layer;
+} Walk;
+
+/* scratch, grown as needed: */
+static Walk *walks = NULL, **active = NULL;
+static int walkSize = 0, activeSize = 0;
+
+static int
+Grow(void **buf, int *size, int n, int elemSize)
+{
+    void *p;
+
+    if (n <= *size)
+        return 0;
+
+    n = MAX(n, *size * 2);
+    p = realloc(*buf, n * elemSize);
+    if (!p)
+        return -1;
+
+    *buf = p;
+    *size = n;
+
+    return 0;
+}
+
+static inline void
+Emit(V4L2ComposeEmitProc emit, void *closure, int layer,
+        int x1, int y1, int x2, int y2)
+{
+    V4L2TileBox box;
+
+    box.x1 = x1;
+    box.y1 = y1;
+    box.x2 = x2;
+    box.y2 = y2;
+    emit(closure, layer, &box);
+}
+
+/* classify the band [y1, y2) of the active walks along x, from one box
+ * edge to the next:
+ */
+static void
+Sweep(Walk **w, int n, int y1, int y2, V4L2ComposeEmitProc emit, void *closure)
+{
+    int i, x = INT_MAX, runLayer = -1, runX1 = 0;
+
+    for (i = 0; i < n; i++) {
+        w[i]->p = w[i]->b;
+        x = MIN(x, w[i]->b->x1);
+    }
+
+    while (1) {
+        int top = -1, next = INT_MAX;
+
+        for (i = 0; i < n; i++) {
+            const V4L2TileBox *p = w[i]->p;
+
+            while ((p < w[i]->bandEnd) && (p->x2 <= x))
+                p++;
+            w[i]->p = p;
+            if (p == w[i]->bandEnd)
+                continue;
+
+            if (p->x1 <= x) {
+                next = MIN(next, p->x2);
+                if (w[i]->layer > top)
+                    top = w[i]->layer;
+            } else {
+                next = MIN(next, p->x1);
+            }
+        }
+
+        if (top != runLayer) {
+            if (runLayer >= 0)
+                Emit(emit, closure, runLayer, runX1, y1, x, y2);
+            runLayer = top;
+            runX1 = x;
+        }
+
+        if (next == INT_MAX)
+            break;
+
+        x = next;
+    }
+}
+
+void
+V4L2Compose(const V4L2ComposeInput *inputs, int ninputs,
+        V4L2ComposeEmitProc emit, void *closure)
+{
+    int i, n = 0, y = INT_MAX;
+
+    if (Grow((void **)&walks, &walkSize, ninputs, sizeof(Walk)) ||
+            Grow((void **)&active, &activeSize, ninputs, sizeof(Walk *))) {
+        /* no memory, draw the inputs bottom up instead: */
+        int layer = -1, next;
+        do {
+            next = INT_MAX;
+            for (i = 0; i < ninputs; i++) {
+                if ((inputs[i].layer > layer) && (inputs[i].layer < next))
+                    next = inputs[i].layer;
+            }
+            for (i = 0; i < ninputs; i++) {
+                const V4L2TileBox *b = inputs[i].boxes;
+                if (inputs[i].layer != next)
+                    continue;
+                for (; b < inputs[i].boxes + inputs[i].nbox; b++)
+                    emit(closure, next, b);
+            }
+            layer = next;
+        } while (next != INT_MAX);
+        return;
+    }
+
+    for (i = 0; i < ninputs; i++) {
+        if (inputs[i].nbox <= 0)
+            continue;
+        walks[n].b = inputs[i].boxes;
+        walks[n].end = inputs[i].boxes + inputs[i].nbox;
+        walks[n].layer = inputs[i].layer;
+        y = MIN(y, inputs[i].boxes[0].y1);
+        n++;
+    }
+
+    while (n > 0) {
+        int y2 = INT_MAX, nactive = 0;
+
+        for (i = 0; i < n; i++) {
+            Walk *w = &walks[i];
+
+            /* bands share y2, so whole bands are skipped: */
+            while ((w->b < w->end) && (w->b->y2 <= y))
+                w->b++;
+            if (w->b == w->end)
+                continue;
+
+            if (w->b->y1 <= y) {
+                w->bandEnd = w->b;
+                while ((w->bandEnd < w->end) && (w->bandEnd->y1 == w->b->y1))
+                    w->bandEnd++;
+                y2 = MIN(y2, w->b->y2);
+                active[nactive++] = w;
+            } else {
+                y2 = MIN(y2, w->b->y1);
+            }
+        }
+
+        if (y2 == INT_MAX)
+            break;
+
+        if (nactive == 1) {
+            /* nothing to resolve, the common case outside video: */
+            const V4L2TileBox *b;
+            for (b = active[0]->b; b < active[0]->bandEnd; b++)
+                Emit(emit, closure, active[0]->layer, b->x1, y, b->x2, y2);
+        } else if (nactive > 1) {
+            Sweep(active, nactive, y, y2, emit, closure);
+        }
+
+        y = y2;
+    }
+}
@@ -0,0 +1,34 @@
+/*
+ * v4l2-compose.h
+ *
+ * Single pass compositing of overlapping layers of boxes.  Each layer is a
+ * banded box list (solid damage, OSD, transparent holes, cursor..), and
+ * the layers are walked together band by band, so that every pixel is
+ * handed out exactly once, for the topmost layer covering it.  Nothing is
+ * drawn first only to be drawn over again, which matters when the
+ * framebuffer is uncached.  No X server dependencies, so that v4l2-replay
+ * can use the very same code.
+ */
+
+#ifndef __V4L2_COMPOSE_H__
+#define __V4L2_COMPOSE_H__
+
+#include "v4l2-tiles.h"
+
+typedef struct {
+    const V4L2TileBox *boxes;   /* y-x banded, as in a region */
+    int nbox;
+    int layer;                  /* higher layers cover lower layers */
+} V4L2ComposeInput;
+
+typedef void (*V4L2ComposeEmitProc)(void *closure, int layer,
+        const V4L2TileBox *box);
+
+/* emit the union of the inputs as boxes that don't overlap, each tagged
+ * with the topmost layer that covers it, band by band from the top.
+ * Several inputs may share a layer.
+ */
+void V4L2Compose(const V4L2ComposeInput *inputs, int ninputs,
+        V4L2ComposeEmitProc emit, void *closure);
+
+#endif /* __V4L2_COMPOSE_H__ */
@@ -0,0 +1,475 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: YUV to ARGB conversion of composited video, ARGB to YUV
+ *   of exported screen regions, and YUV to YUYV for the mosaic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+
+#include "v4l2-convert.h"
+
+#define WEAK __attribute__((weak))
+
+/* The row kernels convert LANES chroma pairs at a time with the compiler's
+ * generic vectors, which become NEON (or SSE) registers, 32 bits per
+ * component so that the products need no care.  The chroma terms are
+ * worked out once per pair, and the even and odd pixels interleaved on the
+ * way out.  Coefficients are in 20.12 fixed point:
+ */
+#define LANES   4
+#define SHIFT   12
+
+typedef int32_t Vec __attribute__((vector_size(LANES * sizeof(int32_t))));
+
+enum { K_Y, K_RV, K_GU, K_GV, K_BU, NUM_K };
+
+static const int32_t coeffs[][NUM_K] = {
+        [V4L2_MATRIX_BT601] = { 4769, 6537, 1605, 3330, 8263 },
+        [V4L2_MATRIX_BT709] = { 4769, 7343,  873, 2183, 8652 },
+};
+
+const int32_t *
+V4L2ConvertCoeffs(int matrix)
+{
+    return coeffs[(matrix == V4L2_MATRIX_BT709) ?
+            V4L2_MATRIX_BT709 : V4L2_MATRIX_BT601];
+}
+
+static inline int
+Clamp(int c)
+{
+    return (c < 0) ? 0 : (c > 255) ? 255 : c;
+}
+
+static inline uint32_t
+ConvertPixel(int y, int u, int v, const int32_t *k)
+{
+    int c = ((y - 16) * k[K_Y]) + (1 << (SHIFT - 1));
+    int r, g, b;
+
+    u -= 128;
+    v -= 128;
+    r = Clamp((c + (v * k[K_RV])) >> SHIFT);
+    g = Clamp((c - (u * k[K_GU]) - (v * k[K_GV])) >> SHIFT);
+    b = Clamp((c + (u * k[K_BU])) >> SHIFT);
+
+    return 0xff000000 | (r << 16) | (g << 8) | b;
+}
+
+/* without compares, which generic vectors only have in C++: */
+static inline Vec
+ClampVec(Vec c)
+{
+    c &= ~(c >> 31);                /* negative to 0 */
+    c |= (255 - c) >> 31;           /* over 255 to all ones */
+    return c & 0xff;
+}
+
+static inline Vec
+PackVec(Vec y, Vec rv, Vec guv, Vec bu, const int32_t *k)
+{
+    Vec c = ((y - 16) * k[K_Y]) + (1 << (SHIFT - 1));
+    Vec r = ClampVec((c + rv) >> SHIFT);
+    Vec g = ClampVec((c - guv) >> SHIFT);
+    Vec b = ClampVec((c + bu) >> SHIFT);
+
+    return (r << 16) | (g << 8) | b | ~0xffffff;
+}
+
+/* 2 * LANES pixels from the lumas of the even and odd pixels, and the
+ * chroma of the pairs:
+ */
+static inline void
+ConvertVec(uint32_t *dst, Vec y0, Vec y1, Vec u, Vec v, const int32_t *k)
+{
+    static const Vec lo = { 0, 4, 1, 5 }, hi = { 2, 6, 3, 7 };
+    Vec rv, guv, bu, p0, p1, out[2];
+
+    u -= 128;
+    v -= 128;
+    rv = v * k[K_RV];
+    guv = (u * k[K_GU]) + (v * k[K_GV]);
+    bu = u * k[K_BU];
+
+    p0 = PackVec(y0, rv, guv, bu, k);
+    p1 = PackVec(y1, rv, guv, bu, k);
+    out[0] = __builtin_shuffle(p0, p1, lo);
+    out[1] = __builtin_shuffle(p0, p1, hi);
+
+    memcpy(dst, out, sizeof(out));
+}
+
+WEAK void
+V4L2ConvertPackedRow(uint32_t *dst, const uint8_t *src, int n,
+        int uyvy, const int32_t *k)
+{
+    int yo = uyvy ? 1 : 0, co = uyvy ? 0 : 1;   /* Y, U of a pair */
+    int i, j;
+
+    for (i = 0; i + (2 * LANES) <= n; i += 2 * LANES, src += LANES * 4) {
+        Vec y0, y1, u, v;
+        for (j = 0; j < LANES; j++) {
+            y0[j] = src[(j * 4) + yo];
+            y1[j] = src[(j * 4) + yo + 2];
+            u[j]  = src[(j * 4) + co];
+            v[j]  = src[(j * 4) + co + 2];
+        }
+        ConvertVec(dst + i, y0, y1, u, v, k);
+    }
+
+    for (; i < n; i += 2, src += 4) {
+        dst[i]     = ConvertPixel(src[yo],     src[co], src[co + 2], k);
+        dst[i + 1] = ConvertPixel(src[yo + 2], src[co], src[co + 2], k);
+    }
+}
+
+WEAK void
+V4L2ConvertPlanarRow(uint32_t *dst, const uint8_t *y, const uint8_t *u,
+        const uint8_t *v, int uvStep, int n, const int32_t *k)
+{
+    int i, j;
+
+    for (i = 0; i + (2 * LANES) <= n; i += 2 * LANES) {
+        Vec y0, y1, uv, vv;
+        for (j = 0; j < LANES; j++) {
+            int c = ((i >> 1) + j) * uvStep;
+            y0[j] = y[i + (j * 2)];
+            y1[j] = y[i + (j * 2) + 1];
+            uv[j] = u[c];
+            vv[j] = v[c];
+        }
+        ConvertVec(dst + i, y0, y1, uv, vv, k);
+    }
+
+    for (; i < n; i += 2) {
+        int c = (i >> 1) * uvStep;
+        dst[i]     = ConvertPixel(y[i],     u[c], v[c], k);
+        dst[i + 1] = ConvertPixel(y[i + 1], u[c], v[c], k);
+    }
+}
+
+/* the kernels take whole chroma pairs, so a pixel at an odd start or end
+ * is converted on its own:
+ */
+void
+V4L2ConvertARGB32(void *dst, int dstStride, const V4L2ScaleImage *src,
+        int x, int y, int w, int h, int matrix)
+{
+    const int32_t *k = V4L2ConvertCoeffs(matrix);
+    int uyvy = (src->format == V4L2_SCALE_UYVY);
+    int packed = uyvy || (src->format == V4L2_SCALE_YUYV);
+    int nv12 = (src->format == V4L2_SCALE_NV12);
+    int yo = uyvy ? 1 : 0, co = uyvy ? 0 : 1;
+    int head = x & 1, n = (w - head) & ~1, tail = (w - head) & 1;
+
+    if (w <= 0)
+        return;
+
+    for (; h > 0; h--, y++, dst += dstStride) {
+        uint32_t *d = dst;
+
+        if (packed) {
+            const uint8_t *row = src->planes[0] + (y * src->strides[0]);
+            const uint8_t *p = row + ((x & ~1) * 2);
+
+            if (head)
+                *d++ = ConvertPixel(p[yo + 2], p[co], p[co + 2], k);
+            p += head * 4;
+            V4L2ConvertPackedRow(d, p, n, uyvy, k);
+            p += n * 2;
+            if (tail)
+                d[n] = ConvertPixel(p[yo], p[co], p[co + 2], k);
+        } else {
+            int uvStep = nv12 ? 2 : 1, c = (x >> 1) * uvStep;
+            const uint8_t *py = src->planes[0] + (y * src->strides[0]) + x;
+            const uint8_t *pu = src->planes[1] + ((y >> 1) * src->strides[1]) + c;
+            const uint8_t *pv = nv12 ? pu + 1 :
+                    src->planes[2] + ((y >> 1) * src->strides[2]) + c;
+
+            if (head) {
+                *d++ = ConvertPixel(*py++, *pu, *pv, k);
+                pu += uvStep;
+                pv += uvStep;
+            }
+            V4L2ConvertPlanarRow(d, py, pu, pv, uvStep, n, k);
+            c = (n >> 1) * uvStep;
+            if (tail)
+                d[n] = ConvertPixel(py[n], pu[c], pv[c], k);
+        }
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* The other way round, for screen regions exported to output devices (see
+ * v4l2-export.c), limited range too.  Again in 20.12 fixed point, the rows
+ * of each summing to 0 for the chroma, and to 219/255 for the luma, so that
+ * nothing needs clamping:
+ */
+enum { K_YR, K_YG, K_YB, K_UR, K_UG, K_UB, K_VR, K_VG, K_VB, NUM_YUV_K };
+
+static const int32_t yuvCoeffs[][NUM_YUV_K] = {
+        [V4L2_MATRIX_BT601] = { 1052, 2065, 401, -607, -1192, 1799,
+                                1799, -1507, -292 },
+        [V4L2_MATRIX_BT709] = {  748, 2516, 254, -412, -1387, 1799,
+                                1799, -1634, -165 },
+};
+
+const int32_t *
+V4L2ConvertYUVCoeffs(int matrix)
+{
+    return yuvCoeffs[(matrix == V4L2_MATRIX_BT709) ?
+            V4L2_MATRIX_BT709 : V4L2_MATRIX_BT601];
+}
+
+#define R(p)    (((p) >> 16) & 0xff)
+#define G(p)    (((p) >> 8) & 0xff)
+#define B(p)    ((p) & 0xff)
+
+/* sums of 1 << shift pixels (or of one, shift 0) to Y, U and V: */
+#define LUMA(r, g, b, k)                                                \
+    ((((r) * k[K_YR]) + ((g) * k[K_YG]) + ((b) * k[K_YB]) +             \
+      (((16 << 1) + 1) << (SHIFT - 1))) >> SHIFT)
+#define CHROMA(r, g, b, k, c, shift)                                    \
+    ((((r) * k[K_##c##R]) + ((g) * k[K_##c##G]) + ((b) * k[K_##c##B]) + \
+      (((128 << 1) + 1) << (SHIFT + (shift) - 1))) >> (SHIFT + (shift)))
+
+/* even and odd pixels of 2 * LANES: */
+static inline void
+SplitVec(const uint32_t *src, Vec *p0, Vec *p1)
+{
+    static const Vec even = { 0, 2, 4, 6 }, odd = { 1, 3, 5, 7 };
+    Vec a, b;
+
+    memcpy(&a, src, sizeof(a));
+    memcpy(&b, src + LANES, sizeof(b));
+    *p0 = __builtin_shuffle(a, b, even);
+    *p1 = __builtin_shuffle(a, b, odd);
+}
+
+WEAK void
+V4L2ConvertRowYUYV(uint8_t *dst, const uint32_t *src, int n, const int32_t *k)
+{
+    int i, j;
+
+    for (i = 0; i + (2 * LANES) <= n; i += 2 * LANES, dst += LANES * 4) {
+        Vec p0, p1, r, g, b, out;
+
+        SplitVec(src + i, &p0, &p1);
+        r = R(p0) + R(p1);
+        g = G(p0) + G(p1);
+        b = B(p0) + B(p1);
+
+        out = LUMA(R(p0), G(p0), B(p0), k) |
+                (CHROMA(r, g, b, k, U, 1) << 8) |
+                (LUMA(R(p1), G(p1), B(p1), k) << 16) |
+                (CHROMA(r, g, b, k, V, 1) << 24);
+        for (j = 0; j < LANES; j++) {
+            dst[(j * 4)]     = out[j];
+            dst[(j * 4) + 1] = out[j] >> 8;
+            dst[(j * 4) + 2] = out[j] >> 16;
+            dst[(j * 4) + 3] = out[j] >> 24;
+        }
+    }
+
+    for (; i < n; i += 2, dst += 4) {
+        uint32_t p0 = src[i], p1 = src[i + 1];
+        int r = R(p0) + R(p1), g = G(p0) + G(p1), b = B(p0) + B(p1);
+
+        dst[0] = LUMA(R(p0), G(p0), B(p0), k);
+        dst[1] = CHROMA(r, g, b, k, U, 1);
+        dst[2] = LUMA(R(p1), G(p1), B(p1), k);
+        dst[3] = CHROMA(r, g, b, k, V, 1);
+    }
+}
+
+WEAK void
+V4L2ConvertRowsNV12(uint8_t *y0, uint8_t *y1, uint8_t *uv,
+        const uint32_t *s0, const uint32_t *s1, int n, const int32_t *k)
+{
+    int i, j;
+
+    for (i = 0; i + (2 * LANES) <= n; i += 2 * LANES) {
+        Vec a0, a1, b0, b1, r, g, b, l0, l1, l2, l3, u, v;
+
+        SplitVec(s0 + i, &a0, &a1);
+        SplitVec(s1 + i, &b0, &b1);
+        r = R(a0) + R(a1) + R(b0) + R(b1);
+        g = G(a0) + G(a1) + G(b0) + G(b1);
+        b = B(a0) + B(a1) + B(b0) + B(b1);
+
+        l0 = LUMA(R(a0), G(a0), B(a0), k);
+        l1 = LUMA(R(a1), G(a1), B(a1), k);
+        l2 = LUMA(R(b0), G(b0), B(b0), k);
+        l3 = LUMA(R(b1), G(b1), B(b1), k);
+        u = CHROMA(r, g, b, k, U, 2);
+        v = CHROMA(r, g, b, k, V, 2);
+        for (j = 0; j < LANES; j++) {
+            y0[i + (j * 2)]     = l0[j];
+            y0[i + (j * 2) + 1] = l1[j];
+            y1[i + (j * 2)]     = l2[j];
+            y1[i + (j * 2) + 1] = l3[j];
+            uv[i + (j * 2)]     = u[j];
+            uv[i + (j * 2) + 1] = v[j];
+        }
+    }
+
+    for (; i < n; i += 2) {
+        uint32_t a0 = s0[i], a1 = s0[i + 1], b0 = s1[i], b1 = s1[i + 1];
+        int r = R(a0) + R(a1) + R(b0) + R(b1);
+        int g = G(a0) + G(a1) + G(b0) + G(b1);
+        int b = B(a0) + B(a1) + B(b0) + B(b1);
+
+        y0[i]     = LUMA(R(a0), G(a0), B(a0), k);
+        y0[i + 1] = LUMA(R(a1), G(a1), B(a1), k);
+        y1[i]     = LUMA(R(b0), G(b0), B(b0), k);
+        y1[i + 1] = LUMA(R(b1), G(b1), B(b1), k);
+        uv[i]     = CHROMA(r, g, b, k, U, 2);
+        uv[i + 1] = CHROMA(r, g, b, k, V, 2);
+    }
+}
+
+/* NV12 rows go two at a time, for the chroma they share: */
+void
+V4L2ConvertYUV(const V4L2ScaleImage *dst, const void *src, int srcStride,
+        int x, int y, int w, int h, int matrix)
+{
+    const int32_t *k = V4L2ConvertYUVCoeffs(matrix);
+    const uint8_t *s = (const uint8_t *)src + (y * srcStride) + (x * 4);
+
+    if ((w <= 0) || (h <= 0))
+        return;
+
+    if (dst->format == V4L2_SCALE_NV12) {
+        for (; h > 1; h -= 2, y += 2, s += 2 * srcStride) {
+            uint8_t *py = dst->planes[0] + (y * dst->strides[0]) + x;
+            uint8_t *puv = dst->planes[1] + ((y >> 1) * dst->strides[1]) + x;
+
+            V4L2ConvertRowsNV12(py, py + dst->strides[0], puv,
+                    (const uint32_t *)s, (const uint32_t *)(s + srcStride),
+                    w, k);
+        }
+    } else {
+        for (; h > 0; h--, y++, s += srcStride) {
+            V4L2ConvertRowYUYV(dst->planes[0] + (y * dst->strides[0]) + (x * 2),
+                    (const uint32_t *)s, w, k);
+        }
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* YUV to YUYV, for the mosaic (see v4l2-mosaic.c), which is only a matter
+ * of moving bytes around, 16 pixels at a time:
+ */
+typedef uint8_t Vec8 __attribute__((vector_size(16)));
+
+WEAK void
+V4L2ConvertRowPlanarYUYV(uint8_t *dst, const uint8_t *y, const uint8_t *u,
+        const uint8_t *v, int uvStep, int n)
+{
+    static const Vec8 lo = { 0, 16, 1, 17, 2, 18, 3, 19,
+                             4, 20, 5, 21, 6, 22, 7, 23 };
+    static const Vec8 hi = { 8, 24, 9, 25, 10, 26, 11, 27,
+                             12, 28, 13, 29, 14, 30, 15, 31 };
+    int i, j;
+
+    for (i = 0; i + 16 <= n; i += 16, dst += 32) {
+        Vec8 luma, chroma, out[2];
+
+        memcpy(&luma, y + i, sizeof(luma));
+        if (uvStep == 2) {
+            memcpy(&chroma, u + i, sizeof(chroma));     /* NV12, as UV */
+        } else {
+            for (j = 0; j < 8; j++) {
+                chroma[(j * 2)]     = u[(i >> 1) + j];
+                chroma[(j * 2) + 1] = v[(i >> 1) + j];
+            }
+        }
+
+        out[0] = __builtin_shuffle(luma, chroma, lo);
+        out[1] = __builtin_shuffle(luma, chroma, hi);
+        memcpy(dst, out, sizeof(out));
+    }
+
+    for (; i < n; i += 2, dst += 4) {
+        int c = (i >> 1) * uvStep;
+        dst[0] = y[i];
+        dst[1] = u[c];
+        dst[2] = y[i + 1];
+        dst[3] = v[c];
+    }
+}
+
+WEAK void
+V4L2ConvertRowSwapYUYV(uint8_t *dst, const uint8_t *src, int n)
+{
+    static const Vec8 swap = { 1, 0, 3, 2, 5, 4, 7, 6,
+                               9, 8, 11, 10, 13, 12, 15, 14 };
+    int i;
+
+    for (i = 0; i + 8 <= n; i += 8, src += 16, dst += 16) {
+        Vec8 p;
+        memcpy(&p, src, sizeof(p));
+        p = __builtin_shuffle(p, swap);
+        memcpy(dst, &p, sizeof(p));
+    }
+
+    for (; i < n; i += 2, src += 4, dst += 4) {
+        dst[0] = src[1];
+        dst[1] = src[0];
+        dst[2] = src[3];
+        dst[3] = src[2];
+    }
+}
+
+void
+V4L2ConvertYUYV(void *dst, int dstStride, const V4L2ScaleImage *src,
+        int x, int y, int w, int h)
+{
+    uint8_t *d = dst;
+
+    if (w <= 0)
+        return;
+
+    for (; h > 0; h--, y++, d += dstStride) {
+        const uint8_t *row = src->planes[0] + (y * src->strides[0]);
+
+        switch (src->format) {
+        case V4L2_SCALE_YUYV:
+            memcpy(d, row + (x * 2), w * 2);
+            break;
+        case V4L2_SCALE_UYVY:
+            V4L2ConvertRowSwapYUYV(d, row + (x * 2), w);
+            break;
+        case V4L2_SCALE_NV12: {
+            const uint8_t *uv = src->planes[1] +
+                    ((y >> 1) * src->strides[1]) + x;
+            V4L2ConvertRowPlanarYUYV(d, row + x, uv, uv + 1, 2, w);
+            break;
+        }
+        default:
+            V4L2ConvertRowPlanarYUYV(d, row + x,
+                    src->planes[1] + ((y >> 1) * src->strides[1]) + (x >> 1),
+                    src->planes[2] + ((y >> 1) * src->strides[2]) + (x >> 1),
+                    1, w);
+            break;
+        }
+    }
+}
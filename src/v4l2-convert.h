@@ -0,0 +1,70 @@
+/*
+ * v4l2-convert.h
+ *
+ * YUV to ARGB conversion, for video composited into the framebuffer by the
+ * CPU (see V4L2SetupComposite()), ARGB to YUV, for screen regions exported
+ * to output devices (see v4l2-export.c), and YUV to YUYV, for the mosaic
+ * (see v4l2-mosaic.c).  No X server dependencies, like the other kernels.
+ * The row kernels are weak symbols, so optimized versions take precedence
+ * at link time.
+ */
+
+#ifndef __V4L2_CONVERT_H__
+#define __V4L2_CONVERT_H__
+
+#include <stdint.h>
+
+#include "v4l2-scale.h"
+
+/* limited range YCbCr, as video is: */
+enum {
+    V4L2_MATRIX_BT601,
+    V4L2_MATRIX_BT709,
+};
+
+/* Convert the w x h pixels of src at (x, y) into opaque ARGB32 pixels at
+ * dst, 1:1.  The box may start and end at odd pixels.  The chroma planes of
+ * YUV420 images are taken to be U then V.
+ */
+void V4L2ConvertARGB32(void *dst, int dstStride, const V4L2ScaleImage *src,
+        int x, int y, int w, int h, int matrix);
+
+/* row kernels, n even, starting at the first pixel of a chroma pair.  The
+ * coefficients are those of V4L2ConvertCoeffs():
+ */
+void V4L2ConvertPackedRow(uint32_t *dst, const uint8_t *src, int n,
+        int uyvy, const int32_t *k);
+void V4L2ConvertPlanarRow(uint32_t *dst, const uint8_t *y, const uint8_t *u,
+        const uint8_t *v, int uvStep, int n, const int32_t *k);
+
+const int32_t *V4L2ConvertCoeffs(int matrix);
+
+/* Convert the w x h ARGB32 pixels at (x, y) of src into dst, at the same
+ * place, which must be YUYV or NV12.  x, y, w and h must all be even.
+ */
+void V4L2ConvertYUV(const V4L2ScaleImage *dst, const void *src, int srcStride,
+        int x, int y, int w, int h, int matrix);
+
+/* row kernels, n even.  The chroma is that of each pair of pixels, or of
+ * each 2x2 block for NV12.  The coefficients are those of
+ * V4L2ConvertYUVCoeffs():
+ */
+void V4L2ConvertRowYUYV(uint8_t *dst, const uint32_t *src, int n,
+        const int32_t *k);
+void V4L2ConvertRowsNV12(uint8_t *y0, uint8_t *y1, uint8_t *uv,
+        const uint32_t *s0, const uint32_t *s1, int n, const int32_t *k);
+
+const int32_t *V4L2ConvertYUVCoeffs(int matrix);
+
+/* Copy the w x h pixels of src at (x, y) to dst as YUYV.  x and w must be
+ * even.  The chroma planes of YUV420 images are taken to be U then V.
+ */
+void V4L2ConvertYUYV(void *dst, int dstStride, const V4L2ScaleImage *src,
+        int x, int y, int w, int h);
+
+/* row kernels, n even.  For UYVY, swap the bytes of each pair: */
+void V4L2ConvertRowPlanarYUYV(uint8_t *dst, const uint8_t *y,
+        const uint8_t *u, const uint8_t *v, int uvStep, int n);
+void V4L2ConvertRowSwapYUYV(uint8_t *dst, const uint8_t *src, int n);
+
+#endif /* __V4L2_CONVERT_H__ */
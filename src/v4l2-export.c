@@ -0,0 +1,688 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: Xv screen regions exported to output devices
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+#include "xf86.h"
+#include "xf86_OSproc.h"
+#include "xf86xv.h"
+#include "v4l2.h"
+#include "v4l2-scale.h"
+#include "v4l2-convert.h"
+
+/* XvGetVideo on an output device without an overlay of its own (an
+ * encoder, v4l2loopback, vivid..) streams a region of the screen into it.
+ * The region is read from the shadow framebuffer, and only what the shadow
+ * update says is damaged (see V4L2ShadowUpdatePacked()), so a screen that
+ * doesn't change costs nothing, and neither is a frame queued.
+ *
+ * Each output buffer remembers what has changed on screen since it was
+ * last filled, so that when it comes back from the device only that is
+ * converted into it again:
+ *
+ *   damage --> stale[] of every buffer --> the first one free --> QBUF
+ *
+ * If none is free, the damage waits for the device to give one back, which
+ * a timer checks for.  Frames are converted to NV12 or YUYV on the way, if
+ * the device takes either (see ExportYUV option), else copied as they are.
+ * If the device won't take the size of the region, the region is converted
+ * into memory of our own first, and scaled from there.  Frames copied as
+ * they are aren't scaled, so then the device has to take the size of the
+ * region, else XvGetVideo fails with BadMatch.
+ */
+
+#define V4L2_EXPORT_BUFS        3
+#define V4L2_EXPORT_RETRY_MSEC  10
+
+#define EXPORT_RGB  -1          /* format of frames copied as they are */
+
+struct _V4L2Export {
+    PortPrivPtr                 pPPriv;
+    const V4L2Backend           *backend;
+    int                         fd, flags;  /* fd's own O_* flags */
+    ScreenPtr                   pScreen;
+    struct _V4L2Export          *next;      /* in exports */
+
+    BoxRec                      box;        /* on screen, even size */
+    short                       vid_w, vid_h;
+    Bool                        still;      /* one frame only */
+    Bool                        pending;    /* damage not queued yet */
+    Bool                        done;       /* the still is queued */
+    OsTimerPtr                  timer;
+
+    struct v4l2_pix_format      pix;        /* as set */
+    int                         format;     /* V4L2_SCALE_*, or EXPORT_RGB */
+    int                         matrix;     /* V4L2_MATRIX_* */
+
+    int                         nbufs;
+    struct {
+        void                    *mem;
+        size_t                  length;
+        Bool                    queued;
+        RegionRec               stale;      /* on screen */
+    } bufs[V4L2_EXPORT_BUFS];
+    Bool                        streaming;
+
+    /* the region at its own size, when the device's differs: */
+    Bool                        scaled;
+    V4L2ScaleImage              scratch;
+    uint8_t                     *scratchMem;
+    size_t                      scratchSize;
+    RegionRec                   scratchStale;
+};
+
+static const struct {
+    CARD32                      fourcc;
+    int                         format;
+} exportFormats[] = {
+        { V4L2_PIX_FMT_NV12,   V4L2_SCALE_NV12 },
+        { V4L2_PIX_FMT_YUYV,   V4L2_SCALE_YUYV },
+        { V4L2_PIX_FMT_BGR32,  EXPORT_RGB },    /* ARGB32 in memory */
+};
+
+#define NUM_EXPORT_FORMATS (sizeof(exportFormats) / sizeof(exportFormats[0]))
+
+/* the ports exporting, for the shadow update to tell: */
+static V4L2Export *exports = NULL;
+int v4l2Exporting = 0;
+
+/* ---------------------------------------------------------------------- */
+
+static int
+ExportIoctl(V4L2Export *exp, unsigned long request, void *arg)
+{
+    uint64_t start = V4L2StatsNow();
+    int ret = exp->backend->ioctl(exp->fd, request, arg);
+    unsigned long usec = V4L2StatsNow() - start;
+    V4L2StatsIoctl(&exp->pPPriv->stats, usec);
+    V4L2_TRACE(IOCTL, exp->pPPriv->nr, request, ret, usec, 0);
+    return ret;
+}
+
+/* take back the buffers the device is done with (the fd is non-blocking): */
+static void
+ExportReclaim(V4L2Export *exp)
+{
+    struct v4l2_buffer buf;
+
+    while (1) {
+        memset(&buf, 0x00, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        buf.memory = V4L2_MEMORY_MMAP;
+
+        if (-1 == ExportIoctl(exp, VIDIOC_DQBUF, &buf))
+            break;
+        if (buf.index < exp->nbufs)
+            exp->bufs[buf.index].queued = FALSE;
+    }
+}
+
+static int
+ExportQueue(V4L2Export *exp, int index)
+{
+    int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    struct v4l2_buffer buf;
+
+    memset(&buf, 0x00, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = index;
+    buf.bytesused = exp->pix.sizeimage;
+    buf.field = V4L2_FIELD_NONE;
+    gettimeofday(&buf.timestamp, NULL);
+
+    if (-1 == ExportIoctl(exp, VIDIOC_QBUF, &buf)) {
+        perror("ioctl VIDIOC_QBUF");
+        return -1;
+    }
+    exp->bufs[index].queued = TRUE;
+
+    /* some devices won't start without a buffer queued: */
+    if (!exp->streaming) {
+        if (-1 == ExportIoctl(exp, VIDIOC_STREAMON, &type)) {
+            perror("ioctl VIDIOC_STREAMON");
+            return -1;
+        }
+        exp->streaming = TRUE;
+    }
+
+    return 0;
+}
+
+/* the image in memory at the device's size, laid out as the device has it: */
+static void
+ExportImage(V4L2Export *exp, V4L2ScaleImage *img, uint8_t *mem)
+{
+    int bpl = exp->pix.bytesperline;
+
+    memset(img, 0x00, sizeof(*img));
+    img->format = exp->format;
+    img->width = exp->pix.width & ~1;
+    img->height = exp->pix.height & ~1;
+    img->planes[0] = mem;
+    img->strides[0] = bpl;
+
+    if (exp->format == V4L2_SCALE_NV12) {
+        img->planes[1] = mem + (bpl * exp->pix.height);
+        img->strides[1] = bpl;
+    }
+}
+
+/* convert (or copy) what is stale of the region into dst, whose top left is
+ * that of the region.  Boxes are widened to even pixels, for the chroma:
+ */
+static void
+ExportConvert(V4L2Export *exp, const V4L2ScaleImage *dst, RegionPtr stale)
+{
+    PixmapPtr pPixmap = exp->pScreen->GetScreenPixmap(exp->pScreen);
+    int devKind = pPixmap->devKind;
+    const uint8_t *src = (const uint8_t *)pPixmap->devPrivate.ptr +
+            (exp->box.y1 * devKind) + (exp->box.x1 * 4);
+    int w = MIN(dst->width, exp->box.x2 - exp->box.x1);
+    int h = MIN(dst->height, exp->box.y2 - exp->box.y1);
+    BoxPtr pbox = RegionRects(stale);
+    int nbox = RegionNumRects(stale);
+
+    for (; nbox > 0; nbox--, pbox++) {
+        int x1 = (pbox->x1 - exp->box.x1) & ~1;
+        int y1 = (pbox->y1 - exp->box.y1) & ~1;
+        int x2 = MIN(w, (pbox->x2 - exp->box.x1 + 1) & ~1);
+        int y2 = MIN(h, (pbox->y2 - exp->box.y1 + 1) & ~1);
+        int y;
+
+        if ((x2 <= x1) || (y2 <= y1))
+            continue;
+
+        if (exp->format != EXPORT_RGB) {
+            V4L2ConvertYUV(dst, src, devKind, x1, y1, x2 - x1, y2 - y1,
+                    exp->matrix);
+            continue;
+        }
+
+        for (y = y1; y < y2; y++) {
+            memcpy(dst->planes[0] + (y * dst->strides[0]) + (x1 * 4),
+                    src + (y * devKind) + (x1 * 4), (x2 - x1) * 4);
+        }
+    }
+
+    RegionEmpty(stale);
+}
+
+/* queue what has changed, if the device has a buffer for it.  Returns
+ * whether something is left for later:
+ */
+static Bool
+ExportFlush(V4L2Export *exp)
+{
+    PixmapPtr pPixmap;
+    V4L2ScaleImage img;
+    int i;
+
+    if (!exp->pending || exp->done)
+        return FALSE;
+
+    pPixmap = exp->pScreen->GetScreenPixmap(exp->pScreen);
+    if (!pPixmap || (pPixmap->drawable.bitsPerPixel != 32))
+        return FALSE;
+
+    if (exp->streaming)
+        ExportReclaim(exp);
+
+    for (i = 0; i < exp->nbufs; i++)
+        if (!exp->bufs[i].queued)
+            break;
+    if (i == exp->nbufs)
+        return TRUE;
+
+    ExportImage(exp, &img, exp->bufs[i].mem);
+
+    if (exp->scaled) {
+        ExportConvert(exp, &exp->scratch, &exp->scratchStale);
+        V4L2Scale(&exp->scratch, &img, 1);
+        RegionEmpty(&exp->bufs[i].stale);
+    } else {
+        ExportConvert(exp, &img, &exp->bufs[i].stale);
+    }
+
+    if (ExportQueue(exp, i))
+        return FALSE;
+
+    V4L2_STAT_ADD(exp->pPPriv->stats.frames, 1);
+    exp->pending = FALSE;
+    if (exp->still)
+        exp->done = TRUE;
+
+    return FALSE;
+}
+
+static CARD32
+ExportTimer(OsTimerPtr timer, CARD32 now, pointer arg)
+{
+    V4L2Export *exp = arg;
+
+    return ExportFlush(exp) ? V4L2_EXPORT_RETRY_MSEC : 0;
+}
+
+static void
+ExportDamage(V4L2Export *exp, RegionPtr damage)
+{
+    RegionRec changed;
+    int i;
+
+    RegionInit(&changed, &exp->box, 1);
+    if (damage)
+        RegionIntersect(&changed, &changed, damage);
+
+    if (RegionNotEmpty(&changed)) {
+        for (i = 0; i < exp->nbufs; i++)
+            RegionUnion(&exp->bufs[i].stale, &exp->bufs[i].stale, &changed);
+        if (exp->scaled)
+            RegionUnion(&exp->scratchStale, &exp->scratchStale, &changed);
+        exp->pending = TRUE;
+    }
+
+    RegionUninit(&changed);
+
+    if (ExportFlush(exp))
+        exp->timer = TimerSet(exp->timer, 0, V4L2_EXPORT_RETRY_MSEC,
+                ExportTimer, exp);
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* the first format we can fill the device has, at w x h if it can: */
+static int
+ExportSetFormat(V4L2Export *exp, const V4L2DeviceInfo *info, int w, int h)
+{
+    struct v4l2_format format;
+    int i;
+
+    for (i = 0; i < NUM_EXPORT_FORMATS; i++) {
+        if (!config.exportYUV && (exportFormats[i].format != EXPORT_RGB))
+            continue;
+
+        memset(&format, 0x00, sizeof(format));
+        format.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        format.fmt.pix.width = w;
+        format.fmt.pix.height = h;
+        format.fmt.pix.pixelformat = exportFormats[i].fourcc;
+        format.fmt.pix.field = V4L2_FIELD_NONE;
+        if (exportFormats[i].format == EXPORT_RGB)
+            format.fmt.pix.colorspace = V4L2_COLORSPACE_SRGB;
+        else
+            format.fmt.pix.colorspace = (h >= 720) ?
+                    V4L2_COLORSPACE_REC709 : V4L2_COLORSPACE_SMPTE170M;
+
+        if ((0 == ExportIoctl(exp, VIDIOC_S_FMT, &format)) &&
+                (format.fmt.pix.pixelformat == exportFormats[i].fourcc))
+            break;
+    }
+
+    if ((i == NUM_EXPORT_FORMATS) ||
+            (format.fmt.pix.width < 2) || (format.fmt.pix.height < 2)) {
+        xf86Msg(X_WARNING, "v4l2: no format to export %dx%d frames to "
+                "%s in\n", w, h, info->card);
+        return -1;
+    }
+
+    exp->pix = format.fmt.pix;
+    exp->format = exportFormats[i].format;
+    if (!exp->pix.bytesperline) {
+        exp->pix.bytesperline = exp->pix.width *
+                ((exp->format == EXPORT_RGB) ? 4 :
+                 (exp->format == V4L2_SCALE_YUYV) ? 2 : 1);
+    }
+    if (!exp->pix.sizeimage) {
+        exp->pix.sizeimage = exp->pix.bytesperline * exp->pix.height *
+                ((exp->format == V4L2_SCALE_NV12) ? 3 : 2) / 2;
+    }
+
+    exp->matrix = (exp->pix.colorspace == V4L2_COLORSPACE_REC709) ?
+            V4L2_MATRIX_BT709 : V4L2_MATRIX_BT601;
+
+    return 0;
+}
+
+static void
+ExportFree(V4L2Export *exp)
+{
+    struct v4l2_requestbuffers req;
+    int i, type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+
+    if (exp->streaming) {
+        ExportIoctl(exp, VIDIOC_STREAMOFF, &type);
+        exp->streaming = FALSE;
+    }
+
+    for (i = 0; i < exp->nbufs; i++) {
+        if (exp->bufs[i].mem)
+            exp->backend->munmap(exp->bufs[i].mem, exp->bufs[i].length);
+        exp->bufs[i].mem = NULL;
+        exp->bufs[i].queued = FALSE;
+        RegionUninit(&exp->bufs[i].stale);
+    }
+
+    if (exp->nbufs) {
+        memset(&req, 0x00, sizeof(req));
+        req.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        req.memory = V4L2_MEMORY_MMAP;
+        req.count = 0;
+        ExportIoctl(exp, VIDIOC_REQBUFS, &req);
+    }
+
+    exp->nbufs = 0;
+}
+
+static int
+ExportAlloc(V4L2Export *exp)
+{
+    struct v4l2_requestbuffers req;
+    int i;
+
+    memset(&req, 0x00, sizeof(req));
+    req.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    req.memory = V4L2_MEMORY_MMAP;
+    req.count = V4L2_EXPORT_BUFS;
+
+    if (-1 == ExportIoctl(exp, VIDIOC_REQBUFS, &req)) {
+        perror("ioctl VIDIOC_REQBUFS");
+        return -1;
+    }
+
+    exp->nbufs = MIN(req.count, V4L2_EXPORT_BUFS);
+    for (i = 0; i < exp->nbufs; i++)
+        RegionNull(&exp->bufs[i].stale);
+
+    if (exp->nbufs < 1) {
+        ExportFree(exp);
+        return -1;
+    }
+
+    for (i = 0; i < exp->nbufs; i++) {
+        struct v4l2_buffer buf;
+
+        memset(&buf, 0x00, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+
+        if (-1 == ExportIoctl(exp, VIDIOC_QUERYBUF, &buf)) {
+            perror("ioctl VIDIOC_QUERYBUF");
+            ExportFree(exp);
+            return -1;
+        }
+
+        exp->bufs[i].length = buf.length;
+        exp->bufs[i].mem = exp->backend->mmap(exp->fd, buf.length,
+                PROT_READ | PROT_WRITE, buf.m.offset);
+        if (exp->bufs[i].mem == MAP_FAILED) {
+            perror("mmap");
+            exp->bufs[i].mem = NULL;
+            ExportFree(exp);
+            return -1;
+        }
+
+        if (buf.length < exp->pix.sizeimage) {
+            DEBUG("Xv/GV: buffer %d too small, %u bytes", i, buf.length);
+            ExportFree(exp);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* where the region is taken from, and whether it needs scaling to the
+ * device's size.  Everything is stale after:
+ */
+static int
+ExportSetRegion(V4L2Export *exp, const BoxRec *box)
+{
+    int w = box->x2 - box->x1, h = box->y2 - box->y1, i;
+
+    /* what was stale of the old region is of no interest: */
+    for (i = 0; i < exp->nbufs; i++)
+        RegionEmpty(&exp->bufs[i].stale);
+    exp->box = *box;
+    exp->scaled = (exp->format != EXPORT_RGB) &&
+            ((w != (exp->pix.width & ~1)) || (h != (exp->pix.height & ~1)));
+
+    RegionEmpty(&exp->scratchStale);
+
+    if (exp->scaled) {
+        size_t size = w * h * 2;
+
+        if (size > exp->scratchSize) {
+            uint8_t *mem = realloc(exp->scratchMem, size);
+            if (!mem)
+                return -1;
+            exp->scratchMem = mem;
+            exp->scratchSize = size;
+        }
+
+        memset(&exp->scratch, 0x00, sizeof(exp->scratch));
+        exp->scratch.format = exp->format;
+        exp->scratch.width = w;
+        exp->scratch.height = h;
+        exp->scratch.planes[0] = exp->scratchMem;
+        if (exp->format == V4L2_SCALE_NV12) {
+            exp->scratch.strides[0] = exp->scratch.strides[1] = w;
+            exp->scratch.planes[1] = exp->scratchMem + (w * h);
+        } else {
+            exp->scratch.strides[0] = w * 2;
+        }
+    }
+
+    exp->done = FALSE;
+    ExportDamage(exp, NULL);
+
+    return 0;
+}
+
+static void
+ExportStop(V4L2Export *exp)
+{
+    V4L2Export **p;
+
+    for (p = &exports; *p; p = &(*p)->next) {
+        if (*p == exp) {
+            *p = exp->next;
+            v4l2Exporting--;
+            break;
+        }
+    }
+    exp->next = NULL;
+
+    if (exp->timer)
+        TimerCancel(exp->timer);
+
+    ExportFree(exp);
+    exp->pending = exp->done = FALSE;
+
+    if (exp->fd != -1) {
+        fcntl(exp->fd, F_SETFL, exp->flags);
+        exp->fd = -1;
+    }
+}
+
+static int
+ExportStart(V4L2Export *exp, const V4L2DeviceInfo *info,
+        short vid_w, short vid_h)
+{
+    if (ExportSetFormat(exp, info, vid_w, vid_h) || ExportAlloc(exp))
+        return -1;
+
+    /* finished buffers are taken back until VIDIOC_DQBUF fails: */
+    fcntl(exp->fd, F_SETFL, exp->flags | O_NONBLOCK);
+
+    exp->vid_w = vid_w;
+    exp->vid_h = vid_h;
+    exp->next = exports;
+    exports = exp;
+    v4l2Exporting++;
+
+    DEBUG("Xv/GV: exporting %dx%d %08x", exp->pix.width, exp->pix.height,
+            exp->pix.pixelformat);
+
+    return 0;
+}
+
+/**
+ * Whether XvGetVideo on a device streams the screen into it.  Output
+ * devices with an overlay show what is queued to them on screen, so don't
+ * count, nor do memory to memory devices.
+ */
+Bool
+V4L2ExportSupported(const V4L2DeviceInfo *info)
+{
+    return (info->capabilities & V4L2_CAP_VIDEO_OUTPUT) &&
+            (info->capabilities & V4L2_CAP_STREAMING) &&
+            !(info->capabilities & V4L2_CAP_VIDEO_OUTPUT_OVERLAY) &&
+            !(info->capabilities & V4L2_CAP_VIDEO_M2M);
+}
+
+/**
+ * Start streaming the drw_w x drw_h region of the screen at drw_x, drw_y
+ * into the port's device, as vid_w x vid_h frames, or just move the region
+ * if already started.  With still, only one frame is queued.
+ */
+int
+V4L2ExportGet(PortPrivPtr pPPriv, const V4L2Backend *backend, int fd,
+        const V4L2DeviceInfo *info, ScreenPtr pScreen, short drw_x, short drw_y, short drw_w, short drw_h,
+        short vid_w, short vid_h, Bool still)
+{
+    V4L2Export *exp = pPPriv->export;
+    BoxRec box;
+
+    box.x1 = MAX(drw_x, 0);
+    box.y1 = MAX(drw_y, 0);
+    box.x2 = MIN(drw_x + drw_w, pScreen->width);
+    box.y2 = MIN(drw_y + drw_h, pScreen->height);
+    box.x2 = box.x1 + ((box.x2 - box.x1) & ~1);
+    box.y2 = box.y1 + ((box.y2 - box.y1) & ~1);
+    if ((box.x2 <= box.x1) || (box.y2 <= box.y1))
+        return BadMatch;
+
+    if ((vid_w <= 0) || (vid_h <= 0)) {
+        vid_w = box.x2 - box.x1;
+        vid_h = box.y2 - box.y1;
+    }
+    vid_w &= ~1;
+    vid_h &= ~1;
+
+    if (!exp) {
+        exp = calloc(1, sizeof(*exp));
+        if (!exp)
+            return BadAlloc;
+        exp->pPPriv = pPPriv;
+        exp->fd = -1;
+        RegionNull(&exp->scratchStale);
+        pPPriv->export = exp;
+    }
+
+    if ((exp->fd == -1) || (exp->still != still) ||
+            (exp->vid_w != vid_w) || (exp->vid_h != vid_h)) {
+        ExportStop(exp);
+
+        exp->backend = backend;
+        exp->fd = fd;
+        exp->flags = fcntl(fd, F_GETFL);
+        exp->pScreen = pScreen;
+        exp->still = still;
+
+        if (ExportStart(exp, info, vid_w, vid_h)) {
+            ExportStop(exp);
+            return BadAlloc;
+        }
+    } else if (!memcmp(&box, &exp->box, sizeof(box)) && !still) {
+        return Success;
+    }
+
+    /* frames copied as they are can't be scaled: */
+    if ((exp->format == EXPORT_RGB) &&
+            (((box.x2 - box.x1) != (exp->pix.width & ~1)) ||
+             ((box.y2 - box.y1) != (exp->pix.height & ~1)))) {
+        DEBUG("Xv/GV: device took %dx%d BGR32 for a %dx%d region",
+                exp->pix.width, exp->pix.height,
+                box.x2 - box.x1, box.y2 - box.y1);
+        ExportStop(exp);
+        return BadMatch;
+    }
+
+    if (ExportSetRegion(exp, &box)) {
+        ExportStop(exp);
+        return BadAlloc;
+    }
+
+    return Success;
+}
+
+/**
+ * Take the damage of a shadow update of pScreen into the exports, and queue
+ * the frames it makes, if there is a buffer for them.
+ */
+void
+V4L2ExportDamage(ScreenPtr pScreen, RegionPtr damage)
+{
+    V4L2Export *exp;
+
+    for (exp = exports; exp; exp = exp->next) {
+        if ((exp->pScreen == pScreen) && !exp->done)
+            ExportDamage(exp, damage);
+    }
+}
+
+/**
+ * Stop exporting, and on shutdown (before the device is closed) also free
+ * what's left.
+ */
+void
+V4L2ExportStop(PortPrivPtr pPPriv, Bool shutdown)
+{
+    V4L2Export *exp = pPPriv->export;
+
+    if (!exp)
+        return;
+
+    ExportStop(exp);
+
+    if (shutdown) {
+        if (exp->timer)
+            TimerFree(exp->timer);
+        RegionUninit(&exp->scratchStale);
+        free(exp->scratchMem);
+        free(exp);
+        pPPriv->export = NULL;
+    }
+}
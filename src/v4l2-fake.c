@@ -0,0 +1,659 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: in-process fake overlay (or output) device
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+
+#include "xf86.h"
+#include "xf86_OSproc.h"
+#include "xf86xv.h"
+#include "v4l2.h"
+
+/* A software stand-in for an OMAP-style video output device with overlay
+ * window, for running the driver without the hardware.  Devices are named
+ * "fake:<n>[@<usec>]", where the optional usec is a latency added to every
+ * ioctl to mimic a slow driver.  Queued buffers are "displayed" as soon as
+ * they are queued, and can be dequeued right away.
+ *
+ * A unit named with ",output" appended is instead a plain video output
+ * device, with no overlay (like an encoder or v4l2loopback), which takes
+ * BGR32 too, for XvGetVideo to stream the screen into (see v4l2-export.c).
+ *
+ * Like a real device node, a unit keeps its formats, framebuffer, window,
+ * crop and controls across open/close; only streaming and the buffers go
+ * away, when the last file on the unit is closed.  As with videobuf2, the
+ * output format can't change and buffers can't be requested again while
+ * there are any (or any are still mapped), and the memory of a buffer
+ * outlives REQBUFS(0) and close until its last munmap.
+ */
+
+#define FAKE_PREFIX     "fake:"
+#define FAKE_OUTPUT     ",output"
+#define FAKE_FD_BASE    0x10000     /* well clear of real file descriptors */
+#define FAKE_MAX_FDS    16
+#define FAKE_MAX_UNITS  16
+#define FAKE_MAX_BUFS   8
+#define FAKE_MAX_SIZE   2048
+#define FAKE_MAX_ORPHANS    (FAKE_MAX_UNITS * FAKE_MAX_BUFS)
+
+typedef struct {
+    Bool                        initialized;
+    int                         unit;
+    Bool                        output;     /* no overlay */
+    int                         users;      /* open files */
+
+    struct v4l2_framebuffer     fbuf;
+    struct v4l2_window          win;
+    struct v4l2_pix_format      pix;
+    struct v4l2_rect            crop;       /* of pix */
+    Bool                        overlay;
+    Bool                        streaming;
+
+    int                         nbufs;
+    struct {
+        void                    *mem;
+        size_t                  length;
+        int                     maps;       /* not munmap'ed yet */
+        Bool                    queued;
+        unsigned int            sequence;
+        struct timeval          timestamp;
+    } bufs[FAKE_MAX_BUFS];
+    unsigned int                sequence;
+
+    INT32                       ctrls[4];
+} FakeDevice;
+
+typedef struct {
+    FakeDevice                  *dev;       /* NULL if not open */
+    int                         latency;    /* usec per ioctl */
+} FakeFile;
+
+/* buffers given up by their device while still mapped, freed on their last
+ * munmap.  dev is that of REQBUFS(0), NULL once the last file is closed:
+ */
+typedef struct {
+    void                        *mem;
+    int                         maps;
+    FakeDevice                  *dev;
+} FakeOrphan;
+
+static FakeDevice fakes[FAKE_MAX_UNITS];
+static FakeOrphan fakeOrphans[FAKE_MAX_ORPHANS];
+static FakeFile fakeFiles[FAKE_MAX_FDS];
+static pthread_mutex_t fakeLock = PTHREAD_MUTEX_INITIALIZER;
+
+static const CARD32 fakeFormats[] = {
+        V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_UYVY, V4L2_PIX_FMT_NV12,
+        V4L2_PIX_FMT_BGR32,     /* output units only */
+};
+
+static const struct {
+    CARD32 id;
+    const char *name;
+} fakeCtrls[] = {
+        { V4L2_CID_BRIGHTNESS, "Brightness" },
+        { V4L2_CID_CONTRAST,   "Contrast" },
+        { V4L2_CID_SATURATION, "Saturation" },
+        { V4L2_CID_HUE,        "Hue" },
+};
+
+#define NFORMATS (sizeof(fakeFormats) / sizeof(fakeFormats[0]))
+#define NCTRLS   (sizeof(fakeCtrls) / sizeof(fakeCtrls[0]))
+
+/* ---------------------------------------------------------------------- */
+
+static FakeFile *
+FakeLookup(int fd)
+{
+    int i = fd - FAKE_FD_BASE;
+    if ((i < 0) || (i >= FAKE_MAX_FDS) || !fakeFiles[i].dev)
+        return NULL;
+    return &fakeFiles[i];
+}
+
+static void
+FakeSetPix(FakeDevice *dev, struct v4l2_pix_format *pix)
+{
+    pix->width  = MIN(MAX(pix->width, 16), FAKE_MAX_SIZE) & ~1;
+    pix->height = MIN(MAX(pix->height, 16), FAKE_MAX_SIZE) & ~1;
+    pix->field  = V4L2_FIELD_NONE;
+
+    if (pix->pixelformat == V4L2_PIX_FMT_NV12) {
+        pix->bytesperline = pix->width;
+        pix->sizeimage = pix->width * pix->height * 3 / 2;
+    } else if ((pix->pixelformat == V4L2_PIX_FMT_BGR32) && dev->output) {
+        pix->bytesperline = pix->width * 4;
+        pix->sizeimage = pix->bytesperline * pix->height;
+    } else {
+        if (pix->pixelformat != V4L2_PIX_FMT_UYVY)
+            pix->pixelformat = V4L2_PIX_FMT_YUYV;
+        pix->bytesperline = pix->width * 2;
+        pix->sizeimage = pix->bytesperline * pix->height;
+    }
+}
+
+/* the state a unit powers up with: */
+static void
+FakeInit(FakeDevice *dev, int unit, Bool output)
+{
+    memset(dev, 0x00, sizeof(*dev));
+    dev->initialized = TRUE;
+    dev->unit = unit;
+    dev->output = output;
+    if (!output) {
+        dev->fbuf.capability = V4L2_FBUF_CAP_CHROMAKEY |
+                V4L2_FBUF_CAP_LOCAL_ALPHA | V4L2_FBUF_CAP_GLOBAL_ALPHA;
+    }
+    dev->win.w.width  = 320;
+    dev->win.w.height = 240;
+    dev->win.global_alpha = 255;
+    dev->pix.width  = 320;
+    dev->pix.height = 240;
+    dev->pix.pixelformat = V4L2_PIX_FMT_YUYV;
+    FakeSetPix(dev, &dev->pix);
+    dev->ctrls[0] = dev->ctrls[1] = dev->ctrls[2] = dev->ctrls[3] = 128;
+}
+
+static int
+FakeFmt(FakeDevice *dev, unsigned long request, struct v4l2_format *fmt)
+{
+    switch (fmt->type) {
+    case V4L2_BUF_TYPE_VIDEO_OVERLAY:
+    case V4L2_BUF_TYPE_VIDEO_OUTPUT_OVERLAY:
+        if (dev->output) {
+            errno = EINVAL;
+            return -1;
+        }
+        if (request == VIDIOC_G_FMT) {
+            fmt->fmt.win = dev->win;
+        } else {
+            struct v4l2_window *win = &fmt->fmt.win;
+            win->w.width  = MIN(win->w.width, FAKE_MAX_SIZE);
+            win->w.height = MIN(win->w.height, FAKE_MAX_SIZE);
+            win->clips = NULL;
+            win->clipcount = 0;
+            win->bitmap = NULL;
+            if (request == VIDIOC_S_FMT)
+                dev->win = *win;
+        }
+        return 0;
+    case V4L2_BUF_TYPE_VIDEO_OUTPUT:
+        if (request == VIDIOC_G_FMT) {
+            fmt->fmt.pix = dev->pix;
+        } else {
+            if ((dev->streaming || dev->nbufs) &&
+                    (request == VIDIOC_S_FMT)) {
+                errno = EBUSY;
+                return -1;
+            }
+            FakeSetPix(dev, &fmt->fmt.pix);
+            if (request == VIDIOC_S_FMT) {
+                dev->pix = fmt->fmt.pix;
+                dev->crop.left = dev->crop.top = 0;
+                dev->crop.width = dev->pix.width;
+                dev->crop.height = dev->pix.height;
+            }
+        }
+        return 0;
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* the crop is kept within the frame: */
+static int
+FakeCrop(FakeDevice *dev, int type, struct v4l2_rect *r)
+{
+    if (type != V4L2_BUF_TYPE_VIDEO_OUTPUT) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    r->left   = MIN(MAX(r->left, 0), (int)dev->pix.width - 16);
+    r->top    = MIN(MAX(r->top, 0), (int)dev->pix.height - 16);
+    r->width  = MIN(MAX(r->width, 16), dev->pix.width - r->left);
+    r->height = MIN(MAX(r->height, 16), dev->pix.height - r->top);
+    dev->crop = *r;
+
+    return 0;
+}
+
+/* whether buffers given up by dev are still mapped: */
+static Bool
+FakeOrphaned(FakeDevice *dev)
+{
+    int i;
+
+    for (i = 0; i < FAKE_MAX_ORPHANS; i++) {
+        if (fakeOrphans[i].mem && (fakeOrphans[i].dev == dev))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* free the buffers of dev, or leave those still mapped to their munmap: */
+static void
+FakeFreeBufs(FakeDevice *dev)
+{
+    int i, j;
+
+    for (i = 0; i < dev->nbufs; i++) {
+        if (dev->bufs[i].maps) {
+            for (j = 0; j < FAKE_MAX_ORPHANS; j++) {
+                if (!fakeOrphans[j].mem)
+                    break;
+            }
+            /* more mappings than there can be buffers leak: */
+            if (j < FAKE_MAX_ORPHANS) {
+                fakeOrphans[j].mem = dev->bufs[i].mem;
+                fakeOrphans[j].maps = dev->bufs[i].maps;
+                fakeOrphans[j].dev = dev;
+            }
+        } else {
+            free(dev->bufs[i].mem);
+        }
+        dev->bufs[i].mem = NULL;
+        dev->bufs[i].maps = 0;
+    }
+    dev->nbufs = 0;
+}
+
+static int
+FakeReqbufs(FakeDevice *dev, struct v4l2_requestbuffers *req)
+{
+    int i;
+
+    if ((req->memory != V4L2_MEMORY_MMAP) || dev->streaming) {
+        errno = dev->streaming ? EBUSY : EINVAL;
+        return -1;
+    }
+
+    if (req->count == 0) {
+        FakeFreeBufs(dev);
+        return 0;
+    }
+
+    /* the old buffers have to be released first: */
+    if (dev->nbufs || FakeOrphaned(dev)) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    dev->nbufs = MIN(req->count, FAKE_MAX_BUFS);
+    for (i = 0; i < dev->nbufs; i++) {
+        dev->bufs[i].mem = calloc(1, dev->pix.sizeimage);
+        dev->bufs[i].length = dev->pix.sizeimage;
+        dev->bufs[i].maps = 0;
+        dev->bufs[i].queued = FALSE;
+        if (!dev->bufs[i].mem) {
+            dev->nbufs = i;
+            break;
+        }
+    }
+
+    req->count = dev->nbufs;
+    return 0;
+}
+
+static int
+FakeBuf(FakeDevice *dev, unsigned long request, struct v4l2_buffer *buf)
+{
+    struct timespec ts;
+    int i;
+
+    if (request == VIDIOC_DQBUF) {
+        /* everything queued is shown immediately, return the oldest: */
+        int oldest = -1;
+        for (i = 0; i < dev->nbufs; i++) {
+            if (dev->bufs[i].queued && ((oldest < 0) ||
+                    (dev->bufs[i].sequence < dev->bufs[oldest].sequence)))
+                oldest = i;
+        }
+        if ((oldest < 0) || !dev->streaming) {
+            errno = EAGAIN;
+            return -1;
+        }
+        i = oldest;
+        dev->bufs[i].queued = FALSE;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        dev->bufs[i].timestamp.tv_sec  = ts.tv_sec;
+        dev->bufs[i].timestamp.tv_usec = ts.tv_nsec / 1000;
+    } else {
+        i = buf->index;
+        if ((i < 0) || (i >= dev->nbufs)) {
+            errno = EINVAL;
+            return -1;
+        }
+        if (request == VIDIOC_QBUF) {
+            if (dev->bufs[i].queued) {
+                errno = EINVAL;
+                return -1;
+            }
+            dev->bufs[i].queued = TRUE;
+            dev->bufs[i].sequence = dev->sequence++;
+        }
+    }
+
+    buf->index     = i;
+    buf->memory    = V4L2_MEMORY_MMAP;
+    buf->length    = dev->bufs[i].length;
+    buf->bytesused = dev->bufs[i].length;
+    buf->m.offset  = i * dev->bufs[i].length;
+    buf->sequence  = dev->bufs[i].sequence;
+    buf->timestamp = dev->bufs[i].timestamp;
+    buf->flags     = V4L2_BUF_FLAG_MAPPED | V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC |
+            (dev->bufs[i].queued ? V4L2_BUF_FLAG_QUEUED : 0);
+    return 0;
+}
+
+static int
+FakeCtrl(FakeDevice *dev, unsigned long request, void *arg)
+{
+    int i;
+
+    if (request == VIDIOC_QUERYCTRL) {
+        struct v4l2_queryctrl *q = arg;
+        CARD32 id = q->id & ~V4L2_CTRL_FLAG_NEXT_CTRL;
+        for (i = 0; i < NCTRLS; i++) {
+            if ((q->id & V4L2_CTRL_FLAG_NEXT_CTRL) ?
+                    (fakeCtrls[i].id > id) : (fakeCtrls[i].id == id))
+                break;
+        }
+        if (i == NCTRLS) {
+            errno = EINVAL;
+            return -1;
+        }
+        memset(q, 0x00, sizeof(*q));
+        q->id = fakeCtrls[i].id;
+        q->type = V4L2_CTRL_TYPE_INTEGER;
+        strncpy((char *)q->name, fakeCtrls[i].name, sizeof(q->name) - 1);
+        q->maximum = 255;
+        q->step = 1;
+        q->default_value = 128;
+        return 0;
+    } else {
+        struct v4l2_control *c = arg;
+        for (i = 0; i < NCTRLS; i++)
+            if (fakeCtrls[i].id == c->id)
+                break;
+        if (i == NCTRLS) {
+            errno = EINVAL;
+            return -1;
+        }
+        if (request == VIDIOC_G_CTRL)
+            c->value = dev->ctrls[i];
+        else
+            dev->ctrls[i] = MIN(MAX(c->value, 0), 255);
+        return 0;
+    }
+}
+
+static int
+FakeIoctlLocked(FakeDevice *dev, unsigned long request, void *arg)
+{
+    /* an output unit has no overlay: */
+    if (dev->output && ((request == VIDIOC_G_FBUF) ||
+            (request == VIDIOC_S_FBUF) || (request == VIDIOC_OVERLAY))) {
+        errno = ENOTTY;
+        return -1;
+    }
+
+    switch (request) {
+    case VIDIOC_QUERYCAP: {
+        struct v4l2_capability *cap = arg;
+        memset(cap, 0x00, sizeof(*cap));
+        strcpy((char *)cap->driver, "v4l2-fake");
+        strcpy((char *)cap->card, dev->output ? "Fake output" : "Fake overlay");
+        snprintf((char *)cap->bus_info, sizeof(cap->bus_info),
+                FAKE_PREFIX "%d", dev->unit);
+        cap->version = 1;
+        cap->capabilities = V4L2_CAP_VIDEO_OUTPUT | V4L2_CAP_STREAMING;
+        if (!dev->output) {
+            cap->capabilities |= V4L2_CAP_VIDEO_OUTPUT_OVERLAY |
+                    V4L2_CAP_VIDEO_OVERLAY;
+        }
+        return 0;
+    }
+    case VIDIOC_G_FBUF:
+        *(struct v4l2_framebuffer *)arg = dev->fbuf;
+        return 0;
+    case VIDIOC_S_FBUF:
+        dev->fbuf.flags = ((struct v4l2_framebuffer *)arg)->flags;
+        return 0;
+    case VIDIOC_G_FMT:
+    case VIDIOC_S_FMT:
+    case VIDIOC_TRY_FMT:
+        return FakeFmt(dev, request, arg);
+    case VIDIOC_ENUM_FMT: {
+        struct v4l2_fmtdesc *desc = arg;
+        if ((desc->type != V4L2_BUF_TYPE_VIDEO_OUTPUT) ||
+                (desc->index >= (dev->output ? NFORMATS : NFORMATS - 1))) {
+            errno = EINVAL;
+            return -1;
+        }
+        desc->pixelformat = fakeFormats[desc->index];
+        return 0;
+    }
+    case VIDIOC_QUERYCTRL:
+    case VIDIOC_G_CTRL:
+    case VIDIOC_S_CTRL:
+        return FakeCtrl(dev, request, arg);
+    case VIDIOC_REQBUFS:
+        return FakeReqbufs(dev, arg);
+    case VIDIOC_QUERYBUF:
+    case VIDIOC_QBUF:
+    case VIDIOC_DQBUF:
+        return FakeBuf(dev, request, arg);
+    case VIDIOC_STREAMON:
+    case VIDIOC_STREAMOFF:
+        dev->streaming = (request == VIDIOC_STREAMON);
+        if (!dev->streaming) {
+            int i;
+            for (i = 0; i < dev->nbufs; i++)
+                dev->bufs[i].queued = FALSE;
+        }
+        return 0;
+    case VIDIOC_OVERLAY:
+        dev->overlay = !!*(int *)arg;
+        return 0;
+#ifdef VIDIOC_S_SELECTION
+    case VIDIOC_S_SELECTION: {
+        struct v4l2_selection *sel = arg;
+        if (sel->target != V4L2_SEL_TGT_CROP) {
+            errno = EINVAL;
+            return -1;
+        }
+        return FakeCrop(dev, sel->type, &sel->r);
+    }
+#endif
+    case VIDIOC_S_CROP: {
+        struct v4l2_crop *crop = arg;
+        return FakeCrop(dev, crop->type, &crop->c);
+    }
+    default:
+        errno = ENOTTY;
+        return -1;
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+
+static int
+FakeOpen(const char *name, int flags)
+{
+    int i, unit = 0, latency = 0;
+    Bool output = (strstr(name, FAKE_OUTPUT) != NULL);
+
+    sscanf(name + strlen(FAKE_PREFIX), "%d@%d", &unit, &latency);
+    if ((unit < 0) || (unit >= FAKE_MAX_UNITS)) {
+        errno = ENODEV;
+        return -1;
+    }
+
+    pthread_mutex_lock(&fakeLock);
+    for (i = 0; i < FAKE_MAX_FDS; i++) {
+        if (!fakeFiles[i].dev) {
+            FakeDevice *dev = &fakes[unit];
+            if (!dev->initialized)
+                FakeInit(dev, unit, output);
+            dev->users++;
+            fakeFiles[i].dev = dev;
+            fakeFiles[i].latency = latency;
+            pthread_mutex_unlock(&fakeLock);
+            return FAKE_FD_BASE + i;
+        }
+    }
+    pthread_mutex_unlock(&fakeLock);
+
+    errno = EMFILE;
+    return -1;
+}
+
+static int
+FakeClose(int fd)
+{
+    FakeFile *file;
+    int i;
+
+    pthread_mutex_lock(&fakeLock);
+    file = FakeLookup(fd);
+    if (file) {
+        FakeDevice *dev = file->dev;
+        if (--dev->users == 0) {
+            FakeFreeBufs(dev);
+            dev->streaming = FALSE;
+            for (i = 0; i < FAKE_MAX_ORPHANS; i++) {
+                if (fakeOrphans[i].dev == dev)
+                    fakeOrphans[i].dev = NULL;
+            }
+        }
+        file->dev = NULL;
+    }
+    pthread_mutex_unlock(&fakeLock);
+
+    if (!file) {
+        errno = EBADF;
+        return -1;
+    }
+    return 0;
+}
+
+static int
+FakeIoctl(int fd, unsigned long request, void *arg)
+{
+    FakeFile *file;
+    int ret, latency = 0;
+
+    pthread_mutex_lock(&fakeLock);
+    file = FakeLookup(fd);
+    if (file) {
+        latency = file->latency;
+        ret = FakeIoctlLocked(file->dev, request, arg);
+    } else {
+        errno = EBADF;
+        ret = -1;
+    }
+    pthread_mutex_unlock(&fakeLock);
+
+    if (latency)
+        usleep(latency);
+
+    return ret;
+}
+
+static void *
+FakeMmap(int fd, size_t length, int prot, off_t offset)
+{
+    FakeFile *file;
+    void *mem = MAP_FAILED;
+
+    pthread_mutex_lock(&fakeLock);
+    file = FakeLookup(fd);
+    if (file && file->dev->nbufs) {
+        FakeDevice *dev = file->dev;
+        int i = offset / dev->bufs[0].length;
+        if ((i < dev->nbufs) && (length <= dev->bufs[i].length)) {
+            mem = dev->bufs[i].mem;
+            dev->bufs[i].maps++;
+        }
+    }
+    pthread_mutex_unlock(&fakeLock);
+
+    if (mem == MAP_FAILED)
+        errno = EINVAL;
+    return mem;
+}
+
+static int
+FakeMunmap(void *addr, size_t length)
+{
+    int i, j;
+
+    pthread_mutex_lock(&fakeLock);
+    for (i = 0; i < FAKE_MAX_UNITS; i++) {
+        FakeDevice *dev = &fakes[i];
+        for (j = 0; j < dev->nbufs; j++) {
+            if ((dev->bufs[j].mem == addr) && dev->bufs[j].maps) {
+                dev->bufs[j].maps--;
+                pthread_mutex_unlock(&fakeLock);
+                return 0;
+            }
+        }
+    }
+    for (i = 0; i < FAKE_MAX_ORPHANS; i++) {
+        if (fakeOrphans[i].mem == addr) {
+            if (--fakeOrphans[i].maps == 0) {
+                free(fakeOrphans[i].mem);
+                fakeOrphans[i].mem = NULL;
+                fakeOrphans[i].dev = NULL;
+            }
+            pthread_mutex_unlock(&fakeLock);
+            return 0;
+        }
+    }
+    pthread_mutex_unlock(&fakeLock);
+
+    errno = EINVAL;
+    return -1;
+}
+
+const V4L2Backend v4l2FakeBackend = {
+        .prefix = FAKE_PREFIX,
+        .open   = FakeOpen,
+        .close  = FakeClose,
+        .ioctl  = FakeIoctl,
+        .mmap   = FakeMmap,
+        .munmap = FakeMunmap,
+};
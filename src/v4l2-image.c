@@ -0,0 +1,1221 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: Xv images, optionally through a mem2mem scaler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+#include "xf86.h"
+#include "xf86_OSproc.h"
+#include "xf86xv.h"
+#include "fourcc.h"
+#include "v4l2.h"
+#include "v4l2-scale.h"
+#include "v4l2-convert.h"
+
+/* Client frames (XvPutImage) are copied into buffers of the overlay
+ * device's video output queue.  If a "Scaler" is configured, frames the
+ * overlay can't take as they are (format not supported, or the window not
+ * the size of the source) are first queued to the scaler, a mem2mem
+ * device, whose capture buffers are then queued to the overlay device as
+ * dmabufs, so the converted frame is never touched by the CPU:
+ *
+ *   client --copy--> scaler OUTPUT --m2m--> scaler CAPTURE --dmabuf--> overlay
+ *
+ * The scaler is run synchronously, one frame at a time.
+ *
+ * Without a scaler, frames go to the overlay at their own size, for it to
+ * scale.  If it turns out it can't (see V4L2ImageSoftScale()), they are
+ * scaled to the size of the window in software, see v4l2-scale.c.
+ *
+ * If the video is composited by the CPU (see V4L2SetupComposite()), the
+ * device isn't involved at all: frames are scaled to the size of the
+ * window into memory of our own, which the compositor converts from.
+ * Ports of the mosaic (see v4l2-mosaic.c) hand theirs over the same way.
+ */
+
+#define V4L2_IMAGE_BUFS   3
+
+typedef struct {
+    PortPrivPtr                 pPPriv;     /* for the statistics */
+    const V4L2Backend           *backend;
+    int                         fd;
+    int                         type;       /* V4L2_BUF_TYPE_* */
+    int                         memory;     /* V4L2_MEMORY_* */
+    struct v4l2_pix_format      pix;        /* as set */
+
+    int                         nbufs;
+    struct {
+        void                    *mem;       /* if MMAP */
+        size_t                  length;
+        int                     dmabuf;     /* exported, or -1 */
+        Bool                    queued;
+        uint64_t                submitted;  /* V4L2StatsNow(), of the */
+        uint64_t                queuedAt;   /* .. image and the QBUF, */
+        uint64_t                due;        /* .. and XV_PRESENT_TIME */
+    } bufs[V4L2_IMAGE_BUFS];
+    Bool                        streaming;
+
+    /* the buffer queued last, to show again after a STREAMOFF, or -1: */
+    int                         last;
+    int                         lastBytes, lastDmabuf;
+
+    /* the overlay's: when frames are shown goes to the statistics, and
+     * how long that takes after the QBUF, smoothed, to XV_PRESENT_TIME
+     */
+    Bool                        timed;
+    unsigned long               showUsec;
+} V4L2Queue;
+
+struct _V4L2Image {
+    /* what the queues are set up for: */
+    int                         id;
+    short                       src_w, src_h, drw_w, drw_h;
+    Bool                        scaled;
+    Bool                        dmabuf;     /* else the CPU copies */
+    Bool                        soft;       /* scaled by the CPU */
+
+    /* images the overlay turned out not to be able to scale: */
+    int                         softId;
+    short                       soft_w, soft_h;
+
+    V4L2Queue                   display;    /* overlay device output */
+
+    int                         scalerFd;
+    V4L2Queue                   src, dst;   /* scaler output, capture */
+
+    /* an overlay buffer held back until XV_PRESENT_TIME, or -1: */
+    int                         held;
+    int                         heldBytes, heldDmabuf;
+    OsTimerPtr                  timer;
+
+    /* composited, the frame last handed to the compositor: */
+    V4L2ScaleImage              frame;
+    uint8_t                     *frameMem;
+    size_t                      frameSize;
+};
+
+static const struct {
+    int                         id;
+    CARD32                      fourcc;
+    Bool                        planar;
+    int                         scale;      /* V4L2_SCALE_* */
+} imageFormats[] = {
+        { FOURCC_YUY2, V4L2_PIX_FMT_YUYV,   FALSE, V4L2_SCALE_YUYV },
+        { FOURCC_UYVY, V4L2_PIX_FMT_UYVY,   FALSE, V4L2_SCALE_UYVY },
+        { FOURCC_I420, V4L2_PIX_FMT_YUV420, TRUE,  V4L2_SCALE_YUV420 },
+        { FOURCC_YV12, V4L2_PIX_FMT_YVU420, TRUE,  V4L2_SCALE_YUV420 },
+};
+
+static const XF86ImageRec imageRecs[] = {
+        XVIMAGE_YUY2,
+        XVIMAGE_UYVY,
+        XVIMAGE_I420,
+        XVIMAGE_YV12,
+};
+
+#define NUM_IMAGE_FORMATS (sizeof(imageFormats) / sizeof(imageFormats[0]))
+
+/* what the scaler takes, see V4L2ImageInit(): */
+static const V4L2Backend *scalerBackend = NULL;
+static Bool scalerMplane = FALSE;
+static int nScalerFormats = 0;
+static CARD32 scalerFormats[V4L2_MAX_FORMATS];
+
+/* for software scaling: */
+static int scaleThreads = 1;
+
+/* ---------------------------------------------------------------------- */
+
+static int
+FormatIndex(int id)
+{
+    int i;
+
+    for (i = 0; i < NUM_IMAGE_FORMATS; i++)
+        if (imageFormats[i].id == id)
+            return i;
+
+    return -1;
+}
+
+static Bool
+HasFormat(const CARD32 *formats, int n, CARD32 fourcc)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        if (formats[i] == fourcc)
+            return TRUE;
+
+    return FALSE;
+}
+
+static inline Bool
+IsMplane(int type)
+{
+    return (type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE) ||
+            (type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE);
+}
+
+/* ioctls on behalf of a port are counted in its statistics: */
+static int
+QueueIoctl(V4L2Queue *q, unsigned long request, void *arg)
+{
+    uint64_t start = V4L2StatsNow();
+    int ret = q->backend->ioctl(q->fd, request, arg);
+    unsigned long usec = V4L2StatsNow() - start;
+    V4L2StatsIoctl(&q->pPPriv->stats, usec);
+    V4L2_TRACE(IOCTL, q->pPPriv->nr, request, ret, usec, 0);
+    return ret;
+}
+
+static void
+QueueInit(V4L2Queue *q, PortPrivPtr pPPriv, const V4L2Backend *backend,
+        int fd, int type)
+{
+    int i;
+
+    memset(q, 0x00, sizeof(*q));
+    q->pPPriv = pPPriv;
+    q->backend = backend;
+    q->fd = fd;
+    q->type = type;
+    q->last = -1;
+
+    for (i = 0; i < V4L2_IMAGE_BUFS; i++)
+        q->bufs[i].dmabuf = -1;
+}
+
+/* stop streaming, but keep the format and buffers: */
+static void
+QueueStreamOff(V4L2Queue *q)
+{
+    int i, type = q->type;
+
+    if (!q->streaming)
+        return;
+
+    QueueIoctl(q, VIDIOC_STREAMOFF, &type);
+    q->streaming = FALSE;
+
+    for (i = 0; i < q->nbufs; i++) {
+        q->bufs[i].queued = FALSE;
+        q->bufs[i].submitted = q->bufs[i].due = 0;
+    }
+}
+
+/* only single plane formats are used, also with the multi-planar API: */
+static int
+QueueSetFormat(V4L2Queue *q, CARD32 fourcc, int width, int height)
+{
+    struct v4l2_format format;
+
+    memset(&format, 0x00, sizeof(format));
+    format.type = q->type;
+
+    if (IsMplane(q->type)) {
+        format.fmt.pix_mp.width = width;
+        format.fmt.pix_mp.height = height;
+        format.fmt.pix_mp.pixelformat = fourcc;
+        format.fmt.pix_mp.field = V4L2_FIELD_NONE;
+        format.fmt.pix_mp.num_planes = 1;
+    } else {
+        format.fmt.pix.width = width;
+        format.fmt.pix.height = height;
+        format.fmt.pix.pixelformat = fourcc;
+        format.fmt.pix.field = V4L2_FIELD_NONE;
+    }
+
+    if (-1 == QueueIoctl(q, VIDIOC_S_FMT, &format)) {
+        perror("ioctl VIDIOC_S_FMT");
+        return -1;
+    }
+
+    if (IsMplane(q->type)) {
+        if (format.fmt.pix_mp.num_planes != 1) {
+            DEBUG("Xv/PI: %d planes not supported", format.fmt.pix_mp.num_planes);
+            return -1;
+        }
+        memset(&q->pix, 0x00, sizeof(q->pix));
+        q->pix.width = format.fmt.pix_mp.width;
+        q->pix.height = format.fmt.pix_mp.height;
+        q->pix.pixelformat = format.fmt.pix_mp.pixelformat;
+        q->pix.bytesperline = format.fmt.pix_mp.plane_fmt[0].bytesperline;
+        q->pix.sizeimage = format.fmt.pix_mp.plane_fmt[0].sizeimage;
+    } else {
+        q->pix = format.fmt.pix;
+    }
+
+    return 0;
+}
+
+static void
+QueueBufInit(V4L2Queue *q, struct v4l2_buffer *buf, struct v4l2_plane *plane,
+        int index)
+{
+    memset(buf, 0x00, sizeof(*buf));
+    buf->type = q->type;
+    buf->memory = q->memory;
+    buf->index = index;
+
+    if (IsMplane(q->type)) {
+        memset(plane, 0x00, sizeof(*plane));
+        buf->m.planes = plane;
+        buf->length = 1;
+    }
+}
+
+static void
+QueueFree(V4L2Queue *q)
+{
+    struct v4l2_requestbuffers req;
+    int i;
+
+    QueueStreamOff(q);
+
+    for (i = 0; i < q->nbufs; i++) {
+        if (q->bufs[i].mem)
+            q->backend->munmap(q->bufs[i].mem, q->bufs[i].length);
+        if (q->bufs[i].dmabuf != -1)
+            close(q->bufs[i].dmabuf);
+        q->bufs[i].mem = NULL;
+        q->bufs[i].dmabuf = -1;
+        q->bufs[i].queued = FALSE;
+    }
+
+    if (q->nbufs) {
+        memset(&req, 0x00, sizeof(req));
+        req.type = q->type;
+        req.memory = q->memory;
+        req.count = 0;
+        QueueIoctl(q, VIDIOC_REQBUFS, &req);
+    }
+
+    q->nbufs = 0;
+    q->last = -1;
+}
+
+static int
+QueueAlloc(V4L2Queue *q, int memory, int count)
+{
+    struct v4l2_requestbuffers req;
+    int i;
+
+    memset(&req, 0x00, sizeof(req));
+    req.type = q->type;
+    req.memory = memory;
+    req.count = count;
+
+    if (-1 == QueueIoctl(q, VIDIOC_REQBUFS, &req)) {
+        DEBUG("Xv/PI: VIDIOC_REQBUFS memory=%d failed: %s", memory, strerror(errno));
+        return -1;
+    }
+
+    q->memory = memory;
+    q->nbufs = MIN(req.count, V4L2_IMAGE_BUFS);
+    if (q->nbufs < 2) {
+        QueueFree(q);
+        return -1;
+    }
+
+    if (memory != V4L2_MEMORY_MMAP)
+        return 0;
+
+    for (i = 0; i < q->nbufs; i++) {
+        struct v4l2_buffer buf;
+        struct v4l2_plane plane;
+        off_t offset;
+
+        QueueBufInit(q, &buf, &plane, i);
+        if (-1 == QueueIoctl(q, VIDIOC_QUERYBUF, &buf)) {
+            perror("ioctl VIDIOC_QUERYBUF");
+            QueueFree(q);
+            return -1;
+        }
+
+        if (IsMplane(q->type)) {
+            q->bufs[i].length = plane.length;
+            offset = plane.m.mem_offset;
+        } else {
+            q->bufs[i].length = buf.length;
+            offset = buf.m.offset;
+        }
+
+        q->bufs[i].mem = q->backend->mmap(q->fd, q->bufs[i].length,
+                PROT_READ | PROT_WRITE, offset);
+        if (q->bufs[i].mem == MAP_FAILED) {
+            perror("mmap");
+            q->bufs[i].mem = NULL;
+            QueueFree(q);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* hand out the buffers of an MMAP queue as dmabufs: */
+static int
+QueueExport(V4L2Queue *q)
+{
+#ifdef VIDIOC_EXPBUF
+    int i;
+
+    for (i = 0; i < q->nbufs; i++) {
+        struct v4l2_exportbuffer exp;
+
+        memset(&exp, 0x00, sizeof(exp));
+        exp.type = q->type;
+        exp.index = i;
+        exp.flags = O_CLOEXEC | O_RDWR;
+
+        if (-1 == QueueIoctl(q, VIDIOC_EXPBUF, &exp)) {
+            DEBUG("Xv/PI: VIDIOC_EXPBUF failed: %s", strerror(errno));
+            return -1;
+        }
+
+        q->bufs[i].dmabuf = exp.fd;
+    }
+
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+static int
+QueueBuf(V4L2Queue *q, int index, int bytesused, int dmabuf)
+{
+    struct v4l2_buffer buf;
+    struct v4l2_plane plane;
+
+    QueueBufInit(q, &buf, &plane, index);
+
+    /* when the image came, for devices that pass timestamps on (as
+     * scalers do, with V4L2_BUF_FLAG_TIMESTAMP_COPY):
+     */
+    buf.timestamp.tv_sec = q->bufs[index].submitted / 1000000;
+    buf.timestamp.tv_usec = q->bufs[index].submitted % 1000000;
+
+    if (IsMplane(q->type)) {
+        plane.bytesused = bytesused;
+        plane.length = q->pix.sizeimage;
+#ifdef VIDIOC_EXPBUF
+        if (q->memory == V4L2_MEMORY_DMABUF)
+            plane.m.fd = dmabuf;
+#endif
+    } else {
+        buf.bytesused = bytesused;
+        buf.length = q->pix.sizeimage;
+#ifdef VIDIOC_EXPBUF
+        if (q->memory == V4L2_MEMORY_DMABUF)
+            buf.m.fd = dmabuf;
+#endif
+    }
+
+    if (-1 == QueueIoctl(q, VIDIOC_QBUF, &buf)) {
+        perror("ioctl VIDIOC_QBUF");
+        return -1;
+    }
+
+    q->bufs[index].queued = TRUE;
+    q->bufs[index].queuedAt = V4L2StatsNow();
+    q->last = index;
+    q->lastBytes = bytesused;
+    q->lastDmabuf = dmabuf;
+
+    if (!q->streaming) {
+        int type = q->type;
+        if (-1 == QueueIoctl(q, VIDIOC_STREAMON, &type)) {
+            perror("ioctl VIDIOC_STREAMON");
+            return -1;
+        }
+        q->streaming = TRUE;
+    }
+
+    return 0;
+}
+
+/* when an overlay buffer was shown, as the device timestamped it.  If it
+ * didn't, when it was dequeued is only later (the buffers are only taken
+ * back as they are needed), so the frame is counted but not timed:
+ */
+static void
+QueueTimeShown(V4L2Queue *q, const struct v4l2_buffer *buf)
+{
+    uint64_t shown = V4L2StatsNow();
+    uint64_t submitted = q->bufs[buf->index].submitted;
+    uint64_t queuedAt = q->bufs[buf->index].queuedAt;
+    uint64_t due = q->bufs[buf->index].due;
+    Bool stamped = FALSE;
+
+    if (!submitted)
+        return;
+
+#ifdef V4L2_BUF_FLAG_TIMESTAMP_MASK
+    if (((buf->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) ==
+            V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) &&
+            (buf->timestamp.tv_sec || buf->timestamp.tv_usec)) {
+        uint64_t t = ((uint64_t)buf->timestamp.tv_sec * 1000000) +
+                buf->timestamp.tv_usec;
+        if ((t >= queuedAt) && (t <= shown)) {
+            shown = t;
+            stamped = TRUE;
+        }
+    }
+#endif
+
+    V4L2_TRACE(PRESENT, q->pPPriv->nr, buf->index, queuedAt - submitted,
+            shown - queuedAt, stamped);
+
+    /* only timestamps tell how soon the device shows what is queued: */
+    if (stamped) {
+        V4L2StatsPresent(&q->pPPriv->stats, due ? due : submitted, shown);
+        q->showUsec = q->showUsec ?
+                ((q->showUsec * 7) + (shown - queuedAt)) / 8 :
+                (shown - queuedAt);
+    } else {
+        V4L2_STAT_ADD(q->pPPriv->stats.unstamped, 1);
+    }
+
+    q->bufs[buf->index].submitted = 0;
+    q->bufs[buf->index].due = 0;
+}
+
+static int
+DequeueBuf(V4L2Queue *q)
+{
+    struct v4l2_buffer buf;
+    struct v4l2_plane plane;
+
+    QueueBufInit(q, &buf, &plane, 0);
+
+    if (-1 == QueueIoctl(q, VIDIOC_DQBUF, &buf)) {
+        DEBUG("Xv/PI: VIDIOC_DQBUF failed: %s", strerror(errno));
+        return -1;
+    }
+
+    q->bufs[buf.index].queued = FALSE;
+
+    if (q->timed)
+        QueueTimeShown(q, &buf);
+
+    return buf.index;
+}
+
+/* a buffer not queued, waiting for the device to return one if need be
+ * (for the overlay, until the next frame is shown):
+ */
+static int
+QueueGetFree(V4L2Queue *q)
+{
+    int i;
+
+    for (i = 0; i < q->nbufs; i++)
+        if (!q->bufs[i].queued)
+            return i;
+
+    return DequeueBuf(q);
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* the source rectangle of a client image, laid out as described by
+ * V4L2ImageAttributes():
+ */
+static void
+ClientImage(V4L2ScaleImage *img, int fmt, const unsigned char *buf,
+        int width, int height, int src_x, int src_y, int src_w, int src_h)
+{
+    int w = (width + 1) & ~1, h = (height + 1) & ~1;
+    int x = src_x & ~1;
+
+    memset(img, 0x00, sizeof(*img));
+    img->width = src_w;
+    img->height = src_h;
+
+    if (!imageFormats[fmt].planar) {
+        img->format = imageFormats[fmt].scale;
+        img->strides[0] = w * 2;
+        img->planes[0] = (uint8_t *)buf + (src_y * img->strides[0]) + (x * 2);
+    } else {
+        int y = src_y & ~1;
+        int pitch = (w + 3) & ~3, pitch2 = ((w >> 1) + 3) & ~3;
+
+        /* the chroma planes are in the same order (U, V for I420, and V,
+         * U for YV12) in client images and in buffers, so they are just
+         * planes 1 and 2 either way:
+         */
+        img->format = V4L2_SCALE_YUV420;
+        img->strides[0] = pitch;
+        img->strides[1] = img->strides[2] = pitch2;
+        img->planes[0] = (uint8_t *)buf + (y * pitch) + x;
+        img->planes[1] = (uint8_t *)buf + (pitch * h) +
+                ((y >> 1) * pitch2) + (x >> 1);
+        img->planes[2] = img->planes[1] + (pitch2 * (h >> 1));
+    }
+}
+
+/* .. and a buffer of a queue, in the same format: */
+static void
+BufferImage(V4L2ScaleImage *img, const V4L2Queue *q, void *mem, int fmt)
+{
+    int bpl = q->pix.bytesperline;
+
+    memset(img, 0x00, sizeof(*img));
+    img->format = imageFormats[fmt].scale;
+    img->width = q->pix.width;
+    img->height = q->pix.height;
+    img->strides[0] = bpl;
+    img->planes[0] = mem;
+
+    if (imageFormats[fmt].planar) {
+        img->strides[1] = img->strides[2] = bpl >> 1;
+        img->planes[1] = img->planes[0] + (bpl * q->pix.height);
+        img->planes[2] = img->planes[1] + ((bpl >> 1) * (q->pix.height >> 1));
+    }
+}
+
+static void
+CopyImage(V4L2ScaleImage *dst, const V4L2ScaleImage *src)
+{
+    int bytes = (src->format == V4L2_SCALE_YUV420) ? src->width : src->width * 2;
+    int y, plane;
+
+    for (y = 0; y < src->height; y++) {
+        memcpy(dst->planes[0] + (y * dst->strides[0]),
+                src->planes[0] + (y * src->strides[0]), bytes);
+    }
+
+    if (src->format != V4L2_SCALE_YUV420)
+        return;
+
+    for (plane = 1; plane < 3; plane++) {
+        for (y = 0; y < (src->height >> 1); y++) {
+            memcpy(dst->planes[plane] + (y * dst->strides[plane]),
+                    src->planes[plane] + (y * src->strides[plane]), bytes >> 1);
+        }
+    }
+}
+
+static void
+ImageRelease(V4L2Image *img)
+{
+    if (img->held != -1) {
+        TimerCancel(img->timer);
+        img->held = -1;
+    }
+    QueueFree(&img->display);
+    QueueFree(&img->src);
+    QueueFree(&img->dst);
+    img->id = 0;
+}
+
+static int
+ImageSetupDirect(V4L2Image *img, CARD32 fourcc)
+{
+    short w = img->soft ? img->drw_w : img->src_w;
+    short h = img->soft ? img->drw_h : img->src_h;
+
+    if (QueueSetFormat(&img->display, fourcc, w, h) ||
+            (img->display.pix.pixelformat != fourcc))
+        return -1;
+
+    V4L2SourceChanged(img->display.pPPriv);
+
+    return QueueAlloc(&img->display, V4L2_MEMORY_MMAP, V4L2_IMAGE_BUFS);
+}
+
+static int
+ImageSetupScaled(V4L2Image *img, const V4L2DeviceInfo *info, CARD32 fourcc)
+{
+    CARD32 out = info->nformats ? info->formats[0] : V4L2_PIX_FMT_UYVY;
+
+    if (QueueSetFormat(&img->src, fourcc, img->src_w, img->src_h) ||
+            (img->src.pix.pixelformat != fourcc) ||
+            QueueAlloc(&img->src, V4L2_MEMORY_MMAP, 2))
+        return -1;
+
+    /* the overlay's preferred format, at the size of the window: */
+    if (QueueSetFormat(&img->dst, out, img->drw_w, img->drw_h) ||
+            QueueAlloc(&img->dst, V4L2_MEMORY_MMAP, V4L2_IMAGE_BUFS))
+        return -1;
+
+    if (QueueSetFormat(&img->display, img->dst.pix.pixelformat,
+            img->dst.pix.width, img->dst.pix.height) ||
+            (img->display.pix.pixelformat != img->dst.pix.pixelformat))
+        return -1;
+
+    V4L2SourceChanged(img->display.pPPriv);
+
+    img->dmabuf = !QueueExport(&img->dst) &&
+            !QueueAlloc(&img->display, V4L2_MEMORY_DMABUF, img->dst.nbufs) &&
+            (img->display.nbufs == img->dst.nbufs);
+
+    if (!img->dmabuf) {
+        xf86Msg(X_WARNING, "v4l2: no dmabuf between scaler and overlay, "
+                "scaled frames are copied\n");
+        QueueFree(&img->display);
+        return QueueAlloc(&img->display, V4L2_MEMORY_MMAP, V4L2_IMAGE_BUFS);
+    }
+
+    return 0;
+}
+
+static int
+ImageOpenScaler(V4L2Image *img, PortPrivPtr pPPriv)
+{
+    if (img->scalerFd == -1) {
+        img->scalerFd = scalerBackend->open(config.scaler, O_RDWR);
+        if (img->scalerFd == -1) {
+            xf86Msg(X_WARNING, "v4l2: could not open scaler '%s'\n",
+                    config.scaler);
+            return -1;
+        }
+    }
+
+    QueueInit(&img->src, pPPriv, scalerBackend, img->scalerFd, scalerMplane ?
+            V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE : V4L2_BUF_TYPE_VIDEO_OUTPUT);
+    QueueInit(&img->dst, pPPriv, scalerBackend, img->scalerFd, scalerMplane ?
+            V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE : V4L2_BUF_TYPE_VIDEO_CAPTURE);
+
+    return 0;
+}
+
+/* run the frame in the first scaler output buffer through the scaler,
+ * into capture buffer out (both are idle in between frames):
+ */
+static int
+ImageScale(V4L2Image *img, int out)
+{
+    if (QueueBuf(&img->dst, out, 0, -1))
+        return -1;
+
+    if (QueueBuf(&img->src, 0, img->src.pix.sizeimage, -1)) {
+        /* nothing will be scaled into out, take it back: */
+        QueueStreamOff(&img->dst);
+        return -1;
+    }
+
+    /* a buffer left queued would never be queued again, take them back
+     * if the scaler doesn't return them:
+     */
+    out = DequeueBuf(&img->dst);
+    if (out < 0)
+        QueueStreamOff(&img->dst);
+
+    if (DequeueBuf(&img->src) < 0)
+        QueueStreamOff(&img->src);
+
+    return out;
+}
+
+/**
+ * Probe the scaler configured with the "Scaler" option, to know which
+ * image formats it can take.  Disables it if it isn't usable.  Without it,
+ * images are scaled in software if need be, by as many threads as CPUs.
+ */
+void
+V4L2ImageInit(void)
+{
+    struct v4l2_capability cap;
+    struct v4l2_fmtdesc desc;
+    CARD32 caps;
+    int fd;
+
+    scaleThreads = MAX(1, sysconf(_SC_NPROCESSORS_ONLN));
+
+    if (!config.scaler)
+        return;
+
+    scalerBackend = V4L2FindBackend(config.scaler);
+    fd = scalerBackend->open(config.scaler, O_RDWR);
+    if (fd == -1) {
+        xf86Msg(X_WARNING, "v4l2: could not open scaler '%s'\n", config.scaler);
+        config.scaler = NULL;
+        return;
+    }
+
+    memset(&cap, 0x00, sizeof(cap));
+    if (-1 == scalerBackend->ioctl(fd, VIDIOC_QUERYCAP, &cap))
+        cap.capabilities = 0;
+
+    caps = cap.capabilities;
+#ifdef V4L2_CAP_DEVICE_CAPS
+    if (caps & V4L2_CAP_DEVICE_CAPS)
+        caps = cap.device_caps;
+#endif
+
+    if (!(caps & (V4L2_CAP_VIDEO_M2M | V4L2_CAP_VIDEO_M2M_MPLANE)) ||
+            !(caps & V4L2_CAP_STREAMING)) {
+        xf86Msg(X_WARNING, "v4l2: '%s' is not a mem2mem device\n", config.scaler);
+        scalerBackend->close(fd);
+        config.scaler = NULL;
+        return;
+    }
+
+    scalerMplane = !(caps & V4L2_CAP_VIDEO_M2M);
+
+    memset(&desc, 0x00, sizeof(desc));
+    desc.type = scalerMplane ?
+            V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE : V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    while ((nScalerFormats < V4L2_MAX_FORMATS) &&
+            (0 == scalerBackend->ioctl(fd, VIDIOC_ENUM_FMT, &desc))) {
+        scalerFormats[nScalerFormats++] = desc.pixelformat;
+        desc.index++;
+    }
+
+    scalerBackend->close(fd);
+
+    xf86Msg(X_INFO, "v4l2: using %s (%s) to scale images, %d formats\n",
+            config.scaler, cap.card, nScalerFormats);
+}
+
+/**
+ * The image formats a port can show, either directly or through the
+ * scaler.  None if the device has no video output queue to show them on,
+ * unless they are composited, in which case all of them.
+ */
+int
+V4L2ImageFormats(const V4L2DeviceInfo *info, Bool composite,
+        XF86ImagePtr *pImages)
+{
+    XF86ImagePtr images;
+    int i, n = 0;
+
+    *pImages = NULL;
+
+    if (!composite && (!(info->capabilities & V4L2_CAP_VIDEO_OUTPUT) ||
+            !(info->capabilities & V4L2_CAP_STREAMING)))
+        return 0;
+
+    images = malloc(sizeof(imageRecs));
+    if (!images)
+        return 0;
+
+    for (i = 0; i < NUM_IMAGE_FORMATS; i++) {
+        CARD32 fourcc = imageFormats[i].fourcc;
+        if (composite || HasFormat(info->formats, info->nformats, fourcc) ||
+                (config.scaler &&
+                HasFormat(scalerFormats, nScalerFormats, fourcc))) {
+            images[n++] = imageRecs[i];
+        }
+    }
+
+    if (!n) {
+        free(images);
+        return 0;
+    }
+
+    *pImages = images;
+    return n;
+}
+
+/**
+ * Layout of client images, as in most Xv drivers: packed formats are two
+ * bytes per pixel, planar ones have a Y plane pitch of a multiple of 4, and
+ * chroma planes of half the width and height with the same alignment.
+ */
+int
+V4L2ImageAttributes(int id, unsigned short *w, unsigned short *h,
+        int *pitches, int *offsets)
+{
+    int fmt = FormatIndex(id);
+    int size, pitch, pitch2;
+
+    *w = MIN((*w + 1) & ~1, 2048);
+    *h = MIN(*h, 2048);
+
+    if (offsets)
+        offsets[0] = 0;
+
+    if ((fmt < 0) || !imageFormats[fmt].planar) {
+        size = *w * 2;
+        if (pitches)
+            pitches[0] = size;
+        return size * *h;
+    }
+
+    *h = (*h + 1) & ~1;
+    pitch = (*w + 3) & ~3;
+    pitch2 = ((*w >> 1) + 3) & ~3;
+    size = pitch * *h;
+
+    if (pitches) {
+        pitches[0] = pitch;
+        pitches[1] = pitches[2] = pitch2;
+    }
+    if (offsets) {
+        offsets[1] = size;
+        offsets[2] = size + (pitch2 * (*h >> 1));
+    }
+
+    return size + (2 * pitch2 * (*h >> 1));
+}
+
+static CARD32
+ImageHeldTimer(OsTimerPtr timer, CARD32 now, pointer arg)
+{
+    V4L2Image *img = arg;
+    int i = img->held;
+
+    img->held = -1;
+    if (i != -1)
+        QueueBuf(&img->display, i, img->heldBytes, img->heldDmabuf);
+
+    return 0;
+}
+
+/* queue overlay buffer i with the image submitted at the given time, or
+ * if the client asked for it to be shown later (XV_PRESENT_TIME), hold it
+ * until then.  Less how long the device takes to show what is queued, so
+ * it is shown at the vblank closest to that time, rather than the next
+ * one after it.  A held image that is replaced is dropped:
+ */
+static void
+ImageShow(PortPrivPtr pPPriv, V4L2Image *img, int i, int bytesused,
+        int dmabuf, uint64_t submitted)
+{
+    V4L2Queue *q = &img->display;
+    CARD32 when;
+
+    q->bufs[i].submitted = submitted;
+    q->bufs[i].due = 0;
+
+    if (pPPriv->presentTime) {
+        /* late or early, it is measured against when it was asked for: */
+        q->bufs[i].due = submitted + ((int64_t)(INT32)(pPPriv->presentTime -
+                GetTimeInMillis()) * 1000);
+        when = pPPriv->presentTime - ((q->showUsec + 500) / 1000);
+        pPPriv->presentTime = 0;
+
+        if ((INT32)(when - GetTimeInMillis()) > 0) {
+            V4L2_STAT_ADD(pPPriv->stats.held, 1);
+            img->held = i;
+            img->heldBytes = bytesused;
+            img->heldDmabuf = dmabuf;
+            img->timer = TimerSet(img->timer, TimerAbsolute, when,
+                    ImageHeldTimer, img);
+            return;
+        }
+    }
+
+    QueueBuf(q, i, bytesused, dmabuf);
+}
+
+/* hand a client image to the compositor, at the size of the window: */
+static int
+ImageComposite(PortPrivPtr pPPriv, V4L2Image *img, int fmt,
+        V4L2ScaleImage *from, short drw_w, short drw_h)
+{
+    V4L2ScaleImage *to = &img->frame;
+    int w = drw_w & ~1, h = drw_h & ~1;
+    size_t size = w * h * 2;
+
+    if ((w < 2) || (h < 2) || (from->width < 2) || (from->height < 2))
+        return Success;
+
+    if (size > img->frameSize) {
+        uint8_t *mem = realloc(img->frameMem, size);
+        if (!mem)
+            return BadAlloc;
+        img->frameMem = mem;
+        img->frameSize = size;
+    }
+
+    memset(to, 0x00, sizeof(*to));
+    to->format = from->format;
+    to->width = w;
+    to->height = h;
+    to->planes[0] = img->frameMem;
+
+    if (from->format != V4L2_SCALE_YUV420) {
+        to->strides[0] = w * 2;
+    } else {
+        /* the compositor takes U then V, YV12 has them the other way: */
+        if (imageFormats[fmt].id == FOURCC_YV12) {
+            uint8_t *plane = from->planes[1];
+            from->planes[1] = from->planes[2];
+            from->planes[2] = plane;
+        }
+        to->strides[0] = w;
+        to->strides[1] = to->strides[2] = w / 2;
+        to->planes[1] = to->planes[0] + (w * h);
+        to->planes[2] = to->planes[1] + (w * h / 4);
+    }
+
+    if ((from->width == w) && (from->height == h))
+        CopyImage(to, from);
+    else
+        V4L2Scale(from, to, scaleThreads);
+
+    if (pPPriv->mosaic) {
+        V4L2MosaicSetFrame(pPPriv, to);
+        return Success;
+    }
+
+    /* no colorimetry comes with Xv images, go by the usual convention: */
+    V4L2SetFrame(pPPriv, to, (from->height >= 720) ?
+            V4L2_MATRIX_BT709 : V4L2_MATRIX_BT601);
+
+    return Success;
+}
+
+/**
+ * Show a client image on the port's overlay.  The caller positions the
+ * window, at the size the image ends up with: the window if it went
+ * through the scaler, else the source rectangle (for the overlay to
+ * scale, if it can).
+ */
+int
+V4L2ImagePut(PortPrivPtr pPPriv, const V4L2Backend *backend, int fd,
+        const V4L2DeviceInfo *info, int id, const unsigned char *buf,
+        short width, short height, short src_x, short src_y,
+        short src_w, short src_h, short drw_w, short drw_h)
+{
+    V4L2Image *img = pPPriv->image;
+    int fmt = FormatIndex(id);
+    uint64_t submitted = V4L2StatsNow();
+    V4L2ScaleImage from, to;
+    V4L2Queue *q;
+    int i;
+
+    if (fmt < 0)
+        return BadMatch;
+
+    if (!img) {
+        img = calloc(1, sizeof(*img));
+        if (!img)
+            return BadAlloc;
+        img->scalerFd = -1;
+        img->held = -1;
+        pPPriv->image = img;
+    }
+
+    if (imageFormats[fmt].planar || pPPriv->composite || pPPriv->mosaic) {
+        src_w &= ~1;
+        src_h &= ~1;
+    }
+    if ((src_w <= 0) || (src_h <= 0) || (drw_w <= 0) || (drw_h <= 0))
+        return Success;
+
+    if (pPPriv->composite || pPPriv->mosaic) {
+        ClientImage(&from, fmt, buf, width, height, src_x, src_y, src_w, src_h);
+        return ImageComposite(pPPriv, img, fmt, &from, drw_w, drw_h);
+    }
+
+    if (img->held != -1) {
+        TimerCancel(img->timer);
+        img->held = -1;
+        V4L2_STAT_ADD(pPPriv->stats.dropped, 1);
+    }
+
+    /* (re)negotiate only if something changed: */
+    if ((img->id != id) || (img->src_w != src_w) || (img->src_h != src_h) ||
+            ((img->scaled || img->soft) &&
+            ((img->drw_w != drw_w) || (img->drw_h != drw_h)))) {
+        CARD32 fourcc = imageFormats[fmt].fourcc;
+        Bool direct = HasFormat(info->formats, info->nformats, fourcc);
+
+        ImageRelease(img);
+
+        img->src_w = src_w;
+        img->src_h = src_h;
+        img->drw_w = drw_w;
+        img->drw_h = drw_h;
+        QueueInit(&img->display, pPPriv, backend, fd,
+                V4L2_BUF_TYPE_VIDEO_OUTPUT);
+        img->display.timed = TRUE;
+
+        /* if there is a scaler, it's better at it than the overlay: */
+        img->scaled = config.scaler && (!direct ||
+                (src_w != drw_w) || (src_h != drw_h));
+        img->soft = !img->scaled && (img->softId == id) &&
+                (img->soft_w == src_w) && (img->soft_h == src_h) &&
+                ((src_w != drw_w) || (src_h != drw_h));
+
+        if (img->scaled) {
+            if (ImageOpenScaler(img, pPPriv) ||
+                    ImageSetupScaled(img, info, fourcc)) {
+                ImageRelease(img);
+                img->scaled = FALSE;
+            }
+        }
+
+        if (!img->scaled && (!direct || ImageSetupDirect(img, fourcc))) {
+            xf86Msg(X_WARNING, "v4l2: can't show %dx%d images of format "
+                    "%08x on %s\n", src_w, src_h, id, info->card);
+            ImageRelease(img);
+            return BadMatch;
+        }
+
+        img->id = id;
+
+        DEBUG("Xv/PI: %08x %dx%d -> %dx%d, %s", id, src_w, src_h, drw_w,
+                drw_h, img->soft ? "scaled in software" :
+                !img->scaled ? "direct" :
+                img->dmabuf ? "scaled, dmabuf" : "scaled, copied");
+    }
+
+    ClientImage(&from, fmt, buf, width, height, src_x, src_y, src_w, src_h);
+
+    if (!img->scaled) {
+        q = &img->display;
+        if ((i = QueueGetFree(q)) < 0)
+            return BadAlloc;
+        BufferImage(&to, q, q->bufs[i].mem, fmt);
+        if (img->soft)
+            V4L2Scale(&from, &to, scaleThreads);
+        else
+            CopyImage(&to, &from);
+        ImageShow(pPPriv, img, i, q->pix.sizeimage, -1, submitted);
+        return Success;
+    }
+
+    BufferImage(&to, &img->src, img->src.bufs[0].mem, fmt);
+    CopyImage(&to, &from);
+
+    if (img->dmabuf) {
+        /* scaler capture buffer i is overlay buffer i: */
+        if (((i = QueueGetFree(&img->display)) < 0) ||
+                ((i = ImageScale(img, i)) < 0))
+            return BadAlloc;
+        ImageShow(pPPriv, img, i, img->dst.pix.sizeimage,
+                img->dst.bufs[i].dmabuf, submitted);
+    } else {
+        int j;
+        if (((i = ImageScale(img, 0)) < 0) ||
+                ((j = QueueGetFree(&img->display)) < 0))
+            return BadAlloc;
+        memcpy(img->display.bufs[j].mem, img->dst.bufs[i].mem,
+                MIN(img->display.bufs[j].length, img->dst.bufs[i].length));
+        ImageShow(pPPriv, img, j, img->display.pix.sizeimage, -1,
+                submitted);
+    }
+
+    return Success;
+}
+
+/**
+ * Called when the overlay didn't take the window it was asked for, after
+ * showing an image.  If it was left to scale the image, have the image
+ * scaled in software instead, from the next V4L2ImagePut() on (until the
+ * format or size of the images changes).  Returns FALSE if that won't help.
+ */
+Bool
+V4L2ImageSoftScale(PortPrivPtr pPPriv)
+{
+    V4L2Image *img = pPPriv->image;
+
+    if (!img || !img->id || img->scaled || img->soft ||
+            ((img->src_w == img->drw_w) && (img->src_h == img->drw_h)) ||
+            (img->drw_w < 4) || (img->drw_h < 4) ||
+            (img->src_w < 4) || (img->src_h < 4))
+        return FALSE;
+
+    xf86Msg(X_INFO, "v4l2: overlay can't scale %dx%d to %dx%d, "
+            "scaling in software\n", img->src_w, img->src_h,
+            img->drw_w, img->drw_h);
+
+    img->softId = img->id;
+    img->soft_w = img->src_w;
+    img->soft_h = img->src_h;
+    ImageRelease(img);
+
+    return TRUE;
+}
+
+/**
+ * Stop showing images, and on shutdown (before the overlay device is
+ * closed) also let go of the scaler.
+ */
+void
+V4L2ImageStop(PortPrivPtr pPPriv, Bool shutdown)
+{
+    V4L2Image *img = pPPriv->image;
+
+    if (!img)
+        return;
+
+    ImageRelease(img);
+    V4L2SetFrame(pPPriv, NULL, 0);
+
+    if (shutdown) {
+        if (img->scalerFd != -1)
+            scalerBackend->close(img->scalerFd);
+        TimerFree(img->timer);
+        free(img->frameMem);
+        free(img);
+        pPPriv->image = NULL;
+    }
+}
+
+/**
+ * Stop the overlay fetching images while the window is clipped away (see
+ * V4L2SuspendOverlay()), but keep the queues as they are negotiated, for
+ * V4L2ImageResume() or the next V4L2ImagePut() to pick up from.  A held
+ * image is dropped.
+ */
+void
+V4L2ImageSuspend(PortPrivPtr pPPriv)
+{
+    V4L2Image *img = pPPriv->image;
+
+    if (!img)
+        return;
+
+    if (img->held != -1) {
+        TimerCancel(img->timer);
+        img->held = -1;
+        V4L2_STAT_ADD(pPPriv->stats.dropped, 1);
+    }
+
+    QueueStreamOff(&img->display);
+}
+
+/**
+ * Show the last image again once the window is back, unless a new one
+ * was put since it was suspended.
+ */
+void
+V4L2ImageResume(PortPrivPtr pPPriv)
+{
+    V4L2Image *img = pPPriv->image;
+    V4L2Queue *q;
+
+    if (!img || !img->id)
+        return;
+
+    q = &img->display;
+    if (!q->streaming && (q->last != -1))
+        QueueBuf(q, q->last, q->lastBytes, q->lastDmabuf);
+}
@@ -0,0 +1,668 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: many Xv ports on one overlay
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+#include "xf86.h"
+#include "xf86_OSproc.h"
+#include "xf86xv.h"
+#include "v4l2.h"
+#include "v4l2-scale.h"
+#include "v4l2-convert.h"
+#include "v4l2-tiles.h"
+
+/* With the Mosaic option, the overlay of one device is shared by several
+ * Xv ports (see V4L2Init()).  The overlay window covers the whole screen,
+ * and each port's frames, scaled to its window as composited ones are (see
+ * v4l2-image.c), are drawn into a screen sized YUYV buffer of the overlay's
+ * video output queue, within the port's clip.  The hole punched in the
+ * framebuffer (or the color key filled) is that of each port's clip, so
+ * together the union of them.
+ *
+ * Buffers are drawn 32x32 tile by tile (the tiles of v4l2-tiles.c).  Each
+ * output buffer has a bitmap of the tiles that changed since it was last
+ * drawn: a new frame marks the tiles of its port's clip, a clip that
+ * changes those of both the old and the new clip.  Once the server has
+ * handled the requests at hand (from the block handler), the first free
+ * buffer gets its changed tiles drawn and is queued, so that however many
+ * ports have a new frame, there is one buffer queued for all of them, and
+ * only their tiles are touched:
+ *
+ *   frame --> dirty[] of every buffer --> block handler --> QBUF
+ *
+ * A tile entirely within a clip box of a port (see V4L2TileMask) is copied
+ * from its frame, with a row kernel per format (see v4l2-convert.c), other
+ * tiles are filled black first, then the parts of the clips in them drawn.
+ * Frames go to even pixels on screen, for the chroma.
+ */
+
+#define V4L2_MOSAIC_BUFS        3
+#define V4L2_MOSAIC_RETRY_MSEC  5
+
+typedef struct {
+    PortPrivPtr                 pPPriv;
+    V4L2ScaleImage              frame;      /* none if 0 wide */
+    short                       x, y;       /* of the frame on screen */
+    RegionRec                   clip;
+    V4L2TileMask                mask;       /* tiles covered by clip */
+} V4L2MosaicPort;
+
+static struct {
+    const V4L2Backend           *backend;
+    int                         fd, flags;  /* fd's own O_* flags */
+    PortPrivPtr                 owner;      /* counts the ioctls */
+    ScreenPtr                   pScreen;
+
+    struct v4l2_pix_format      pix;        /* as set, screen sized */
+    int                         cols, rows, words;  /* of tiles */
+
+    int                         nbufs;
+    struct {
+        void                    *mem;
+        size_t                  length;
+        Bool                    queued;
+        uint32_t                *dirty;     /* tiles to draw, by row */
+    } bufs[V4L2_MOSAIC_BUFS];
+    Bool                        streaming;
+    Bool                        pending;    /* a buffer has tiles to draw */
+    Bool                        blockHandler;
+    OsTimerPtr                  timer;
+
+    V4L2MosaicPort              *ports;
+    int                         nports;
+} mosaic = { .fd = -1 };
+
+/* ---------------------------------------------------------------------- */
+
+static int
+MosaicIoctl(unsigned long request, void *arg)
+{
+    uint64_t start = V4L2StatsNow();
+    int ret = mosaic.backend->ioctl(mosaic.fd, request, arg);
+    unsigned long usec = V4L2StatsNow() - start;
+    V4L2StatsIoctl(&mosaic.owner->stats, usec);
+    V4L2_TRACE(IOCTL, mosaic.owner->nr, request, ret, usec, 0);
+    return ret;
+}
+
+static V4L2MosaicPort *
+MosaicPort(PortPrivPtr pPPriv)
+{
+    int i;
+
+    for (i = 0; i < mosaic.nports; i++)
+        if (mosaic.ports[i].pPPriv == pPPriv)
+            return &mosaic.ports[i];
+
+    return NULL;
+}
+
+/* mark the tiles of a region to be drawn again, in every buffer: */
+static void
+MosaicDirty(RegionPtr region)
+{
+    BoxPtr pbox = RegionRects(region);
+    int nbox = RegionNumRects(region);
+    int i, row, col;
+
+    if (!mosaic.nbufs)
+        return;
+
+    for (; nbox > 0; nbox--, pbox++) {
+        int c1 = MAX(pbox->x1, 0) >> V4L2_TILE_SHIFT;
+        int r1 = MAX(pbox->y1, 0) >> V4L2_TILE_SHIFT;
+        int c2 = MIN((pbox->x2 + V4L2_TILE_SIZE - 1) >> V4L2_TILE_SHIFT,
+                mosaic.cols);
+        int r2 = MIN((pbox->y2 + V4L2_TILE_SIZE - 1) >> V4L2_TILE_SHIFT,
+                mosaic.rows);
+
+        for (i = 0; i < mosaic.nbufs; i++) {
+            for (row = r1; row < r2; row++) {
+                uint32_t *w = mosaic.bufs[i].dirty + (row * mosaic.words);
+                for (col = c1; col < c2; col++)
+                    w[col >> 5] |= 1u << (col & 31);
+            }
+        }
+
+        if ((c1 < c2) && (r1 < r2))
+            mosaic.pending = TRUE;
+    }
+}
+
+/* the luma of the one pixel at x of port p's frame, in rows [y1, y2): */
+static void
+MosaicDrawLuma(V4L2MosaicPort *p, uint8_t *base, int stride, int x,
+        int y1, int y2)
+{
+    int fx = p->x & ~1;
+    uint8_t pair[4];
+    int y;
+
+    for (y = y1; y < y2; y++) {
+        V4L2ConvertYUYV(pair, sizeof(pair), &p->frame, (x & ~1) - fx,
+                y - p->y, 2, 1);
+        base[(y * stride) + (x * 2)] = pair[(x & 1) * 2];
+    }
+}
+
+/* the part of the box b that is also in the frame of port p.  The pixels
+ * of a pair share their chroma, so at an edge of the box that splits one
+ * (at an odd x), only the luma of the pixel within it is drawn:
+ */
+static void
+MosaicDrawBox(V4L2MosaicPort *p, uint8_t *base, int stride, const BoxRec *b)
+{
+    int fx = p->x & ~1;
+    int x1 = MAX(b->x1, fx);
+    int y1 = MAX(b->y1, p->y);
+    int x2 = MIN(b->x2, fx + p->frame.width);
+    int y2 = MIN(b->y2, p->y + p->frame.height);
+
+    if ((x2 <= x1) || (y2 <= y1))
+        return;
+
+    if (x1 & 1)
+        MosaicDrawLuma(p, base, stride, x1++, y1, y2);
+    if ((x2 & 1) && (x2 > x1))
+        MosaicDrawLuma(p, base, stride, --x2, y1, y2);
+
+    V4L2ConvertYUYV(base + (y1 * stride) + (x1 * 2), stride, &p->frame,
+            x1 - fx, y1 - p->y, x2 - x1, y2 - y1);
+}
+
+static void
+MosaicFill(uint8_t *base, int stride, const BoxRec *b)
+{
+    int x, y;
+
+    for (y = b->y1; y < b->y2; y++) {
+        uint32_t *d = (uint32_t *)(base + (y * stride) + (b->x1 * 2));
+        for (x = b->x1; x < b->x2; x += 2)
+            *d++ = 0x80108010;          /* two black YUYV pixels */
+    }
+}
+
+static void
+MosaicDrawTile(uint8_t *base, int stride, int row, int col)
+{
+    int word = (row * mosaic.words) + (col >> 5);
+    uint32_t bit = 1u << (col & 31);
+    BoxRec tile;
+    int i;
+
+    tile.x1 = col << V4L2_TILE_SHIFT;
+    tile.y1 = row << V4L2_TILE_SHIFT;
+    tile.x2 = MIN(tile.x1 + V4L2_TILE_SIZE, mosaic.pix.width & ~1);
+    tile.y2 = MIN(tile.y1 + V4L2_TILE_SIZE, mosaic.pix.height);
+
+    /* clips don't overlap, a tile within one is just that port's: */
+    for (i = 0; i < mosaic.nports; i++) {
+        V4L2MosaicPort *p = &mosaic.ports[i];
+        if (p->frame.width && p->mask.full && (p->mask.full[word] & bit) &&
+                (tile.x1 >= (p->x & ~1)) && (tile.y1 >= p->y) &&
+                (tile.x2 <= (p->x & ~1) + p->frame.width) &&
+                (tile.y2 <= p->y + p->frame.height)) {
+            MosaicDrawBox(p, base, stride, &tile);
+            return;
+        }
+    }
+
+    MosaicFill(base, stride, &tile);
+
+    for (i = 0; i < mosaic.nports; i++) {
+        V4L2MosaicPort *p = &mosaic.ports[i];
+        BoxPtr pbox;
+        int nbox;
+
+        if (!p->frame.width || !p->mask.full ||
+                !((p->mask.full[word] | p->mask.part[word]) & bit))
+            continue;
+
+        pbox = RegionRects(&p->clip);
+        nbox = RegionNumRects(&p->clip);
+        for (; nbox > 0; nbox--, pbox++) {
+            BoxRec b;
+
+            b.x1 = MAX(pbox->x1, tile.x1);
+            b.y1 = MAX(pbox->y1, tile.y1);
+            b.x2 = MIN(pbox->x2, tile.x2);
+            b.y2 = MIN(pbox->y2, tile.y2);
+            if ((b.x1 < b.x2) && (b.y1 < b.y2))
+                MosaicDrawBox(p, base, stride, &b);
+        }
+    }
+}
+
+/* take back the buffers the device is done with (the fd is non-blocking): */
+static void
+MosaicReclaim(void)
+{
+    struct v4l2_buffer buf;
+
+    while (1) {
+        memset(&buf, 0x00, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        buf.memory = V4L2_MEMORY_MMAP;
+
+        if (-1 == MosaicIoctl(VIDIOC_DQBUF, &buf))
+            break;
+        if (buf.index < mosaic.nbufs)
+            mosaic.bufs[buf.index].queued = FALSE;
+    }
+}
+
+static int
+MosaicQueue(int index)
+{
+    int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    struct v4l2_buffer buf;
+
+    memset(&buf, 0x00, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = index;
+    buf.bytesused = mosaic.pix.sizeimage;
+    buf.field = V4L2_FIELD_NONE;
+
+    if (-1 == MosaicIoctl(VIDIOC_QBUF, &buf)) {
+        perror("ioctl VIDIOC_QBUF");
+        return -1;
+    }
+    mosaic.bufs[index].queued = TRUE;
+
+    if (!mosaic.streaming) {
+        if (-1 == MosaicIoctl(VIDIOC_STREAMON, &type)) {
+            perror("ioctl VIDIOC_STREAMON");
+            return -1;
+        }
+        mosaic.streaming = TRUE;
+    }
+
+    return 0;
+}
+
+/* draw the changed tiles into a free buffer and queue it.  Returns whether
+ * there was none free:
+ */
+static Bool
+MosaicFlush(void)
+{
+    uint8_t *base;
+    uint32_t *dirty;
+    int stride, i, row, word;
+
+    if (!mosaic.pending || !mosaic.nbufs)
+        return FALSE;
+
+    if (mosaic.streaming)
+        MosaicReclaim();
+
+    for (i = 0; i < mosaic.nbufs; i++)
+        if (!mosaic.bufs[i].queued)
+            break;
+    if (i == mosaic.nbufs)
+        return TRUE;
+
+    base = mosaic.bufs[i].mem;
+    stride = mosaic.pix.bytesperline;
+    dirty = mosaic.bufs[i].dirty;
+
+    for (row = 0; row < mosaic.rows; row++) {
+        for (word = 0; word < mosaic.words; word++) {
+            uint32_t bits = dirty[(row * mosaic.words) + word];
+
+            while (bits) {
+                int col = (word << 5) + __builtin_ctz(bits);
+                bits &= bits - 1;
+                MosaicDrawTile(base, stride, row, col);
+            }
+        }
+    }
+    memset(dirty, 0x00, mosaic.rows * mosaic.words * sizeof(uint32_t));
+
+    MosaicQueue(i);
+    mosaic.pending = FALSE;
+
+    return FALSE;
+}
+
+static CARD32
+MosaicTimer(OsTimerPtr timer, CARD32 now, pointer arg)
+{
+    return MosaicFlush() ? V4L2_MOSAIC_RETRY_MSEC : 0;
+}
+
+/* once the requests at hand are handled, so that the frames of all the
+ * ports that have one go out together:
+ */
+static void
+MosaicBlockHandler(pointer data, OSTimePtr pTimeout, pointer pReadmask)
+{
+    if (mosaic.pending && MosaicFlush())
+        mosaic.timer = TimerSet(mosaic.timer, 0, V4L2_MOSAIC_RETRY_MSEC,
+                MosaicTimer, NULL);
+}
+
+/* ---------------------------------------------------------------------- */
+
+static void
+MosaicFree(void)
+{
+    struct v4l2_requestbuffers req;
+    int i, type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+
+    if (mosaic.timer)
+        TimerCancel(mosaic.timer);
+
+    if (mosaic.blockHandler) {
+        RemoveBlockAndWakeupHandlers((BlockHandlerProcPtr)MosaicBlockHandler,
+                (WakeupHandlerProcPtr)NoopDDA, NULL);
+        mosaic.blockHandler = FALSE;
+    }
+
+    if (mosaic.streaming) {
+        MosaicIoctl(VIDIOC_STREAMOFF, &type);
+        mosaic.streaming = FALSE;
+    }
+
+    for (i = 0; i < mosaic.nbufs; i++) {
+        if (mosaic.bufs[i].mem)
+            mosaic.backend->munmap(mosaic.bufs[i].mem, mosaic.bufs[i].length);
+        mosaic.bufs[i].mem = NULL;
+        mosaic.bufs[i].queued = FALSE;
+        free(mosaic.bufs[i].dirty);
+        mosaic.bufs[i].dirty = NULL;
+    }
+
+    if (mosaic.nbufs) {
+        memset(&req, 0x00, sizeof(req));
+        req.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        req.memory = V4L2_MEMORY_MMAP;
+        req.count = 0;
+        MosaicIoctl(VIDIOC_REQBUFS, &req);
+    }
+
+    mosaic.nbufs = 0;
+    mosaic.pending = FALSE;
+
+    if (mosaic.fd != -1) {
+        fcntl(mosaic.fd, F_SETFL, mosaic.flags);
+        mosaic.fd = -1;
+    }
+}
+
+/* a screen sized YUYV queue on the overlay, all of it to be drawn: */
+static int
+MosaicAlloc(const V4L2DeviceInfo *info)
+{
+    struct v4l2_requestbuffers req;
+    struct v4l2_format format;
+    int width = mosaic.pScreen->width & ~1, height = mosaic.pScreen->height;
+    int i;
+
+    memset(&format, 0x00, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    format.fmt.pix.width = width;
+    format.fmt.pix.height = height;
+    format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+    format.fmt.pix.field = V4L2_FIELD_NONE;
+
+    if (-1 == MosaicIoctl(VIDIOC_S_FMT, &format)) {
+        perror("ioctl VIDIOC_S_FMT");
+        return -1;
+    }
+
+    if ((format.fmt.pix.pixelformat != V4L2_PIX_FMT_YUYV) ||
+            (format.fmt.pix.width != width) ||
+            (format.fmt.pix.height != height)) {
+        xf86Msg(X_WARNING, "v4l2: %s can't take %dx%d YUYV frames for "
+                "the mosaic\n", info->card, width, height);
+        return -1;
+    }
+
+    mosaic.pix = format.fmt.pix;
+    if (mosaic.pix.bytesperline < width * 2)
+        mosaic.pix.bytesperline = width * 2;
+    if (mosaic.pix.sizeimage < mosaic.pix.bytesperline * height)
+        mosaic.pix.sizeimage = mosaic.pix.bytesperline * height;
+
+    mosaic.cols = (width + V4L2_TILE_SIZE - 1) >> V4L2_TILE_SHIFT;
+    mosaic.rows = (height + V4L2_TILE_SIZE - 1) >> V4L2_TILE_SHIFT;
+    mosaic.words = (mosaic.cols + 31) >> 5;
+
+    memset(&req, 0x00, sizeof(req));
+    req.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    req.memory = V4L2_MEMORY_MMAP;
+    req.count = V4L2_MOSAIC_BUFS;
+
+    if (-1 == MosaicIoctl(VIDIOC_REQBUFS, &req)) {
+        perror("ioctl VIDIOC_REQBUFS");
+        return -1;
+    }
+
+    mosaic.nbufs = MIN(req.count, V4L2_MOSAIC_BUFS);
+    if (mosaic.nbufs < 2)
+        return -1;
+
+    for (i = 0; i < mosaic.nbufs; i++) {
+        struct v4l2_buffer buf;
+
+        mosaic.bufs[i].dirty = malloc(mosaic.rows * mosaic.words *
+                sizeof(uint32_t));
+        if (!mosaic.bufs[i].dirty)
+            return -1;
+        memset(mosaic.bufs[i].dirty, 0xff, mosaic.rows * mosaic.words *
+                sizeof(uint32_t));
+
+        memset(&buf, 0x00, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+
+        if (-1 == MosaicIoctl(VIDIOC_QUERYBUF, &buf)) {
+            perror("ioctl VIDIOC_QUERYBUF");
+            return -1;
+        }
+
+        mosaic.bufs[i].length = buf.length;
+        mosaic.bufs[i].mem = mosaic.backend->mmap(mosaic.fd, buf.length,
+                PROT_READ | PROT_WRITE, buf.m.offset);
+        if (mosaic.bufs[i].mem == MAP_FAILED) {
+            perror("mmap");
+            mosaic.bufs[i].mem = NULL;
+            return -1;
+        }
+
+        if (buf.length < mosaic.pix.sizeimage) {
+            DEBUG("Xv/MO: buffer %d too small, %u bytes", i, buf.length);
+            return -1;
+        }
+    }
+
+    /* bits past the last column mustn't be drawn: */
+    if (mosaic.cols & 31) {
+        int row;
+        for (i = 0; i < mosaic.nbufs; i++)
+            for (row = 0; row < mosaic.rows; row++)
+                mosaic.bufs[i].dirty[(row * mosaic.words) + mosaic.words - 1] =
+                        (1u << (mosaic.cols & 31)) - 1;
+    }
+
+    mosaic.pending = TRUE;
+
+    return 0;
+}
+
+static int
+MosaicStart(PortPrivPtr pPPriv, const V4L2Backend *backend, int fd,
+        const V4L2DeviceInfo *info, ScreenPtr pScreen)
+{
+    mosaic.backend = backend;
+    mosaic.fd = fd;
+    mosaic.flags = fcntl(fd, F_GETFL);
+    mosaic.owner = pPPriv;
+    mosaic.pScreen = pScreen;
+
+    if (MosaicAlloc(info)) {
+        MosaicFree();
+        return -1;
+    }
+
+    /* finished buffers are taken back until VIDIOC_DQBUF fails: */
+    fcntl(fd, F_SETFL, mosaic.flags | O_NONBLOCK);
+
+    RegisterBlockAndWakeupHandlers((BlockHandlerProcPtr)MosaicBlockHandler,
+            (WakeupHandlerProcPtr)NoopDDA, NULL);
+    mosaic.blockHandler = TRUE;
+
+    DEBUG("Xv/MO: mosaic of %dx%d on %s", mosaic.pix.width,
+            mosaic.pix.height, info->card);
+
+    return 0;
+}
+
+/**
+ * Whether a device can host the mosaic: its overlay must show what is
+ * queued to its video output, keyed or blended (not composited), and take
+ * YUYV.
+ */
+Bool
+V4L2MosaicSupported(const V4L2DeviceInfo *info, Bool composite)
+{
+    int i;
+
+    if (composite || !(info->capabilities & V4L2_CAP_VIDEO_OUTPUT) ||
+            !(info->capabilities & V4L2_CAP_STREAMING))
+        return FALSE;
+
+    for (i = 0; i < info->nformats; i++)
+        if (info->formats[i] == V4L2_PIX_FMT_YUYV)
+            return TRUE;
+
+    return FALSE;
+}
+
+/**
+ * Where a port of the mosaic shows its frames: the top left of its window,
+ * and its clip.  Starts the mosaic with the first port that shows.
+ */
+int
+V4L2MosaicSetPosition(PortPrivPtr pPPriv, const V4L2Backend *backend,
+        int fd, const V4L2DeviceInfo *info, ScreenPtr pScreen,
+        short x, short y, RegionPtr clipBoxes)
+{
+    V4L2MosaicPort *p = MosaicPort(pPPriv);
+
+    if (!p) {
+        V4L2MosaicPort *ports = realloc(mosaic.ports,
+                sizeof(ports[0]) * (mosaic.nports + 1));
+        if (!ports)
+            return BadAlloc;
+        mosaic.ports = ports;
+        p = &mosaic.ports[mosaic.nports++];
+        memset(p, 0x00, sizeof(*p));
+        p->pPPriv = pPPriv;
+        RegionNull(&p->clip);
+    }
+
+    if ((mosaic.fd == -1) && MosaicStart(pPPriv, backend, fd, info, pScreen))
+        return BadAlloc;
+
+    /* a video that is playing sets the same clip every frame: */
+    if ((p->x == x) && (p->y == y) && RegionEqual(&p->clip, clipBoxes))
+        return Success;
+
+    MosaicDirty(&p->clip);
+    RegionCopy(&p->clip, clipBoxes);
+    MosaicDirty(&p->clip);
+    p->x = x;
+    p->y = y;
+
+    if (!p->mask.full &&
+            V4L2TileMaskInit(&p->mask, mosaic.pix.width, mosaic.pix.height)) {
+        xf86Msg(X_WARNING, "v4l2: could not allocate tile mask\n");
+        return BadAlloc;
+    }
+    V4L2TileMaskClear(&p->mask);
+    V4L2TileMaskAdd(&p->mask, (V4L2TileBox *)RegionRects(&p->clip),
+            RegionNumRects(&p->clip));
+
+    return Success;
+}
+
+/**
+ * Hand the latest frame of a port of the mosaic over, at the size of its
+ * window, to be drawn once the server is done with the requests at hand.
+ * The frame has to stay as it is until then.
+ */
+void
+V4L2MosaicSetFrame(PortPrivPtr pPPriv, const V4L2ScaleImage *frame)
+{
+    V4L2MosaicPort *p = MosaicPort(pPPriv);
+
+    if (!p)
+        return;
+
+    V4L2_STAT_ADD(pPPriv->stats.frames, 1);
+    p->frame = *frame;
+    MosaicDirty(&p->clip);
+}
+
+/**
+ * Take a port out of the mosaic, and stop the mosaic with the last one.
+ * Returns whether other ports still use the device.
+ */
+Bool
+V4L2MosaicStop(PortPrivPtr pPPriv)
+{
+    V4L2MosaicPort *p = MosaicPort(pPPriv);
+    int i;
+
+    if (p) {
+        MosaicDirty(&p->clip);
+        RegionUninit(&p->clip);
+        V4L2TileMaskFini(&p->mask);
+        *p = mosaic.ports[--mosaic.nports];
+    }
+
+    if (!mosaic.nports) {
+        MosaicFree();
+        return FALSE;
+    }
+
+    /* the ioctls count against a port still in use: */
+    for (i = 0; (i < mosaic.nports) && (mosaic.owner == pPPriv); i++)
+        mosaic.owner = mosaic.ports[i].pPPriv;
+
+    return TRUE;
+}
@@ -0,0 +1,377 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: parallel device probe and persistent capability cache
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/videodev2.h>
+
+#include "xf86.h"
+#include "xf86_OSproc.h"
+#include "xf86xv.h"
+#include "v4l2.h"
+
+/* The cache is a flat binary file: a small header followed by an array
+ * of V4L2DeviceInfo.  Bump the version whenever V4L2DeviceInfo changes.
+ */
+#define CACHE_MAGIC     "v4l2cap"
+#define CACHE_VERSION   2
+#define CACHE_MAX       256         /* entries, far more than plugged in */
+
+typedef struct {
+    char        magic[8];
+    CARD32      version;
+    CARD32      size;       /* sizeof(V4L2DeviceInfo), sanity check */
+    CARD32      count;
+} CacheHeader;
+
+static V4L2DeviceInfo *cache = NULL;
+static int cacheCount = 0;
+
+/* per-device probe job.  The probe threads must not call into the X
+ * server (xf86Msg and friends are not thread safe), so anything worth
+ * logging is left in the job and reported once all threads are joined.
+ */
+typedef struct {
+    pthread_t           thread;
+    Bool                threaded;
+    const char          *name;
+    int                 fd;
+    int                 err;
+    Bool                hit;
+    V4L2DeviceInfo      *info;
+} ProbeJob;
+
+/* ---------------------------------------------------------------------- */
+
+static void
+V4L2LoadCache(void)
+{
+    CacheHeader hdr;
+    struct stat st;
+    FILE *f;
+
+    if (!config.cacheFile)
+        return;
+
+    f = fopen(config.cacheFile, "rb");
+    if (!f)
+        return;
+
+    if ((fread(&hdr, sizeof(hdr), 1, f) != 1) ||
+            memcmp(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic)) ||
+            (hdr.version != CACHE_VERSION) ||
+            (hdr.size != sizeof(V4L2DeviceInfo))) {
+        xf86Msg(X_WARNING, "v4l2: ignoring stale cache %s\n", config.cacheFile);
+        fclose(f);
+        return;
+    }
+
+    /* the count is only trusted if the file holds exactly that many: */
+    if (fstat(fileno(f), &st) || (hdr.count > CACHE_MAX) ||
+            (st.st_size != sizeof(hdr) +
+                    ((off_t)sizeof(V4L2DeviceInfo) * hdr.count))) {
+        xf86Msg(X_WARNING, "v4l2: ignoring corrupt cache %s\n",
+                config.cacheFile);
+        fclose(f);
+        return;
+    }
+
+    cache = malloc(sizeof(V4L2DeviceInfo) * hdr.count);
+    if (cache && (fread(cache, sizeof(V4L2DeviceInfo), hdr.count, f) == hdr.count)) {
+        cacheCount = hdr.count;
+    } else {
+        free(cache);
+        cache = NULL;
+    }
+
+    fclose(f);
+
+    DEBUG("loaded %d cached device(s) from %s", cacheCount, config.cacheFile);
+}
+
+#define CACHEABLE(job) (((job)->fd != -1) && !(job)->err)
+
+static void
+V4L2SaveCache(ProbeJob *jobs, int n)
+{
+    CacheHeader hdr;
+    char *tmp;
+    FILE *f;
+    int i, j;
+
+    tmp = malloc(strlen(config.cacheFile) + 5);
+    if (!tmp)
+        return;
+    sprintf(tmp, "%s.tmp", config.cacheFile);
+
+    f = fopen(tmp, "wb");
+    if (!f) {
+        xf86Msg(X_WARNING, "v4l2: could not write cache %s\n", tmp);
+        free(tmp);
+        return;
+    }
+
+    memset(&hdr, 0x00, sizeof(hdr));
+    memcpy(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic));
+    hdr.version = CACHE_VERSION;
+    hdr.size = sizeof(V4L2DeviceInfo);
+
+    /* write out the devices found this time, followed by any old entries
+     * for devices that weren't present (so unplugging a device for one
+     * boot doesn't lose its entry).  The old entries are in the order they
+     * were last seen, so once the cache is full the oldest are dropped:
+     */
+    fwrite(&hdr, sizeof(hdr), 1, f);
+
+    for (i = 0; (i < n) && (hdr.count < CACHE_MAX); i++) {
+        if (CACHEABLE(&jobs[i])) {
+            fwrite(jobs[i].info, sizeof(V4L2DeviceInfo), 1, f);
+            hdr.count++;
+        }
+    }
+
+    for (j = 0; (j < cacheCount) && (hdr.count < CACHE_MAX); j++) {
+        Bool found = FALSE;
+        for (i = 0; i < n && !found; i++) {
+            V4L2DeviceInfo *info = jobs[i].info;
+            found = CACHEABLE(&jobs[i]) &&
+                    !strcmp(info->driver, cache[j].driver) &&
+                    !strcmp(info->bus_info, cache[j].bus_info);
+        }
+        if (!found) {
+            fwrite(&cache[j], sizeof(V4L2DeviceInfo), 1, f);
+            hdr.count++;
+        }
+    }
+
+    /* rewrite the header with the final count */
+    rewind(f);
+    fwrite(&hdr, sizeof(hdr), 1, f);
+
+    if (fclose(f) || rename(tmp, config.cacheFile)) {
+        xf86Msg(X_WARNING, "v4l2: could not write cache %s\n", config.cacheFile);
+        unlink(tmp);
+    }
+
+    free(tmp);
+}
+
+/* look up a device by the identity reported by VIDIOC_QUERYCAP.  The cache
+ * is read-only while the probe threads run, so no locking is needed.
+ */
+static V4L2DeviceInfo *
+V4L2FindCached(V4L2DeviceInfo *info)
+{
+    int i;
+
+    for (i = 0; i < cacheCount; i++) {
+        if (!strcmp(info->driver, cache[i].driver) &&
+                !strcmp(info->bus_info, cache[i].bus_info) &&
+                (info->version == cache[i].version)) {
+            return &cache[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* gather everything we'd otherwise have to ask the device for later: */
+static void
+V4L2QueryDevice(const V4L2Backend *backend, int fd, V4L2DeviceInfo *info)
+{
+    struct v4l2_framebuffer fbuf;
+    struct v4l2_format format;
+    struct v4l2_fmtdesc desc;
+    struct v4l2_frmsizeenum size;
+    struct v4l2_queryctrl ctrl;
+    enum v4l2_buf_type type;
+
+    memset(&fbuf, 0x00, sizeof(fbuf));
+    if (0 == backend->ioctl(fd, VIDIOC_G_FBUF, &fbuf)) {
+        info->fbufCapability = fbuf.capability;
+    }
+
+    memset(&format, 0x00, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_OVERLAY;
+    if (0 == backend->ioctl(fd, VIDIOC_G_FMT, &format)) {
+        info->width  = format.fmt.win.w.width;
+        info->height = format.fmt.win.w.height;
+    }
+
+    if (info->capabilities & V4L2_CAP_VIDEO_OUTPUT) {
+        type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    } else if (info->capabilities & V4L2_CAP_VIDEO_CAPTURE) {
+        type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    } else {
+        type = V4L2_BUF_TYPE_VIDEO_OVERLAY;
+    }
+
+    memset(&desc, 0x00, sizeof(desc));
+    desc.type = type;
+    while ((info->nformats < V4L2_MAX_FORMATS) &&
+            (0 == backend->ioctl(fd, VIDIOC_ENUM_FMT, &desc))) {
+        info->formats[info->nformats++] = desc.pixelformat;
+        desc.index++;
+    }
+
+    /* the port's encodings (see V4L2BuildEncodings()): */
+    memset(&size, 0x00, sizeof(size));
+    size.pixel_format = info->nformats ? info->formats[0] : 0;
+    while (info->nformats && (info->nsizes < V4L2_MAX_SIZES) &&
+            (0 == backend->ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &size)) &&
+            (size.type == V4L2_FRMSIZE_TYPE_DISCRETE)) {
+        info->sizes[info->nsizes].width  = size.discrete.width;
+        info->sizes[info->nsizes].height = size.discrete.height;
+        info->nsizes++;
+        size.index++;
+    }
+
+    memset(&ctrl, 0x00, sizeof(ctrl));
+    ctrl.id = V4L2_CTRL_FLAG_NEXT_CTRL;
+    while ((info->nctrls < V4L2_MAX_CTRLS) &&
+            (0 == backend->ioctl(fd, VIDIOC_QUERYCTRL, &ctrl))) {
+        if (!(ctrl.flags & V4L2_CTRL_FLAG_DISABLED)) {
+            int i = info->nctrls++;
+            info->ctrls[i].id   = ctrl.id;
+            info->ctrls[i].min  = ctrl.minimum;
+            info->ctrls[i].max  = ctrl.maximum;
+            info->ctrls[i].step = ctrl.step;
+            info->ctrls[i].def  = ctrl.default_value;
+            strncpy(info->ctrls[i].name, (char *)ctrl.name,
+                    sizeof(info->ctrls[i].name) - 1);
+        }
+        ctrl.id |= V4L2_CTRL_FLAG_NEXT_CTRL;
+    }
+}
+
+static void *
+V4L2ProbeThread(void *arg)
+{
+    ProbeJob *job = arg;
+    V4L2DeviceInfo *info = job->info, *cached;
+    const V4L2Backend *backend = V4L2FindBackend(job->name);
+    struct v4l2_capability cap;
+
+    job->fd = backend->open(job->name, O_RDWR);
+    if (-1 == job->fd) {
+        job->err = errno;
+        return NULL;
+    }
+
+    memset(&cap, 0x00, sizeof(cap));
+    if (-1 == backend->ioctl(job->fd, VIDIOC_QUERYCAP, &cap)) {
+        /* can't identify it, so can't cache it.. but still probe it */
+        job->err = errno;
+    }
+
+    strncpy(info->driver, (char *)cap.driver, sizeof(info->driver) - 1);
+    strncpy(info->card, (char *)cap.card, sizeof(info->card) - 1);
+    strncpy(info->bus_info, (char *)cap.bus_info, sizeof(info->bus_info) - 1);
+    info->version = cap.version;
+    info->capabilities = cap.capabilities;
+
+    if (!job->err && (cached = V4L2FindCached(info))) {
+        memcpy(info, cached, sizeof(*info));
+        job->hit = TRUE;
+    } else {
+        V4L2QueryDevice(backend, job->fd, info);
+    }
+
+    return NULL;
+}
+
+/**
+ * Open and identify the devices in @names concurrently.  On return fds[i]
+ * is the open file descriptor (or -1) and info[i] what we know about it.
+ * Returns the number of devices successfully opened.
+ */
+int
+V4L2ProbeDevices(char **names, int n, int *fds, V4L2DeviceInfo *info)
+{
+    ProbeJob *jobs;
+    Bool dirty = FALSE;
+    int i, found = 0;
+
+    jobs = calloc(n, sizeof(ProbeJob));
+    if (!jobs)
+        return 0;
+
+    V4L2LoadCache();
+
+    memset(info, 0x00, sizeof(V4L2DeviceInfo) * n);
+
+    for (i = 0; i < n; i++) {
+        jobs[i].name = names[i];
+        jobs[i].fd   = -1;
+        jobs[i].info = &info[i];
+        jobs[i].threaded = !pthread_create(&jobs[i].thread, NULL,
+                V4L2ProbeThread, &jobs[i]);
+        if (!jobs[i].threaded) {
+            /* fall back to probing it ourselves */
+            V4L2ProbeThread(&jobs[i]);
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        if (jobs[i].threaded)
+            pthread_join(jobs[i].thread, NULL);
+
+        fds[i] = jobs[i].fd;
+
+        if (-1 == jobs[i].fd) {
+            DEBUG("open %s failed: %s", names[i], strerror(jobs[i].err));
+            continue;
+        }
+
+        DEBUG("%s: %s (%s) caps=%08x fbuf=%08x %d fmts %d ctrls%s",
+                names[i], info[i].card, info[i].driver,
+                (unsigned int)info[i].capabilities,
+                (unsigned int)info[i].fbufCapability,
+                info[i].nformats, info[i].nctrls,
+                jobs[i].hit ? " (cached)" : "");
+
+        if (!jobs[i].hit && CACHEABLE(&jobs[i]))
+            dirty = TRUE;
+
+        found++;
+    }
+
+    if (dirty && config.cacheFile)
+        V4L2SaveCache(jobs, n);
+
+    free(cache);
+    cache = NULL;
+    cacheCount = 0;
+    free(jobs);
+
+    return found;
+}
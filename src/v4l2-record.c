@@ -0,0 +1,171 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: record Xv requests and damage for offline replay
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "xf86.h"
+#include "xf86_OSproc.h"
+#include "xf86xv.h"
+#include "regionstr.h"
+#include "v4l2.h"
+
+/* Unlike the trace ring this writes synchronously (through a large stdio
+ * buffer), since a recording needs every event.  It is meant for capturing
+ * a workload, not to be left enabled.
+ */
+#define RECORD_BUFSIZE  (256 * 1024)
+#define RECORD_OPTIONS  1024
+
+Bool v4l2Recording = FALSE;
+
+static FILE *recordFile = NULL;
+static uint64_t recordStart;
+
+/* ---------------------------------------------------------------------- */
+
+void
+V4L2Record(int type, int port, int a0, int a1, int a2, int a3,
+        RegionPtr boxes)
+{
+    V4L2RecordEntry entry;
+    BoxPtr pbox = NULL;
+    int i;
+
+    memset(&entry, 0x00, sizeof(entry));
+    entry.usec    = V4L2StatsNow() - recordStart;
+    entry.type    = type;
+    entry.port    = port;
+    entry.args[0] = a0;
+    entry.args[1] = a1;
+    entry.args[2] = a2;
+    entry.args[3] = a3;
+
+    if (boxes) {
+        entry.nbox = MIN(RegionNumRects(boxes), 0xffff);
+        pbox = RegionRects(boxes);
+    }
+
+    fwrite(&entry, sizeof(entry), 1, recordFile);
+
+    for (i = 0; i < entry.nbox; i++, pbox++) {
+        V4L2RecordBox box = { pbox->x1, pbox->y1, pbox->x2, pbox->y2 };
+        fwrite(&box, sizeof(box), 1, recordFile);
+    }
+}
+
+void
+V4L2RecordFlush(void)
+{
+    if (recordFile)
+        fflush(recordFile);
+}
+
+static void
+RecordOption(char *buf, uint32_t *len, const char *name, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    n = snprintf(buf + *len, RECORD_OPTIONS - *len, "%s=", name);
+    if ((n < 0) || (*len + n >= RECORD_OPTIONS))
+        return;
+
+    va_start(ap, fmt);
+    n += vsnprintf(buf + *len + n, RECORD_OPTIONS - *len - n, fmt, ap);
+    va_end(ap);
+    if (*len + n >= RECORD_OPTIONS)
+        return;
+
+    *len += n + 1;      /* and the NUL */
+}
+
+/* the options that decide what the session drew, and how, for the replay
+ * to run with.  Not the files, nor the Scaler, which is a device the
+ * replay doesn't have:
+ */
+static uint32_t
+RecordOptions(char *buf)
+{
+    static const char *osdAlpha[] = { "off", "premultiplied", "straight" };
+    uint32_t len = 0;
+
+#define BOOL(x) ((x) ? "on" : "off")
+    RecordOption(buf, &len, "Devices", "%s", config.devices);
+    RecordOption(buf, &len, "Alpha", "%s", BOOL(config.alpha));
+    RecordOption(buf, &len, "ColorKey", "0x%08x", config.colorKey);
+    RecordOption(buf, &len, "OSDAlpha", "%s", osdAlpha[config.osdAlpha]);
+    RecordOption(buf, &len, "PageFlip", "%s", BOOL(config.pageFlip));
+    RecordOption(buf, &len, "TileHash", "%s", BOOL(config.tileHash));
+    RecordOption(buf, &len, "FusedCompose", "%s", BOOL(config.fusedCompose));
+    RecordOption(buf, &len, "UpdateBudget", "%d", config.updateBudget);
+    RecordOption(buf, &len, "DirectRender", "%s", BOOL(config.directRender));
+    RecordOption(buf, &len, "DeferSetup", "%s", BOOL(config.deferSetup));
+    RecordOption(buf, &len, "Composite", "%s", BOOL(config.composite));
+    RecordOption(buf, &len, "Deinterlace", "%s",
+            (config.deinterlace == V4L2_DEINTERLACE_BOB) ? "bob" : "linear");
+    RecordOption(buf, &len, "ExportYUV", "%s", BOOL(config.exportYUV));
+    RecordOption(buf, &len, "Mosaic", "%d", config.mosaic);
+    RecordOption(buf, &len, "HugeShadow", "%s", BOOL(config.hugeShadow));
+#undef BOOL
+
+    return len;
+}
+
+/**
+ * Start recording, if a record file is configured.
+ */
+void
+V4L2RecordInit(ScrnInfoPtr pScrn)
+{
+    V4L2RecordHeader hdr;
+    char options[RECORD_OPTIONS];
+
+    if (recordFile || !config.recordFile)
+        return;
+
+    recordFile = fopen(config.recordFile, "wb");
+    if (!recordFile) {
+        xf86Msg(X_WARNING, "v4l2: could not open %s\n", config.recordFile);
+        return;
+    }
+
+    setvbuf(recordFile, NULL, _IOFBF, RECORD_BUFSIZE);
+
+    memset(&hdr, 0x00, sizeof(hdr));
+    memcpy(hdr.magic, V4L2_RECORD_MAGIC, sizeof(hdr.magic));
+    hdr.version = V4L2_RECORD_VERSION;
+    hdr.width   = pScrn->virtualX;
+    hdr.height  = pScrn->virtualY;
+    hdr.options = RecordOptions(options);
+    fwrite(&hdr, sizeof(hdr), 1, recordFile);
+    fwrite(options, hdr.options, 1, recordFile);
+
+    recordStart = V4L2StatsNow();
+    v4l2Recording = TRUE;
+
+    xf86Msg(X_INFO, "v4l2: recording session to %s\n", config.recordFile);
+}
@@ -0,0 +1,52 @@
+/*
+ * v4l2-record.h
+ *
+ * Session recording format, shared between the driver and v4l2-replay.
+ * This header must not depend on any X server headers.
+ */
+
+#ifndef __V4L2_RECORD_H__
+#define __V4L2_RECORD_H__
+
+#include <stdint.h>
+
+#define V4L2_RECORD_MAGIC       "v4l2rec"
+#define V4L2_RECORD_VERSION     3
+
+/* entry types, and the meaning of their arguments.  Append only. */
+enum {
+    V4L2_RECORD_PUT_VIDEO,      /* drw_x, drw_y, drw_w, drw_h; clip boxes */
+    V4L2_RECORD_REPUT_IMAGE,    /* drw_x, drw_y; clip boxes */
+    V4L2_RECORD_STOP_VIDEO,     /* shutdown */
+    V4L2_RECORD_DAMAGE,         /* screen; damage boxes (one update) */
+    V4L2_RECORD_CURSOR,         /* x, y, width, height of cursor image,
+                                 * before the DAMAGE it is drawn with */
+    V4L2_RECORD_PUT_IMAGE,      /* drw_x, drw_y, drw_w, drw_h; clip boxes */
+};
+
+typedef struct {
+    int16_t     x1, y1, x2, y2;
+} V4L2RecordBox;
+
+/* each entry is followed by nbox V4L2RecordBox */
+typedef struct {
+    uint64_t    usec;           /* since recording started */
+    uint8_t     type;
+    uint8_t     port;
+    uint16_t    nbox;
+    int16_t     args[4];
+    uint32_t    pad;            /* same size where uint64_t is 4 aligned */
+} V4L2RecordEntry;
+
+/* followed by options bytes of the driver options the session ran with,
+ * as "Name=Value" strings, each NUL terminated
+ */
+typedef struct {
+    char        magic[8];
+    uint32_t    version;
+    uint16_t    width, height;  /* of the (first) screen */
+    uint32_t    options;
+    uint32_t    pad;
+} V4L2RecordHeader;
+
+#endif /* __V4L2_RECORD_H__ */
@@ -0,0 +1,500 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: software scaling and deinterlacing of YUV images
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "v4l2-scale.h"
+
+#define WEAK __attribute__((weak))
+
+#ifndef MAX
+#  define MAX(a,b) ((a) > (b) ? (a) : (b))
+#endif
+#ifndef MIN
+#  define MIN(a,b) ((a) > (b) ? (b) : (a))
+#endif
+
+/* Planes are scaled one row at a time, vertically first: the source rows
+ * a destination row depends on are blended (or averaged) into a scratch
+ * row, which is then resampled horizontally, component by component, into
+ * the destination.  So the working set is a few rows, whatever the image
+ * size, and the vertical pass, the bulk of the work, is a plain byte-wise
+ * loop over whole rows that vectorizes well.
+ */
+
+#define MAX_THREADS     4
+#define MAX_BANDS       16
+#define MAX_WIDTH       4096    /* in bytes, of a plane's row */
+
+typedef struct {
+    int plane, offset, step;    /* where the samples are, in bytes */
+    int xshift, yshift;         /* subsampling */
+} Component;
+
+static const struct {
+    int nplanes, ncomps;
+    Component comps[3];
+} layouts[] = {
+    [V4L2_SCALE_YUYV]   = { 1, 3, { { 0, 0, 2, 0, 0 }, { 0, 1, 4, 1, 0 },
+                                    { 0, 3, 4, 1, 0 } } },
+    [V4L2_SCALE_UYVY]   = { 1, 3, { { 0, 1, 2, 0, 0 }, { 0, 0, 4, 1, 0 },
+                                    { 0, 2, 4, 1, 0 } } },
+    [V4L2_SCALE_YUV420] = { 3, 3, { { 0, 0, 1, 0, 0 }, { 1, 0, 1, 1, 1 },
+                                    { 2, 0, 1, 1, 1 } } },
+    [V4L2_SCALE_NV12]   = { 2, 3, { { 0, 0, 1, 0, 0 }, { 1, 0, 2, 1, 1 },
+                                    { 1, 1, 2, 1, 1 } } },
+};
+
+/* horizontal maps, one per component, computed once per frame.  Linear:
+ * (index << 9) | weight, weight in [0, 256].  Box: first index of each
+ * destination sample, plus one past the last:
+ */
+typedef struct {
+    int box;
+    int n;
+    uint32_t *map;
+} HMap;
+
+typedef struct {
+    const V4L2ScaleImage *src;
+    V4L2ScaleImage *dst;
+    HMap hmaps[3];
+    int nbands;
+    int next, done;             /* bands taken, finished */
+} Job;
+
+/* ---------------------------------------------------------------------- */
+
+WEAK void
+V4L2ScaleBlendRow(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+        int n, int weight)
+{
+    int i, w0 = 256 - weight;
+
+    for (i = 0; i < n; i++)
+        dst[i] = ((a[i] * w0) + (b[i] * weight) + 128) >> 8;
+}
+
+WEAK void
+V4L2ScaleAccumRow(uint16_t *acc, const uint8_t *src, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        acc[i] += src[i];
+}
+
+WEAK void
+V4L2ScaleAverageRow(uint8_t *dst, const uint16_t *acc, int n, int count)
+{
+    uint32_t recip = (65536 + (count / 2)) / count;
+    int i;
+
+    for (i = 0; i < n; i++)
+        dst[i] = ((acc[i] * recip) + 32768) >> 16;
+}
+
+WEAK void
+V4L2ScaleLinearH(uint8_t *dst, int dstStep, const uint8_t *src,
+        int srcStep, const uint32_t *map, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        const uint8_t *s = src + ((map[i] >> 9) * srcStep);
+        int w = map[i] & 0x1ff;
+        dst[i * dstStep] = ((s[0] * (256 - w)) + (s[srcStep] * w) + 128) >> 8;
+    }
+}
+
+WEAK void
+V4L2ScaleBoxH(uint8_t *dst, int dstStep, const uint8_t *src,
+        int srcStep, const uint32_t *map, int n)
+{
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+        int count = map[i + 1] - map[i];
+        int sum = 0;
+        for (j = map[i]; j < map[i + 1]; j++)
+            sum += src[j * srcStep];
+        dst[i * dstStep] = (sum + (count / 2)) / count;
+    }
+}
+
+/* rows of bytes, LANES at a time, averaged without widening: */
+#define LANES   16
+
+typedef uint8_t Bytes __attribute__((vector_size(LANES)));
+
+WEAK void
+V4L2DeinterlaceRow(uint8_t *dst, const uint8_t *a, const uint8_t *b, int n)
+{
+    int i;
+
+    for (i = 0; i + LANES <= n; i += LANES) {
+        Bytes va, vb;
+        memcpy(&va, a + i, LANES);
+        memcpy(&vb, b + i, LANES);
+        va = (va | vb) - ((va ^ vb) >> 1);
+        memcpy(dst + i, &va, LANES);
+    }
+
+    for (; i < n; i++)
+        dst[i] = (a[i] + b[i] + 1) >> 1;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* position of the center of destination sample i in the source, in 1/256
+ * of a sample:
+ */
+static inline int
+SourcePos(int i, int srcN, int dstN)
+{
+    int pos = (int)((((int64_t)((2 * i) + 1) * srcN) - dstN) * 256 / (2 * dstN));
+    return MIN(MAX(pos, 0), (srcN - 1) * 256);
+}
+
+static int
+HMapInit(HMap *h, int srcN, int dstN)
+{
+    int i;
+
+    h->box = (srcN >= (2 * dstN));
+    h->n = dstN;
+    h->map = malloc((dstN + 1) * sizeof(uint32_t));
+    if (!h->map)
+        return -1;
+
+    for (i = 0; i < dstN; i++) {
+        if (h->box) {
+            h->map[i] = (int)(((int64_t)i * srcN) / dstN);
+        } else {
+            int pos = SourcePos(i, srcN, dstN);
+            int idx = pos >> 8, w = pos & 0xff;
+            if (idx >= (srcN - 1)) {
+                idx = srcN - 2;
+                w = 256;
+            }
+            h->map[i] = (idx << 9) | w;
+        }
+    }
+    h->map[dstN] = srcN;
+
+    return 0;
+}
+
+static int
+RowBytes(int format, int plane, int width)
+{
+    int i, bytes = 0;
+
+    for (i = 0; i < layouts[format].ncomps; i++) {
+        const Component *c = &layouts[format].comps[i];
+        if (c->plane == plane) {
+            int n = width >> c->xshift;
+            bytes = MAX(bytes, c->offset + (c->step * (n - 1)) + 1);
+        }
+    }
+
+    return bytes;
+}
+
+static int
+PlaneYShift(int format, int plane)
+{
+    int i;
+
+    for (i = 0; i < layouts[format].ncomps; i++)
+        if (layouts[format].comps[i].plane == plane)
+            return layouts[format].comps[i].yshift;
+
+    return 0;
+}
+
+/* scale destination rows [y1, y2) of a plane: */
+static void
+ScalePlane(Job *job, int plane, int y1, int y2, uint8_t *row, uint16_t *acc)
+{
+    const V4L2ScaleImage *src = job->src;
+    V4L2ScaleImage *dst = job->dst;
+    int format = src->format;
+    int yshift = PlaneYShift(format, plane);
+    int srcRows = src->height >> yshift, dstRows = dst->height >> yshift;
+    int bytes = RowBytes(format, plane, src->width);
+    int sstride = src->strides[plane], dstride = dst->strides[plane];
+    int box = (srcRows >= (2 * dstRows));
+    int y, i;
+
+    for (y = y1; y < y2; y++) {
+        const uint8_t *in;
+        uint8_t *out = dst->planes[plane] + (y * dstride);
+
+        if (box) {
+            int r1 = (int)(((int64_t)y * srcRows) / dstRows);
+            int r2 = (int)(((int64_t)(y + 1) * srcRows) / dstRows);
+            int r;
+
+            /* more than 256 rows would overflow the accumulator: */
+            r2 = MIN(r2, r1 + 256);
+            memset(acc, 0x00, bytes * sizeof(uint16_t));
+            for (r = r1; r < r2; r++)
+                V4L2ScaleAccumRow(acc, src->planes[plane] + (r * sstride), bytes);
+            V4L2ScaleAverageRow(row, acc, bytes, r2 - r1);
+            in = row;
+        } else {
+            int pos = SourcePos(y, srcRows, dstRows);
+            int r = pos >> 8, w = pos & 0xff;
+
+            in = src->planes[plane] + (r * sstride);
+            if (w && (r < (srcRows - 1))) {
+                V4L2ScaleBlendRow(row, in, in + sstride, bytes, w);
+                in = row;
+            }
+        }
+
+        for (i = 0; i < layouts[format].ncomps; i++) {
+            const Component *c = &layouts[format].comps[i];
+            const HMap *h = &job->hmaps[i];
+
+            if (c->plane != plane)
+                continue;
+
+            if (h->box) {
+                V4L2ScaleBoxH(out + c->offset, c->step, in + c->offset,
+                        c->step, h->map, h->n);
+            } else {
+                V4L2ScaleLinearH(out + c->offset, c->step, in + c->offset,
+                        c->step, h->map, h->n);
+            }
+        }
+    }
+}
+
+static void
+ScaleBand(Job *job, int band)
+{
+    uint8_t row[MAX_WIDTH];
+    uint16_t acc[MAX_WIDTH];
+    int plane;
+
+    for (plane = 0; plane < layouts[job->src->format].nplanes; plane++) {
+        int rows = job->dst->height >> PlaneYShift(job->src->format, plane);
+        ScalePlane(job, plane, (band * rows) / job->nbands,
+                ((band + 1) * rows) / job->nbands, row, acc);
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* workers, started on first use and kept for the life of the server: */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t start, finish;
+    int nthreads;
+    unsigned int gen;           /* bumped for each job */
+    int active;                 /* workers inside a job */
+    Job job;
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .finish = PTHREAD_COND_INITIALIZER,
+};
+
+static void
+RunBands(Job *job)
+{
+    int band;
+
+    while ((band = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) <
+            job->nbands) {
+        ScaleBand(job, band);
+        __atomic_fetch_add(&job->done, 1, __ATOMIC_RELEASE);
+    }
+}
+
+static void *
+Worker(void *arg)
+{
+    unsigned int seen = 0;
+
+    pthread_mutex_lock(&pool.lock);
+    while (1) {
+        while (pool.gen == seen)
+            pthread_cond_wait(&pool.start, &pool.lock);
+        seen = pool.gen;
+        pool.active++;
+        pthread_mutex_unlock(&pool.lock);
+
+        RunBands(&pool.job);
+
+        pthread_mutex_lock(&pool.lock);
+        pool.active--;
+        pthread_cond_broadcast(&pool.finish);
+    }
+
+    return NULL;
+}
+
+/* the workers must not take the server's signals: */
+static void
+StartWorkers(int n)
+{
+    sigset_t all, old;
+
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+
+    while (pool.nthreads < n) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, Worker, NULL))
+            break;
+        pthread_detach(thread);
+        pool.nthreads++;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+static int
+JobInit(Job *job, const V4L2ScaleImage *src, V4L2ScaleImage *dst)
+{
+    const int format = src->format;
+    int i;
+
+    job->src = src;
+    job->dst = dst;
+    job->next = 0;
+    job->done = 0;
+
+    for (i = 0; i < layouts[format].ncomps; i++) {
+        const Component *c = &layouts[format].comps[i];
+        if (HMapInit(&job->hmaps[i], src->width >> c->xshift,
+                dst->width >> c->xshift)) {
+            while (i--)
+                free(job->hmaps[i].map);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void
+JobFini(Job *job)
+{
+    int i;
+
+    for (i = 0; i < layouts[job->src->format].ncomps; i++)
+        free(job->hmaps[i].map);
+}
+
+void
+V4L2Scale(const V4L2ScaleImage *src, V4L2ScaleImage *dst, int threads)
+{
+    const int format = src->format;
+    Job *job = &pool.job;
+
+    /* the bilinear filter needs two samples of each component: */
+    if ((src->width < 4) || (src->height < 4) ||
+            (dst->width < 4) || (dst->height < 4) ||
+            (RowBytes(format, 0, src->width) > MAX_WIDTH))
+        return;
+
+    /* on its own the caller needs nothing shared, and may be any thread: */
+    threads = MIN(MAX(threads, 1), MAX_THREADS);
+    if (threads == 1) {
+        Job own;
+
+        if (JobInit(&own, src, dst))
+            return;
+        own.nbands = 1;
+        RunBands(&own);
+        JobFini(&own);
+        return;
+    }
+
+    StartWorkers(threads - 1);
+
+    pthread_mutex_lock(&pool.lock);
+
+    /* stragglers of the last job are done with it before it's reused: */
+    while (pool.active)
+        pthread_cond_wait(&pool.finish, &pool.lock);
+
+    if (JobInit(job, src, dst)) {
+        pthread_mutex_unlock(&pool.lock);
+        return;
+    }
+
+    job->nbands = MIN(MAX_BANDS, MAX(1, (dst->height >> 1) / 16));
+    if (pool.nthreads == 0)
+        job->nbands = 1;
+
+    if (job->nbands > 1) {
+        pool.gen++;
+        pthread_cond_broadcast(&pool.start);
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    RunBands(job);
+
+    pthread_mutex_lock(&pool.lock);
+    while ((__atomic_load_n(&job->done, __ATOMIC_ACQUIRE) < job->nbands) ||
+            pool.active)
+        pthread_cond_wait(&pool.finish, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+
+    JobFini(job);
+}
+
+/* ---------------------------------------------------------------------- */
+
+void
+V4L2Deinterlace(const V4L2ScaleImage *field, V4L2ScaleImage *dst, int mode)
+{
+    const int format = field->format;
+    int plane, y;
+
+    if ((field->width != dst->width) || ((2 * field->height) != dst->height))
+        return;
+
+    for (plane = 0; plane < layouts[format].nplanes; plane++) {
+        int rows = field->height >> PlaneYShift(format, plane);
+        int bytes = RowBytes(format, plane, field->width);
+        int fstride = field->strides[plane], dstride = dst->strides[plane];
+
+        for (y = 0; y < rows; y++) {
+            const uint8_t *in = field->planes[plane] + (y * fstride);
+            uint8_t *out = dst->planes[plane] + (2 * y * dstride);
+
+            memcpy(out, in, bytes);
+            if ((mode == V4L2_DEINTERLACE_LINEAR) && (y < (rows - 1)))
+                V4L2DeinterlaceRow(out + dstride, in, in + fstride, bytes);
+            else
+                memcpy(out + dstride, in, bytes);
+        }
+    }
+}
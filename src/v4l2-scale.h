@@ -0,0 +1,62 @@
+/*
+ * v4l2-scale.h
+ *
+ * Software scaling of YUV images, for when the overlay can't scale, and
+ * deinterlacing of captured video.  No X server dependencies, so that the
+ * offline tools can be built with the very same code.  The row kernels are
+ * weak symbols, so optimized versions take precedence at link time, like
+ * the ones in v4l2-blit.c.
+ */
+
+#ifndef __V4L2_SCALE_H__
+#define __V4L2_SCALE_H__
+
+#include <stdint.h>
+
+enum {
+    V4L2_SCALE_YUYV,            /* packed 4:2:2 */
+    V4L2_SCALE_UYVY,
+    V4L2_SCALE_YUV420,          /* planar 4:2:0, Y U V or Y V U planes */
+    V4L2_SCALE_NV12,            /* semi-planar 4:2:0, Y and UV planes */
+};
+
+typedef struct {
+    int         format;
+    int         width, height;  /* in pixels, even */
+    uint8_t     *planes[3];
+    int         strides[3];     /* bytes */
+} V4L2ScaleImage;
+
+/* Scale src to the size of dst, which must be of the same format.  Planes
+ * are scaled with a box filter along an axis that shrinks by 2x or more,
+ * else bilinear.  The rows of the destination are split into bands which
+ * are scaled in parallel by up to threads threads (including the caller).
+ * With a single thread it is reentrant, and safe to call from any thread.
+ */
+void V4L2Scale(const V4L2ScaleImage *src, V4L2ScaleImage *dst, int threads);
+
+enum {
+    V4L2_DEINTERLACE_BOB,       /* repeat each line of the field */
+    V4L2_DEINTERLACE_LINEAR,    /* interpolate the missing lines */
+};
+
+/* Make a frame of dst, twice the height of field (one field of interlaced
+ * video, so every other line of the frame) and of the same format and
+ * width.  Reentrant, like V4L2Scale() with a single thread.
+ */
+void V4L2Deinterlace(const V4L2ScaleImage *field, V4L2ScaleImage *dst,
+        int mode);
+
+/* row kernels: */
+void V4L2ScaleBlendRow(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+        int n, int weight);
+void V4L2ScaleAccumRow(uint16_t *acc, const uint8_t *src, int n);
+void V4L2ScaleAverageRow(uint8_t *dst, const uint16_t *acc, int n, int count);
+void V4L2ScaleLinearH(uint8_t *dst, int dstStep, const uint8_t *src,
+        int srcStep, const uint32_t *map, int n);
+void V4L2ScaleBoxH(uint8_t *dst, int dstStep, const uint8_t *src,
+        int srcStep, const uint32_t *map, int n);
+void V4L2DeinterlaceRow(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+        int n);
+
+#endif /* __V4L2_SCALE_H__ */
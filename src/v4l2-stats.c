@@ -0,0 +1,240 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: runtime statistics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+
+#include "xf86.h"
+#include "xf86_OSproc.h"
+#include "xf86xv.h"
+#include "v4l2.h"
+
+V4L2ScreenStats v4l2ScreenStats[MAXSCREENS];
+
+static struct {
+    const char *name;
+    V4L2PortStats *stats;
+} *ports = NULL;
+
+static int numPorts = 0;
+
+/* set from the signal handler, the actual dump happens from the wakeup
+ * handler where it is safe to do file I/O:
+ */
+static volatile sig_atomic_t dumpRequested = 0;
+
+static const char *opNames[V4L2_NUM_OPS] = {
+        "solid", "transparent", "cursor", "osd", "video"
+};
+
+/* ---------------------------------------------------------------------- */
+
+/* in usec, 64 bit so it doesn't wrap (a 32 bit long would in 71 minutes) */
+uint64_t
+V4L2StatsNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+void
+V4L2StatsIoctl(V4L2PortStats *stats, unsigned long usec)
+{
+    int bucket = 0;
+
+    while ((usec >> bucket) && (bucket < V4L2_STAT_HIST - 1))
+        bucket++;
+
+    V4L2_STAT_ADD(stats->ioctls, 1);
+    V4L2_STAT_ADD(stats->ioctlUsec, usec);
+    V4L2_STAT_ADD(stats->ioctlHist[bucket], 1);
+}
+
+/**
+ * Count an Xv image the overlay showed, at V4L2StatsNow() time present,
+ * that was due at due (when it was submitted, or the XV_PRESENT_TIME it
+ * was held for).  Jitter is how much that latency changed from the
+ * previous frame, so a steady delay isn't any, but frames shown unevenly
+ * though submitted evenly are.  That is the D of RFC 3550, not smoothed
+ * into a running estimate as RTP does: percentiles are taken of it as is.
+ */
+void
+V4L2StatsPresent(V4L2PortStats *stats, uint64_t due, uint64_t present)
+{
+    unsigned long n = V4L2_STAT_GET(stats->presented);
+    unsigned long latency = (present > due) ? (present - due) : 0;
+
+    if (n) {
+        unsigned long prev = stats->latencyUsec[(n - 1) % V4L2_STAT_SAMPLES];
+        stats->jitterUsec[(n - 1) % V4L2_STAT_SAMPLES] =
+                (latency > prev) ? (latency - prev) : (prev - latency);
+    }
+    stats->latencyUsec[n % V4L2_STAT_SAMPLES] = latency;
+
+    V4L2_STAT_ADD(stats->presented, 1);
+}
+
+static int
+CompareSamples(const void *a, const void *b)
+{
+    unsigned long x = *(const unsigned long *)a, y = *(const unsigned long *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * The given percentile of the latest of count samples kept in a ring of
+ * V4L2_STAT_SAMPLES, or 0 if there are none.
+ */
+unsigned long
+V4L2StatsPercentile(const unsigned long *samples, unsigned long count,
+        int percent)
+{
+    unsigned long sorted[V4L2_STAT_SAMPLES];
+    int n = MIN(count, V4L2_STAT_SAMPLES);
+
+    if (!n)
+        return 0;
+
+    memcpy(sorted, samples, n * sizeof(sorted[0]));
+    qsort(sorted, n, sizeof(sorted[0]), CompareSamples);
+
+    return sorted[((n - 1) * percent + 50) / 100];
+}
+
+void
+V4L2StatsAddPort(const char *name, V4L2PortStats *stats)
+{
+    ports = realloc(ports, sizeof(ports[0]) * (numPorts + 1));
+    if (!ports) {
+        numPorts = 0;
+        return;
+    }
+    ports[numPorts].name  = name;
+    ports[numPorts].stats = stats;
+    numPorts++;
+}
+
+static void
+V4L2StatsDump(void)
+{
+    FILE *f;
+    unsigned long n;
+    int i, j;
+
+    f = fopen(config.statsFile, "w");
+    if (!f) {
+        xf86Msg(X_WARNING, "v4l2: could not write %s\n", config.statsFile);
+        return;
+    }
+
+    for (i = 0; i < screenInfo.numScreens; i++) {
+        V4L2ScreenStats *s = &v4l2ScreenStats[i];
+        fprintf(f, "screen %d: updates=%lu update_usec=%lu regions=%lu "
+                "flips=%lu vsync_waits=%lu\n", i,
+                V4L2_STAT_GET(s->updates), V4L2_STAT_GET(s->updateUsec),
+                V4L2_STAT_GET(s->regionAllocs), V4L2_STAT_GET(s->flips),
+                V4L2_STAT_GET(s->vsyncWaits));
+        fprintf(f, "  hashed_tiles=%lu skipped_bytes=%lu deferred_bytes=%lu\n",
+                V4L2_STAT_GET(s->hashedTiles), V4L2_STAT_GET(s->skippedBytes),
+                V4L2_STAT_GET(s->deferredBytes));
+        for (j = 0; j < V4L2_NUM_OPS; j++) {
+            fprintf(f, "  %-12s boxes=%lu bytes=%lu\n", opNames[j],
+                    V4L2_STAT_GET(s->boxes[j]), V4L2_STAT_GET(s->bytes[j]));
+        }
+    }
+
+    for (i = 0; i < numPorts; i++) {
+        V4L2PortStats *s = ports[i].stats;
+        fprintf(f, "port %d (%s): ioctls=%lu ioctl_usec=%lu reputs=%lu commits=%lu\n",
+                i, ports[i].name,
+                V4L2_STAT_GET(s->ioctls), V4L2_STAT_GET(s->ioctlUsec),
+                V4L2_STAT_GET(s->reputs), V4L2_STAT_GET(s->commits));
+        fprintf(f, "  frames=%lu dropped=%lu\n",
+                V4L2_STAT_GET(s->frames), V4L2_STAT_GET(s->dropped));
+        n = V4L2_STAT_GET(s->presented);
+        fprintf(f, "  presented=%lu unstamped=%lu held=%lu latency_usec "
+                "p50=%lu p90=%lu p99=%lu jitter_usec p50=%lu p90=%lu p99=%lu\n",
+                n, V4L2_STAT_GET(s->unstamped), V4L2_STAT_GET(s->held),
+                V4L2StatsPercentile(s->latencyUsec, n, 50),
+                V4L2StatsPercentile(s->latencyUsec, n, 90),
+                V4L2StatsPercentile(s->latencyUsec, n, 99),
+                V4L2StatsPercentile(s->jitterUsec, n ? n - 1 : 0, 50),
+                V4L2StatsPercentile(s->jitterUsec, n ? n - 1 : 0, 90),
+                V4L2StatsPercentile(s->jitterUsec, n ? n - 1 : 0, 99));
+        fprintf(f, "  ioctl_usec histogram:");
+        for (j = 0; j < V4L2_STAT_HIST - 1; j++) {
+            fprintf(f, " <%lu:%lu", 1UL << j, V4L2_STAT_GET(s->ioctlHist[j]));
+        }
+        /* the last bucket takes everything above: */
+        fprintf(f, " >=%lu:%lu", 1UL << (j - 1),
+                V4L2_STAT_GET(s->ioctlHist[j]));
+        fprintf(f, "\n");
+    }
+
+    fclose(f);
+}
+
+static void
+V4L2StatsSignal(int sig)
+{
+    dumpRequested = 1;
+}
+
+static void
+V4L2StatsWakeup(pointer blockData, int result, pointer pReadmask)
+{
+    if (UNLIKELY (dumpRequested)) {
+        dumpRequested = 0;
+        if (config.statsFile)
+            V4L2StatsDump();
+        if (config.traceFile)
+            V4L2TraceDump();
+        V4L2RecordFlush();
+    }
+}
+
+/**
+ * If a stats or trace file is configured, dump the counters and/or trace
+ * ring to it whenever the server receives SIGUSR2.  That also flushes the
+ * session recording, if there is one.
+ */
+void
+V4L2StatsInit(void)
+{
+    static Bool done = FALSE;
+
+    if (done || !(config.statsFile || config.traceFile || config.recordFile))
+        return;
+
+    done = TRUE;
+
+    OsSignal(SIGUSR2, V4L2StatsSignal);
+    RegisterBlockAndWakeupHandlers((BlockHandlerProcPtr)NoopDDA,
+            V4L2StatsWakeup, NULL);
+}
@@ -0,0 +1,332 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: tile bitmaps for masking video clips out of the damage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "v4l2-tiles.h"
+
+#define S  V4L2_TILE_SHIFT
+#define T  V4L2_TILE_SIZE
+
+#ifndef MAX
+#  define MAX(a,b) ((a) > (b) ? (a) : (b))
+#endif
+#ifndef MIN
+#  define MIN(a,b) ((a) > (b) ? (b) : (a))
+#endif
+
+int
+V4L2TileMaskInit(V4L2TileMask *mask, int width, int height)
+{
+    mask->width  = width;
+    mask->height = height;
+    mask->cols   = (width + T - 1) >> S;
+    mask->rows   = (height + T - 1) >> S;
+    mask->words  = (mask->cols + 31) >> 5;
+    mask->full   = calloc(mask->rows * mask->words, sizeof(uint32_t));
+    mask->part   = calloc(mask->rows * mask->words, sizeof(uint32_t));
+
+    if (!mask->full || !mask->part) {
+        V4L2TileMaskFini(mask);
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+V4L2TileMaskFini(V4L2TileMask *mask)
+{
+    free(mask->full);
+    free(mask->part);
+    memset(mask, 0, sizeof(*mask));
+}
+
+void
+V4L2TileMaskClear(V4L2TileMask *mask)
+{
+    memset(mask->full, 0, mask->rows * mask->words * sizeof(uint32_t));
+    memset(mask->part, 0, mask->rows * mask->words * sizeof(uint32_t));
+}
+
+/* set bits [a, b) */
+static void
+SetBits(uint32_t *row, int a, int b)
+{
+    while (a < b) {
+        int n = MIN(b - a, 32 - (a & 31));
+        row[a >> 5] |= ((n == 32) ? ~0u : ((1u << n) - 1)) << (a & 31);
+        a += n;
+    }
+}
+
+static inline int
+TestBit(const uint32_t *row, int a)
+{
+    return (row[a >> 5] >> (a & 31)) & 1;
+}
+
+/* end of the run of tiles starting at tx whose bit (in a | b) is set (or
+ * clear), not going past end:
+ */
+static int
+RunEnd(const uint32_t *a, const uint32_t *b, int tx, int end, int set)
+{
+    while (tx < end) {
+        int shift = tx & 31;
+        uint32_t w = a[tx >> 5] | (b ? b[tx >> 5] : 0);
+        uint32_t stop;
+
+        if (!set)
+            w = ~w;
+        stop = ~(w >> shift);
+        if (shift)
+            stop &= (1u << (32 - shift)) - 1;
+
+        if (stop)
+            return MIN(tx + __builtin_ctz(stop), end);
+
+        tx += 32 - shift;
+    }
+
+    return end;
+}
+
+void
+V4L2TileMaskAdd(V4L2TileMask *mask, const V4L2TileBox *boxes, int nbox)
+{
+    int i, ty;
+
+    for (i = 0; i < nbox; i++) {
+        int x1 = MAX(boxes[i].x1, 0), y1 = MAX(boxes[i].y1, 0);
+        int x2 = MIN(boxes[i].x2, mask->width);
+        int y2 = MIN(boxes[i].y2, mask->height);
+        int tx1, tx2, ty1, ty2, fx1, fx2, fy1, fy2;
+
+        if ((x1 >= x2) || (y1 >= y2))
+            continue;
+
+        /* tiles touched: */
+        tx1 = x1 >> S;
+        tx2 = (x2 + T - 1) >> S;
+        ty1 = y1 >> S;
+        ty2 = (y2 + T - 1) >> S;
+
+        /* tiles covered, where the screen edge counts as a tile edge: */
+        fx1 = (x1 + T - 1) >> S;
+        fx2 = (x2 == mask->width) ? mask->cols : (x2 >> S);
+        fy1 = (y1 + T - 1) >> S;
+        fy2 = (y2 == mask->height) ? mask->rows : (y2 >> S);
+
+        for (ty = ty1; ty < ty2; ty++) {
+            uint32_t *full = mask->full + (ty * mask->words);
+            uint32_t *part = mask->part + (ty * mask->words);
+
+            if ((ty >= fy1) && (ty < fy2) && (fx1 < fx2)) {
+                SetBits(full, fx1, fx2);
+                SetBits(part, tx1, fx1);
+                SetBits(part, fx2, tx2);
+            } else {
+                SetBits(part, tx1, tx2);
+            }
+        }
+    }
+
+    for (i = 0; i < mask->rows * mask->words; i++)
+        mask->part[i] &= ~mask->full[i];
+}
+
+void
+V4L2TileMaskOr(V4L2TileMask *dst, const V4L2TileMask *src)
+{
+    int i;
+
+    for (i = 0; i < dst->rows * dst->words; i++) {
+        dst->full[i] |= src->full[i];
+        dst->part[i] = (dst->part[i] | src->part[i]) & ~dst->full[i];
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+
+typedef struct {
+    const V4L2TileBoxList *clips;
+    int nclips;
+    V4L2TileEmitProc emit;
+    void *closure;
+} SubtractCtx;
+
+/* first box of a banded list that ends below y: */
+static const V4L2TileBox *
+FirstBelow(const V4L2TileBox *boxes, int nbox, int y)
+{
+    int lo = 0, hi = nbox;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (boxes[mid].y2 <= y)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return boxes + lo;
+}
+
+/* exact: emit sub minus clips[k..], walking the bands of each clip */
+static void
+SubtractExact(SubtractCtx *ctx, int k, const V4L2TileBox *sub)
+{
+    const V4L2TileBox *c, *end, *b;
+    V4L2TileBox piece;
+    int y;
+
+    if (k == ctx->nclips) {
+        ctx->emit(ctx->closure, sub);
+        return;
+    }
+
+    c = FirstBelow(ctx->clips[k].boxes, ctx->clips[k].nbox, sub->y1);
+    end = ctx->clips[k].boxes + ctx->clips[k].nbox;
+    y = sub->y1;
+
+    while ((c < end) && (c->y1 < sub->y2) && (y < sub->y2)) {
+        const V4L2TileBox *band = c;
+        int ry2, x;
+
+        while ((c < end) && (c->y1 == band->y1))
+            c++;
+
+        if (band->y2 <= y)
+            continue;
+
+        /* rows above the band are not covered: */
+        if (band->y1 > y) {
+            piece.x1 = sub->x1;
+            piece.y1 = y;
+            piece.x2 = sub->x2;
+            piece.y2 = band->y1;
+            SubtractExact(ctx, k + 1, &piece);
+            y = band->y1;
+        }
+
+        /* neither are the gaps between the band's boxes: */
+        ry2 = MIN(band->y2, sub->y2);
+        x = sub->x1;
+        for (b = band; b < c; b++) {
+            if (b->x2 <= x)
+                continue;
+            if (b->x1 >= sub->x2)
+                break;
+            if (b->x1 > x) {
+                piece.x1 = x;
+                piece.y1 = y;
+                piece.x2 = b->x1;
+                piece.y2 = ry2;
+                SubtractExact(ctx, k + 1, &piece);
+            }
+            x = b->x2;
+        }
+        if (x < sub->x2) {
+            piece.x1 = x;
+            piece.y1 = y;
+            piece.x2 = sub->x2;
+            piece.y2 = ry2;
+            SubtractExact(ctx, k + 1, &piece);
+        }
+
+        y = ry2;
+    }
+
+    if (y < sub->y2) {
+        piece.x1 = sub->x1;
+        piece.y1 = y;
+        piece.x2 = sub->x2;
+        piece.y2 = sub->y2;
+        SubtractExact(ctx, k + 1, &piece);
+    }
+}
+
+void
+V4L2TileMaskSubtract(const V4L2TileMask *mask,
+        const V4L2TileBoxList *clips, int nclips,
+        const V4L2TileBox *damage, int ndamage,
+        V4L2TileEmitProc emit, void *closure)
+{
+    SubtractCtx ctx = { clips, nclips, emit, closure };
+    int start = 0, i, ty, ty1, ty2;
+
+    if (ndamage == 0)
+        return;
+
+    /* banded, so the first and last boxes bound the damage vertically: */
+    ty1 = MAX(damage[0].y1, 0) >> S;
+    ty2 = MIN((damage[ndamage - 1].y2 + T - 1) >> S, mask->rows);
+
+    for (ty = ty1; ty < ty2; ty++) {
+        const uint32_t *full = mask->full + (ty * mask->words);
+        const uint32_t *part = mask->part + (ty * mask->words);
+        int rowY1 = ty << S, rowY2 = rowY1 + T;
+
+        while ((start < ndamage) && (damage[start].y2 <= rowY1))
+            start++;
+
+        for (i = start; (i < ndamage) && (damage[i].y1 < rowY2); i++) {
+            const V4L2TileBox *d = &damage[i];
+            int y1 = MAX(d->y1, rowY1), y2 = MIN(d->y2, rowY2);
+            int tx = MAX(d->x1, 0) >> S;
+            int txEnd = MIN((MIN(d->x2, mask->width) + T - 1) >> S, mask->cols);
+
+            if (y1 >= y2)
+                continue;
+
+            while (tx < txEnd) {
+                V4L2TileBox box;
+                int end;
+
+                if (TestBit(full, tx)) {
+                    /* inside video, nothing to do: */
+                    tx = RunEnd(full, NULL, tx, txEnd, 1);
+                    continue;
+                }
+
+                if (TestBit(part, tx)) {
+                    end = tx + 1;
+                    box.x1 = MAX(d->x1, tx << S);
+                    box.x2 = MIN(d->x2, end << S);
+                    box.y1 = y1;
+                    box.y2 = y2;
+                    SubtractExact(&ctx, 0, &box);
+                } else {
+                    end = RunEnd(full, part, tx, txEnd, 0);
+                    box.x1 = MAX(d->x1, tx << S);
+                    box.x2 = MIN(d->x2, end << S);
+                    box.y1 = y1;
+                    box.y2 = y2;
+                    emit(closure, &box);
+                }
+
+                tx = end;
+            }
+        }
+    }
+}
@@ -0,0 +1,55 @@
+/*
+ * v4l2-tiles.h
+ *
+ * Tile bitmaps for taking the video clips out of the damage without region
+ * arithmetic.  A mask marks each 32x32 tile of the screen as free, fully
+ * covered by a clip box, or partially covered.  Runs of free tiles are
+ * found a word at a time, full tiles are skipped, and only partial tiles
+ * look at the actual clip boxes.  No X server dependencies, so that
+ * v4l2-replay can use the very same code.
+ */
+
+#ifndef __V4L2_TILES_H__
+#define __V4L2_TILES_H__
+
+#include <stdint.h>
+
+#define V4L2_TILE_SHIFT  5
+#define V4L2_TILE_SIZE   (1 << V4L2_TILE_SHIFT)
+
+/* same layout as the X server's BoxRec */
+typedef struct {
+    int16_t     x1, y1, x2, y2;
+} V4L2TileBox;
+
+/* boxes in y-x banded order, as in a region */
+typedef struct {
+    const V4L2TileBox *boxes;
+    int nbox;
+} V4L2TileBoxList;
+
+typedef struct {
+    int width, height;
+    int cols, rows;
+    int words;                  /* per row of tiles */
+    uint32_t *full;             /* tile is inside a single clip box */
+    uint32_t *part;             /* tile is partially covered */
+} V4L2TileMask;
+
+typedef void (*V4L2TileEmitProc)(void *closure, const V4L2TileBox *box);
+
+int V4L2TileMaskInit(V4L2TileMask *mask, int width, int height);
+void V4L2TileMaskFini(V4L2TileMask *mask);
+void V4L2TileMaskClear(V4L2TileMask *mask);
+void V4L2TileMaskAdd(V4L2TileMask *mask, const V4L2TileBox *boxes, int nbox);
+void V4L2TileMaskOr(V4L2TileMask *dst, const V4L2TileMask *src);
+
+/* emit the parts of the damage that are outside all the clips, tile row
+ * by tile row from the top.  mask must cover (at least) the clips.
+ */
+void V4L2TileMaskSubtract(const V4L2TileMask *mask,
+        const V4L2TileBoxList *clips, int nclips,
+        const V4L2TileBox *damage, int ndamage,
+        V4L2TileEmitProc emit, void *closure);
+
+#endif /* __V4L2_TILES_H__ */
@@ -0,0 +1,134 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: low overhead binary event trace
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "xf86.h"
+#include "xf86_OSproc.h"
+#include "xf86xv.h"
+#include "v4l2.h"
+
+/* The ring is written without locks: each writer claims a slot with an
+ * atomic increment of head, invalidates it, fills it in, and then
+ * publishes it by storing its sequence number.  The dumper reads the
+ * sequence number before and after copying a slot, and skips the slot
+ * unless both match, ie. if it was being (over)written while we read it.
+ * Writers are on other threads too (capture and export workers), so the
+ * fences are needed on ARM, where stores and loads are reordered.
+ */
+V4L2TraceRecord *v4l2Trace = NULL;
+static uint32_t head = 0;
+
+/* ---------------------------------------------------------------------- */
+
+void
+V4L2TraceEvent(int event, int port, int a0, int a1, int a2, int a3)
+{
+    uint32_t idx = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+    V4L2TraceRecord *rec = &v4l2Trace[idx & (V4L2_TRACE_ENTRIES - 1)];
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    /* the invalidation has to be seen before any of the new contents: */
+    __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    rec->event   = event;
+    rec->port    = port;
+    rec->nsec    = (ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+    rec->args[0] = a0;
+    rec->args[1] = a1;
+    rec->args[2] = a2;
+    rec->args[3] = a3;
+    __atomic_store_n(&rec->seq, idx + 1, __ATOMIC_RELEASE);
+}
+
+void
+V4L2TraceDump(void)
+{
+    V4L2TraceHeader hdr;
+    uint32_t end, idx;
+    FILE *f;
+
+    if (!v4l2Trace)
+        return;
+
+    f = fopen(config.traceFile, "wb");
+    if (!f) {
+        xf86Msg(X_WARNING, "v4l2: could not write %s\n", config.traceFile);
+        return;
+    }
+
+    end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    idx = (end > V4L2_TRACE_ENTRIES) ? end - V4L2_TRACE_ENTRIES : 0;
+
+    memset(&hdr, 0x00, sizeof(hdr));
+    memcpy(hdr.magic, V4L2_TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = V4L2_TRACE_VERSION;
+    fwrite(&hdr, sizeof(hdr), 1, f);
+
+    for (; idx != end; idx++) {
+        V4L2TraceRecord *slot = &v4l2Trace[idx & (V4L2_TRACE_ENTRIES - 1)];
+        V4L2TraceRecord rec;
+        uint32_t s1, s2;
+
+        /* the copy is done after the first load and before the second: */
+        s1 = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        rec = *slot;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        s2 = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+        if ((s1 != idx + 1) || (s2 != s1))
+            continue;
+        rec.seq = s1;
+        fwrite(&rec, sizeof(rec), 1, f);
+        hdr.count++;
+    }
+
+    rewind(f);
+    fwrite(&hdr, sizeof(hdr), 1, f);
+    fclose(f);
+
+    xf86Msg(X_INFO, "v4l2: wrote %u trace records to %s\n",
+            (unsigned int)hdr.count, config.traceFile);
+}
+
+/**
+ * Allocate the trace ring, if tracing is enabled.  Until this is called
+ * V4L2_TRACE() is a no-op.
+ */
+void
+V4L2TraceInit(void)
+{
+    if (v4l2Trace || !config.traceFile)
+        return;
+
+    v4l2Trace = calloc(V4L2_TRACE_ENTRIES, sizeof(V4L2TraceRecord));
+    if (!v4l2Trace) {
+        xf86Msg(X_WARNING, "v4l2: could not allocate trace buffer\n");
+    }
+}
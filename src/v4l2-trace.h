@@ -0,0 +1,62 @@
+/*
+ * v4l2-trace.h
+ *
+ * Binary trace format, shared between the driver and v4l2-tracedump.  This
+ * header must not depend on any X server headers.
+ */
+
+#ifndef __V4L2_TRACE_H__
+#define __V4L2_TRACE_H__
+
+#include <stdint.h>
+
+#define V4L2_TRACE_MAGIC        "v4l2trc"
+#define V4L2_TRACE_VERSION      1
+
+/* number of records in the ring, must be a power of two */
+#define V4L2_TRACE_ENTRIES      16384
+
+/* event ids, and the meaning of their arguments.  Append only, the ids
+ * are part of the file format.  Coordinates packed as XY are
+ * (x & 0xffff) | (y << 16).
+ */
+enum {
+    V4L2_TRACE_PUT_VIDEO,       /* drw_x, drw_y, drw_w, drw_h */
+    V4L2_TRACE_PUT_STILL,       /* drw_x, drw_y, drw_w, drw_h */
+    V4L2_TRACE_REPUT_IMAGE,     /* drw_x, drw_y */
+    V4L2_TRACE_STOP_VIDEO,      /* shutdown */
+    V4L2_TRACE_SET_CLIP,        /* nbox, extents XY1, extents XY2 */
+    V4L2_TRACE_CLEAR_CLIP,      /* - */
+    V4L2_TRACE_IOCTL,           /* request, result, usec */
+    V4L2_TRACE_UPDATE_BEGIN,    /* screen, damage nbox, active clips */
+    V4L2_TRACE_UPDATE_END,      /* screen, usec */
+    V4L2_TRACE_BLIT,            /* op, nbox, bytes */
+    V4L2_TRACE_FLIP,            /* screen, page shown, usec waited for vsync
+                                   before drawing it, usec to pan to it */
+    V4L2_TRACE_PUT_IMAGE,       /* drw_x, drw_y, drw_w, drw_h */
+    V4L2_TRACE_GET_VIDEO,       /* drw_x, drw_y, drw_w, drw_h */
+    V4L2_TRACE_GET_STILL,       /* drw_x, drw_y, drw_w, drw_h */
+    V4L2_TRACE_PRESENT,         /* buffer, usec PutImage to QBUF, QBUF to
+                                   shown, shown as timestamped (else when
+                                   dequeued) */
+    V4L2_TRACE_SUSPEND,         /* suspended (else resumed), overlay turned
+                                   off/on */
+    V4L2_TRACE_NUM_EVENTS
+};
+
+typedef struct {
+    uint32_t    seq;            /* index + 1, once the record is complete */
+    uint16_t    event;
+    uint16_t    port;
+    uint64_t    nsec;           /* CLOCK_MONOTONIC */
+    int32_t     args[4];
+} V4L2TraceRecord;
+
+/* a dump is this header followed by count records, oldest first */
+typedef struct {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    count;
+} V4L2TraceHeader;
+
+#endif /* __V4L2_TRACE_H__ */
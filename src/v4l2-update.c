@@ -0,0 +1,338 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: what a shadow update draws, and in which order
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "v4l2-update.h"
+
+#define SPRITE_PAD  V4L2_UPDATE_SPRITE_PAD
+
+typedef struct {
+    V4L2ComposeEmitProc emit;
+    void *closure;
+} Solid;
+
+static void
+EmitSolid(void *closure, const V4L2TileBox *box)
+{
+    Solid *solid = closure;
+    solid->emit(solid->closure, V4L2_UPDATE_SOLID, box);
+}
+
+static void
+EmitRegion(V4L2ComposeEmitProc emit, void *closure, RegionPtr region,
+        int layer)
+{
+    int nbox = RegionNumRects(region);
+    BoxPtr pbox = RegionRects(region);
+
+    while (nbox--)
+        emit(closure, layer, (V4L2TileBox *)pbox++);
+}
+
+/* the part of a cursor that is over video (bounds), and the padded area
+ * around it that has to be transparent too (padded).  Both are added to:
+ */
+static void
+CursorRegions(V4L2UpdatePtr update, const BoxRec *cursor,
+        RegionPtr bounds, RegionPtr padded)
+{
+    BoxRec cursorRect = *cursor, paddedRect;
+    RegionRec tmp;
+    int i;
+
+    paddedRect.x1 = cursorRect.x1 - SPRITE_PAD;
+    paddedRect.y1 = cursorRect.y1 - SPRITE_PAD;
+    paddedRect.x2 = cursorRect.x2 + 2 * SPRITE_PAD;
+    paddedRect.y2 = cursorRect.y2 + 2 * SPRITE_PAD;
+
+    for (i = 0; i < update->nclips; i++) {
+        RegionPtr clip = update->clips[i].clip;
+
+        if (clip && RegionContainsRect(clip, &cursorRect)) {
+            /* cursor at least partially intersects:
+             */
+            RegionInit(&tmp, &cursorRect, 1);
+            RegionIntersect(&tmp, &tmp, clip);
+            RegionUnion(bounds, bounds, &tmp);
+            RegionUninit(&tmp);
+
+            RegionInit(&tmp, &paddedRect, 1);
+            RegionIntersect(&tmp, &tmp, clip);
+            RegionUnion(padded, padded, &tmp);
+            RegionUninit(&tmp);
+        }
+    }
+}
+
+/* what was drawn for the previous cursors, within current video: */
+static void
+CursorStale(V4L2UpdatePtr update, RegionPtr stale)
+{
+    RegionRec video;
+    int i;
+
+    RegionNull(&video);
+    for (i = 0; i < update->nclips; i++) {
+        if (update->clips[i].clip) {
+            RegionUnion(&video, &video, update->clips[i].clip);
+        }
+    }
+    RegionIntersect(stale, stale, &video);
+    RegionUninit(&video);
+}
+
+/* the solid damage minus the clips masked out of it, using the tile masks
+ * of the clips rather than region arithmetic when they all have one.
+ * Returns the mask to subtract with, or NULL if solid was done with
+ * region arithmetic:
+ */
+static const V4L2TileMask *
+SolidMask(V4L2UpdatePtr update, RegionPtr *damage, RegionPtr solid,
+        int *nclips)
+{
+    const V4L2TileMask *mask = NULL;
+    int i, n = 0;
+
+    for (i = 0; i < update->nclips; i++) {
+        const V4L2UpdateClip *clip = &update->clips[i];
+
+        if (!clip->clip || !clip->masked)
+            continue;
+
+        if (!clip->mask || !clip->mask->full) {
+            n = -1;
+            break;
+        }
+
+        update->clipLists[n].boxes = (V4L2TileBox *)RegionRects(clip->clip);
+        update->clipLists[n].nbox = RegionNumRects(clip->clip);
+        if (n == 0) {
+            mask = clip->mask;
+        } else {
+            if (n == 1) {
+                if (!update->clipMask->full &&
+                        V4L2TileMaskInit(update->clipMask,
+                                update->width, update->height)) {
+                    n = -1;
+                    break;
+                }
+                V4L2TileMaskClear(update->clipMask);
+                V4L2TileMaskOr(update->clipMask, mask);
+                mask = update->clipMask;
+            }
+            V4L2TileMaskOr(update->clipMask, clip->mask);
+        }
+        n++;
+    }
+
+    if (n > 0) {
+        *nclips = n;
+        return mask;
+    }
+
+    /* without the masks, fall back to region arithmetic: */
+    if (n < 0) {
+        for (i = 0; i < update->nclips; i++) {
+            const V4L2UpdateClip *clip = &update->clips[i];
+            if (clip->clip && clip->masked) {
+                RegionSubtract(solid, *damage, clip->clip);
+                *damage = solid;
+            }
+        }
+    }
+
+    *nclips = 0;
+    return NULL;
+}
+
+/* one pass per layer, each drawing over the last: */
+static void
+UpdatePasses(V4L2UpdatePtr update, V4L2ComposeEmitProc emit, void *closure)
+{
+    RegionPtr damage = update->damage;
+    const V4L2TileMask *mask;
+    RegionRec solid, cur, bounds, padded;
+    int i, nclips;
+
+    RegionNull(&solid);
+
+    /* active regions are masked out of the damage, so they aren't blit
+     * to screen:
+     */
+    mask = SolidMask(update, &damage, &solid, &nclips);
+
+    /* OSD windows keep their own alpha:
+     */
+    if (update->osd) {
+        if (damage != &solid) {
+            RegionCopy(&solid, damage);
+            damage = &solid;
+        }
+        RegionSubtract(damage, damage, update->osd);
+    }
+
+    /* blit non-video damaged areas to screen:
+     */
+    if (mask) {
+        Solid s = { emit, closure };
+        V4L2TileMaskSubtract(mask, update->clipLists, nclips,
+                (V4L2TileBox *)RegionRects(damage), RegionNumRects(damage),
+                EmitSolid, &s);
+    } else {
+        EmitRegion(emit, closure, damage, V4L2_UPDATE_SOLID);
+    }
+
+    RegionUninit(&solid);
+
+    /* after the solid blit, which would otherwise take the tiles the OSD
+     * shares with it as up to date:
+     */
+    if (update->osd) {
+        EmitRegion(emit, closure, update->osd, V4L2_UPDATE_OSD);
+    }
+
+    if (update->nclips == 0)
+        return;
+
+    /* fill updated video regions with transparent pixels:
+     */
+    for (i = 0; i < update->nclips; i++) {
+        if (update->clips[i].clip && update->clips[i].filled) {
+            EmitRegion(emit, closure, update->clips[i].clip,
+                    V4L2_UPDATE_HOLE);
+        }
+    }
+
+    if (update->holes) {
+        EmitRegion(emit, closure, update->holes, V4L2_UPDATE_HOLE);
+    }
+
+    /* handle any cursors that are over video:
+     */
+    RegionNull(&cur);
+    for (i = 0; i < update->ncursors; i++) {
+        RegionNull(&bounds);
+        RegionNull(&padded);
+        CursorRegions(update, &update->cursors[i], &bounds, &padded);
+        EmitRegion(emit, closure, &padded, V4L2_UPDATE_HOLE);
+        EmitRegion(emit, closure, &bounds, V4L2_UPDATE_CURSOR + i);
+        RegionUnion(&cur, &cur, &padded);
+        RegionUninit(&bounds);
+        RegionUninit(&padded);
+    }
+
+    /* fill what remains of the previous cursors with transparent pixels,
+     * to clean up after them:
+     */
+    RegionSubtract(update->cursorRegion, update->cursorRegion, &cur);
+    CursorStale(update, update->cursorRegion);
+    EmitRegion(emit, closure, update->cursorRegion, V4L2_UPDATE_HOLE);
+
+    RegionCopy(update->cursorRegion, &cur);
+    RegionUninit(&cur);
+}
+
+static inline void
+AddInput(V4L2ComposeInput *inputs, int *n, RegionPtr region, int layer)
+{
+    inputs[*n].boxes = (V4L2TileBox *)RegionRects(region);
+    inputs[*n].nbox = RegionNumRects(region);
+    inputs[*n].layer = layer;
+    (*n)++;
+}
+
+/* the same pixels in a single pass.  The video clips are layered over the
+ * damage rather than subtracted from it, and the cursors over the
+ * transparent pixels rather than drawn after them:
+ */
+static void
+UpdateFused(V4L2UpdatePtr update, V4L2ComposeEmitProc emit, void *closure)
+{
+    V4L2ComposeInput *inputs = update->inputs;
+    RegionRec bounds[V4L2_UPDATE_MAX_CURSORS], cur;
+    int i, j, n = 0;
+
+    AddInput(inputs, &n, update->damage, V4L2_UPDATE_SOLID);
+
+    /* OSD windows keep their own alpha:
+     */
+    if (update->osd) {
+        AddInput(inputs, &n, update->osd, V4L2_UPDATE_OSD);
+    }
+
+    /* updated video regions are transparent:
+     */
+    if (update->holes) {
+        AddInput(inputs, &n, update->holes, V4L2_UPDATE_HOLE);
+    }
+    for (i = 0; i < update->nclips; i++) {
+        if (update->clips[i].clip && update->clips[i].filled) {
+            AddInput(inputs, &n, update->clips[i].clip, V4L2_UPDATE_HOLE);
+        }
+    }
+
+    /* cursors that are over video, and the padding around them:
+     */
+    RegionNull(&cur);
+    for (i = 0; i < update->ncursors; i++) {
+        RegionNull(&bounds[i]);
+        CursorRegions(update, &update->cursors[i], &bounds[i], &cur);
+        AddInput(inputs, &n, &bounds[i], V4L2_UPDATE_CURSOR + i);
+    }
+    AddInput(inputs, &n, &cur, V4L2_UPDATE_HOLE);
+
+    /* clean up after the previous cursors, within current video.  The
+     * current ones are layered over it, so there's nothing to subtract:
+     */
+    CursorStale(update, update->cursorRegion);
+    AddInput(inputs, &n, update->cursorRegion, V4L2_UPDATE_HOLE);
+
+    V4L2Compose(inputs, n, emit, closure);
+
+    if (update->overlaid) {
+        for (i = 0; i < n; i++) {
+            if (inputs[i].layer == V4L2_UPDATE_SOLID)
+                continue;
+            for (j = 0; j < inputs[i].nbox; j++)
+                update->overlaid(closure, &inputs[i].boxes[j]);
+        }
+    }
+
+    for (i = 0; i < update->ncursors; i++) {
+        RegionUninit(&bounds[i]);
+    }
+
+    RegionCopy(update->cursorRegion, &cur);
+    RegionUninit(&cur);
+}
+
+void
+V4L2UpdateDraw(V4L2UpdatePtr update, V4L2ComposeEmitProc emit, void *closure)
+{
+    if ((update->nclips > 0) && update->fused) {
+        UpdateFused(update, emit, closure);
+    } else {
+        UpdatePasses(update, emit, closure);
+    }
+}
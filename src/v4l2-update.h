@@ -0,0 +1,86 @@
+/*
+ * v4l2-update.h
+ *
+ * What a shadow update draws into the framebuffer, and in which order:
+ * the solid damage around the video, the OSD, the holes punched for the
+ * video, the cursors over it and the clean up after the previous cursors,
+ * in several passes or (see FusedCompose option) in one.  Only the
+ * server's regions are used, which are pixman's, so that v4l2-replay can
+ * use the very same code.
+ */
+
+#ifndef __V4L2_UPDATE_H__
+#define __V4L2_UPDATE_H__
+
+#include "regionstr.h"
+#include "v4l2-tiles.h"
+#include "v4l2-compose.h"
+
+/* layers, from the bottom.  Each cursor gets its own, as each has its own
+ * image:
+ */
+#define V4L2_UPDATE_SOLID       0
+#define V4L2_UPDATE_OSD         1
+#define V4L2_UPDATE_HOLE        2
+#define V4L2_UPDATE_CURSOR      3
+#define V4L2_UPDATE_MAX_CURSORS 4
+#define V4L2_UPDATE_LAYERS      (V4L2_UPDATE_CURSOR + V4L2_UPDATE_MAX_CURSORS)
+
+/* compose inputs a fused update of nclips clips needs at most: damage,
+ * OSD, holes, updated clips, cursor padding and cleanup, and cursors
+ */
+#define V4L2_UPDATE_MAX_INPUTS(nclips) \
+    ((nclips) + 4 + V4L2_UPDATE_MAX_CURSORS)
+
+/* padding around the cursor, that the software sprite saves and restores
+ * (see miSpriteComputeSaved() in misprite.c), so it has to be kept
+ * transparent too:
+ */
+#define V4L2_UPDATE_SPRITE_PAD  8
+
+typedef struct {
+    RegionPtr clip;             /* of a port, NULL if it has no video */
+    const V4L2TileMask *mask;   /* tiles of clip, NULL to do without */
+    Bool masked;                /* taken out of the solid damage */
+    Bool filled;                /* .. and made transparent */
+} V4L2UpdateClip;
+
+typedef struct {
+    RegionPtr damage;
+    RegionPtr osd;              /* of damage, drawn with its alpha, or NULL */
+    RegionPtr holes;            /* more to make transparent, or NULL */
+
+    const V4L2UpdateClip *clips;
+    int nclips;                 /* none if there is no video at all */
+
+    const BoxRec *cursors;      /* images, in screen coordinates */
+    int ncursors;
+
+    /* what was made transparent around the cursors when the page was last
+     * drawn, replaced with what is this time.  Kept as is without video:
+     */
+    RegionPtr cursorRegion;
+
+    Bool fused;
+
+    /* a fused update may draw solid spans of a tile after the rest of it,
+     * so this is called (with the closure of emit) for each box of the
+     * layers above the solid one, once all is drawn.  NULL if not needed:
+     */
+    V4L2TileEmitProc overlaid;
+
+    /* scratch, of the caller: nclips lists, a mask the size of the screen
+     * (initialized here as needed) and V4L2_UPDATE_MAX_INPUTS(nclips)
+     * compose inputs:
+     */
+    V4L2TileBoxList *clipLists;
+    V4L2TileMask *clipMask;
+    int width, height;
+    V4L2ComposeInput *inputs;
+} V4L2UpdateRec, *V4L2UpdatePtr;
+
+/* emit the boxes of the update, each with the layer it is drawn with */
+void V4L2UpdateDraw(V4L2UpdatePtr update, V4L2ComposeEmitProc emit,
+        void *closure);
+
+#endif /* __V4L2_UPDATE_H__ */
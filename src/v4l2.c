@@ -30,6 +30,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
@@ -69,6 +70,23 @@ typedef enum {
         OPTION_DEVICES,      /* comma separated list of v4l2 devices */
         OPTION_ALPHA,        /* use alpha blending if supported by device */
         OPTION_COLORKEY,     /* colorkey value to use, if not using alpha */
+        OPTION_OSDALPHA,     /* pass per-pixel alpha of OSD windows through */
+        OPTION_PAGEFLIP,     /* double buffer the framebuffer */
+        OPTION_TILEHASH,     /* skip writing tiles whose content is unchanged */
+        OPTION_FUSEDCOMPOSE, /* write each pixel of an update only once */
+        OPTION_UPDATEBUDGET, /* KB per update while video is shown */
+        OPTION_DIRECTRENDER, /* alpha without a shadow framebuffer */
+        OPTION_CACHEFILE,    /* where to keep probed device capabilities */
+        OPTION_DEFERSETUP,   /* negotiate with device on first use */
+        OPTION_STATSFILE,    /* where to dump statistics on SIGUSR2 */
+        OPTION_TRACEFILE,    /* enables tracing, where to dump on SIGUSR2 */
+        OPTION_RECORDFILE,   /* record Xv requests and damage for replay */
+        OPTION_SCALER,       /* mem2mem device to scale/convert Xv images */
+        OPTION_COMPOSITE,    /* composite video on devices with no overlay */
+        OPTION_DEINTERLACE,  /* how interlaced captured video is shown */
+        OPTION_EXPORTYUV,    /* convert exported screen regions to YUV */
+        OPTION_MOSAIC,       /* Xv ports sharing the first overlay */
+        OPTION_HUGESHADOW,   /* move the shadow into huge pages */
         NUM_OPTIONS
 } FBDevOpts;
 
@@ -76,12 +94,46 @@ typedef enum {
 #define DEFAULT_DEVICES      "/dev/video1,/dev/video2,/dev/video3"
 #define DEFAULT_ALPHA        TRUE
 #define DEFAULT_COLORKEY     0x0000ff00
+#define DEFAULT_OSDALPHA     V4L2_OSD_ALPHA_OFF
+#define DEFAULT_PAGEFLIP     FALSE
+#define DEFAULT_TILEHASH     FALSE
+#define DEFAULT_FUSEDCOMPOSE FALSE
+#define DEFAULT_UPDATEBUDGET 0
+#define DEFAULT_DIRECTRENDER FALSE
+#define DEFAULT_CACHEFILE    NULL
+#define DEFAULT_DEFERSETUP   FALSE
+#define DEFAULT_STATSFILE    NULL
+#define DEFAULT_TRACEFILE    NULL
+#define DEFAULT_RECORDFILE   NULL
+#define DEFAULT_SCALER       NULL
+#define DEFAULT_COMPOSITE    TRUE
+#define DEFAULT_DEINTERLACE  V4L2_DEINTERLACE_LINEAR
+#define DEFAULT_EXPORTYUV    TRUE
+#define DEFAULT_MOSAIC       0
+#define DEFAULT_HUGESHADOW   FALSE
 
 static const OptionInfoRec V4L2DevOptions[] = {
         { OPTION_DEBUG,         "Debug",        OPTV_BOOLEAN,   {0},  FALSE },
         { OPTION_DEVICES,       "Devices",      OPTV_STRING,    {0},  FALSE },
         { OPTION_ALPHA,         "Alpha",        OPTV_BOOLEAN,   {0},  FALSE },
         { OPTION_COLORKEY,      "ColorKey",     OPTV_INTEGER,   {0},  FALSE },
+        { OPTION_OSDALPHA,      "OSDAlpha",     OPTV_STRING,    {0},  FALSE },
+        { OPTION_PAGEFLIP,      "PageFlip",     OPTV_BOOLEAN,   {0},  FALSE },
+        { OPTION_TILEHASH,      "TileHash",     OPTV_BOOLEAN,   {0},  FALSE },
+        { OPTION_FUSEDCOMPOSE,  "FusedCompose", OPTV_BOOLEAN,   {0},  FALSE },
+        { OPTION_UPDATEBUDGET,  "UpdateBudget", OPTV_INTEGER,   {0},  FALSE },
+        { OPTION_DIRECTRENDER,  "DirectRender", OPTV_BOOLEAN,   {0},  FALSE },
+        { OPTION_CACHEFILE,     "CacheFile",    OPTV_STRING,    {0},  FALSE },
+        { OPTION_DEFERSETUP,    "DeferSetup",   OPTV_BOOLEAN,   {0},  FALSE },
+        { OPTION_STATSFILE,     "StatsFile",    OPTV_STRING,    {0},  FALSE },
+        { OPTION_TRACEFILE,     "TraceFile",    OPTV_STRING,    {0},  FALSE },
+        { OPTION_RECORDFILE,    "RecordFile",   OPTV_STRING,    {0},  FALSE },
+        { OPTION_SCALER,        "Scaler",       OPTV_STRING,    {0},  FALSE },
+        { OPTION_COMPOSITE,     "Composite",    OPTV_BOOLEAN,   {0},  FALSE },
+        { OPTION_DEINTERLACE,   "Deinterlace",  OPTV_STRING,    {0},  FALSE },
+        { OPTION_EXPORTYUV,     "ExportYUV",    OPTV_BOOLEAN,   {0},  FALSE },
+        { OPTION_MOSAIC,        "Mosaic",       OPTV_INTEGER,   {0},  FALSE },
+        { OPTION_HUGESHADOW,    "HugeShadow",   OPTV_BOOLEAN,   {0},  FALSE },
         { -1,                   NULL,           OPTV_NONE,      {0},  FALSE }
 };
 
@@ -89,7 +141,24 @@ V4L2Config config = {
         .debug     = DEFAULT_DEBUG,
         .devices   = DEFAULT_DEVICES,
         .alpha     = DEFAULT_ALPHA,
-        .colorKey  = DEFAULT_COLORKEY
+        .colorKey  = DEFAULT_COLORKEY,
+        .osdAlpha  = DEFAULT_OSDALPHA,
+        .pageFlip  = DEFAULT_PAGEFLIP,
+        .tileHash  = DEFAULT_TILEHASH,
+        .fusedCompose = DEFAULT_FUSEDCOMPOSE,
+        .updateBudget = DEFAULT_UPDATEBUDGET,
+        .directRender = DEFAULT_DIRECTRENDER,
+        .cacheFile = DEFAULT_CACHEFILE,
+        .deferSetup = DEFAULT_DEFERSETUP,
+        .statsFile = DEFAULT_STATSFILE,
+        .traceFile = DEFAULT_TRACEFILE,
+        .recordFile = DEFAULT_RECORDFILE,
+        .scaler = DEFAULT_SCALER,
+        .composite = DEFAULT_COMPOSITE,
+        .deinterlace = DEFAULT_DEINTERLACE,
+        .exportYUV = DEFAULT_EXPORTYUV,
+        .mosaic = DEFAULT_MOSAIC,
+        .hugeShadow = DEFAULT_HUGESHADOW
 };
 
 #ifdef XFree86LOADER
@@ -137,6 +206,7 @@ v4l2Setup(pointer module, pointer opts, int *errmaj, int *errmin)
     } else {
         /* OK */
         OptionInfoPtr options;
+        const char *s;
 
         /* handle options */
         if (!(options = malloc(sizeof(V4L2DevOptions)))) {
@@ -154,6 +224,58 @@ v4l2Setup(pointer module, pointer opts, int *errmaj, int *errmin)
         if (!xf86GetOptValInteger(options, OPTION_COLORKEY, (int *)&config.colorKey)) {
             config.colorKey = DEFAULT_COLORKEY;
         }
+        if ((s = xf86GetOptValString(options, OPTION_OSDALPHA))) {
+            if (!xf86NameCmp(s, "premultiplied")) {
+                config.osdAlpha = V4L2_OSD_ALPHA_PREMULTIPLIED;
+            } else if (!xf86NameCmp(s, "straight")) {
+                config.osdAlpha = V4L2_OSD_ALPHA_STRAIGHT;
+            } else if (xf86NameCmp(s, "off")) {
+                xf86Msg(X_WARNING, "v4l2: unknown OSDAlpha mode \"%s\"\n", s);
+            }
+        }
+        config.pageFlip = xf86ReturnOptValBool(options, OPTION_PAGEFLIP, DEFAULT_PAGEFLIP);
+        config.tileHash = xf86ReturnOptValBool(options, OPTION_TILEHASH, DEFAULT_TILEHASH);
+        config.fusedCompose = xf86ReturnOptValBool(options, OPTION_FUSEDCOMPOSE,
+                DEFAULT_FUSEDCOMPOSE);
+        if (!xf86GetOptValInteger(options, OPTION_UPDATEBUDGET, &config.updateBudget) ||
+                (config.updateBudget < 0)) {
+            config.updateBudget = DEFAULT_UPDATEBUDGET;
+        }
+        config.directRender = xf86ReturnOptValBool(options, OPTION_DIRECTRENDER,
+                DEFAULT_DIRECTRENDER);
+        if (!(config.cacheFile = xf86GetOptValString(options, OPTION_CACHEFILE))) {
+            config.cacheFile = DEFAULT_CACHEFILE;
+        }
+        config.deferSetup = xf86ReturnOptValBool(options, OPTION_DEFERSETUP, DEFAULT_DEFERSETUP);
+        if (!(config.statsFile = xf86GetOptValString(options, OPTION_STATSFILE))) {
+            config.statsFile = DEFAULT_STATSFILE;
+        }
+        if (!(config.traceFile = xf86GetOptValString(options, OPTION_TRACEFILE))) {
+            config.traceFile = DEFAULT_TRACEFILE;
+        }
+        if (!(config.recordFile = xf86GetOptValString(options, OPTION_RECORDFILE))) {
+            config.recordFile = DEFAULT_RECORDFILE;
+        }
+        if (!(config.scaler = xf86GetOptValString(options, OPTION_SCALER))) {
+            config.scaler = DEFAULT_SCALER;
+        }
+        config.composite = xf86ReturnOptValBool(options, OPTION_COMPOSITE,
+                DEFAULT_COMPOSITE);
+        if ((s = xf86GetOptValString(options, OPTION_DEINTERLACE))) {
+            if (!xf86NameCmp(s, "bob")) {
+                config.deinterlace = V4L2_DEINTERLACE_BOB;
+            } else if (xf86NameCmp(s, "linear")) {
+                xf86Msg(X_WARNING, "v4l2: unknown Deinterlace mode \"%s\"\n", s);
+            }
+        }
+        config.exportYUV = xf86ReturnOptValBool(options, OPTION_EXPORTYUV,
+                DEFAULT_EXPORTYUV);
+        if (!xf86GetOptValInteger(options, OPTION_MOSAIC, &config.mosaic) ||
+                (config.mosaic < 0)) {
+            config.mosaic = DEFAULT_MOSAIC;
+        }
+        config.hugeShadow = xf86ReturnOptValBool(options, OPTION_HUGESHADOW,
+                DEFAULT_HUGESHADOW);
 
         xf86AddDriver (&V4L2, module, 0);
 
@@ -178,10 +300,35 @@ v4l2Setup(pointer module, pointer opts, int *errmaj, int *errmin)
 #define XV_MUTE		"XV_MUTE"
 #define XV_VOLUME      	"XV_VOLUME"
 
+#define XV_GLOBAL_ALPHA         "XV_GLOBAL_ALPHA"
+#define XV_PRESENT_TIME         "XV_PRESENT_TIME"
+
+/* read-only statistics: */
+#define XV_STAT_IOCTLS          "XV_STAT_IOCTLS"
+#define XV_STAT_IOCTL_USEC      "XV_STAT_IOCTL_USEC"
+#define XV_STAT_REPUTS          "XV_STAT_REPUTS"
+#define XV_STAT_COMMITS         "XV_STAT_COMMITS"
+#define XV_STAT_UPDATES         "XV_STAT_UPDATES"
+#define XV_STAT_UPDATE_USEC     "XV_STAT_UPDATE_USEC"
+#define XV_STAT_SOLID_BYTES     "XV_STAT_SOLID_BYTES"
+#define XV_STAT_TRANSP_BYTES    "XV_STAT_TRANSPARENT_BYTES"
+#define XV_STAT_CURSOR_BYTES    "XV_STAT_CURSOR_BYTES"
+#define XV_STAT_REGIONS         "XV_STAT_REGIONS"
+#define XV_STAT_LATENCY_P50     "XV_STAT_LATENCY_P50"
+#define XV_STAT_LATENCY_P99     "XV_STAT_LATENCY_P99"
+#define XV_STAT_JITTER_P50      "XV_STAT_JITTER_P50"
+#define XV_STAT_JITTER_P99      "XV_STAT_JITTER_P99"
+
 #define MAKE_ATOM(a) MakeAtom(a, sizeof(a) - 1, TRUE)
 
 static Atom xvEncoding, xvBrightness, xvContrast, xvSaturation, xvHue;
 static Atom xvFreq, xvMute, xvVolume;
+static Atom xvGlobalAlpha, xvPresentTime;
+static Atom xvStatIoctls, xvStatIoctlUsec, xvStatReputs, xvStatCommits;
+static Atom xvStatUpdates, xvStatUpdateUsec, xvStatSolidBytes;
+static Atom xvStatTranspBytes, xvStatCursorBytes, xvStatRegions;
+static Atom xvStatLatencyP50, xvStatLatencyP99;
+static Atom xvStatJitterP50, xvStatJitterP99;
 
 static XF86VideoFormatRec
 InputVideoFormats[] = {
@@ -200,19 +347,80 @@ static const XF86AttributeRec Attributes[] = {
         {XvSettable | XvGettable, -1000,    1000, XV_SATURATION},
         {XvSettable | XvGettable, -1000,    1000, XV_HUE},
 };
+#define V4L2_STAT_ATTR (sizeof(StatAttributes) / sizeof(XF86AttributeRec))
+
+static const XF86AttributeRec StatAttributes[] = {
+        {XvGettable, 0, 0x7fffffff, XV_STAT_IOCTLS},
+        {XvGettable, 0, 0x7fffffff, XV_STAT_IOCTL_USEC},
+        {XvGettable, 0, 0x7fffffff, XV_STAT_REPUTS},
+        {XvGettable, 0, 0x7fffffff, XV_STAT_COMMITS},
+        {XvGettable, 0, 0x7fffffff, XV_STAT_UPDATES},
+        {XvGettable, 0, 0x7fffffff, XV_STAT_UPDATE_USEC},
+        {XvGettable, 0, 0x7fffffff, XV_STAT_SOLID_BYTES},
+        {XvGettable, 0, 0x7fffffff, XV_STAT_TRANSP_BYTES},
+        {XvGettable, 0, 0x7fffffff, XV_STAT_CURSOR_BYTES},
+        {XvGettable, 0, 0x7fffffff, XV_STAT_REGIONS},
+        {XvGettable, 0, 0x7fffffff, XV_STAT_LATENCY_P50},
+        {XvGettable, 0, 0x7fffffff, XV_STAT_LATENCY_P99},
+        {XvGettable, 0, 0x7fffffff, XV_STAT_JITTER_P50},
+        {XvGettable, 0, 0x7fffffff, XV_STAT_JITTER_P99},
+};
 static const XF86AttributeRec VolumeAttr = 
 {XvSettable | XvGettable, -1000,    1000, XV_VOLUME};
 static const XF86AttributeRec MuteAttr = 
 {XvSettable | XvGettable,     0,       1, XV_MUTE};
 static const XF86AttributeRec FreqAttr = 
 {XvSettable | XvGettable,     0, 16*1000, XV_FREQ};
+static const XF86AttributeRec GlobalAlphaAttr =
+{XvSettable | XvGettable,     0,     255, XV_GLOBAL_ALPHA};
+/* X server time (of events), which takes all 32 bits: */
+static const XF86AttributeRec PresentTimeAttr =
+{XvSettable | XvGettable, -0x7fffffff - 1, 0x7fffffff, XV_PRESENT_TIME};
+
+/* don't change the global alpha more often than once per frame: */
+#define V4L2_GLOBAL_ALPHA_MSEC  16
 
-#define V4L2_FD   (v4l2_devices[pPPriv->nr].fd)
-#define V4L2_NAME (v4l2_devices[pPPriv->nr].devName)
+#define V4L2_FD      (v4l2_devices[pPPriv->dev].fd)
+#define V4L2_NAME    (v4l2_devices[pPPriv->dev].devName)
+#define V4L2_BACKEND (v4l2_devices[pPPriv->dev].backend)
+
+#define V4L2_FORMAT  (v4l2_devices[pPPriv->dev].format)
+#define V4L2_INFO    (v4l2_devices[pPPriv->dev].info)
+#define V4L2_WINDOW  (v4l2_devices[pPPriv->dev].window)
+#define V4L2_CROP    (v4l2_devices[pPPriv->dev].crop)
 
 static struct V4L2_DEVICE {
     int  fd;
     char *devName;
+    const V4L2Backend *backend;
+    V4L2DeviceInfo info;
+
+    /* overlay format as last set, so updating the window doesn't need a
+     * VIDIOC_G_FMT first.  Like the framebuffer flags, the device keeps it
+     * while closed, so once negotiated it isn't asked for again:
+     */
+    struct v4l2_format format;
+    Bool negotiated;
+
+    /* overlay window as last asked for, which the device may have
+     * adjusted (see V4L2WindowHonored()):
+     */
+    struct v4l2_rect window;
+
+    /* source rectangle as last asked for, valid while the device is open
+     * and its format is unchanged (empty if not set), the size of the
+     * source (once known), and whether the device lacks the selection API:
+     */
+    struct v4l2_rect crop;
+    struct v4l2_device_source {
+        Bool known;
+        int width, height;
+    } source;
+    Bool noSelection;
+
+    /* the device's ports, more than one if it hosts the mosaic: */
+    PortPrivPtr *ports;
+    int nports;
 } *v4l2_devices = NULL;
 
 /* ---------------------------------------------------------------------- */
@@ -221,37 +429,62 @@ static struct V4L2_DEVICE {
 static void V4L2QueryBestSize(ScrnInfoPtr pScrn, Bool motion,
         short vid_w, short vid_h, short drw_w, short drw_h,
         unsigned int *p_w, unsigned int *p_h, pointer data);
+static void V4L2ApplyGlobalAlpha(PortPrivPtr pPPriv);
 
 /* ---------------------------------------------------------------------- */
+
+/* all ioctls on a port's device go through here, so they get counted: */
+static int
+V4L2Ioctl(PortPrivPtr pPPriv, unsigned long request, void *arg)
+{
+    uint64_t start = V4L2StatsNow();
+    int ret = V4L2_BACKEND->ioctl(V4L2_FD, request, arg);
+    unsigned long usec = V4L2StatsNow() - start;
+    V4L2StatsIoctl(&pPPriv->stats, usec);
+    V4L2_TRACE(IOCTL, pPPriv->nr, request, ret, usec, 0);
+    return ret;
+}
+
 static void
 V4L2SetupDevice(PortPrivPtr pPPriv, ScrnInfoPtr pScrn)
 {
     struct v4l2_framebuffer fbuf;
+    CARD32 capability = V4L2_INFO.fbufCapability;
+    int i;
 
-    /* setup alpha or colorkey if supported */
+    /* setup alpha or colorkey if supported.  What the device supports is
+     * known from the probe (or the capability cache), so only a device that
+     * does is asked for its framebuffer:
+     */
 
-    memset(&fbuf, 0x00, sizeof(fbuf));
+    if(capability & (V4L2_FBUF_CAP_CHROMAKEY | V4L2_FBUF_CAP_LOCAL_ALPHA)) {
+        struct v4l2_format format;
 
-    if (-1 == ioctl(V4L2_FD, VIDIOC_G_FBUF, &fbuf)) {
-        perror("ioctl VIDIOC_G_FBUF");
-    }
+        memset(&fbuf, 0x00, sizeof(fbuf));
 
-    DEBUG("flags=%08x", fbuf.flags);
-    DEBUG("capability=%08x", fbuf.capability);
-    DEBUG("pixelformat=%08x", fbuf.fmt.pixelformat);
+        if (-1 == V4L2Ioctl(pPPriv, VIDIOC_G_FBUF, &fbuf)) {
+            perror("ioctl VIDIOC_G_FBUF");
+        }
 
-    if(fbuf.capability & (V4L2_FBUF_CAP_CHROMAKEY | V4L2_FBUF_CAP_LOCAL_ALPHA)) {
-        struct v4l2_format format;
+        DEBUG("flags=%08x", fbuf.flags);
+        DEBUG("capability=%08x", capability);
+        DEBUG("pixelformat=%08x", fbuf.fmt.pixelformat);
 
         fbuf.flags = V4L2_FBUF_FLAG_OVERLAY;
         fbuf.fmt.pixelformat = V4L2_PIX_FMT_BGR32;  // ???
 
+        if (capability & V4L2_FBUF_CAP_GLOBAL_ALPHA) {
+            fbuf.flags |= V4L2_FBUF_FLAG_GLOBAL_ALPHA;
+        }
+
         /* prefer alpha blending to colorkey, if both are supported: */
-        if(config.alpha && (fbuf.capability & V4L2_FBUF_CAP_LOCAL_ALPHA)) {
+        if(config.alpha && (capability & V4L2_FBUF_CAP_LOCAL_ALPHA)) {
             xf86Msg(X_INFO, "v4l2: enabling local-alpha for %s\n", V4L2_NAME);
             fbuf.flags |= V4L2_FBUF_FLAG_LOCAL_ALPHA;
-            pPPriv->colorKey = 0xff000000;
-            V4L2SetupAlpha(pPPriv);
+            for (i = 0; i < v4l2_devices[pPPriv->dev].nports; i++) {
+                v4l2_devices[pPPriv->dev].ports[i]->colorKey = 0xff000000;
+                V4L2SetupAlpha(v4l2_devices[pPPriv->dev].ports[i]);
+            }
         } else {
             xf86Msg(X_INFO, "v4l2: enabling chromakey for %s\n", V4L2_NAME);
             fbuf.flags |= V4L2_FBUF_FLAG_CHROMAKEY;
@@ -262,25 +495,37 @@ V4L2SetupDevice(PortPrivPtr pPPriv, ScrnInfoPtr pScrn)
          * format, I think..
          */
 
-        if (-1 == ioctl(V4L2_FD, VIDIOC_S_FBUF, &fbuf)) {
+        if (-1 == V4L2Ioctl(pPPriv, VIDIOC_S_FBUF, &fbuf)) {
             perror("ioctl VIDIOC_S_FBUF");
+            return;
         }
 
         memset(&format, 0x00, sizeof(format));
         format.type = V4L2_BUF_TYPE_VIDEO_OVERLAY;
 
-        if (-1 == ioctl(V4L2_FD, VIDIOC_G_FMT, &format)) {
+        if (-1 == V4L2Ioctl(pPPriv, VIDIOC_G_FMT, &format)) {
             perror("ioctl VIDIOC_G_FMT");
         }
 
         format.fmt.win.chromakey = pPPriv->colorKey;
+        format.fmt.win.global_alpha = pPPriv->globalAlpha;
 
-        if (-1 == ioctl(V4L2_FD, VIDIOC_S_FMT, &format)) {
+        if (-1 == V4L2Ioctl(pPPriv, VIDIOC_S_FMT, &format)) {
             perror("ioctl VIDIOC_S_FMT");
+            return;
         }
+
+        V4L2_FORMAT = format;
+        pPPriv->globalAlphaPending = FALSE;
+    } else if (pPPriv->composite) {
+        xf86Msg(X_INFO, "v4l2: neither chromakey or alpha is supported by %s, "
+                "compositing its video\n", V4L2_NAME);
+        V4L2SetupComposite(pPPriv);
     } else {
         xf86Msg(X_INFO, "v4l2: neither chromakey or alpha is supported by %s\n", V4L2_NAME);
     }
+
+    v4l2_devices[pPPriv->dev].negotiated = TRUE;
 }
 
 static int
@@ -289,7 +534,7 @@ V4L2OpenDevice(PortPrivPtr pPPriv, ScrnInfoPtr pScrn)
     static int first = 1;
 
     if (-1 == V4L2_FD) {
-        V4L2_FD = open(V4L2_NAME, O_RDWR, 0);
+        V4L2_FD = V4L2_BACKEND->open(V4L2_NAME, O_RDWR);
 
         if (first) {
             first = 0;
@@ -299,8 +544,14 @@ V4L2OpenDevice(PortPrivPtr pPPriv, ScrnInfoPtr pScrn)
         DEBUG("Xv/OD width=%d, height=%d, depth=%d",
                 pScrn->virtualX, pScrn->virtualY, pScrn->bitsPerPixel);
 
-        if (-1 != V4L2_FD) {
+        if ((-1 != V4L2_FD) && !v4l2_devices[pPPriv->dev].negotiated) {
             V4L2SetupDevice(pPPriv, pScrn);
+        } else if (-1 != V4L2_FD) {
+            /* global alpha set while closed (see V4L2SetGlobalAlpha()): */
+            pPPriv->globalAlphaPending =
+                    (V4L2_FORMAT.type == V4L2_BUF_TYPE_VIDEO_OVERLAY) &&
+                    (V4L2_FORMAT.fmt.win.global_alpha != pPPriv->globalAlpha);
+            V4L2ApplyGlobalAlpha(pPPriv);
         }
     }
 
@@ -319,12 +570,141 @@ V4L2CloseDevice(PortPrivPtr pPPriv, ScrnInfoPtr pScrn)
 {
     DEBUG("Xv/CD: fd=%d", V4L2_FD);
     if (-1 != V4L2_FD) {
-        close(V4L2_FD);
+        /* a pending global alpha is applied on the next open, which sets
+         * up a new timer if it needs one:
+         */
+        if (pPPriv->globalAlphaTimer) {
+            TimerFree(pPPriv->globalAlphaTimer);
+            pPPriv->globalAlphaTimer = NULL;
+        }
+        V4L2_BACKEND->close(V4L2_FD);
         V4L2_FD = -1;
+        V4L2SourceChanged(pPPriv);
         DEBUG("Xv/CD: device is closed");
     }
 }
 
+/* the overlay window in framebuffer coordinates, which differ from the
+ * screen's when the framebuffer is rotated or reflected (alpha mode only),
+ * in which case the video is rotated to match as well, if the device can:
+ */
+static void
+V4L2RotateWindow(PortPrivPtr pPPriv, ScrnInfoPtr pScrn, struct v4l2_rect *w,
+        short drw_x, short drw_y, short drw_w, short drw_h)
+{
+    ScreenPtr pScreen = screenInfo.screens[pScrn->scrnIndex];
+    int degrees = 0, hflip = 0, vflip = 0;
+    BoxRec box;
+
+    box.x1 = drw_x;
+    box.y1 = drw_y;
+    box.x2 = drw_x + drw_w;
+    box.y2 = drw_y + drw_h;
+
+    if ((drw_w <= 0) || (drw_h <= 0)) {
+        /* size not known yet, keep the device's: */
+        w->left = drw_x;
+        w->top = drw_y;
+        return;
+    }
+
+    if (config.alpha && pScreen && V4L2RotateBox(pScreen, &box)) {
+        V4L2RotateVideo(pScreen, &degrees, &hflip, &vflip);
+    }
+
+    w->left = box.x1;
+    w->top = box.y1;
+    w->width = box.x2 - box.x1;
+    w->height = box.y2 - box.y1;
+
+    /* each only when it changes, they are independent of one another: */
+#ifdef V4L2_CID_ROTATE
+    if (degrees != pPPriv->rotate) {
+        struct v4l2_control ctrl;
+
+        ctrl.id = V4L2_CID_ROTATE;
+        ctrl.value = degrees;
+        if (-1 == V4L2Ioctl(pPPriv, VIDIOC_S_CTRL, &ctrl)) {
+            DEBUG("Xv/RW: V4L2_CID_ROTATE not supported");
+        }
+        pPPriv->rotate = degrees;
+    }
+#endif
+
+    if (hflip != pPPriv->hflip) {
+        struct v4l2_control ctrl;
+
+        ctrl.id = V4L2_CID_HFLIP;
+        ctrl.value = hflip;
+        if (-1 == V4L2Ioctl(pPPriv, VIDIOC_S_CTRL, &ctrl)) {
+            DEBUG("Xv/RW: V4L2_CID_HFLIP not supported");
+        }
+        pPPriv->hflip = hflip;
+    }
+
+    if (vflip != pPPriv->vflip) {
+        struct v4l2_control ctrl;
+
+        ctrl.id = V4L2_CID_VFLIP;
+        ctrl.value = vflip;
+        if (-1 == V4L2Ioctl(pPPriv, VIDIOC_S_CTRL, &ctrl)) {
+            DEBUG("Xv/RW: V4L2_CID_VFLIP not supported");
+        }
+        pPPriv->vflip = vflip;
+    }
+}
+
+/* While the window is clipped away (covered, unmapped or off screen, for
+ * which Xv stops the port without shutting it down, and puts it again once
+ * it is visible), or its clip is empty, the overlay is turned off so that
+ * it doesn't fetch video nobody sees: images stop streaming, and the
+ * overlay is switched off if the device does that with VIDIOC_OVERLAY.
+ * The format, window and buffers are kept, for V4L2ResumeOverlay() to turn
+ * it back on as it was:
+ */
+static void
+V4L2SuspendOverlay(PortPrivPtr pPPriv)
+{
+    int off = 0;
+
+    if (pPPriv->suspended || (-1 == V4L2_FD))
+        return;
+
+    pPPriv->suspended = TRUE;
+
+    V4L2ImageSuspend(pPPriv);
+
+    if (V4L2_FORMAT.type == V4L2_BUF_TYPE_VIDEO_OVERLAY) {
+        pPPriv->overlayOff = (0 == V4L2Ioctl(pPPriv, VIDIOC_OVERLAY, &off));
+    }
+
+    V4L2_TRACE(SUSPEND, pPPriv->nr, TRUE, pPPriv->overlayOff, 0, 0);
+}
+
+/* .. and the window is back, show the last image again if show: */
+static void
+V4L2ResumeOverlay(PortPrivPtr pPPriv, Bool show)
+{
+    int on = 1;
+
+    if (!pPPriv->suspended)
+        return;
+
+    V4L2_TRACE(SUSPEND, pPPriv->nr, FALSE, pPPriv->overlayOff, 0, 0);
+
+    pPPriv->suspended = FALSE;
+
+    if (pPPriv->overlayOff) {
+        if (-1 == V4L2Ioctl(pPPriv, VIDIOC_OVERLAY, &on)) {
+            perror("ioctl VIDIOC_OVERLAY");
+        }
+        pPPriv->overlayOff = FALSE;
+    }
+
+    if (show)
+        V4L2ImageResume(pPPriv);
+}
+
 static int
 V4L2UpdateOverlay(PortPrivPtr pPPriv, ScrnInfoPtr pScrn,
         short drw_x, short drw_y, short drw_w, short drw_h,
@@ -332,34 +712,65 @@ V4L2UpdateOverlay(PortPrivPtr pPPriv, ScrnInfoPtr pScrn,
 {
     struct v4l2_format format;
 
-    /* @todo check if x/y w/h has actually changed to avoid unnecessary ioctl
-     */
-
     /* Open a file handle to the device */
     if (V4L2OpenDevice(pPPriv, pScrn))
         return Success;
 
-    memset(&format, 0x00, sizeof(format));
-    format.type = V4L2_BUF_TYPE_VIDEO_OVERLAY;
+    /* nothing to tell the device when the video is drawn by us: */
+    if (pPPriv->composite) {
+        V4L2SetFramePosition(pPPriv, drw_x, drw_y);
+        V4L2SetClip(pPPriv, pDraw, clipBoxes);
+        return Success;
+    }
 
-    if (-1 == ioctl(V4L2_FD, VIDIOC_G_FMT, &format)) {
-        perror("ioctl VIDIOC_G_FMT");
+    /* nothing of the video can be seen (the mosaic's overlay is shared): */
+    if (!RegionNotEmpty(clipBoxes) && !pPPriv->mosaic) {
+        V4L2ClearClip(pPPriv);
+        V4L2SuspendOverlay(pPPriv);
+        return Success;
     }
 
-    format.fmt.win.chromakey = pPPriv->colorKey;
+    V4L2ResumeOverlay(pPPriv, TRUE);
+
+    if (V4L2_FORMAT.type != V4L2_BUF_TYPE_VIDEO_OVERLAY) {
+        memset(&V4L2_FORMAT, 0x00, sizeof(V4L2_FORMAT));
+        V4L2_FORMAT.type = V4L2_BUF_TYPE_VIDEO_OVERLAY;
 
-    format.fmt.win.w.top = drw_y;
-    format.fmt.win.w.left = drw_x;
+        if (-1 == V4L2Ioctl(pPPriv, VIDIOC_G_FMT, &V4L2_FORMAT)) {
+            perror("ioctl VIDIOC_G_FMT");
+        }
+    }
+
+    format = V4L2_FORMAT;
+
+    format.fmt.win.chromakey = pPPriv->colorKey;
+    format.fmt.win.global_alpha = pPPriv->globalAlpha;
 
     if (drw_w != -1) {
-        format.fmt.win.w.width = drw_w;
+        pPPriv->drw_w = drw_w;
     }
     if (drw_h != -1) {
-        format.fmt.win.w.height = drw_h;
+        pPPriv->drw_h = drw_h;
     }
 
-    if (-1 == ioctl(V4L2_FD, VIDIOC_S_FMT, &format)) {
-        perror("ioctl VIDIOC_S_FMT");
+    V4L2RotateWindow(pPPriv, pScrn, &format.fmt.win.w,
+            drw_x, drw_y, pPPriv->drw_w, pPPriv->drw_h);
+    V4L2_WINDOW = format.fmt.win.w;
+
+    /* this also takes care of any pending global alpha change: */
+    pPPriv->globalAlphaPending = FALSE;
+
+    /* nothing to tell the device if the window didn't actually change
+     * (which is the common case for ReputImage):
+     */
+    if (memcmp(&format.fmt.win, &V4L2_FORMAT.fmt.win, sizeof(format.fmt.win))) {
+        V4L2_STAT_ADD(pPPriv->stats.commits, 1);
+
+        if (-1 == V4L2Ioctl(pPPriv, VIDIOC_S_FMT, &format)) {
+            perror("ioctl VIDIOC_S_FMT");
+        } else {
+            V4L2_FORMAT = format;
+        }
     }
 
     V4L2SetClip(pPPriv, pDraw, clipBoxes);
@@ -367,6 +778,173 @@ V4L2UpdateOverlay(PortPrivPtr pPPriv, ScrnInfoPtr pScrn,
     return Success;
 }
 
+static void
+V4L2ApplyGlobalAlpha(PortPrivPtr pPPriv)
+{
+    struct v4l2_format format;
+
+    if (!pPPriv->globalAlphaPending)
+        return;
+
+    pPPriv->globalAlphaPending = FALSE;
+    pPPriv->globalAlphaTime = GetTimeInMillis();
+
+    format = V4L2_FORMAT;
+    format.fmt.win.global_alpha = pPPriv->globalAlpha;
+
+    V4L2_STAT_ADD(pPPriv->stats.commits, 1);
+
+    if (-1 == V4L2Ioctl(pPPriv, VIDIOC_S_FMT, &format)) {
+        perror("ioctl VIDIOC_S_FMT");
+    } else {
+        V4L2_FORMAT = format;
+    }
+}
+
+static CARD32
+V4L2GlobalAlphaTimer(OsTimerPtr timer, CARD32 now, pointer arg)
+{
+    V4L2ApplyGlobalAlpha((PortPrivPtr)arg);
+    return 0;
+}
+
+/* global alpha doesn't need the device to be opened: while it is closed
+ * the value is just remembered for the next open.  While open, a fade
+ * sets it many times a second, so only the first set in each interval
+ * goes to the device right away, the last one is applied by a timer at
+ * the end of the interval.  It is the overlay's, so the ports of the
+ * mosaic, which share it, all take the value.
+ */
+static void
+V4L2SetGlobalAlpha(PortPrivPtr pPPriv, INT32 value)
+{
+    CARD32 next;
+    int i;
+
+    value = MAX(0, MIN(value, 255));
+    for (i = 0; i < v4l2_devices[pPPriv->dev].nports; i++)
+        v4l2_devices[pPPriv->dev].ports[i]->globalAlpha = value;
+
+    if ((-1 == V4L2_FD) ||
+            (V4L2_FORMAT.type != V4L2_BUF_TYPE_VIDEO_OVERLAY) ||
+            (V4L2_FORMAT.fmt.win.global_alpha == pPPriv->globalAlpha)) {
+        return;
+    }
+
+    if (pPPriv->globalAlphaPending)
+        return;             /* the timer will pick up the new value */
+
+    pPPriv->globalAlphaPending = TRUE;
+
+    next = pPPriv->globalAlphaTime + V4L2_GLOBAL_ALPHA_MSEC;
+    if ((INT32)(next - GetTimeInMillis()) <= 0) {
+        V4L2ApplyGlobalAlpha(pPPriv);
+    } else {
+        pPPriv->globalAlphaTimer = TimerSet(pPPriv->globalAlphaTimer,
+                TimerAbsolute, next, V4L2GlobalAlphaTimer, pPPriv);
+    }
+}
+
+/* crop the video to the Xv source rectangle, which is a no-op if it didn't
+ * change, or if it is all of the source and nothing else was asked for
+ * since the format was set.  With the selection API if the device has it,
+ * else VIDIOC_S_CROP.  A rectangle the device rejects is remembered like
+ * any other, so it isn't retried (and complained about) on every put:
+ */
+static void
+V4L2SetCrop(PortPrivPtr pPPriv,
+        short vid_x, short vid_y, short vid_w, short vid_h)
+{
+    struct v4l2_device_source *source = &v4l2_devices[pPPriv->dev].source;
+    struct v4l2_rect rect;
+    int type;
+
+    if ((vid_w <= 0) || (vid_h <= 0))
+        return;
+
+    rect.left = vid_x;
+    rect.top = vid_y;
+    rect.width = vid_w;
+    rect.height = vid_h;
+
+    if (!memcmp(&rect, &V4L2_CROP, sizeof(rect)))
+        return;
+
+    /* the source is the frames queued to an output device, or captured
+     * by a capture device:
+     */
+    type = (V4L2_INFO.capabilities & V4L2_CAP_VIDEO_OUTPUT) ?
+            V4L2_BUF_TYPE_VIDEO_OUTPUT : V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    if (!source->known) {
+        struct v4l2_format format;
+
+        memset(&format, 0x00, sizeof(format));
+        format.type = type;
+        source->known = TRUE;
+        if (0 == V4L2Ioctl(pPPriv, VIDIOC_G_FMT, &format)) {
+            source->width = format.fmt.pix.width;
+            source->height = format.fmt.pix.height;
+        }
+    }
+
+    /* the device shows all of the source after the format is set: */
+    if (!V4L2_CROP.width && (rect.left == 0) && (rect.top == 0) &&
+            (rect.width == source->width) && (rect.height == source->height)) {
+        V4L2_CROP = rect;
+        return;
+    }
+
+    V4L2_STAT_ADD(pPPriv->stats.commits, 1);
+    V4L2_CROP = rect;
+
+#ifdef VIDIOC_S_SELECTION
+    if (!v4l2_devices[pPPriv->dev].noSelection) {
+        struct v4l2_selection sel;
+
+        memset(&sel, 0x00, sizeof(sel));
+        sel.type = type;
+        sel.target = V4L2_SEL_TGT_CROP;
+        sel.r = rect;
+
+        if (0 == V4L2Ioctl(pPPriv, VIDIOC_S_SELECTION, &sel))
+            return;
+
+        if (errno != ENOTTY) {
+            /* the API is there, but not for this rectangle: */
+            perror("ioctl VIDIOC_S_SELECTION");
+            return;
+        }
+
+        DEBUG("Xv/SC: no selection API, using VIDIOC_S_CROP");
+        v4l2_devices[pPPriv->dev].noSelection = TRUE;
+    }
+#endif
+
+    {
+        struct v4l2_crop crop;
+
+        memset(&crop, 0x00, sizeof(crop));
+        crop.type = type;
+        crop.c = rect;
+
+        if (-1 == V4L2Ioctl(pPPriv, VIDIOC_S_CROP, &crop)) {
+            perror("ioctl VIDIOC_S_CROP");
+        }
+    }
+}
+
+/**
+ * The format of the frames of a port's device changed (see v4l2-image.c),
+ * which resets the device's crop.
+ */
+void
+V4L2SourceChanged(PortPrivPtr pPPriv)
+{
+    memset(&V4L2_CROP, 0x00, sizeof(V4L2_CROP));
+    v4l2_devices[pPPriv->dev].source.known = FALSE;
+}
+
 static int
 V4L2PutVideo(ScrnInfoPtr pScrn,
         short vid_x, short vid_y, short drw_x, short drw_y,
@@ -375,10 +953,24 @@ V4L2PutVideo(ScrnInfoPtr pScrn,
 {
     PortPrivPtr pPPriv = (PortPrivPtr) data;
 
-    DEBUG("Xv/PV vid_x=%d, vid_y=%d, vid_w=%d, vid_h=%d",
-            vid_x, vid_y, vid_w, vid_h);
-    DEBUG("Xv/PV drw_x=%d, drw_y=%d, drw_w=%d, drw_h=%d",
-            drw_x, drw_y, drw_w, drw_h);
+    V4L2_TRACE(PUT_VIDEO, pPPriv->nr, drw_x, drw_y, drw_w, drw_h);
+    V4L2_RECORD(PUT_VIDEO, pPPriv->nr, drw_x, drw_y, drw_w, drw_h, clipBoxes);
+
+    if (V4L2OpenDevice(pPPriv, pScrn))
+        return Success;
+
+    /* a capture device has no overlay, we show what it captures, all of
+     * it (the source rectangle is one of the port's encodings, not of the
+     * format the device captures in):
+     */
+    if (pPPriv->composite && V4L2CaptureSupported(&V4L2_INFO)) {
+        int ret = V4L2CapturePut(pPPriv, V4L2_BACKEND, V4L2_FD, &V4L2_INFO,
+                drw_w, drw_h, FALSE);
+        if (ret != Success)
+            return ret;
+    } else {
+        V4L2SetCrop(pPPriv, vid_x, vid_y, vid_w, vid_h);
+    }
 
     return V4L2UpdateOverlay(pPPriv, pScrn,
             drw_x, drw_y, drw_w, drw_h,
@@ -393,88 +985,378 @@ V4L2PutStill(ScrnInfoPtr pScrn,
 {
     PortPrivPtr pPPriv = (PortPrivPtr) data;
 
-    DEBUG("Xv/PS vid_x=%d, vid_y=%d, vid_w=%d, vid_h=%d",
-            vid_x, vid_y, vid_w, vid_h);
-    DEBUG("Xv/PS drw_x=%d, drw_y=%d, drw_w=%d, drw_h=%d",
-            drw_x, drw_y, drw_w, drw_h);
+    V4L2_TRACE(PUT_STILL, pPPriv->nr, drw_x, drw_y, drw_w, drw_h);
+    V4L2_RECORD(PUT_VIDEO, pPPriv->nr, drw_x, drw_y, drw_w, drw_h, clipBoxes);
+
+    if (V4L2OpenDevice(pPPriv, pScrn))
+        return Success;
+
+    if (pPPriv->composite && V4L2CaptureSupported(&V4L2_INFO)) {
+        int ret = V4L2CapturePut(pPPriv, V4L2_BACKEND, V4L2_FD, &V4L2_INFO,
+                drw_w, drw_h, TRUE);
+        if (ret != Success)
+            return ret;
+    } else {
+        V4L2SetCrop(pPPriv, vid_x, vid_y, vid_w, vid_h);
+    }
 
     return V4L2UpdateOverlay(pPPriv, pScrn,
             drw_x, drw_y, drw_w, drw_h,
             clipBoxes, pDraw);
 }
 
+/* the screen into an output device, the drawable being the window (or the
+ * root) whose region it is, in screen coordinates:
+ */
+static int
+V4L2GetVideo(ScrnInfoPtr pScrn,
+        short vid_x, short vid_y, short drw_x, short drw_y,
+        short vid_w, short vid_h, short drw_w, short drw_h,
+        RegionPtr clipBoxes, pointer data, DrawablePtr pDraw)
+{
+    PortPrivPtr pPPriv = (PortPrivPtr) data;
+    ScreenPtr pScreen = screenInfo.screens[pScrn->scrnIndex];
+
+    V4L2_TRACE(GET_VIDEO, pPPriv->nr, drw_x, drw_y, drw_w, drw_h);
+
+    if (V4L2OpenDevice(pPPriv, pScrn))
+        return BadAlloc;
+
+    return V4L2ExportGet(pPPriv, V4L2_BACKEND, V4L2_FD, &V4L2_INFO, pScreen,
+            drw_x, drw_y, drw_w, drw_h, vid_w, vid_h, FALSE);
+}
+
+static int
+V4L2GetStill(ScrnInfoPtr pScrn,
+        short vid_x, short vid_y, short drw_x, short drw_y,
+        short vid_w, short vid_h, short drw_w, short drw_h,
+        RegionPtr clipBoxes, pointer data, DrawablePtr pDraw)
+{
+    PortPrivPtr pPPriv = (PortPrivPtr) data;
+    ScreenPtr pScreen = screenInfo.screens[pScrn->scrnIndex];
+
+    V4L2_TRACE(GET_STILL, pPPriv->nr, drw_x, drw_y, drw_w, drw_h);
+
+    if (V4L2OpenDevice(pPPriv, pScrn))
+        return BadAlloc;
+
+    return V4L2ExportGet(pPPriv, V4L2_BACKEND, V4L2_FD, &V4L2_INFO, pScreen,
+            drw_x, drw_y, drw_w, drw_h, vid_w, vid_h, TRUE);
+}
+
 static int
 V4L2ReputImage(ScrnInfoPtr pScrn, short drw_x, short drw_y,
         RegionPtr clipBoxes, pointer data, DrawablePtr pDraw )
 {
     PortPrivPtr pPPriv = (PortPrivPtr) data;
 
-    DEBUG("Xv/RI drw_x=%d, drw_y=%d", drw_x, drw_y);
+    V4L2_TRACE(REPUT_IMAGE, pPPriv->nr, drw_x, drw_y, 0, 0);
+    V4L2_RECORD(REPUT_IMAGE, pPPriv->nr, drw_x, drw_y, 0, 0, clipBoxes);
+
+    V4L2_STAT_ADD(pPPriv->stats.reputs, 1);
+
+    if (pPPriv->mosaic) {
+        ScreenPtr pScreen = screenInfo.screens[pScrn->scrnIndex];
+
+        if (V4L2OpenDevice(pPPriv, pScrn))
+            return Success;
+
+        V4L2MosaicSetPosition(pPPriv, V4L2_BACKEND, V4L2_FD, &V4L2_INFO,
+                pScreen, drw_x, drw_y, clipBoxes);
+        drw_x = drw_y = 0;
+    }
 
     return V4L2UpdateOverlay(pPPriv, pScrn,
             drw_x, drw_y, -1, -1,
             clipBoxes, pDraw);
 }
 
+/* whether the device scales to about the size of the window asked for,
+ * rather than rejecting it or falling back to a size of its own, for
+ * example because it can't scale.  Devices round the window to their
+ * alignment (up to 16 pixels), which doesn't change the scale much:
+ */
+#define V4L2_WINDOW_SLACK   16
+
+static Bool
+V4L2WindowHonored(PortPrivPtr pPPriv)
+{
+    return (abs((int)V4L2_FORMAT.fmt.win.w.width -
+                    (int)V4L2_WINDOW.width) < V4L2_WINDOW_SLACK) &&
+            (abs((int)V4L2_FORMAT.fmt.win.w.height -
+                    (int)V4L2_WINDOW.height) < V4L2_WINDOW_SLACK);
+}
+
+static int
+V4L2PutImage(ScrnInfoPtr pScrn,
+        short src_x, short src_y, short drw_x, short drw_y,
+        short src_w, short src_h, short drw_w, short drw_h,
+        int id, unsigned char *buf, short width, short height,
+        Bool sync, RegionPtr clipBoxes, pointer data, DrawablePtr pDraw)
+{
+    PortPrivPtr pPPriv = (PortPrivPtr) data;
+    int ret;
+
+    V4L2_TRACE(PUT_IMAGE, pPPriv->nr, drw_x, drw_y, drw_w, drw_h);
+    V4L2_RECORD(PUT_IMAGE, pPPriv->nr, drw_x, drw_y, drw_w, drw_h, clipBoxes);
+
+    if (V4L2OpenDevice(pPPriv, pScrn))
+        return BadAlloc;
+
+    /* the overlay covers the screen, the image goes in the mosaic: */
+    if (pPPriv->mosaic) {
+        ScreenPtr pScreen = screenInfo.screens[pScrn->scrnIndex];
+
+        ret = V4L2MosaicSetPosition(pPPriv, V4L2_BACKEND, V4L2_FD,
+                &V4L2_INFO, pScreen, drw_x, drw_y, clipBoxes);
+        if (ret != Success)
+            return ret;
+
+        ret = V4L2ImagePut(pPPriv, V4L2_BACKEND, V4L2_FD, &V4L2_INFO,
+                id, buf, width, height, src_x, src_y, src_w, src_h,
+                drw_w, drw_h);
+        if (ret != Success)
+            return ret;
+
+        return V4L2UpdateOverlay(pPPriv, pScrn,
+                0, 0, pScreen->width, pScreen->height,
+                clipBoxes, pDraw);
+    }
+
+    ret = V4L2ImagePut(pPPriv, V4L2_BACKEND, V4L2_FD, &V4L2_INFO,
+            id, buf, width, height, src_x, src_y, src_w, src_h, drw_w, drw_h);
+    if (ret != Success)
+        return ret;
+
+    ret = V4L2UpdateOverlay(pPPriv, pScrn,
+            drw_x, drw_y, drw_w, drw_h,
+            clipBoxes, pDraw);
+
+    /* if the overlay can't scale the image, scale it in software and
+     * show this frame again:
+     */
+    if (!V4L2WindowHonored(pPPriv) && V4L2ImageSoftScale(pPPriv)) {
+        ret = V4L2ImagePut(pPPriv, V4L2_BACKEND, V4L2_FD, &V4L2_INFO,
+                id, buf, width, height, src_x, src_y, src_w, src_h,
+                drw_w, drw_h);
+        if (ret != Success)
+            return ret;
+
+        ret = V4L2UpdateOverlay(pPPriv, pScrn,
+                drw_x, drw_y, drw_w, drw_h,
+                clipBoxes, pDraw);
+    }
+
+    return ret;
+}
+
+static int
+V4L2QueryImageAttributes(ScrnInfoPtr pScrn, int id,
+        unsigned short *w, unsigned short *h, int *pitches, int *offsets)
+{
+    return V4L2ImageAttributes(id, w, h, pitches, offsets);
+}
+
 static void
 V4L2StopVideo(ScrnInfoPtr pScrn, pointer data, Bool shutdown)
 {
     PortPrivPtr pPPriv = (PortPrivPtr) data;
+    Bool shared;
 
-    DEBUG("Xv/StopVideo shutdown=%d",shutdown);
+    V4L2_TRACE(STOP_VIDEO, pPPriv->nr, shutdown, 0, 0, 0);
+    V4L2_RECORD(STOP_VIDEO, pPPriv->nr, shutdown, 0, 0, 0, NULL);
+    V4L2RecordFlush();
 
     V4L2ClearClip(pPPriv);
+    V4L2CaptureStop(pPPriv, shutdown);
+    V4L2ExportStop(pPPriv, shutdown);
+
+    /* the device stays open while other ports of the mosaic use it: */
+    shared = pPPriv->mosaic && V4L2MosaicStop(pPPriv);
 
-    if (shutdown) {
+    /* not shut down, the window was clipped away: */
+    if (!shutdown && !pPPriv->composite && !pPPriv->mosaic) {
+        V4L2SuspendOverlay(pPPriv);
+        return;
+    }
+
+    /* the overlay is left on, as it was before the port was used: */
+    V4L2ResumeOverlay(pPPriv, FALSE);
+    V4L2ImageStop(pPPriv, shutdown);
+
+    if (shutdown && !shared) {
         V4L2CloseDevice(pPPriv, pScrn);
     }
 }
 
-/* v4l2 uses range 0 - 65535; Xv uses -1000 - 1000 */
+/* v4l2 controls have the range the device reports (as probed or cached);
+ * Xv uses -1000 - 1000
+ */
 static int
-v4l2_to_xv(int val) {
-    val = val * 2000 / 65536 - 1000;
+v4l2_to_xv(int val, int min, int max) {
+    if (max <= min) return 0;
+    val = (long long)(val - min) * 2000 / (max - min) - 1000;
     if (val < -1000) val = -1000;
     if (val >  1000) val =  1000;
     return val;
 }
 
 static int
-xv_to_v4l2(int val) {
-    val = val * 65536 / 2000 + 32768;
-    if (val <    -0) val =     0;
-    if (val > 65535) val = 65535;
+xv_to_v4l2(int val, int min, int max) {
+    val = min + (long long)(val + 1000) * (max - min) / 2000;
+    if (val < min) val = min;
+    if (val > max) val = max;
     return val;
 }
 
+/* the picture attributes are the device's controls of the same name, and
+ * are only offered if it has them:
+ */
+static const struct {
+    const char *name;
+    CARD32 id;
+} PictureCtrls[] = {
+        { XV_BRIGHTNESS, V4L2_CID_BRIGHTNESS },
+        { XV_CONTRAST,   V4L2_CID_CONTRAST },
+        { XV_SATURATION, V4L2_CID_SATURATION },
+        { XV_HUE,        V4L2_CID_HUE },
+};
+
+/* index in info->ctrls of the control behind an attribute, or -1: */
+static int
+V4L2FindCtrl(const V4L2DeviceInfo *info, const char *name)
+{
+    int i, j;
+
+    for (i = 0; i < sizeof(PictureCtrls) / sizeof(PictureCtrls[0]); i++) {
+        if (!name || strcmp(name, PictureCtrls[i].name))
+            continue;
+        for (j = 0; j < info->nctrls; j++) {
+            if (info->ctrls[j].id == PictureCtrls[i].id)
+                return j;
+        }
+    }
+
+    return -1;
+}
+
 static int
 V4L2SetPortAttribute(ScrnInfoPtr pScrn,
         Atom attribute, INT32 value, pointer data)
 {
     PortPrivPtr pPPriv = (PortPrivPtr) data;
-    int ret = Success;
+    Bool opened = (-1 == V4L2_FD);
+    int i, ret = Success;
 
-    if (V4L2OpenDevice(pPPriv, pScrn))
+    DEBUG("Xv/SPA %lu, %ld", attribute, value);
+
+    if (attribute == xvGlobalAlpha) {
+        V4L2SetGlobalAlpha(pPPriv, value);
         return Success;
+    }
 
-    DEBUG("Xv/SPA %lu, %ld", attribute, value);
+    /* for the next XvPutImage only: */
+    if (attribute == xvPresentTime) {
+        pPPriv->presentTime = value;
+        return Success;
+    }
+
+    if (V4L2OpenDevice(pPPriv, pScrn))
+        return Success;
 
     if (-1 == V4L2_FD) {
         ret = Success;
+    } else if ((i = V4L2FindCtrl(&V4L2_INFO, NameForAtom(attribute))) >= 0) {
+        struct v4l2_control ctrl;
+
+        ctrl.id = V4L2_INFO.ctrls[i].id;
+        ctrl.value = xv_to_v4l2(value, V4L2_INFO.ctrls[i].min,
+                V4L2_INFO.ctrls[i].max);
+        if (-1 == V4L2Ioctl(pPPriv, VIDIOC_S_CTRL, &ctrl)) {
+            perror("ioctl VIDIOC_S_CTRL");
+            ret = BadValue;
+        }
     } else {
         ret = BadValue;
     }
 
-    V4L2CloseDevice(pPPriv,pScrn);
+    /* don't close the device under a running video: */
+    if (opened)
+        V4L2CloseDevice(pPPriv,pScrn);
     return ret;
 }
 
+/* statistics don't need the device, so are handled before opening it: */
+static Bool
+V4L2GetStatAttribute(ScrnInfoPtr pScrn,
+        Atom attribute, INT32 *value, PortPrivPtr pPPriv)
+{
+    V4L2PortStats *ps = &pPPriv->stats;
+    V4L2ScreenStats *ss = &v4l2ScreenStats[pScrn->scrnIndex];
+    unsigned long val, n;
+
+    if (attribute == xvStatIoctls) {
+        val = V4L2_STAT_GET(ps->ioctls);
+    } else if (attribute == xvStatIoctlUsec) {
+        val = V4L2_STAT_GET(ps->ioctlUsec);
+    } else if (attribute == xvStatReputs) {
+        val = V4L2_STAT_GET(ps->reputs);
+    } else if (attribute == xvStatCommits) {
+        val = V4L2_STAT_GET(ps->commits);
+    } else if (attribute == xvStatUpdates) {
+        val = V4L2_STAT_GET(ss->updates);
+    } else if (attribute == xvStatUpdateUsec) {
+        val = V4L2_STAT_GET(ss->updateUsec);
+    } else if (attribute == xvStatSolidBytes) {
+        val = V4L2_STAT_GET(ss->bytes[V4L2_OP_SOLID]);
+    } else if (attribute == xvStatTranspBytes) {
+        val = V4L2_STAT_GET(ss->bytes[V4L2_OP_TRANSPARENT]);
+    } else if (attribute == xvStatCursorBytes) {
+        val = V4L2_STAT_GET(ss->bytes[V4L2_OP_CURSOR]);
+    } else if (attribute == xvStatRegions) {
+        val = V4L2_STAT_GET(ss->regionAllocs);
+    } else if (attribute == xvStatLatencyP50) {
+        val = V4L2StatsPercentile(ps->latencyUsec,
+                V4L2_STAT_GET(ps->presented), 50);
+    } else if (attribute == xvStatLatencyP99) {
+        val = V4L2StatsPercentile(ps->latencyUsec,
+                V4L2_STAT_GET(ps->presented), 99);
+    } else if (attribute == xvStatJitterP50) {
+        n = V4L2_STAT_GET(ps->presented);
+        val = V4L2StatsPercentile(ps->jitterUsec, n ? n - 1 : 0, 50);
+    } else if (attribute == xvStatJitterP99) {
+        n = V4L2_STAT_GET(ps->presented);
+        val = V4L2StatsPercentile(ps->jitterUsec, n ? n - 1 : 0, 99);
+    } else {
+        return FALSE;
+    }
+
+    /* counters wrap at the attribute's range: */
+    *value = val & 0x7fffffff;
+
+    return TRUE;
+}
+
 static int
 V4L2GetPortAttribute(ScrnInfoPtr pScrn,
         Atom attribute, INT32 *value, pointer data)
 {
     PortPrivPtr pPPriv = (PortPrivPtr) data;
-    int ret = Success;
+    Bool opened = (-1 == V4L2_FD);
+    int i, ret = Success;
+
+    if (V4L2GetStatAttribute(pScrn, attribute, value, pPPriv))
+        return Success;
+
+    if (attribute == xvGlobalAlpha) {
+        *value = pPPriv->globalAlpha;
+        return Success;
+    }
+
+    if (attribute == xvPresentTime) {
+        *value = pPPriv->presentTime;
+        return Success;
+    }
 
     if (V4L2OpenDevice(pPPriv, pScrn))
         return Success;
@@ -483,13 +1365,25 @@ V4L2GetPortAttribute(ScrnInfoPtr pScrn,
 
     if (-1 == V4L2_FD) {
         ret = Success;
+    } else if ((i = V4L2FindCtrl(&V4L2_INFO, NameForAtom(attribute))) >= 0) {
+        struct v4l2_control ctrl;
+
+        ctrl.id = V4L2_INFO.ctrls[i].id;
+        if (-1 == V4L2Ioctl(pPPriv, VIDIOC_G_CTRL, &ctrl)) {
+            perror("ioctl VIDIOC_G_CTRL");
+            ret = BadValue;
+        } else {
+            *value = v4l2_to_xv(ctrl.value, V4L2_INFO.ctrls[i].min,
+                    V4L2_INFO.ctrls[i].max);
+        }
     } else {
         ret = BadValue;
     }
 
     DEBUG("Xv/GPA %lu, %ld", attribute, *value);
 
-    V4L2CloseDevice(pPPriv,pScrn);
+    if (opened)
+        V4L2CloseDevice(pPPriv,pScrn);
     return ret;
 }
 
@@ -505,6 +1399,14 @@ V4L2QueryBestSize(ScrnInfoPtr pScrn, Bool motion,
     if (0 != pPPriv->yuv_format) {
         *p_w = pPPriv->myfmt->max_width;
         *p_h = pPPriv->myfmt->max_height;
+    } else if ((config.scaler && pPPriv->image) ||
+            pPPriv->composite || pPPriv->mosaic) {
+        /* images are scaled to whatever size the window is.  The scaler
+         * only takes images, not video, and the query doesn't say which
+         * it is for, so only once the port has been putting images:
+         */
+        *p_w = drw_w;
+        *p_h = drw_h;
     } else {
         *p_w = (drw_w < maxx) ? drw_w : maxx;
         *p_h = (drw_h < maxy) ? drw_h : maxy;
@@ -541,13 +1443,23 @@ v4l2_add_enc(XF86VideoEncodingPtr enc, int i,
     return 0;
 }
 
+/* the sizes the device enumerates (as probed or cached), or else a few
+ * common ones:
+ */
 static void
-V4L2BuildEncodings(PortPrivPtr p)
+V4L2BuildEncodings(PortPrivPtr p, const V4L2DeviceInfo *info)
 {
-    int entries = 4;
+    int i, entries = info->nsizes ? info->nsizes : 4;
     p->enc = malloc(sizeof(XF86VideoEncodingRec) * entries);
     if (NULL == p->enc)
         goto fail;
+    for (i = 0; i < info->nsizes; i++) {
+        if (v4l2_add_enc(p->enc, p->nenc++, info->sizes[i].width,
+                info->sizes[i].height, 1001, 30000))
+            goto fail;
+    }
+    if (info->nsizes)
+        return;
     v4l2_add_enc(p->enc, p->nenc++,  320,  240, 1001, 30000);
     v4l2_add_enc(p->enc, p->nenc++,  640,  480, 1001, 30000);
     v4l2_add_enc(p->enc, p->nenc++, 1280,  720, 1001, 30000);
@@ -628,22 +1540,55 @@ v4l2_check_yuv(PortPrivPtr pPPriv, ScrnInfoPtr pScrn)
 #endif
 }
 
+/* ports are allocated cache line aligned, for their stats (see v4l2.h): */
+static PortPrivPtr
+V4L2AllocPort(void)
+{
+    void *p;
+
+    if (posix_memalign(&p, V4L2_CACHE_LINE, sizeof(PortPrivRec)))
+        return NULL;
+
+    return p;
+}
+
 static int
 V4L2Init(ScrnInfoPtr pScrn, XF86VideoAdaptorPtr **adaptors)
 {
     PortPrivPtr pPPriv;
     DevUnion *Private;
     XF86VideoAdaptorPtr *VAR = NULL;
-    char *dev, *devices;
-    int  fd,i,j;
+    V4L2DeviceInfo *info;
+    char *dev, *devices, **names = NULL;
+    int  *fds, fd,i,j,k,n;
+    int  nports = 0, mosaic = config.mosaic;
 
     /* we need devices to be a mutable string that we own */
     devices = strdup(config.devices);
 
     DEBUG("init start");
 
-    for (i = 0; dev = strsep(&devices, ","); ) {
-        fd = open(dev, O_RDWR, 0);
+    V4L2TraceInit();
+    V4L2RecordInit(pScrn);
+    V4L2ImageInit();
+
+    for (n = 0; dev = strsep(&devices, ","); n++) {
+        names = realloc(names, sizeof(names[0]) * (n + 1));
+        names[n] = dev;
+    }
+
+    /* open and identify all the devices at once, rather than paying for
+     * each device's (potentially slow) ioctls one after another:
+     */
+    fds  = malloc(sizeof(fds[0]) * n);
+    info = malloc(sizeof(info[0]) * n);
+    if (!fds || !info)
+        return FALSE;
+    V4L2ProbeDevices(names, n, fds, info);
+
+    for (i = 0, k = 0; k < n; k++) {
+        dev = names[k];
+        fd = fds[k];
         DEBUG("open %s -> %d", dev, fd);
         if (fd == -1) {
             xf86Msg(X_INFO, "v4l2: could not open '%s'.. skipping\n", dev);
@@ -652,13 +1597,20 @@ V4L2Init(ScrnInfoPtr pScrn, XF86VideoAdaptorPtr **adaptors)
         DEBUG("%s open ok", dev);
 
         /* our private data */
-        pPPriv = malloc(sizeof(PortPrivRec));
+        pPPriv = V4L2AllocPort();
         if (!pPPriv)
             return FALSE;
         memset(pPPriv,0,sizeof(PortPrivRec));
-        pPPriv->nr = i;
+        pPPriv->nr = nports++;
+        pPPriv->dev = i;
 
         pPPriv->colorKey = config.colorKey;
+        pPPriv->globalAlpha = 255;
+        /* a device with an overlay of its own shows the video there, even
+         * if it can't be keyed or blended (it is then just not clipped):
+         */
+        pPPriv->composite = config.composite && !(info[k].capabilities &
+                (V4L2_CAP_VIDEO_OUTPUT_OVERLAY | V4L2_CAP_VIDEO_OVERLAY));
 
         /* check device */
 #if 0 /* @todo */
@@ -676,7 +1628,12 @@ V4L2Init(ScrnInfoPtr pScrn, XF86VideoAdaptorPtr **adaptors)
 
         V4L2_NAME = dev;
         V4L2_FD = fd;
-        V4L2BuildEncodings(pPPriv);
+        V4L2_BACKEND = V4L2FindBackend(dev);
+        v4l2_devices[i].info = info[k];
+        v4l2_devices[i].ports = NULL;
+        v4l2_devices[i].nports = 0;
+        V4L2StatsAddPort(dev, &pPPriv->stats);
+        V4L2BuildEncodings(pPPriv, &info[k]);
         if (!pPPriv->enc)
             return FALSE;
         v4l2_check_yuv(pPPriv, pScrn);
@@ -691,9 +1648,23 @@ V4L2Init(ScrnInfoPtr pScrn, XF86VideoAdaptorPtr **adaptors)
 
         /* build attribute list */
         for (j = 0; j < V4L2_ATTR; j++) {
-            /* video attributes */
+            /* video attributes, the picture ones if the device has them */
+            if ((V4L2FindCtrl(&info[k], Attributes[j].name) >= 0) ||
+                    !strcmp(Attributes[j].name, XV_ENCODING)) {
+                v4l2_add_attr(&VAR[i]->pAttributes, &VAR[i]->nAttributes,
+                        &Attributes[j]);
+            }
+        }
+
+        if (info[k].fbufCapability & V4L2_FBUF_CAP_GLOBAL_ALPHA) {
+            v4l2_add_attr(&VAR[i]->pAttributes, &VAR[i]->nAttributes,
+                    &GlobalAlphaAttr);
+        }
+
+        for (j = 0; j < V4L2_STAT_ATTR; j++) {
+            /* statistics */
             v4l2_add_attr(&VAR[i]->pAttributes, &VAR[i]->nAttributes,
-                    &Attributes[j]);
+                    &StatAttributes[j]);
         }
 
         if (0 != pPPriv->yuv_format) {
@@ -704,28 +1675,78 @@ V4L2Init(ScrnInfoPtr pScrn, XF86VideoAdaptorPtr **adaptors)
             }
         }
 
+        /* the first device that can, hosts the mosaic, whose ports only
+         * take images (see v4l2-mosaic.c):
+         */
+        if ((mosaic > 1) && V4L2MosaicSupported(&info[k], pPPriv->composite)) {
+            xf86Msg(X_INFO, "v4l2: %d ports on %s\n", mosaic, dev);
+            pPPriv->mosaic = TRUE;
+            v4l2_devices[i].nports = mosaic;
+            mosaic = 0;
+        } else {
+            v4l2_devices[i].nports = 1;
+        }
+
         /* hook in private data */
-        Private = malloc(sizeof(DevUnion));
-        if (!Private)
+        v4l2_devices[i].ports = calloc(v4l2_devices[i].nports,
+                sizeof(PortPrivPtr));
+        Private = calloc(v4l2_devices[i].nports, sizeof(DevUnion));
+        if (!Private || !v4l2_devices[i].ports)
             return FALSE;
-        memset(Private,0,sizeof(DevUnion));
-        Private->ptr = (pointer)pPPriv;
+        v4l2_devices[i].ports[0] = pPPriv;
+        Private[0].ptr = (pointer)pPPriv;
+        for (j = 1; j < v4l2_devices[i].nports; j++) {
+            PortPrivPtr pPort = V4L2AllocPort();
+            if (!pPort)
+                return FALSE;
+            *pPort = *pPPriv;
+            memset(&pPort->stats, 0x00, sizeof(pPort->stats));
+            pPort->nr = nports++;
+            V4L2StatsAddPort(dev, &pPort->stats);
+            v4l2_devices[i].ports[j] = pPort;
+            Private[j].ptr = (pointer)pPort;
+        }
         VAR[i]->pPortPrivates = Private;
-        VAR[i]->nPorts = 1;
+        VAR[i]->nPorts = v4l2_devices[i].nports;
 
         /* init VideoAdaptorRec */
-        VAR[i]->type  = XvInputMask | XvWindowMask | XvVideoMask;
+        VAR[i]->type  = XvInputMask | XvWindowMask;
         VAR[i]->name  = "video4linux2";
         VAR[i]->flags = 0;
 
-        VAR[i]->PutVideo = V4L2PutVideo;
-        VAR[i]->PutStill = V4L2PutStill;
         VAR[i]->ReputImage = V4L2ReputImage;
         VAR[i]->StopVideo = V4L2StopVideo;
         VAR[i]->SetPortAttribute = V4L2SetPortAttribute;
         VAR[i]->GetPortAttribute = V4L2GetPortAttribute;
         VAR[i]->QueryBestSize = V4L2QueryBestSize;
 
+        if (!pPPriv->mosaic) {
+            VAR[i]->type |= XvVideoMask;
+            VAR[i]->PutVideo = V4L2PutVideo;
+            VAR[i]->PutStill = V4L2PutStill;
+        }
+
+        /* the screen, if the device has somewhere to send it: */
+        if (!pPPriv->mosaic && V4L2ExportSupported(&info[k])) {
+            VAR[i]->type |= XvOutputMask;
+            VAR[i]->GetVideo = V4L2GetVideo;
+            VAR[i]->GetStill = V4L2GetStill;
+        }
+
+        /* images, if the device has somewhere to put them: */
+        VAR[i]->nImages = V4L2ImageFormats(&info[k],
+                pPPriv->composite || pPPriv->mosaic, &VAR[i]->pImages);
+        if (VAR[i]->nImages) {
+            /* images the overlay shows can be timed: */
+            if (!pPPriv->composite && !pPPriv->mosaic) {
+                v4l2_add_attr(&VAR[i]->pAttributes, &VAR[i]->nAttributes,
+                        &PresentTimeAttr);
+            }
+            VAR[i]->type |= XvImageMask;
+            VAR[i]->PutImage = V4L2PutImage;
+            VAR[i]->QueryImageAttributes = V4L2QueryImageAttributes;
+        }
+
         VAR[i]->nEncodings = pPPriv->nenc;
         VAR[i]->pEncodings = pPPriv->enc;
         VAR[i]->nFormats =
@@ -733,8 +1754,11 @@ V4L2Init(ScrnInfoPtr pScrn, XF86VideoAdaptorPtr **adaptors)
         VAR[i]->pFormats = InputVideoFormats;
 
         /* ensure colorkey is properly configured.. some drivers need this
-         * before STREAMON.. */
-        V4L2SetupDevice(pPPriv, pScrn);
+         * before STREAMON.. unless asked to leave it until first use, in
+         * which case V4L2OpenDevice() takes care of it.
+         */
+        if (!config.deferSetup)
+            V4L2SetupDevice(pPPriv, pScrn);
 
         V4L2CloseDevice(pPPriv, pScrn);
         DEBUG("%s closed ok", dev);
@@ -752,6 +1776,30 @@ V4L2Init(ScrnInfoPtr pScrn, XF86VideoAdaptorPtr **adaptors)
     xvMute       = MAKE_ATOM(XV_MUTE);
     xvVolume     = MAKE_ATOM(XV_VOLUME);
 
+    xvGlobalAlpha = MAKE_ATOM(XV_GLOBAL_ALPHA);
+    xvPresentTime = MAKE_ATOM(XV_PRESENT_TIME);
+
+    xvStatIoctls      = MAKE_ATOM(XV_STAT_IOCTLS);
+    xvStatIoctlUsec   = MAKE_ATOM(XV_STAT_IOCTL_USEC);
+    xvStatReputs      = MAKE_ATOM(XV_STAT_REPUTS);
+    xvStatCommits     = MAKE_ATOM(XV_STAT_COMMITS);
+    xvStatUpdates     = MAKE_ATOM(XV_STAT_UPDATES);
+    xvStatUpdateUsec  = MAKE_ATOM(XV_STAT_UPDATE_USEC);
+    xvStatSolidBytes  = MAKE_ATOM(XV_STAT_SOLID_BYTES);
+    xvStatTranspBytes = MAKE_ATOM(XV_STAT_TRANSP_BYTES);
+    xvStatCursorBytes = MAKE_ATOM(XV_STAT_CURSOR_BYTES);
+    xvStatRegions     = MAKE_ATOM(XV_STAT_REGIONS);
+    xvStatLatencyP50  = MAKE_ATOM(XV_STAT_LATENCY_P50);
+    xvStatLatencyP99  = MAKE_ATOM(XV_STAT_LATENCY_P99);
+    xvStatJitterP50   = MAKE_ATOM(XV_STAT_JITTER_P50);
+    xvStatJitterP99   = MAKE_ATOM(XV_STAT_JITTER_P99);
+
+    V4L2StatsInit();
+
+    free(names);
+    free(fds);
+    free(info);
+
     DEBUG("init done, %d device(s) found",i);
 
     *adaptors = VAR;
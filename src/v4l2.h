@@ -8,26 +8,187 @@
 #ifndef __V4L2_H__
 #define __V4L2_H__
 
+#include "v4l2-trace.h"
+#include "v4l2-record.h"
+#include "v4l2-scale.h"
+#include "v4l2-blit.h"
+
 typedef struct {
     int debug;
     const char *devices;
     int alpha;
     CARD32 colorKey;
+    int osdAlpha;
+    int pageFlip;
+    int tileHash;
+    int fusedCompose;
+    int updateBudget;           /* KB, 0 for no limit */
+    int directRender;
+    const char *cacheFile;
+    int deferSetup;
+    const char *statsFile;
+    const char *traceFile;
+    const char *recordFile;
+    const char *scaler;         /* mem2mem device for Xv images */
+    int composite;
+    int deinterlace;            /* V4L2_DEINTERLACE_*, of captured video */
+    int exportYUV;              /* convert exported screen regions */
+    int mosaic;                 /* Xv ports sharing one overlay, or 0 */
+    int hugeShadow;
 } V4L2Config;
 
 extern V4L2Config config;
 
+/* what the display controller expects in the alpha channel of OSD windows
+ * (see V4L2SetupAlpha()).  X keeps ARGB premultiplied, so "straight" costs
+ * a conversion per pixel:
+ */
+enum {
+    V4L2_OSD_ALPHA_OFF,
+    V4L2_OSD_ALPHA_PREMULTIPLIED,
+    V4L2_OSD_ALPHA_STRAIGHT,
+};
+
 #define DEBUG(fmt, ...) do {                                         \
     if (config.debug)                                                \
         xf86Msg(X_INFO, "v4l2: "fmt"\n", ##__VA_ARGS__);             \
     } while (0)
 
+#define LIKELY(x)      __builtin_expect(!!(x), 1)
+#define UNLIKELY(x)    __builtin_expect(!!(x), 0)
+
+/* for state that is written on every update or frame, or from other
+ * threads, so that it doesn't share cache lines with what is only read:
+ */
+#define V4L2_CACHE_ALIGNED  __attribute__((aligned(V4L2_CACHE_LINE)))
+
+/* DEBUG() is synchronous and much too slow for the hot paths, which
+ * should use V4L2_TRACE() instead to log into the binary trace ring.
+ */
+extern V4L2TraceRecord *v4l2Trace;
+
+#define V4L2_TRACE(event, port, a0, a1, a2, a3) do {                  \
+    if (UNLIKELY (v4l2Trace))                                        \
+        V4L2TraceEvent(V4L2_TRACE_##event, port, a0, a1, a2, a3);    \
+    } while (0)
+
+#define V4L2_TRACE_XY(x, y)  (((x) & 0xffff) | ((y) << 16))
+
+/* session recording, for offline replay with v4l2-replay */
+extern Bool v4l2Recording;
+
+#define V4L2_RECORD(type, port, a0, a1, a2, a3, boxes) do {          \
+    if (UNLIKELY (v4l2Recording))                                    \
+        V4L2Record(V4L2_RECORD_##type, port, a0, a1, a2, a3, boxes); \
+    } while (0)
+
+
+#define V4L2_MAX_FORMATS  16
+#define V4L2_MAX_CTRLS    32
+#define V4L2_MAX_SIZES    8
+
+/* what we know about a device without having to negotiate with it, either
+ * learned by probing or loaded from the capability cache (keyed by the
+ * driver/bus_info/version reported by VIDIOC_QUERYCAP)
+ */
+typedef struct {
+    char                        driver[16];
+    char                        card[32];
+    char                        bus_info[32];
+    CARD32                      version;
+    CARD32                      capabilities;
+
+    CARD32                      fbufCapability;
+    int                         width, height;    /* overlay window */
+
+    int                         nformats;
+    CARD32                      formats[V4L2_MAX_FORMATS];
+
+    /* discrete frame sizes of the first format, if it has any: */
+    int                         nsizes;
+    struct {
+        int                     width, height;
+    } sizes[V4L2_MAX_SIZES];
+
+    int                         nctrls;
+    struct {
+        CARD32                  id;
+        INT32                   min, max, step, def;
+        char                    name[32];
+    } ctrls[V4L2_MAX_CTRLS];
+} V4L2DeviceInfo;
+
+/* Runtime counters.  These are bumped from the hot paths, so they are
+ * plain integers updated with relaxed atomics: no locking, and no ordering
+ * guarantees beyond each counter being eventually consistent.
+ */
+#define V4L2_STAT_HIST  16      /* ioctl latency buckets, log2(usec) */
+#define V4L2_STAT_SAMPLES 128   /* latest frames shown, for percentiles */
+
+#define V4L2_STAT_ADD(counter, n) \
+    __atomic_fetch_add(&(counter), (n), __ATOMIC_RELAXED)
+#define V4L2_STAT_GET(counter) \
+    __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+typedef struct {
+    unsigned long               ioctls;
+    unsigned long               ioctlUsec;
+    unsigned long               ioctlHist[V4L2_STAT_HIST];
+    unsigned long               reputs;
+    unsigned long               commits;
+    unsigned long               frames;     /* composited (see V4L2SetFrame()),
+                                               or exported */
+    unsigned long               dropped;    /* .. replaced before drawn */
+
+    /* Xv images shown by the overlay (see V4L2StatsPresent()): from
+     * XvPutImage (or XV_PRESENT_TIME) to the device showing the frame, and
+     * how much that changed from one frame to the next, of the latest
+     * frames the device timestamped.  Those it didn't are only counted:
+     */
+    unsigned long               presented;
+    unsigned long               unstamped;
+    unsigned long               held;       /* for XV_PRESENT_TIME */
+    unsigned long               latencyUsec[V4L2_STAT_SAMPLES];
+    unsigned long               jitterUsec[V4L2_STAT_SAMPLES];
+} V4L2PortStats;
+
+/* kinds of framebuffer writes made by the alpha path: */
+enum {
+    V4L2_OP_SOLID,
+    V4L2_OP_TRANSPARENT,
+    V4L2_OP_CURSOR,
+    V4L2_OP_OSD,
+    V4L2_OP_VIDEO,              /* composited by the CPU */
+    V4L2_NUM_OPS
+};
+
+typedef struct {
+    unsigned long               updates;
+    unsigned long               updateUsec;
+    unsigned long               boxes[V4L2_NUM_OPS];
+    unsigned long               bytes[V4L2_NUM_OPS];
+    unsigned long               regionAllocs;
+    unsigned long               flips;
+    unsigned long               vsyncWaits;
+    unsigned long               hashedTiles;
+    unsigned long               skippedBytes;   /* solid, unchanged tiles */
+    unsigned long               deferredBytes;  /* over the update budget */
+} V4L2ScreenStats;
+
+extern V4L2ScreenStats v4l2ScreenStats[MAXSCREENS];
+
+typedef struct _V4L2Image V4L2Image;
+typedef struct _V4L2Capture V4L2Capture;
+typedef struct _V4L2Export V4L2Export;
 
 typedef struct _PortPrivRec {
     ScrnInfoPtr                 pScrn;
 
-    /* file handle */
+    /* port number, and the device it is on (file handle), which is a
+     * different one for each port except those of the mosaic:
+     */
     int                         nr;
+    int                         dev;
 
     XF86VideoEncodingPtr        enc;
     int                         *input;
@@ -43,13 +204,146 @@ typedef struct _PortPrivRec {
     /* colorkey */
     CARD32                      colorKey;
 
+    /* global alpha (XV_GLOBAL_ALPHA), sets in quick succession are
+     * coalesced into one ioctl by a timer
+     */
+    int                         globalAlpha;
+    Bool                        globalAlphaPending;
+    CARD32                      globalAlphaTime;  /* of last ioctl, msec */
+    OsTimerPtr                  globalAlphaTimer;
+
+    /* overlay window size in screen coordinates, for ReputImage when the
+     * framebuffer is rotated, and the V4L2_CID_ROTATE, _HFLIP and _VFLIP
+     * values last set
+     */
+    short                       drw_w, drw_h;
+    int                         rotate, hflip, vflip;
+
+    /* Xv images, see v4l2-image.c */
+    V4L2Image                   *image;
+
+    /* video composited by the CPU, the device can't blend it or key it: */
+    Bool                        composite;
+
+    /* one of the ports sharing the overlay, see v4l2-mosaic.c */
+    Bool                        mosaic;
+
+    /* when the next Xv image is to be shown, X server time in msec, or 0
+     * for right away (XV_PRESENT_TIME), see v4l2-image.c
+     */
+    CARD32                      presentTime;
+
+    /* the window is clipped away (see V4L2SuspendOverlay()), and whether
+     * the overlay was turned off for it with VIDIOC_OVERLAY:
+     */
+    Bool                        suspended;
+    Bool                        overlayOff;
+
+    /* what a capture device captures, see v4l2-capture.c */
+    V4L2Capture                 *capture;
+
+    /* the screen streamed into an output device, see v4l2-export.c */
+    V4L2Export                  *export;
+
+    /* bumped from the capture and export threads too: */
+    V4L2PortStats               stats V4L2_CACHE_ALIGNED;
+
 } PortPrivRec, *PortPrivPtr;
 
 
+/* All device access goes through a backend, so the driver logic can be
+ * run against something other than a kernel device.  The backend is picked
+ * by device name prefix, see V4L2FindBackend().
+ */
+typedef struct {
+    const char *prefix;
+    int   (*open)(const char *name, int flags);
+    int   (*close)(int fd);
+    int   (*ioctl)(int fd, unsigned long request, void *arg);
+    void *(*mmap)(int fd, size_t length, int prot, off_t offset);
+    int   (*munmap)(void *addr, size_t length);
+} V4L2Backend;
+
+extern const V4L2Backend v4l2KernelBackend;
+extern const V4L2Backend v4l2FakeBackend;
+
+const V4L2Backend *V4L2FindBackend(const char *name);
+
+/* parallel device probe + capability cache */
+int V4L2ProbeDevices(char **names, int n, int *fds, V4L2DeviceInfo *info);
+
+/* runtime statistics */
+uint64_t V4L2StatsNow(void);
+void V4L2StatsIoctl(V4L2PortStats *stats, unsigned long usec);
+void V4L2StatsPresent(V4L2PortStats *stats, uint64_t due, uint64_t present);
+unsigned long V4L2StatsPercentile(const unsigned long *samples,
+        unsigned long count, int percent);
+void V4L2StatsAddPort(const char *name, V4L2PortStats *stats);
+void V4L2StatsInit(void);
+
+/* binary trace */
+void V4L2TraceEvent(int event, int port, int a0, int a1, int a2, int a3);
+void V4L2TraceDump(void);
+void V4L2TraceInit(void);
+
+/* session recording */
+void V4L2Record(int type, int port, int a0, int a1, int a2, int a3,
+        RegionPtr boxes);
+void V4L2RecordFlush(void);
+void V4L2RecordInit(ScrnInfoPtr pScrn);
+
 /* used when alpha blending is enabled */
 void V4L2SetupAlpha(PortPrivPtr pPPriv);
 void V4L2SetClip(PortPrivPtr pPPriv, DrawablePtr pDraw, RegionPtr clipBoxes);
 void V4L2ClearClip(PortPrivPtr pPPriv);
+Bool V4L2RotateBox(ScreenPtr pScreen, BoxPtr pbox);
+Bool V4L2RotateVideo(ScreenPtr pScreen, int *degrees, int *hflip, int *vflip);
+
+/* used when the video is composited by the CPU */
+void V4L2SetupComposite(PortPrivPtr pPPriv);
+void V4L2SetFrame(PortPrivPtr pPPriv, const V4L2ScaleImage *frame, int matrix);
+void V4L2SetFramePosition(PortPrivPtr pPPriv, short x, short y);
+void V4L2SourceChanged(PortPrivPtr pPPriv);
+
+/* Xv images, optionally through a mem2mem scaler */
+void V4L2ImageInit(void);
+int V4L2ImageFormats(const V4L2DeviceInfo *info, Bool composite,
+        XF86ImagePtr *pImages);
+int V4L2ImageAttributes(int id, unsigned short *w, unsigned short *h,
+        int *pitches, int *offsets);
+int V4L2ImagePut(PortPrivPtr pPPriv, const V4L2Backend *backend, int fd,
+        const V4L2DeviceInfo *info, int id, const unsigned char *buf,
+        short width, short height, short src_x, short src_y,
+        short src_w, short src_h, short drw_w, short drw_h);
+Bool V4L2ImageSoftScale(PortPrivPtr pPPriv);
+void V4L2ImageStop(PortPrivPtr pPPriv, Bool shutdown);
+void V4L2ImageSuspend(PortPrivPtr pPPriv);
+void V4L2ImageResume(PortPrivPtr pPPriv);
+
+/* video from capture devices, composited */
+Bool V4L2CaptureSupported(const V4L2DeviceInfo *info);
+int V4L2CapturePut(PortPrivPtr pPPriv, const V4L2Backend *backend, int fd,
+        const V4L2DeviceInfo *info, short drw_w, short drw_h, Bool still);
+void V4L2CaptureStop(PortPrivPtr pPPriv, Bool shutdown);
+
+/* screen regions exported to output devices */
+extern int v4l2Exporting;
+
+Bool V4L2ExportSupported(const V4L2DeviceInfo *info);
+int V4L2ExportGet(PortPrivPtr pPPriv, const V4L2Backend *backend, int fd,
+        const V4L2DeviceInfo *info, ScreenPtr pScreen,
+        short drw_x, short drw_y, short drw_w, short drw_h,
+        short vid_w, short vid_h, Bool still);
+void V4L2ExportDamage(ScreenPtr pScreen, RegionPtr damage);
+void V4L2ExportStop(PortPrivPtr pPPriv, Bool shutdown);
+
+/* several ports on one overlay */
+Bool V4L2MosaicSupported(const V4L2DeviceInfo *info, Bool composite);
+int V4L2MosaicSetPosition(PortPrivPtr pPPriv, const V4L2Backend *backend,
+        int fd, const V4L2DeviceInfo *info, ScreenPtr pScreen,
+        short x, short y, RegionPtr clipBoxes);
+void V4L2MosaicSetFrame(PortPrivPtr pPPriv, const V4L2ScaleImage *frame);
+Bool V4L2MosaicStop(PortPrivPtr pPPriv);
 
 #ifndef MAX
 #  define MAX(a,b) ((a) > (b) ? (a) : (b))
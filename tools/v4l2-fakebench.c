@@ -0,0 +1,400 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: run the driver's Xv adaptor and shadow update against the
+ *   fake backend (see v4l2-fake.c), on a fake server (see
+ *   v4l2-fakeserver.c), and count the ioctls and time each step: an image
+ *   port put, reput, timed, clipped away and back, a video port cropped
+ *   and faded, updates drawn around and over the video and a cursor moved
+ *   over it, a burst drawn around it and the screen exposed, then all
+ *   stopped.  The framebuffer is checked against the screen after the
+ *   burst, and at the end.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <linux/videodev2.h>
+
+#include "v4l2.h"
+#include "v4l2-fakeserver.h"
+
+#define FOURCC_YUY2     0x32595559
+#define FRAME_MSEC      16
+#define MAX_OPTIONS     32
+#define SETTLE_FRAMES   8
+#define SETTLE_MSEC     100
+
+static XF86VideoAdaptorPtr imageAdaptor, videoAdaptor;
+static pointer imagePort, videoPort;
+static RegionRec imageClip, videoClip;
+static BoxRec imageWin, videoWin;
+static unsigned char *buf;
+static int width = 640, height = 480;
+
+static Atom
+atom(const char *name)
+{
+    return MakeAtom(name, strlen(name), TRUE);
+}
+
+/* a turn of the main loop, and on to the next frame: */
+static void
+frame(void)
+{
+    FakeServerBlock();
+    FakeServerAdvance(FRAME_MSEC);
+}
+
+/* turns of the main loop until whatever an UpdateBudget held back (for
+ * V4L2_BUDGET_MSEC at a time, and up to four updates) has been drawn:
+ */
+static void
+settle(void)
+{
+    int i;
+
+    for (i = 0; i < SETTLE_FRAMES; i++) {
+        FakeServerBlock();
+        FakeServerAdvance(SETTLE_MSEC);
+    }
+    FakeServerBlock();
+}
+
+static int
+put(RegionPtr clip)
+{
+    return (*imageAdaptor->PutImage)(fakeServer.pScrn, 0, 0,
+            imageWin.x1, imageWin.y1, width, height,
+            imageWin.x2 - imageWin.x1, imageWin.y2 - imageWin.y1,
+            FOURCC_YUY2, buf, width, height, FALSE, clip, imagePort,
+            &fakeServer.pRoot->drawable);
+}
+
+static int
+reput(RegionPtr clip)
+{
+    return (*imageAdaptor->ReputImage)(fakeServer.pScrn,
+            imageWin.x1, imageWin.y1, clip, imagePort,
+            &fakeServer.pRoot->drawable);
+}
+
+/* the source rectangle panned across the device's frames: */
+static int
+video(int i)
+{
+    int w = videoWin.x2 - videoWin.x1, h = videoWin.y2 - videoWin.y1;
+
+    return (*videoAdaptor->PutVideo)(fakeServer.pScrn, i % 64, i % 48,
+            videoWin.x1, videoWin.y1, w, h, w, h, &videoClip, videoPort,
+            &fakeServer.pRoot->drawable);
+}
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n frames] [-l usec] [-s WxH] "
+            "[-o Name=Value].. [WxH]\n", prog);
+    exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+    int screenWidth = 800, screenHeight = 600;
+    int frames = 300, latency = 0, noptions = 1;
+    char *options[MAX_OPTIONS + 2], devices[64], *name;
+    struct v4l2_format before, after;
+    const V4L2Backend *backend;
+    PortPrivPtr pPPriv;
+    RegionRec empty, area;
+    BoxRec box, cursor;
+    unsigned long wrong;
+    uint64_t t;
+    int fd, opt, i;
+
+    while ((opt = getopt(argc, argv, "n:l:s:o:")) != -1) {
+        switch (opt) {
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        case 'l':
+            latency = atoi(optarg);
+            break;
+        case 's':
+            if (sscanf(optarg, "%dx%d", &screenWidth, &screenHeight) != 2)
+                usage(argv[0]);
+            break;
+        case 'o':
+            if (noptions == MAX_OPTIONS)
+                usage(argv[0]);
+            options[noptions++] = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if ((argc - optind > 1) || ((argc - optind == 1) &&
+            (sscanf(argv[optind], "%dx%d", &width, &height) != 2)))
+        usage(argv[0]);
+
+    /* an image port and a video port, unless told otherwise: */
+    snprintf(devices, sizeof(devices), "Devices=fake:0@%d,fake:1@%d",
+            latency, latency);
+    options[0] = devices;
+    options[noptions] = NULL;
+
+    buf = calloc(1, (size_t)width * height * 2);
+    if (!buf) {
+        perror("alloc");
+        return 1;
+    }
+
+    /* the image in the middle of the screen, at its own size if it fits,
+     * the video in the top left corner, under it:
+     */
+    imageWin.x1 = MAX(0, (screenWidth - width) / 2);
+    imageWin.y1 = MAX(0, (screenHeight - height) / 2);
+    imageWin.x2 = imageWin.x1 + MIN(width, screenWidth);
+    imageWin.y2 = imageWin.y1 + MIN(height, screenHeight);
+    RegionInit(&imageClip, &imageWin, 1);
+
+    videoWin.x1 = 0;
+    videoWin.y1 = 0;
+    videoWin.x2 = screenWidth / 3;
+    videoWin.y2 = screenHeight / 3;
+    RegionInit(&videoClip, &videoWin, 1);
+    RegionSubtract(&videoClip, &videoClip, &imageClip);
+
+    RegionNull(&empty);
+
+    /* loading, probing, setting up the devices and the first redraw: */
+    t = V4L2StatsNow();
+    if (!FakeServerStart(screenWidth, screenHeight, options)) {
+        fprintf(stderr, "no devices\n");
+        return 1;
+    }
+    frame();
+    FakeServerReport("init", 0, V4L2StatsNow() - t);
+
+    imageAdaptor = fakeServer.adaptors[0];
+    imagePort = imageAdaptor->pPortPrivates[0].ptr;
+    pPPriv = imagePort;
+    if (!imageAdaptor->PutImage) {
+        fprintf(stderr, "the first device takes no images\n");
+        return 1;
+    }
+    if (fakeServer.nadaptors > 1) {
+        videoAdaptor = fakeServer.adaptors[1];
+        videoPort = videoAdaptor->pPortPrivates[0].ptr;
+    }
+
+    /* XvPutImage(), the first one sets up the queue: */
+    t = V4L2StatsNow();
+    put(&imageClip);
+    frame();
+    FakeServerReport("setup", 1, V4L2StatsNow() - t);
+
+    t = V4L2StatsNow();
+    for (i = 0; i < frames; i++) {
+        buf[i % (width * 2)] = i;
+        put(&imageClip);
+        frame();
+    }
+    FakeServerReport("put", frames, V4L2StatsNow() - t);
+
+    /* the window moved, or was exposed: */
+    t = V4L2StatsNow();
+    for (i = 0; i < frames; i++) {
+        reput(&imageClip);
+        frame();
+    }
+    FakeServerReport("reput", frames, V4L2StatsNow() - t);
+
+    /* XV_PRESENT_TIME, held until the timer fires: */
+    t = V4L2StatsNow();
+    (*imageAdaptor->SetPortAttribute)(fakeServer.pScrn,
+            atom("XV_PRESENT_TIME"), GetTimeInMillis() + FRAME_MSEC,
+            imagePort);
+    put(&imageClip);
+    frame();
+    FakeServerReport("timed", 1, V4L2StatsNow() - t);
+
+    /* covered by another window, and back: */
+    t = V4L2StatsNow();
+    reput(&empty);
+    frame();
+    FakeServerReport("suspend", 1, V4L2StatsNow() - t);
+
+    t = V4L2StatsNow();
+    reput(&imageClip);
+    frame();
+    FakeServerReport("resume", 1, V4L2StatsNow() - t);
+
+    if (videoAdaptor && videoAdaptor->PutVideo) {
+        t = V4L2StatsNow();
+        for (i = 0; i < frames; i++) {
+            video(i);
+            frame();
+        }
+        FakeServerReport("crop", frames, V4L2StatsNow() - t);
+
+        /* a fade, set faster than the device is told: */
+        t = V4L2StatsNow();
+        for (i = 0; i < frames; i++) {
+            (*videoAdaptor->SetPortAttribute)(fakeServer.pScrn,
+                    atom("XV_GLOBAL_ALPHA"), 255 - i % 256, videoPort);
+            FakeServerBlock();
+            FakeServerAdvance(FRAME_MSEC / 4);
+        }
+        FakeServerAdvance(FRAME_MSEC);
+        FakeServerReport("alpha", frames, V4L2StatsNow() - t);
+    }
+
+    /* something drawn across the screen, over the video too: */
+    t = V4L2StatsNow();
+    for (i = 0; i < frames; i++) {
+        box.x1 = (i * 7) % screenWidth;
+        box.y1 = (i * 5) % screenHeight;
+        box.x2 = box.x1 + screenWidth / 4;
+        box.y2 = box.y1 + screenHeight / 8;
+        RegionInit(&area, &box, 1);
+        FakeServerDraw(&area, 0x00102030 + i);
+        RegionUninit(&area);
+        put(&imageClip);
+        frame();
+    }
+    FakeServerReport("draw", frames, V4L2StatsNow() - t);
+
+    /* the cursor across the image, damaging where it was and is: */
+    t = V4L2StatsNow();
+    for (i = 0; i < frames; i++) {
+        RegionInit(&area, &cursor, 1);
+        if (i)
+            FakeServerDamage(&area);
+        RegionUninit(&area);
+
+        cursor.x1 = imageWin.x1 + (i * 3) % (imageWin.x2 - imageWin.x1);
+        cursor.y1 = imageWin.y1 + (i * 2) % (imageWin.y2 - imageWin.y1);
+        cursor.x2 = cursor.x1 + 16;
+        cursor.y2 = cursor.y1 + 16;
+        FakeServerCursors(&cursor, 1);
+        RegionInit(&area, &cursor, 1);
+        FakeServerDamage(&area);
+        RegionUninit(&area);
+
+        put(&imageClip);
+        frame();
+    }
+    FakeServerReport("cursor", frames, V4L2StatsNow() - t);
+
+    /* a burst drawn around the video while it is paused, which an
+     * UpdateBudget holds back and the following updates catch up on, then
+     * the whole screen exposed and the image reput, its clip filled in
+     * the same bands as what is around it.  The framebuffer then shows
+     * all of it, however TileHash hashed the tiles the burst was split
+     * across:
+     */
+    t = V4L2StatsNow();
+    box.x1 = 0;
+    box.y1 = 0;
+    box.x2 = screenWidth;
+    box.y2 = screenHeight;
+    RegionInit(&area, &box, 1);
+    RegionSubtract(&area, &area, &imageClip);
+    RegionSubtract(&area, &area, &videoClip);
+    FakeServerDraw(&area, 0x00405060);
+    RegionUninit(&area);
+    settle();
+    RegionInit(&area, &box, 1);
+    FakeServerDamage(&area);
+    RegionUninit(&area);
+    reput(&imageClip);
+    settle();
+    FakeServerReport("burst", 2 * SETTLE_FRAMES, V4L2StatsNow() - t);
+
+    RegionNull(&area);
+    RegionUnion(&area, &imageClip, &videoClip);
+    wrong = FakeServerCheck(&area);
+    RegionUninit(&area);
+
+    /* the clients go away, and with them their windows, the root window
+     * painted where they were (which with DirectRender is the only way
+     * the holes get drawn over):
+     */
+    t = V4L2StatsNow();
+    (*imageAdaptor->StopVideo)(fakeServer.pScrn, imagePort, TRUE);
+    FakeServerDraw(&imageClip, 0x00000000);
+    if (videoPort) {
+        (*videoAdaptor->StopVideo)(fakeServer.pScrn, videoPort, TRUE);
+        FakeServerDraw(&videoClip, 0x00000000);
+    }
+    frame();
+    FakeServerReport("stop", 1, V4L2StatsNow() - t);
+
+    /* and once idle, the screen as drawn: */
+    settle();
+    wrong += FakeServerCheck(NULL);
+    printf("framebuffer: %lu pixels wrong\n", wrong);
+
+    printf("presented %lu (%lu unstamped), latency p50 %lu p99 %lu us, "
+            "jitter p99 %lu us\n", pPPriv->stats.presented,
+            pPPriv->stats.unstamped,
+            V4L2StatsPercentile(pPPriv->stats.latencyUsec,
+                    pPPriv->stats.presented, 50),
+            V4L2StatsPercentile(pPPriv->stats.latencyUsec,
+                    pPPriv->stats.presented, 99),
+            V4L2StatsPercentile(pPPriv->stats.jitterUsec,
+                    pPPriv->stats.presented ?
+                            pPPriv->stats.presented - 1 : 0, 99));
+
+    FakeServerStop();
+
+    /* the negotiated format outlives the file, as on a real device: */
+    name = strndup(config.devices, strcspn(config.devices, ","));
+    backend = V4L2FindBackend(name);
+
+    fd = backend->open(name, O_RDWR);
+    memset(&before, 0x00, sizeof(before));
+    before.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    backend->ioctl(fd, VIDIOC_G_FMT, &before);
+    backend->close(fd);
+
+    fd = backend->open(name, O_RDWR);
+    memset(&after, 0x00, sizeof(after));
+    after.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    backend->ioctl(fd, VIDIOC_G_FMT, &after);
+    backend->close(fd);
+
+    printf("format across reopen: %dx%d -> %dx%d\n",
+            before.fmt.pix.width, before.fmt.pix.height,
+            after.fmt.pix.width, after.fmt.pix.height);
+
+    free(name);
+    free(buf);
+
+    return wrong || (memcmp(&before.fmt.pix, &after.fmt.pix,
+            sizeof(before.fmt.pix)) != 0);
+}
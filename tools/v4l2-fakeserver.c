@@ -0,0 +1,1000 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: the bits of the X server the driver calls into, for
+ *   running it offline (see v4l2-fakeserver.h)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <linux/videodev2.h>
+
+#include "inputstr.h"
+#include "mipointrst.h"
+#include "propertyst.h"
+#include "damage.h"
+#include "v4l2.h"
+#include "v4l2-update.h"
+#include "v4l2-fakeserver.h"
+
+#define FAKE_MAX_ATOMS      256
+#define FAKE_MAX_HANDLERS   16
+#define FAKE_MAX_DAMAGES    4
+
+extern XF86ModuleData v4l2ModuleData;
+
+FakeServerRec fakeServer;
+
+ScreenInfo screenInfo;
+InputInfo inputInfo;
+ScrnInfoPtr *xf86Screens;
+CallbackListPtr PropertyStateCallback;
+
+/* the parts of the regions that aren't inline: */
+BoxRec RegionEmptyBox;
+RegDataRec RegionEmptyData;
+RegDataRec RegionBrokenData;
+
+RegionPtr
+RegionCreate(BoxPtr rect, int size)
+{
+    RegionPtr pReg = malloc(sizeof(RegionRec));
+
+    if (pReg)
+        RegionInit(pReg, rect, size);
+    return pReg;
+}
+
+void
+RegionDestroy(RegionPtr pReg)
+{
+    if (pReg) {
+        RegionUninit(pReg);
+        free(pReg);
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* messages, options and loading: */
+
+void
+xf86Msg(MessageType type, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+void
+xf86DrvMsgVerb(int scrnIndex, MessageType type, int verb,
+        const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+int
+xf86NameCmp(const char *s1, const char *s2)
+{
+    for (;;) {
+        while ((*s1 == '_') || (*s1 == ' ') || (*s1 == '\t'))
+            s1++;
+        while ((*s2 == '_') || (*s2 == ' ') || (*s2 == '\t'))
+            s2++;
+        if (!*s1 || (tolower(*s1) != tolower(*s2)))
+            return tolower(*s1) - tolower(*s2);
+        s1++;
+        s2++;
+    }
+}
+
+/* the value of an option, "" if it is given without one.  The last one
+ * given counts:
+ */
+static const char *
+FindOption(char **options, const char *name)
+{
+    const char *value = NULL;
+    size_t len;
+    char *s;
+
+    for (; options && *options; options++) {
+        s = strchr(*options, '=');
+        len = s ? s - *options : strlen(*options);
+        if ((strlen(name) == len) && !strncasecmp(*options, name, len))
+            value = s ? s + 1 : "";
+    }
+
+    return value;
+}
+
+/* the options are passed as the module's, as "Name=Value" strings: */
+void
+xf86ProcessOptions(int scrnIndex, pointer options, OptionInfoPtr optinfo)
+{
+    const char *s;
+
+    for (; optinfo->name; optinfo++) {
+        optinfo->found = FALSE;
+        if (!(s = FindOption(options, optinfo->name)))
+            continue;
+
+        switch (optinfo->type) {
+        case OPTV_BOOLEAN:
+            optinfo->value.bool = !*s || !xf86NameCmp(s, "on") ||
+                    !xf86NameCmp(s, "true") || !xf86NameCmp(s, "yes") ||
+                    !strcmp(s, "1");
+            break;
+        case OPTV_INTEGER:
+            optinfo->value.num = strtol(s, NULL, 0);
+            break;
+        case OPTV_STRING:
+            optinfo->value.str = (char *)s;
+            break;
+        default:
+            continue;
+        }
+        optinfo->found = TRUE;
+    }
+}
+
+static const OptionInfoRec *
+FindToken(const OptionInfoRec *table, int token)
+{
+    for (; table->name; table++) {
+        if (table->token == token)
+            return table->found ? table : NULL;
+    }
+    return NULL;
+}
+
+Bool
+xf86ReturnOptValBool(const OptionInfoRec *table, int token, Bool def)
+{
+    const OptionInfoRec *p = FindToken(table, token);
+    return p ? p->value.bool : def;
+}
+
+char *
+xf86GetOptValString(const OptionInfoRec *table, int token)
+{
+    const OptionInfoRec *p = FindToken(table, token);
+    return p ? (char *)p->value.str : NULL;
+}
+
+Bool
+xf86GetOptValInteger(const OptionInfoRec *table, int token, int *value)
+{
+    const OptionInfoRec *p = FindToken(table, token);
+
+    if (p)
+        *value = p->value.num;
+    return p != NULL;
+}
+
+void
+LoaderGetOS(const char **name, int *major, int *minor, int *teeny)
+{
+    if (name)
+        *name = "linux";
+    if (major)
+        *major = 0;
+    if (minor)
+        *minor = 0;
+    if (teeny)
+        *teeny = 0;
+}
+
+static DriverPtr driver;
+static xf86XVInitGenericAdaptorPtr adaptorInit;
+
+void
+xf86AddDriver(DriverPtr drv, pointer module, int flags)
+{
+    driver = drv;
+}
+
+Bool
+xf86XVRegisterGenericAdaptorDriver(xf86XVInitGenericAdaptorPtr InitFunc)
+{
+    adaptorInit = InitFunc;
+    return TRUE;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* atoms, callbacks, signals, sockets: */
+
+static char *atoms[FAKE_MAX_ATOMS];
+static int natoms;
+
+Atom
+MakeAtom(const char *string, unsigned len, Bool makeit)
+{
+    int i;
+
+    for (i = 0; i < natoms; i++) {
+        if ((strlen(atoms[i]) == len) && !strncmp(atoms[i], string, len))
+            return i + 1;
+    }
+
+    if (!makeit || (natoms == FAKE_MAX_ATOMS))
+        return None;
+
+    atoms[natoms] = strndup(string, len);
+    return ++natoms;
+}
+
+const char *
+NameForAtom(Atom atom)
+{
+    return ((atom > 0) && (atom <= natoms)) ? atoms[atom - 1] : NULL;
+}
+
+/* there are no properties to change: */
+Bool
+AddCallback(CallbackListPtr *pcbl, CallbackProcPtr callback, pointer data)
+{
+    return TRUE;
+}
+
+/* nor anyone to send SIGUSR2 for the stats */
+OsSigHandlerPtr
+OsSignal(int sig, OsSigHandlerPtr handler)
+{
+    return NULL;
+}
+
+void
+AddGeneralSocket(int fd)
+{
+}
+
+void
+RemoveGeneralSocket(int fd)
+{
+}
+
+void
+NoopDDA(void)
+{
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* time, timers and the main loop.  The clock only moves when told to, so
+ * runs are repeatable:
+ */
+
+struct _OsTimerRec {
+    OsTimerPtr next;
+    CARD32 expires;
+    OsTimerCallback callback;
+    pointer arg;
+};
+
+static CARD32 now = 1;
+static OsTimerPtr timers;
+
+static struct {
+    BlockHandlerProcPtr block;
+    WakeupHandlerProcPtr wakeup;
+    pointer data;
+} handlers[FAKE_MAX_HANDLERS];
+static int nhandlers;
+
+CARD32
+GetTimeInMillis(void)
+{
+    return now;
+}
+
+static void
+TimerDisarm(OsTimerPtr timer)
+{
+    OsTimerPtr *prev;
+
+    for (prev = &timers; *prev; prev = &(*prev)->next) {
+        if (*prev == timer) {
+            *prev = timer->next;
+            return;
+        }
+    }
+}
+
+/* like the server's, a timer that has already expired fires right away: */
+OsTimerPtr
+TimerSet(OsTimerPtr timer, int flags, CARD32 millis, OsTimerCallback func,
+        pointer arg)
+{
+    if (!timer && !(timer = calloc(1, sizeof(*timer))))
+        return NULL;
+
+    TimerDisarm(timer);
+    if (!millis)
+        return timer;
+
+    if (!(flags & TimerAbsolute))
+        millis += now;
+
+    timer->callback = func;
+    timer->arg = arg;
+
+    if ((INT32)(millis - now) <= 0) {
+        millis = (*func)(timer, now, arg);
+        if (!millis)
+            return timer;
+        millis += now;
+    }
+
+    timer->expires = millis;
+    timer->next = timers;
+    timers = timer;
+
+    return timer;
+}
+
+void
+TimerCancel(OsTimerPtr timer)
+{
+    if (timer)
+        TimerDisarm(timer);
+}
+
+void
+TimerFree(OsTimerPtr timer)
+{
+    if (timer) {
+        TimerDisarm(timer);
+        free(timer);
+    }
+}
+
+static void
+DoTimers(void)
+{
+    OsTimerPtr timer, first;
+    CARD32 next;
+
+    for (;;) {
+        first = NULL;
+        for (timer = timers; timer; timer = timer->next) {
+            if ((INT32)(timer->expires - now) <= 0 &&
+                    (!first || (INT32)(timer->expires - first->expires) < 0))
+                first = timer;
+        }
+        if (!first)
+            return;
+
+        TimerDisarm(first);
+        next = (*first->callback)(first, now, first->arg);
+        if (next)
+            TimerSet(first, 0, next, first->callback, first->arg);
+    }
+}
+
+void
+FakeServerAdvance(CARD32 msec)
+{
+    now += msec;
+    DoTimers();
+}
+
+Bool
+RegisterBlockAndWakeupHandlers(BlockHandlerProcPtr blockHandler,
+        WakeupHandlerProcPtr wakeupHandler, pointer blockData)
+{
+    if (nhandlers == FAKE_MAX_HANDLERS)
+        return FALSE;
+
+    handlers[nhandlers].block = blockHandler;
+    handlers[nhandlers].wakeup = wakeupHandler;
+    handlers[nhandlers].data = blockData;
+    nhandlers++;
+    return TRUE;
+}
+
+void
+RemoveBlockAndWakeupHandlers(BlockHandlerProcPtr blockHandler,
+        WakeupHandlerProcPtr wakeupHandler, pointer blockData)
+{
+    int i;
+
+    for (i = 0; i < nhandlers; i++) {
+        if ((handlers[i].block == blockHandler) &&
+                (handlers[i].wakeup == wakeupHandler) &&
+                (handlers[i].data == blockData)) {
+            handlers[i] = handlers[--nhandlers];
+            return;
+        }
+    }
+}
+
+void
+FakeServerBlock(void)
+{
+    ScreenPtr pScreen = fakeServer.pScreen;
+    int i;
+
+    DoTimers();
+
+    (*pScreen->BlockHandler)(pScreen->myNum, NULL, NULL, NULL);
+    for (i = 0; i < nhandlers; i++)
+        (*handlers[i].block)(handlers[i].data, NULL, NULL);
+
+    /* nothing to wait for: */
+    for (i = 0; i < nhandlers; i++)
+        (*handlers[i].wakeup)(handlers[i].data, 0, NULL);
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* damage, each of which is on all of the screen: */
+
+typedef struct {
+    RegionRec region;
+    ScreenPtr pScreen;
+} FakeDamageRec, *FakeDamagePtr;
+
+static FakeDamagePtr damages[FAKE_MAX_DAMAGES];
+static int ndamages;
+
+DamagePtr
+DamageCreate(DamageReportFunc damageReport, DamageDestroyFunc damageDestroy,
+        DamageReportLevel damageLevel, Bool isInternal, ScreenPtr pScreen,
+        pointer closure)
+{
+    FakeDamagePtr pDamage = calloc(1, sizeof(*pDamage));
+
+    if (!pDamage)
+        return NULL;
+
+    RegionNull(&pDamage->region);
+    pDamage->pScreen = pScreen;
+    return (DamagePtr)pDamage;
+}
+
+void
+DamageRegister(DrawablePtr pDrawable, DamagePtr pDamage)
+{
+    if (ndamages < FAKE_MAX_DAMAGES)
+        damages[ndamages++] = (FakeDamagePtr)pDamage;
+}
+
+RegionPtr
+DamageRegion(DamagePtr pDamage)
+{
+    return &((FakeDamagePtr)pDamage)->region;
+}
+
+void
+DamageEmpty(DamagePtr pDamage)
+{
+    RegionEmpty(&((FakeDamagePtr)pDamage)->region);
+}
+
+void
+DamageRegionAppend(DrawablePtr pDrawable, RegionPtr pRegion)
+{
+    BoxRec box = { 0, 0, pDrawable->pScreen->width,
+            pDrawable->pScreen->height };
+    RegionRec clipped;
+    int i;
+
+    RegionInit(&clipped, &box, 1);
+    RegionIntersect(&clipped, &clipped, pRegion);
+    for (i = 0; i < ndamages; i++) {
+        if (damages[i]->pScreen == pDrawable->pScreen)
+            RegionUnion(&damages[i]->region, &damages[i]->region, &clipped);
+    }
+    RegionUninit(&clipped);
+}
+
+void
+DamageRegionProcessPending(DrawablePtr pDrawable)
+{
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* the screen: */
+
+static ScrnInfoRec scrn;
+static ScrnInfoPtr scrns[1] = { &scrn };
+static ScreenRec screen;
+static PixmapRec pixmap;
+static WindowRec root;
+static shadowBufRec shadow;
+
+/* the one private looked up is the pointer of a device (see MIPOINTER in
+ * v4l2-alpha.c), which is what devPrivates is set to:
+ */
+pointer
+dixLookupPrivate(PrivateRec **privates, const DevPrivateKey key)
+{
+    return *privates;
+}
+
+/* no framebuffer device, so no page flipping */
+int
+fbdevHWGetFD(ScrnInfoPtr pScrn)
+{
+    return 0;
+}
+
+void
+xf86XVFillKeyHelper(ScreenPtr pScreen, CARD32 key, RegionPtr clipBoxes)
+{
+    FakeServerDraw(clipBoxes, key);
+}
+
+static Bool
+FakeEnterVT(int scrnIndex, int flags)
+{
+    return TRUE;
+}
+
+static void
+FakeLeaveVT(int scrnIndex, int flags)
+{
+}
+
+static Bool
+FakeCloseScreen(int scrnIndex, ScreenPtr pScreen)
+{
+    return TRUE;
+}
+
+/* the shadow layer's, which redraws the damage: */
+static void
+FakeBlockHandler(int i, pointer blockData, pointer pTimeout,
+        pointer pReadmask)
+{
+    if (shadow.update && RegionNotEmpty(DamageRegion(shadow.pDamage))) {
+        (*shadow.update)(fakeServer.pScreen, &shadow);
+        DamageEmpty(shadow.pDamage);
+    }
+}
+
+static PixmapPtr
+FakeGetScreenPixmap(ScreenPtr pScreen)
+{
+    return &pixmap;
+}
+
+static Bool
+FakeWindowProc(WindowPtr pWin)
+{
+    return TRUE;
+}
+
+static Bool
+FakeModifyPixmapHeader(PixmapPtr pPixmap, int width, int height, int depth,
+        int bitsPerPixel, int devKind, pointer pPixData)
+{
+    if (devKind > 0)
+        pPixmap->devKind = devKind;
+    if (pPixData)
+        pPixmap->devPrivate.ptr = pPixData;
+    return TRUE;
+}
+
+static void *
+FakeWindow(ScreenPtr pScreen, CARD32 row, CARD32 offset, int mode,
+        CARD32 *size, void *closure)
+{
+    *size = fakeServer.fbStride;
+    return (CARD8 *)fakeServer.fb + row * fakeServer.fbStride + offset;
+}
+
+/* as the fbdev driver takes its Rotate option: */
+static int
+FakeRotate(char **options)
+{
+    const char *s = FindOption(options, "Rotate");
+
+    if (!s || config.directRender)
+        return SHADOW_ROTATE_0;
+    if (!xf86NameCmp(s, "CW"))
+        return SHADOW_ROTATE_270;
+    if (!xf86NameCmp(s, "UD"))
+        return SHADOW_ROTATE_180;
+    if (!xf86NameCmp(s, "CCW"))
+        return SHADOW_ROTATE_90;
+    return SHADOW_ROTATE_0;
+}
+
+/* where the shadow layer puts a screen pixel in the framebuffer: */
+static CARD32 *
+FakePixel(int x, int y)
+{
+    int w = fakeServer.width, h = fakeServer.height, fx = x, fy = y;
+
+    switch (fakeServer.rotate) {
+    case SHADOW_ROTATE_90:
+        fx = y;
+        fy = w - 1 - x;
+        break;
+    case SHADOW_ROTATE_180:
+        fx = w - 1 - x;
+        fy = h - 1 - y;
+        break;
+    case SHADOW_ROTATE_270:
+        fx = h - 1 - y;
+        fy = x;
+        break;
+    }
+
+    return (CARD32 *)((CARD8 *)fakeServer.fb + fy * fakeServer.fbStride) + fx;
+}
+
+Bool
+FakeServerStart(int width, int height, char **options)
+{
+    BoxRec box = { 0, 0, width, height };
+    int errmaj = 0, errmin = 0;
+
+    if (!v4l2ModuleData.setup(NULL, options, &errmaj, &errmin)) {
+        fprintf(stderr, "driver setup failed (%d, %d)\n", errmaj, errmin);
+        return FALSE;
+    }
+
+    fakeServer.width = width;
+    fakeServer.height = height;
+    fakeServer.stride = width * 4;
+    fakeServer.rotate = FakeRotate(options);
+    fakeServer.fbStride = (fakeServer.rotate &
+            (SHADOW_ROTATE_90 | SHADOW_ROTATE_270)) ? height * 4 : width * 4;
+    fakeServer.fb = calloc(height, fakeServer.stride);
+    fakeServer.shadow = calloc(height, fakeServer.stride);
+    if (!fakeServer.fb || !fakeServer.shadow)
+        return FALSE;
+
+    scrn.scrnIndex = 0;
+    scrn.virtualX = width;
+    scrn.virtualY = height;
+    scrn.displayWidth = width;
+    scrn.bitsPerPixel = 32;
+    scrn.depth = 24;
+    scrn.EnterVT = FakeEnterVT;
+    scrn.LeaveVT = FakeLeaveVT;
+    xf86Screens = scrns;
+
+    screen.myNum = 0;
+    screen.width = width;
+    screen.height = height;
+    screen.root = &root;
+    screen.CloseScreen = FakeCloseScreen;
+    screen.BlockHandler = FakeBlockHandler;
+    screen.GetScreenPixmap = FakeGetScreenPixmap;
+    screen.CreateWindow = FakeWindowProc;
+    screen.DestroyWindow = FakeWindowProc;
+    screen.ModifyPixmapHeader = FakeModifyPixmapHeader;
+    screenInfo.numScreens = 1;
+    screenInfo.screens[0] = &screen;
+
+    /* X draws straight into the framebuffer when there is no shadow: */
+    pixmap.drawable.type = DRAWABLE_PIXMAP;
+    pixmap.drawable.depth = 24;
+    pixmap.drawable.bitsPerPixel = 32;
+    pixmap.drawable.width = width;
+    pixmap.drawable.height = height;
+    pixmap.drawable.pScreen = &screen;
+    pixmap.devKind = fakeServer.stride;
+    pixmap.devPrivate.ptr = config.directRender ?
+            fakeServer.fb : fakeServer.shadow;
+
+    root.drawable.type = DRAWABLE_WINDOW;
+    root.drawable.depth = 24;
+    root.drawable.bitsPerPixel = 32;
+    root.drawable.width = width;
+    root.drawable.height = height;
+    root.drawable.pScreen = &screen;
+    root.viewable = TRUE;
+    RegionInit(&root.winSize, &box, 1);
+    RegionInit(&root.borderSize, &box, 1);
+    RegionInit(&root.clipList, &box, 1);
+    RegionInit(&root.borderClip, &box, 1);
+
+    if (!config.directRender) {
+        shadow.pDamage = DamageCreate(NULL, NULL, DamageReportNone, TRUE,
+                &screen, &screen);
+        DamageRegister(&pixmap.drawable, shadow.pDamage);
+        shadow.update = (fakeServer.rotate == SHADOW_ROTATE_0) ?
+                shadowUpdatePackedWeak() : shadowUpdateRotatePackedWeak();
+        shadow.window = FakeWindow;
+        shadow.pPixmap = &pixmap;
+        shadow.randr = fakeServer.rotate;
+    }
+
+    fakeServer.pScrn = &scrn;
+    fakeServer.pScreen = &screen;
+    fakeServer.pRoot = &root;
+
+    if (!driver || !(*driver->Probe)(driver, 0) || !adaptorInit)
+        return FALSE;
+
+    fakeServer.nadaptors = (*adaptorInit)(&scrn, &fakeServer.adaptors);
+
+    return fakeServer.nadaptors > 0;
+}
+
+void
+FakeServerStop(void)
+{
+    int i, j;
+
+    for (i = 0; i < fakeServer.nadaptors; i++) {
+        XF86VideoAdaptorPtr adaptor = fakeServer.adaptors[i];
+        for (j = 0; j < adaptor->nPorts; j++)
+            (*adaptor->StopVideo)(&scrn, adaptor->pPortPrivates[j].ptr, TRUE);
+    }
+
+    (*screen.CloseScreen)(screen.myNum, &screen);
+}
+
+static void
+Fill(CARD32 *base, int stride, RegionPtr region, CARD32 pixel)
+{
+    BoxPtr pbox = RegionRects(region);
+    int nbox = RegionNumRects(region);
+    int x, y;
+
+    for (; nbox--; pbox++) {
+        for (y = pbox->y1; y < pbox->y2; y++) {
+            CARD32 *p = (CARD32 *)((CARD8 *)base + y * stride);
+            for (x = pbox->x1; x < pbox->x2; x++)
+                p[x] = pixel;
+        }
+    }
+}
+
+void
+FakeServerDraw(RegionPtr region, CARD32 pixel)
+{
+    BoxRec box = { 0, 0, fakeServer.width, fakeServer.height };
+    RegionRec clipped;
+
+    RegionInit(&clipped, &box, 1);
+    RegionIntersect(&clipped, &clipped, region);
+
+    /* the shadow may have been moved (see HugeShadow option): */
+    Fill(pixmap.devPrivate.ptr, pixmap.devKind, &clipped, pixel);
+    if (config.directRender)
+        Fill(fakeServer.shadow, fakeServer.stride, &clipped, pixel);
+
+    DamageRegionAppend(&pixmap.drawable, &clipped);
+    RegionUninit(&clipped);
+}
+
+void
+FakeServerDamage(RegionPtr region)
+{
+    DamageRegionAppend(&pixmap.drawable, region);
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* cursors, a pointer device each: */
+
+static DeviceIntRec devices[FAKE_SERVER_MAX_CURSORS];
+static SpriteInfoRec sprites[FAKE_SERVER_MAX_CURSORS];
+static miPointerRec pointers[FAKE_SERVER_MAX_CURSORS];
+static CursorRec cursors[FAKE_SERVER_MAX_CURSORS];
+static CursorBits bits[FAKE_SERVER_MAX_CURSORS];
+
+void
+FakeServerCursors(const BoxRec *boxes, int n)
+{
+    int i, x, y;
+
+    inputInfo.devices = NULL;
+
+    for (i = MIN(n, FAKE_SERVER_MAX_CURSORS) - 1; i >= 0; i--) {
+        int w = boxes[i].x2 - boxes[i].x1, h = boxes[i].y2 - boxes[i].y1;
+
+        if ((bits[i].width != w) || (bits[i].height != h)) {
+            free(bits[i].argb);
+            bits[i].argb = malloc(sizeof(CARD32) * MAX(1, w * h));
+            if (!bits[i].argb)
+                continue;
+            bits[i].width = w;
+            bits[i].height = h;
+
+            /* premultiplied, with an opaque outline: */
+            for (y = 0; y < h; y++) {
+                for (x = 0; x < w; x++) {
+                    bits[i].argb[y * w + x] =
+                            ((x == 0) || (y == 0) || (x == w - 1) ||
+                                    (y == h - 1)) ? 0xffffffff : 0x80400040;
+                }
+            }
+        }
+
+        cursors[i].bits = &bits[i];
+        pointers[i].pScreen = &screen;
+        pointers[i].pCursor = &cursors[i];
+        pointers[i].x = boxes[i].x1;
+        pointers[i].y = boxes[i].y1;
+        sprites[i].spriteOwner = TRUE;
+        devices[i].spriteInfo = &sprites[i];
+        devices[i].devPrivates = (PrivateRec *)&pointers[i];
+        devices[i].next = inputInfo.devices;
+        inputInfo.devices = &devices[i];
+    }
+}
+
+unsigned long
+FakeServerCheck(RegionPtr video)
+{
+    const CARD32 *want = pixmap.devPrivate.ptr;
+    int stride = pixmap.devKind;
+    RegionRec skip;
+    DeviceIntPtr pDev;
+    unsigned long wrong = 0;
+    int x, y;
+
+    if (config.directRender) {
+        want = fakeServer.shadow;
+        stride = fakeServer.stride;
+    }
+
+    RegionNull(&skip);
+    for (pDev = inputInfo.devices; pDev; pDev = pDev->next) {
+        miPointerPtr pPointer = (miPointerPtr)pDev->devPrivates;
+        RegionRec padded;
+        BoxRec box;
+
+        box.x1 = pPointer->x - V4L2_UPDATE_SPRITE_PAD;
+        box.y1 = pPointer->y - V4L2_UPDATE_SPRITE_PAD;
+        box.x2 = pPointer->x + pPointer->pCursor->bits->width +
+                2 * V4L2_UPDATE_SPRITE_PAD;
+        box.y2 = pPointer->y + pPointer->pCursor->bits->height +
+                2 * V4L2_UPDATE_SPRITE_PAD;
+        RegionInit(&padded, &box, 1);
+        RegionUnion(&skip, &skip, &padded);
+        RegionUninit(&padded);
+    }
+
+    for (y = 0; y < fakeServer.height; y++) {
+        const CARD32 *w = (const CARD32 *)((const CARD8 *)want + y * stride);
+
+        for (x = 0; x < fakeServer.width; x++) {
+            BoxRec pixel = { x, y, x + 1, y + 1 };
+            CARD32 fb = *FakePixel(x, y);
+
+            if ((fb & 0x00ffffff) == (w[x] & 0x00ffffff) &&
+                    (!config.alpha || ((fb >> 24) == 0xff)))
+                continue;
+
+            if (RegionContainsRect(&skip, &pixel) != rgnOUT)
+                continue;
+
+            if (config.alpha && video &&
+                    (RegionContainsRect(video, &pixel) == rgnIN) &&
+                    ((fb >> 24) == 0))
+                continue;
+
+            wrong++;
+        }
+    }
+
+    RegionUninit(&skip);
+
+    return wrong;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* the fake backend, with the ioctls counted.  The probe calls it from
+ * several threads at once:
+ */
+static const struct {
+    unsigned long request;
+    const char *name;
+} names[] = {
+        { VIDIOC_QUERYCAP,    "QUERYCAP" },
+        { VIDIOC_ENUM_FMT,    "ENUM_FMT" },
+        { VIDIOC_QUERYCTRL,   "QUERYCTRL" },
+        { VIDIOC_G_FBUF,      "G_FBUF" },
+        { VIDIOC_S_FBUF,      "S_FBUF" },
+        { VIDIOC_G_FMT,       "G_FMT" },
+        { VIDIOC_S_FMT,       "S_FMT" },
+        { VIDIOC_TRY_FMT,     "TRY_FMT" },
+        { VIDIOC_S_SELECTION, "S_SELECTION" },
+        { VIDIOC_S_CROP,      "S_CROP" },
+        { VIDIOC_S_CTRL,      "S_CTRL" },
+        { VIDIOC_REQBUFS,     "REQBUFS" },
+        { VIDIOC_QUERYBUF,    "QUERYBUF" },
+        { VIDIOC_QBUF,        "QBUF" },
+        { VIDIOC_DQBUF,       "DQBUF" },
+        { VIDIOC_STREAMON,    "STREAMON" },
+        { VIDIOC_STREAMOFF,   "STREAMOFF" },
+        { VIDIOC_OVERLAY,     "OVERLAY" },
+        { 0,                  "other" },
+};
+
+#define NNAMES (sizeof(names) / sizeof(names[0]))
+
+static unsigned long counts[NNAMES];
+static V4L2ScreenStats reported;
+
+static int
+CountIoctl(int fd, unsigned long request, void *arg)
+{
+    int i;
+
+    for (i = 0; (i < NNAMES - 1) && (names[i].request != request); i++)
+        ;
+    V4L2_STAT_ADD(counts[i], 1);
+    return v4l2FakeBackend.ioctl(fd, request, arg);
+}
+
+/* all devices are fake ones: */
+const V4L2Backend *
+V4L2FindBackend(const char *name)
+{
+    static V4L2Backend backend;
+
+    if (!backend.ioctl) {
+        backend = v4l2FakeBackend;
+        backend.ioctl = CountIoctl;
+    }
+
+    return &backend;
+}
+
+void
+FakeServerReport(const char *step, int frames, unsigned long usec)
+{
+    const V4L2ScreenStats *stats = &v4l2ScreenStats[0];
+    unsigned long bytes = 0;
+    int i;
+
+    printf("%-8s %4d frames %8.1f us/frame:", step, frames,
+            frames ? (double)usec / frames : (double)usec);
+    for (i = 0; i < NNAMES; i++) {
+        unsigned long n = V4L2_STAT_GET(counts[i]);
+        if (n)
+            printf(" %s=%lu", names[i].name, n);
+        V4L2_STAT_ADD(counts[i], -n);
+    }
+
+    for (i = 0; i < V4L2_NUM_OPS; i++)
+        bytes += stats->bytes[i] - reported.bytes[i];
+    if (stats->updates != reported.updates) {
+        printf(" | updates=%lu KB=%lu skippedKB=%lu deferredKB=%lu",
+                stats->updates - reported.updates, bytes / 1024,
+                (stats->skippedBytes - reported.skippedBytes) / 1024,
+                (stats->deferredBytes - reported.deferredBytes) / 1024);
+    }
+    printf("\n");
+
+    reported = *stats;
+}
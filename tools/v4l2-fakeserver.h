@@ -0,0 +1,88 @@
+/*
+ * v4l2-fakeserver.h
+ *
+ * Just enough of an X server to load the driver and run its Xv adaptor
+ * and shadow update offline, against the fake devices (see v4l2-fake.c):
+ * one in-memory screen with a shadow (or, with DirectRender, none) and a
+ * framebuffer (rotated, if asked), damage, timers on a clock of its own,
+ * block and wakeup handlers, and cursors.  The ioctls of the devices are
+ * counted.  Used by v4l2-fakebench and v4l2-replay.
+ */
+
+#ifndef __V4L2_FAKESERVER_H__
+#define __V4L2_FAKESERVER_H__
+
+#include "xf86.h"
+#include "xf86xv.h"
+#include "scrnintstr.h"
+#include "windowstr.h"
+#include "pixmapstr.h"
+#include "regionstr.h"
+#include "shadow.h"
+
+#define FAKE_SERVER_MAX_CURSORS 4
+
+typedef struct {
+    ScrnInfoPtr pScrn;
+    ScreenPtr pScreen;
+    WindowPtr pRoot;            /* what the Xv requests draw to */
+    int width, height, stride;
+
+    /* the framebuffer, and what it should show: the shadow, or with
+     * DirectRender a copy of what was drawn into the framebuffer.  With
+     * the fbdev driver's Rotate option (CW, UD or CCW, among the options
+     * given), the framebuffer is rotated from the screen:
+     */
+    CARD32 *fb;
+    CARD32 *shadow;
+    int rotate;                 /* the shadow layer's randr bits */
+    int fbStride;
+
+    /* of the driver, each port in pPortPrivates[].ptr */
+    XF86VideoAdaptorPtr *adaptors;
+    int nadaptors;
+} FakeServerRec;
+
+extern FakeServerRec fakeServer;
+
+/* load the driver with options ("Name=Value", NULL terminated), set up a
+ * screen of width x height and initialize the Xv adaptors.  FALSE if the
+ * driver would not load, or found no devices:
+ */
+Bool FakeServerStart(int width, int height, char **options);
+
+/* stop all ports and close the screen */
+void FakeServerStop(void);
+
+/* draw pixel into region of the screen, as X would, and damage it */
+void FakeServerDraw(RegionPtr region, CARD32 pixel);
+
+/* damage region of the screen without changing it */
+void FakeServerDamage(RegionPtr region);
+
+/* move the cursors (ARGB images of the boxes' size, up to
+ * FAKE_SERVER_MAX_CURSORS) to boxes, or remove them with n = 0.  What
+ * the sprite would damage is left to the caller:
+ */
+void FakeServerCursors(const BoxRec *boxes, int n);
+
+/* a turn of the main loop: expired timers, block handlers (the shadow
+ * update among them) and wakeup handlers
+ */
+void FakeServerBlock(void);
+
+/* move the clock on, firing the timers that expire */
+void FakeServerAdvance(CARD32 msec);
+
+/* pixels of the framebuffer that don't show what they should: the
+ * screen outside of video (with opaque alpha, with Alpha), transparent
+ * inside of it.  The cursors, and the padding around them, are skipped:
+ */
+unsigned long FakeServerCheck(RegionPtr video);
+
+/* print the ioctls since the last report, and what the updates wrote, as
+ * one line of step, and reset the counts
+ */
+void FakeServerReport(const char *step, int frames, unsigned long usec);
+
+#endif /* __V4L2_FAKESERVER_H__ */
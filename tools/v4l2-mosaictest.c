@@ -0,0 +1,462 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: check the tile compositor of the mosaic (see v4l2-mosaic.c)
+ *   against a brute-force reference, pixel by pixel, on the fake device
+ *   (see v4l2-fake.c).  Ports get random windows (at odd positions too),
+ *   clipped by the ones above them, random frames and formats, and come
+ *   and go; after each round the buffer the mosaic queued must be what
+ *   each pixel of the screen says it should be.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+
+#include "xf86.h"
+#include "xf86xv.h"
+#include "v4l2.h"
+
+#define MAX_PORTS   4
+
+/* the bits of the driver and server the mosaic calls back into: */
+V4L2Config config;
+V4L2TraceRecord *v4l2Trace;
+
+static BlockHandlerProcPtr blockHandler;
+
+/* the server's, for the region macros: */
+BoxRec RegionEmptyBox;
+RegDataRec RegionEmptyData;
+RegDataRec RegionBrokenData;
+
+void
+xf86Msg(MessageType type, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+void V4L2TraceEvent(int event, int port, int a, int b, int c, int d) {}
+void V4L2StatsIoctl(V4L2PortStats *stats, unsigned long usec) {}
+void NoopDDA(void) {}
+
+uint64_t
+V4L2StatsNow(void)
+{
+    return 0;
+}
+
+OsTimerPtr
+TimerSet(OsTimerPtr timer, int flags, CARD32 millis, OsTimerCallback func,
+        pointer arg)
+{
+    return timer;
+}
+
+void
+TimerCancel(OsTimerPtr timer)
+{
+}
+
+Bool
+RegisterBlockAndWakeupHandlers(BlockHandlerProcPtr handler,
+        WakeupHandlerProcPtr wakeupHandler, pointer blockData)
+{
+    blockHandler = handler;
+    return TRUE;
+}
+
+void
+RemoveBlockAndWakeupHandlers(BlockHandlerProcPtr handler,
+        WakeupHandlerProcPtr wakeupHandler, pointer blockData)
+{
+    blockHandler = NULL;
+}
+
+/* ---------------------------------------------------------------------- */
+
+typedef struct {
+    PortPrivRec                 port;
+    Bool                        active;
+    short                       x, y, w, h;     /* window */
+    V4L2ScaleImage              frame;
+    uint8_t                     *mem;
+    RegionRec                   clip;
+} TestPort;
+
+static TestPort ports[MAX_PORTS];
+static int width, height;
+static signed char *owner;      /* port drawn at each pixel, or -1 */
+
+static int
+rnd(int n)
+{
+    return n ? (rand() % n) : 0;
+}
+
+/* a random frame the size of the window, of a format composited frames
+ * come in (see ImageComposite()):
+ */
+static void
+frame_init(TestPort *t)
+{
+    static const int formats[] = {
+            V4L2_SCALE_YUYV, V4L2_SCALE_UYVY, V4L2_SCALE_YUV420,
+    };
+    V4L2ScaleImage *f = &t->frame;
+    int w = t->w & ~1, h = t->h & ~1;
+    size_t i, size = w * h * 2;
+
+    free(t->mem);
+    t->mem = malloc(size);
+    for (i = 0; i < size; i++)
+        t->mem[i] = rand();
+
+    memset(f, 0x00, sizeof(*f));
+    f->format = formats[rnd(3)];
+    f->width = w;
+    f->height = h;
+    f->planes[0] = t->mem;
+    if (f->format == V4L2_SCALE_YUV420) {
+        f->strides[0] = w;
+        f->strides[1] = f->strides[2] = w / 2;
+        f->planes[1] = f->planes[0] + (w * h);
+        f->planes[2] = f->planes[1] + (w * h / 4);
+    } else {
+        f->strides[0] = w * 2;
+    }
+}
+
+/* Y, U and V of pixel x, y of a frame: */
+static void
+frame_pixel(const V4L2ScaleImage *f, int x, int y, uint8_t yuv[3])
+{
+    const uint8_t *row = f->planes[0] + (y * f->strides[0]);
+
+    switch (f->format) {
+    case V4L2_SCALE_YUYV:
+        yuv[0] = row[x * 2];
+        yuv[1] = row[((x & ~1) * 2) + 1];
+        yuv[2] = row[((x & ~1) * 2) + 3];
+        break;
+    case V4L2_SCALE_UYVY:
+        yuv[0] = row[(x * 2) + 1];
+        yuv[1] = row[(x & ~1) * 2];
+        yuv[2] = row[((x & ~1) * 2) + 2];
+        break;
+    default:
+        yuv[0] = row[x];
+        yuv[1] = f->planes[1][((y >> 1) * f->strides[1]) + (x >> 1)];
+        yuv[2] = f->planes[2][((y >> 1) * f->strides[2]) + (x >> 1)];
+        break;
+    }
+}
+
+/* the clips, as X makes them: the window within the screen, less the
+ * windows of the ports above it, in bands of boxes.  And who is seen at
+ * each pixel:
+ */
+static void
+clips_init(void)
+{
+    BoxRec *boxes = malloc(sizeof(BoxRec) * width * height / 2 + 1);
+    int *band = malloc(sizeof(int) * width), *prev = malloc(sizeof(int) * width);
+    int i, x, y;
+
+    memset(owner, -1, width * height);
+    for (i = MAX_PORTS - 1; i >= 0; i--) {
+        TestPort *t = &ports[i];
+        if (!t->active)
+            continue;
+        for (y = MAX(t->y, 0); y < MIN(t->y + t->h, height); y++)
+            for (x = MAX(t->x, 0); x < MIN(t->x + t->w, width); x++)
+                owner[(y * width) + x] = i;
+    }
+
+    for (i = 0; i < MAX_PORTS; i++) {
+        TestPort *t = &ports[i];
+        int nbox = 0, nprev = 0, first = 0;
+
+        if (!t->active)
+            continue;
+
+        for (y = 0; y < height; y++) {
+            int n = 0, same;
+
+            /* the runs of this row: */
+            for (x = 0; x < width; x++) {
+                if ((owner[(y * width) + x] == i) &&
+                        (!x || (owner[(y * width) + x - 1] != i)))
+                    band[n++] = x;
+                if ((owner[(y * width) + x] == i) &&
+                        ((x == width - 1) || (owner[(y * width) + x + 1] != i)))
+                    band[n++] = x + 1;
+            }
+
+            /* rows that are the same make one band: */
+            same = (n == nprev) && n && !memcmp(band, prev, n * sizeof(int));
+            if (same) {
+                int j;
+                for (j = first; j < nbox; j++)
+                    boxes[j].y2 = y + 1;
+            } else {
+                int j;
+                first = nbox;
+                for (j = 0; j < n; j += 2)
+                    boxes[nbox++] = (BoxRec){ band[j], y, band[j + 1], y + 1 };
+            }
+            memcpy(prev, band, n * sizeof(int));
+            nprev = n;
+        }
+
+        RegionUninit(&t->clip);
+        RegionInitBoxes(&t->clip, boxes, nbox);
+    }
+
+    /* only within the frame is anything drawn: */
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            i = owner[(y * width) + x];
+            if ((i >= 0) && ((x < (ports[i].x & ~1)) ||
+                    (x >= (ports[i].x & ~1) + ports[i].frame.width) ||
+                    (y >= ports[i].y + ports[i].frame.height)))
+                owner[(y * width) + x] = -1;
+        }
+    }
+
+    free(boxes);
+    free(band);
+    free(prev);
+}
+
+/* the buffer queued last, from the device's side: */
+static const uint8_t *
+queued_buffer(int fd, int sizeimage)
+{
+    struct v4l2_buffer buf;
+    int i, last = -1;
+    unsigned int sequence = 0;
+
+    for (i = 0; i < 8; i++) {
+        memset(&buf, 0x00, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (v4l2FakeBackend.ioctl(fd, VIDIOC_QUERYBUF, &buf))
+            break;
+        if ((buf.flags & V4L2_BUF_FLAG_QUEUED) &&
+                ((last < 0) || (buf.sequence > sequence))) {
+            last = i;
+            sequence = buf.sequence;
+        }
+    }
+
+    if (last < 0)
+        return NULL;
+
+    return v4l2FakeBackend.mmap(fd, sizeimage, PROT_READ | PROT_WRITE,
+            last * sizeimage);
+}
+
+/* every pixel against what it should be.  Pixels pair up for the chroma,
+ * which is the frame's if both are the same port's, else black's:
+ */
+static int
+check(const uint8_t *mem, int stride, int round)
+{
+    int x, y, errors = 0;
+
+    if (!mem) {
+        fprintf(stderr, "round %d: nothing queued\n", round);
+        return 1;
+    }
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            const uint8_t *d = mem + (y * stride) + (x * 2);
+            int i = owner[(y * width) + x];
+            int j = owner[(y * width) + (x ^ 1)];
+            uint8_t want[3] = { 0x10, 0x80, 0x80 };
+            uint8_t got[3];
+
+            if (i >= 0) {
+                TestPort *t = &ports[i];
+                uint8_t yuv[3];
+                frame_pixel(&t->frame, x - (t->x & ~1), y - t->y, yuv);
+                want[0] = yuv[0];
+                if (i == j) {
+                    want[1] = yuv[1];
+                    want[2] = yuv[2];
+                }
+            }
+
+            got[0] = d[0];
+            got[1] = d[(x & 1) ? -1 : 1];
+            got[2] = d[(x & 1) ? 1 : 3];
+
+            if (memcmp(got, want, 3)) {
+                if (errors++ < 10) {
+                    fprintf(stderr, "round %d: pixel %d,%d of port %d: "
+                            "%02x %02x %02x, not %02x %02x %02x\n",
+                            round, x, y, i, got[0], got[1], got[2],
+                            want[0], want[1], want[2]);
+                }
+            }
+        }
+    }
+
+    return errors;
+}
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n rounds] [-s seed] [WxH]\n", prog);
+    exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+    int rounds = 200, seed = 1, errors = 0;
+    struct v4l2_format format;
+    struct v4l2_capability cap;
+    const uint8_t *mem;
+    V4L2DeviceInfo info;
+    ScreenRec screen;
+    int fd, opt, r, i;
+
+    width = 202;
+    height = 130;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+        case 'n':
+            rounds = atoi(optarg);
+            break;
+        case 's':
+            seed = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if ((argc - optind > 1) || ((argc - optind == 1) &&
+            (sscanf(argv[optind], "%dx%d", &width, &height) != 2)))
+        usage(argv[0]);
+
+    srand(seed);
+    width &= ~1;
+    owner = malloc(width * height);
+
+    fd = v4l2FakeBackend.open("fake:0", O_RDWR);
+    if ((fd < 0) || !owner) {
+        perror("fake:0");
+        return 1;
+    }
+
+    memset(&info, 0x00, sizeof(info));
+    v4l2FakeBackend.ioctl(fd, VIDIOC_QUERYCAP, &cap);
+    info.capabilities = cap.capabilities;
+    info.formats[info.nformats++] = V4L2_PIX_FMT_YUYV;
+    strcpy(info.card, "fake");
+
+    memset(&screen, 0x00, sizeof(screen));
+    screen.width = width;
+    screen.height = height;
+
+    for (i = 0; i < MAX_PORTS; i++) {
+        ports[i].port.nr = i;
+        RegionNull(&ports[i].clip);
+    }
+
+    for (r = 0; r < rounds; r++) {
+        /* some ports move, some get a new frame, some come or go: */
+        for (i = 0; i < MAX_PORTS; i++) {
+            TestPort *t = &ports[i];
+            int what = rnd(8);
+
+            if (t->active && (what == 0)) {
+                V4L2MosaicStop(&t->port);
+                t->active = FALSE;
+            } else if (!t->active && (what < 4)) {
+                t->active = TRUE;
+                what = 1;
+            }
+
+            if (t->active && (what == 1)) {
+                t->w = 4 + rnd(width / 2);
+                t->h = 4 + rnd(height / 2);
+                t->x = rnd(width + 8) - 8;
+                t->y = rnd(height + 8) - 8;
+                frame_init(t);
+            } else if (t->active && (what == 2)) {
+                frame_init(t);
+            }
+        }
+
+        clips_init();
+
+        for (i = 0; i < MAX_PORTS; i++) {
+            TestPort *t = &ports[i];
+            if (!t->active)
+                continue;
+            if (V4L2MosaicSetPosition(&t->port, &v4l2FakeBackend, fd, &info,
+                    &screen, t->x, t->y, &t->clip) != Success) {
+                fprintf(stderr, "round %d: port %d not in the mosaic\n", r, i);
+                return 1;
+            }
+            V4L2MosaicSetFrame(&t->port, &t->frame);
+        }
+
+        if (!blockHandler)
+            continue;
+        blockHandler(NULL, NULL, NULL);
+
+        memset(&format, 0x00, sizeof(format));
+        format.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        v4l2FakeBackend.ioctl(fd, VIDIOC_G_FMT, &format);
+        mem = queued_buffer(fd, format.fmt.pix.sizeimage);
+        errors += check(mem, format.fmt.pix.bytesperline, r);
+        if (mem)
+            v4l2FakeBackend.munmap((void *)mem, format.fmt.pix.sizeimage);
+    }
+
+    for (i = 0; i < MAX_PORTS; i++)
+        if (ports[i].active)
+            V4L2MosaicStop(&ports[i].port);
+    v4l2FakeBackend.close(fd);
+
+    printf("%d rounds of %dx%d, %d pixels wrong\n", rounds, width, height,
+            errors);
+
+    return errors != 0;
+}
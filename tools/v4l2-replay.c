@@ -0,0 +1,374 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: replay a session recorded by the v4l2 driver (see
+ *   RecordFile) through the driver itself, on a fake server with fake
+ *   devices, and report how long each shadow update took, what it wrote,
+ *   and the ioctls of the session.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "v4l2.h"
+#include "v4l2-fakeserver.h"
+
+/* The replay loads the driver on a fake server (see v4l2-fakeserver.c),
+ * with the options the session was recorded with and a fake device in
+ * place of each recorded one.  The Xv requests go to its adaptors, as
+ * they came (an empty clip suspends the port, as it did then), and each
+ * recorded update is damaged, with the cursors it was drawn with, and
+ * drawn by the driver's block handler.  The clock moves on as recorded,
+ * so the driver's timers fire as they did.
+ *
+ * The recorded damage includes what the driver damaged itself (filling
+ * clips, catching up on an UpdateBudget), which the replayed driver damages
+ * again; as damage is a region, it is drawn once.
+ */
+
+#define MAX_PORTS   16
+#define MAX_OPTIONS 32
+#define FOURCC_YUY2 0x32595559
+
+/* by the port numbers of the recording: */
+static struct {
+    XF86VideoAdaptorPtr adaptor;
+    pointer port;
+} ports[MAX_PORTS];
+
+static unsigned char *image;        /* what PutImage shows */
+static unsigned long unsupported;   /* requests the ports don't take */
+
+/* ---------------------------------------------------------------------- */
+
+/* each device of the recording, as a fake one: */
+static char *
+FakeDevices(const char *recorded)
+{
+    static char devices[256];
+    char *list = strdup(recorded), *p = list, *dev;
+    int n = 0, len;
+
+    len = snprintf(devices, sizeof(devices), "Devices=");
+    while (list && (dev = strsep(&p, ","))) {
+        if (!strncmp(dev, "fake:", 5)) {
+            len += snprintf(devices + len, sizeof(devices) - len, "%s%s",
+                    n ? "," : "", dev);
+        } else {
+            len += snprintf(devices + len, sizeof(devices) - len,
+                    "%sfake:%d", n ? "," : "", n);
+        }
+        if (len >= sizeof(devices))
+            break;
+        n++;
+    }
+    free(list);
+
+    return devices;
+}
+
+static void
+FindPorts(void)
+{
+    int i, j;
+
+    for (i = 0; i < fakeServer.nadaptors; i++) {
+        XF86VideoAdaptorPtr adaptor = fakeServer.adaptors[i];
+        for (j = 0; j < adaptor->nPorts; j++) {
+            PortPrivPtr pPPriv = adaptor->pPortPrivates[j].ptr;
+            if (pPPriv->nr < MAX_PORTS) {
+                ports[pPPriv->nr].adaptor = adaptor;
+                ports[pPPriv->nr].port = pPPriv;
+            }
+        }
+    }
+}
+
+static void
+Request(const V4L2RecordEntry *entry, RegionPtr clip)
+{
+    XF86VideoAdaptorPtr adaptor = ports[entry->port].adaptor;
+    pointer port = ports[entry->port].port;
+    DrawablePtr pDraw = &fakeServer.pRoot->drawable;
+    const int16_t *a = entry->args;
+    short w, h;
+
+    switch (entry->type) {
+    case V4L2_RECORD_PUT_IMAGE:
+        if (!adaptor->PutImage)
+            break;
+        /* an image of the window's size, as far as the screen goes: */
+        w = MAX(2, MIN(a[2], fakeServer.width)) & ~1;
+        h = MAX(1, MIN(a[3], fakeServer.height));
+        (*adaptor->PutImage)(fakeServer.pScrn, 0, 0, a[0], a[1], w, h,
+                a[2], a[3], FOURCC_YUY2, image, w, h, FALSE, clip, port,
+                pDraw);
+        return;
+    case V4L2_RECORD_PUT_VIDEO:
+        if (!adaptor->PutVideo)
+            break;
+        (*adaptor->PutVideo)(fakeServer.pScrn, 0, 0, a[0], a[1], a[2], a[3],
+                a[2], a[3], clip, port, pDraw);
+        return;
+    case V4L2_RECORD_REPUT_IMAGE:
+        (*adaptor->ReputImage)(fakeServer.pScrn, a[0], a[1], clip, port,
+                pDraw);
+        return;
+    case V4L2_RECORD_STOP_VIDEO:
+        (*adaptor->StopVideo)(fakeServer.pScrn, port, a[0]);
+        return;
+    }
+
+    unsupported++;
+}
+
+static int
+cmp_ul(const void *a, const void *b)
+{
+    unsigned long x = *(const unsigned long *)a, y = *(const unsigned long *)b;
+    return (x > y) - (x < y);
+}
+
+static unsigned long
+now_nsec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000000UL) + ts.tv_nsec;
+}
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n iterations] [-o Name=Value].. "
+            "<recording>\n", prog);
+    fprintf(stderr, "  -o  a driver option, over the recorded ones\n");
+    exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+    V4L2RecordHeader hdr;
+    V4L2RecordEntry entry;
+    RegionRec region;
+    BoxRec cursors[FAKE_SERVER_MAX_CURSORS];
+    BoxPtr boxes = NULL;
+    char *recorded = NULL, *options[MAX_OPTIONS * 2 + 2], *p;
+    char *overrides[MAX_OPTIONS];
+    unsigned long *times = NULL, total = 0;
+    unsigned long nframes = 0, size = 0;
+    uint64_t usec = 0;
+    CARD32 clock = 0, start;
+    int c, iterations = 1, iter, i, nbox, boxSize = 0;
+    int noptions = 0, noverrides = 0, ncursors = 0;
+    FILE *f;
+
+    while ((c = getopt(argc, argv, "n:o:")) != -1) {
+        switch (c) {
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 'o':
+            if (noverrides == MAX_OPTIONS)
+                usage(argv[0]);
+            overrides[noverrides++] = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+
+    f = fopen(argv[optind], "rb");
+    if (!f) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    if ((fread(&hdr, sizeof(hdr), 1, f) != 1) ||
+            memcmp(hdr.magic, V4L2_RECORD_MAGIC, sizeof(hdr.magic)) ||
+            (hdr.version != V4L2_RECORD_VERSION)) {
+        fprintf(stderr, "%s: not a v4l2 recording (or wrong version)\n",
+                argv[optind]);
+        return 1;
+    }
+
+    /* the recorded options, the devices made fake, then those given: */
+    recorded = calloc(1, hdr.options + 1);
+    if (!recorded || (fread(recorded, 1, hdr.options, f) != hdr.options)) {
+        fprintf(stderr, "%s: truncated options\n", argv[optind]);
+        return 1;
+    }
+    for (p = recorded; p < recorded + hdr.options; p += strlen(p) + 1) {
+        if (noptions == MAX_OPTIONS)
+            break;
+        if (!strncmp(p, "Devices=", 8))
+            options[noptions++] = FakeDevices(p + 8);
+        else
+            options[noptions++] = p;
+    }
+    for (i = 0; i < noverrides; i++)
+        options[noptions++] = overrides[i];
+    options[noptions] = NULL;
+
+    image = calloc(1, hdr.width * hdr.height * 2);
+    if (!image) {
+        perror("calloc");
+        return 1;
+    }
+
+    if (!FakeServerStart(hdr.width, hdr.height, options)) {
+        fprintf(stderr, "no devices\n");
+        return 1;
+    }
+    FindPorts();
+    FakeServerBlock();
+    FakeServerReport("init", 0, 0);
+
+    for (iter = 0; iter < iterations; iter++) {
+        fseek(f, sizeof(hdr) + hdr.options, SEEK_SET);
+        start = clock;
+        ncursors = 0;
+
+        while (fread(&entry, sizeof(entry), 1, f) == 1) {
+            if (entry.nbox > boxSize) {
+                boxSize = entry.nbox;
+                boxes = realloc(boxes, boxSize * sizeof(boxes[0]));
+                if (!boxes) {
+                    perror("realloc");
+                    return 1;
+                }
+            }
+            for (nbox = 0; nbox < entry.nbox; nbox++) {
+                V4L2RecordBox b;
+                if (fread(&b, sizeof(b), 1, f) != 1)
+                    break;
+                boxes[nbox].x1 = b.x1;
+                boxes[nbox].y1 = b.y1;
+                boxes[nbox].x2 = b.x2;
+                boxes[nbox].y2 = b.y2;
+            }
+            usec = entry.usec;
+
+            /* to when it happened, firing the timers due by then: */
+            if (start + (CARD32)(entry.usec / 1000) > clock) {
+                FakeServerAdvance(start + entry.usec / 1000 - clock);
+                clock = start + entry.usec / 1000;
+            }
+
+            switch (entry.type) {
+            case V4L2_RECORD_PUT_VIDEO:
+            case V4L2_RECORD_PUT_IMAGE:
+            case V4L2_RECORD_REPUT_IMAGE:
+            case V4L2_RECORD_STOP_VIDEO:
+                if ((entry.port >= MAX_PORTS) || !ports[entry.port].port) {
+                    unsupported++;
+                    break;
+                }
+                RegionInitBoxes(&region, boxes, nbox);
+                Request(&entry, &region);
+                RegionUninit(&region);
+                break;
+            case V4L2_RECORD_CURSOR:
+                /* those of the next update, recorded before its damage: */
+                if (ncursors < FAKE_SERVER_MAX_CURSORS) {
+                    cursors[ncursors].x1 = entry.args[0];
+                    cursors[ncursors].y1 = entry.args[1];
+                    cursors[ncursors].x2 = entry.args[0] + entry.args[2];
+                    cursors[ncursors].y2 = entry.args[1] + entry.args[3];
+                    ncursors++;
+                }
+                break;
+            case V4L2_RECORD_DAMAGE: {
+                unsigned long t;
+                if (entry.args[0] != 0) {
+                    ncursors = 0;
+                    break;      /* only the first screen is replayed */
+                }
+                if (nframes == size) {
+                    size = size ? size * 2 : 1024;
+                    times = realloc(times, size * sizeof(times[0]));
+                    if (!times) {
+                        perror("realloc");
+                        return 1;
+                    }
+                }
+                FakeServerCursors(cursors, ncursors);
+                RegionInitBoxes(&region, boxes, nbox);
+                FakeServerDamage(&region);
+                RegionUninit(&region);
+                t = now_nsec();
+                FakeServerBlock();
+                t = now_nsec() - t;
+                times[nframes++] = t;
+                total += t;
+                ncursors = 0;
+                break;
+            }
+            }
+        }
+
+        /* the next iteration starts from scratch: */
+        for (i = 0; i < MAX_PORTS; i++) {
+            if (ports[i].port)
+                (*ports[i].adaptor->StopVideo)(fakeServer.pScrn,
+                        ports[i].port, TRUE);
+        }
+        FakeServerBlock();
+    }
+
+    fclose(f);
+
+    if (!nframes) {
+        printf("no frames\n");
+        FakeServerStop();
+        return 0;
+    }
+
+    qsort(times, nframes, sizeof(times[0]), cmp_ul);
+
+    printf("frames:       %lu (%dx%d, %d iteration%s of %.1f s)\n",
+            nframes, hdr.width, hdr.height, iterations,
+            (iterations == 1) ? "" : "s", usec / 1e6);
+    printf("usec/frame:   p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+            times[nframes / 2] / 1000.0,
+            times[nframes * 90 / 100] / 1000.0,
+            times[nframes * 99 / 100] / 1000.0,
+            times[nframes - 1] / 1000.0);
+    if (unsupported)
+        printf("unsupported:  %lu requests\n", unsupported);
+    FakeServerReport("replay", nframes, total / 1000);
+
+    FakeServerStop();
+
+    free(recorded);
+    free(image);
+    free(times);
+    free(boxes);
+
+    return 0;
+}
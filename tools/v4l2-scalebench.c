@@ -0,0 +1,163 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: time the software scaler (see v4l2-scale.c) for a given
+ *   format and pair of sizes, to know what scaling in software will cost
+ *   on a device whose overlay can't scale.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "v4l2-scale.h"
+
+static const struct {
+    const char *name;
+    int format;
+} formats[] = {
+        { "yuyv",   V4L2_SCALE_YUYV },
+        { "uyvy",   V4L2_SCALE_UYVY },
+        { "yuv420", V4L2_SCALE_YUV420 },
+        { "nv12",   V4L2_SCALE_NV12 },
+};
+
+#define NFORMATS (sizeof(formats) / sizeof(formats[0]))
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+/* allocate an image, laid out as the driver's buffers are: */
+static size_t
+image_init(V4L2ScaleImage *img, int format, int width, int height)
+{
+    size_t size;
+
+    memset(img, 0x00, sizeof(*img));
+    img->format = format;
+    img->width = width;
+    img->height = height;
+
+    switch (format) {
+    case V4L2_SCALE_YUYV:
+    case V4L2_SCALE_UYVY:
+        img->strides[0] = width * 2;
+        size = img->strides[0] * height;
+        img->planes[0] = malloc(size);
+        break;
+    case V4L2_SCALE_YUV420:
+        img->strides[0] = width;
+        img->strides[1] = img->strides[2] = width / 2;
+        size = width * height * 3 / 2;
+        img->planes[0] = malloc(size);
+        img->planes[1] = img->planes[0] + (width * height);
+        img->planes[2] = img->planes[1] + (width * height / 4);
+        break;
+    default:
+        img->strides[0] = img->strides[1] = width;
+        size = width * height * 3 / 2;
+        img->planes[0] = malloc(size);
+        img->planes[1] = img->planes[0] + (width * height);
+        break;
+    }
+
+    if (!img->planes[0]) {
+        perror("malloc");
+        exit(1);
+    }
+
+    return size;
+}
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-f yuyv|uyvy|yuv420|nv12] [-t threads] "
+            "[-n iterations] SRCxSRC DSTxDST\n", prog);
+    exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+    V4L2ScaleImage src, dst, ref;
+    int format = V4L2_SCALE_YUYV, threads = 1, iterations = 100;
+    int sw, sh, dw, dh, opt, i;
+    size_t srcSize, dstSize;
+    double t;
+
+    while ((opt = getopt(argc, argv, "f:t:n:")) != -1) {
+        switch (opt) {
+        case 'f':
+            for (i = 0; i < NFORMATS; i++)
+                if (!strcmp(optarg, formats[i].name))
+                    break;
+            if (i == NFORMATS)
+                usage(argv[0]);
+            format = formats[i].format;
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if ((argc - optind != 2) ||
+            (sscanf(argv[optind], "%dx%d", &sw, &sh) != 2) ||
+            (sscanf(argv[optind + 1], "%dx%d", &dw, &dh) != 2))
+        usage(argv[0]);
+
+    srcSize = image_init(&src, format, sw & ~1, sh & ~1);
+    dstSize = image_init(&dst, format, dw & ~1, dh & ~1);
+    image_init(&ref, format, dw & ~1, dh & ~1);
+
+    srand(1);
+    for (i = 0; i < srcSize; i++)
+        src.planes[0][i] = rand();
+
+    /* banding must not change the result: */
+    V4L2Scale(&src, &ref, 1);
+    V4L2Scale(&src, &dst, threads);
+    if (memcmp(ref.planes[0], dst.planes[0], dstSize)) {
+        fprintf(stderr, "%d threads differ from 1 thread\n", threads);
+        return 1;
+    }
+
+    t = now();
+    for (i = 0; i < iterations; i++)
+        V4L2Scale(&src, &dst, threads);
+    t = now() - t;
+
+    printf("%dx%d -> %dx%d, %d thread(s): %.3f ms/frame, %.1f MB/s in\n",
+            src.width, src.height, dst.width, dst.height, threads,
+            t * 1000 / iterations, srcSize * iterations / t / 1e6);
+
+    return 0;
+}
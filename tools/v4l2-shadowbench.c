@@ -0,0 +1,301 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: time the solid blit (see v4l2-blit.c) from a shadow
+ *   allocated the way the fbdev driver does, and from one allocated by
+ *   V4L2ShadowAlloc() (see HugeShadow option), for a few shapes of damage.
+ *   Also check the un-premultiplying blit of OSD windows against a pixel
+ *   at a time with the lookup table, and time both.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "v4l2-blit.h"
+
+typedef struct {
+    int x1, y1, x2, y2;
+} Box;
+
+#define MAX_BOXES   256
+#define ROUNDS      5
+
+#ifndef MIN
+#  define MIN(a,b) ((a) > (b) ? (b) : (a))
+#endif
+
+static const char *kinds[] = { "no", "transparent", "hugetlb" };
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+/* damage of a given shape: */
+static int
+damage_init(Box *boxes, const char *shape, int width, int height)
+{
+    int i, n = 0;
+
+    srand(1);
+
+    if (!strcmp(shape, "full")) {
+        boxes[n++] = (Box){ 0, 0, width, height };
+    } else if (!strcmp(shape, "boxes")) {
+        /* windows, menus, text..: */
+        for (i = 0; i < 64; i++) {
+            int w = 16 + (rand() % 240), h = 16 + (rand() % 240);
+            int x = rand() % (width - w), y = rand() % (height - h);
+            boxes[n++] = (Box){ x, y, x + w, y + h };
+        }
+    } else if (!strcmp(shape, "columns")) {
+        /* scrollbars, panels, text cursors..: */
+        for (i = 0; i < 32; i++) {
+            int w = 8 + (rand() % 24);
+            int x = rand() % (width - w);
+            boxes[n++] = (Box){ x, 0, x + w, height };
+        }
+    }
+
+    return n;
+}
+
+static double
+bench(void *win, int winStride, void *sha, int shaStride,
+        const Box *boxes, int nbox, int iterations, size_t *bytes)
+{
+    double t;
+    int i, j;
+
+    *bytes = 0;
+    for (j = 0; j < nbox; j++)
+        *bytes += (size_t)(boxes[j].x2 - boxes[j].x1) *
+                (boxes[j].y2 - boxes[j].y1) * 4;
+
+    t = now();
+    for (i = 0; i < iterations; i++) {
+        for (j = 0; j < nbox; j++) {
+            const Box *b = &boxes[j];
+            V4L2ShadowBlitSolidARGB32(
+                    win + (b->y1 * winStride) + (b->x1 * 4), winStride,
+                    sha + (b->y1 * shaStride) + (b->x1 * 4), shaStride,
+                    b->x2 - b->x1, b->y2 - b->y1);
+        }
+    }
+
+    return now() - t;
+}
+
+/* the un-premultiply of OSDAlpha "straight", a pixel at a time: */
+static uint32_t
+unpremultiply_ref(uint32_t p)
+{
+    static uint32_t table[256];
+    uint32_t a = p >> 24, m, r, g, b;
+
+    if (!table[1]) {
+        for (m = 1; m < 256; m++)
+            table[m] = ((255 << 16) + (m / 2)) / m;
+    }
+
+    if (a == 0xff)
+        return p;
+    if (a == 0)
+        return 0;
+
+    m = table[a];
+    r = ((((p >> 16) & 0xff) * m) + 0x8000) >> 16;
+    g = ((((p >>  8) & 0xff) * m) + 0x8000) >> 16;
+    b = ((((p >>  0) & 0xff) * m) + 0x8000) >> 16;
+
+    return (a << 24) | (MIN(r, 0xff) << 16) | (MIN(g, 0xff) << 8) | MIN(b, 0xff);
+}
+
+/* every alpha with every value of each channel, premultiplied or not, in
+ * rows of an odd width so that they start in every lane.  Returns the
+ * number of pixels that differ:
+ */
+static int
+check_unpremultiply(void)
+{
+    enum { W = 251, H = (256 * 256 + W - 1) / W };
+    static const V4L2TileBox holes[] = {
+        { 3, 5, 40, 17 }, { 37, 20, 200, 75 },
+    };
+    uint32_t *sha = malloc(W * H * 4), *win = malloc(W * H * 4);
+    int i, wrong = 0;
+
+    if (!sha || !win) {
+        perror("alloc");
+        exit(1);
+    }
+
+    for (i = 0; i < W * H; i++) {
+        uint32_t a = (i >> 8) & 0xff, c = i & 0xff;
+        sha[i] = (a << 24) | (c << 16) | ((255 - c) << 8) | ((c * 7) & 0xff);
+    }
+
+    V4L2ShadowBlitUnpremultiplyARGB32(win, W * 4, sha, W * 4, W, H);
+    for (i = 0; i < W * H; i++)
+        wrong += (win[i] != unpremultiply_ref(sha[i]));
+
+    /* and gathered, a column at a time: */
+    V4L2ShadowBlitGatherARGB32(win, H * 4, sha, W * 4, 4, H, W,
+            V4L2_GATHER_UNPREMULTIPLY);
+    for (i = 0; i < W * H; i++)
+        wrong += (win[(i % W) * H + (i / W)] != unpremultiply_ref(sha[i]));
+
+    /* and with holes, which come out transparent: */
+    V4L2ShadowBlitGatherHolesARGB32(win, H * 4, sha, W * 4, 4, H, W,
+            V4L2_GATHER_UNPREMULTIPLY, holes, 2);
+    for (i = 0; i < W * H; i++) {
+        int x = i / W, y = i % W, j;
+        uint32_t want = unpremultiply_ref(sha[i]);
+
+        for (j = 0; j < 2; j++) {
+            if ((x >= holes[j].x1) && (x < holes[j].x2) &&
+                    (y >= holes[j].y1) && (y < holes[j].y2))
+                want = 0;
+        }
+        wrong += (win[y * H + x] != want);
+    }
+
+    free(sha);
+    free(win);
+
+    return wrong;
+}
+
+static double
+bench_unpremultiply(uint32_t *win, uint32_t *sha, int width, int height,
+        int iterations, int ref)
+{
+    double t;
+    int i, j;
+
+    t = now();
+    for (i = 0; i < iterations; i++) {
+        if (!ref) {
+            V4L2ShadowBlitUnpremultiplyARGB32(win, width * 4, sha, width * 4,
+                    width, height);
+            continue;
+        }
+        for (j = 0; j < width * height; j++)
+            win[j] = unpremultiply_ref(sha[j]);
+    }
+
+    return now() - t;
+}
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n iterations] [WxH]\n", prog);
+    exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+    static const char *shapes[] = { "full", "boxes", "columns" };
+    Box boxes[MAX_BOXES];
+    int width = 1920, height = 1080, iterations = 100;
+    int stride, huge, opt, i, r, nbox, wrong;
+    size_t size, bytes;
+    void *plain, *padded, *win;
+    double t0, t1;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if ((argc - optind > 1) || ((argc - optind == 1) &&
+            (sscanf(argv[optind], "%dx%d", &width, &height) != 2)))
+        usage(argv[0]);
+
+    /* as the fbdev driver allocates its shadow: */
+    plain = calloc(1, (size_t)width * height * 4);
+    padded = V4L2ShadowAlloc(width, height, &stride, &size, &huge);
+    win = malloc((size_t)width * height * 4);
+    if (!plain || !padded || !win) {
+        perror("alloc");
+        return 1;
+    }
+
+    /* touch everything, so page faults aren't timed: */
+    memset(padded, 0x55, size);
+    memset(plain, 0x55, (size_t)width * height * 4);
+    memset(win, 0x00, (size_t)width * height * 4);
+
+    printf("%dx%d: shadow stride %d -> %d, %s huge pages\n", width, height,
+            width * 4, stride, kinds[huge]);
+
+    for (i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+        nbox = damage_init(boxes, shapes[i], width, height);
+
+        /* alternated, and the best of each, to even out the noise: */
+        for (r = 0, t0 = t1 = 1e9; r < ROUNDS; r++) {
+            t0 = MIN(t0, bench(win, width * 4, plain, width * 4,
+                    boxes, nbox, iterations, &bytes));
+            t1 = MIN(t1, bench(win, width * 4, padded, stride,
+                    boxes, nbox, iterations, &bytes));
+        }
+        printf("%-8s %3d boxes: before %.3f ms/update %.1f MB/s, "
+                "after %.3f ms/update %.1f MB/s (%+.1f%%)\n",
+                shapes[i], nbox,
+                t0 * 1000 / iterations, bytes * iterations / t0 / 1e6,
+                t1 * 1000 / iterations, bytes * iterations / t1 / 1e6,
+                (t0 - t1) * 100 / t0);
+    }
+
+    /* half transparent, as the edges of OSD windows are: */
+    for (i = 0; i < width * height; i++)
+        ((uint32_t *)plain)[i] = ((i & 0xff) << 24) | (i & 0x7f7f7f);
+
+    for (r = 0, t0 = t1 = 1e9; r < ROUNDS; r++) {
+        t0 = MIN(t0, bench_unpremultiply(win, plain, width, height,
+                iterations, 1));
+        t1 = MIN(t1, bench_unpremultiply(win, plain, width, height,
+                iterations, 0));
+    }
+    bytes = (size_t)width * height * 4;
+    printf("unpremultiply full: before %.3f ms/update %.1f MB/s, "
+            "after %.3f ms/update %.1f MB/s (%+.1f%%)\n",
+            t0 * 1000 / iterations, bytes * iterations / t0 / 1e6,
+            t1 * 1000 / iterations, bytes * iterations / t1 / 1e6,
+            (t0 - t1) * 100 / t0);
+
+    wrong = check_unpremultiply();
+    printf("unpremultiply: %d pixels differ from the table\n", wrong);
+
+    V4L2ShadowFree(padded, size);
+
+    return wrong != 0;
+}
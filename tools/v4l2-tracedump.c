@@ -0,0 +1,146 @@
+/* xf86-video-v4l2
+ *
+ * Copyright (C) 2010 Texas Instruments, Inc - http://www.ti.com/
+ *
+ * Description: decode a trace dumped by the v4l2 driver (see TraceFile)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "v4l2-trace.h"
+
+#define XY_X(v)  ((int)(short)((v) & 0xffff))
+#define XY_Y(v)  ((int)(short)((unsigned)(v) >> 16))
+
+static const char *opNames[] = { "solid", "transparent", "cursor", "osd" };
+
+#define NUM_OPS  (sizeof(opNames) / sizeof(opNames[0]))
+
+static void
+print_event(const V4L2TraceRecord *rec)
+{
+    const int32_t *a = rec->args;
+
+    switch (rec->event) {
+    case V4L2_TRACE_PUT_VIDEO:
+    case V4L2_TRACE_PUT_STILL:
+        printf("%s drw=%d,%d %dx%d",
+                (rec->event == V4L2_TRACE_PUT_VIDEO) ? "PutVideo" : "PutStill",
+                a[0], a[1], a[2], a[3]);
+        break;
+    case V4L2_TRACE_PUT_IMAGE:
+        printf("PutImage drw=%d,%d %dx%d", a[0], a[1], a[2], a[3]);
+        break;
+    case V4L2_TRACE_GET_VIDEO:
+    case V4L2_TRACE_GET_STILL:
+        printf("%s drw=%d,%d %dx%d",
+                (rec->event == V4L2_TRACE_GET_VIDEO) ? "GetVideo" : "GetStill",
+                a[0], a[1], a[2], a[3]);
+        break;
+    case V4L2_TRACE_PRESENT:
+        printf("Present buf=%d queued=+%dus shown=+%dus%s", a[0], a[1], a[2],
+                a[3] ? "" : " (dequeued)");
+        break;
+    case V4L2_TRACE_SUSPEND:
+        printf("%s%s", a[0] ? "Suspend" : "Resume",
+                a[1] ? (a[0] ? " overlay=off" : " overlay=on") : "");
+        break;
+    case V4L2_TRACE_REPUT_IMAGE:
+        printf("ReputImage drw=%d,%d", a[0], a[1]);
+        break;
+    case V4L2_TRACE_STOP_VIDEO:
+        printf("StopVideo shutdown=%d", a[0]);
+        break;
+    case V4L2_TRACE_SET_CLIP:
+        printf("SetClip nbox=%d extents=%d,%d-%d,%d", a[0],
+                XY_X(a[1]), XY_Y(a[1]), XY_X(a[2]), XY_Y(a[2]));
+        break;
+    case V4L2_TRACE_CLEAR_CLIP:
+        printf("ClearClip");
+        break;
+    case V4L2_TRACE_IOCTL:
+        printf("ioctl %08x -> %d, %dus", (unsigned)a[0], a[1], a[2]);
+        break;
+    case V4L2_TRACE_UPDATE_BEGIN:
+        printf("UpdateBegin screen=%d nbox=%d clips=%d", a[0], a[1], a[2]);
+        break;
+    case V4L2_TRACE_UPDATE_END:
+        printf("UpdateEnd screen=%d %dus", a[0], a[1]);
+        break;
+    case V4L2_TRACE_BLIT:
+        printf("Blit %s nbox=%d bytes=%d",
+                ((unsigned)a[0] < NUM_OPS) ? opNames[a[0]] : "?", a[1], a[2]);
+        break;
+    case V4L2_TRACE_FLIP:
+        printf("Flip screen=%d page=%d waited=%dus pan=%dus",
+                a[0], a[1], a[2], a[3]);
+        break;
+    default:
+        printf("event%d %d %d %d %d", rec->event, a[0], a[1], a[2], a[3]);
+        break;
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    V4L2TraceHeader hdr;
+    V4L2TraceRecord rec;
+    uint64_t first = 0, prev = 0;
+    uint32_t i;
+    FILE *f;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <tracefile>\n", argv[0]);
+        return 1;
+    }
+
+    f = fopen(argv[1], "rb");
+    if (!f) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    if ((fread(&hdr, sizeof(hdr), 1, f) != 1) ||
+            memcmp(hdr.magic, V4L2_TRACE_MAGIC, sizeof(hdr.magic)) ||
+            (hdr.version != V4L2_TRACE_VERSION)) {
+        fprintf(stderr, "%s: not a v4l2 trace (or wrong version)\n", argv[1]);
+        return 1;
+    }
+
+    /* timestamps are printed relative to the first record, followed by
+     * the delta from the previous one, both in usec:
+     */
+    for (i = 0; i < hdr.count; i++) {
+        if (fread(&rec, sizeof(rec), 1, f) != 1) {
+            fprintf(stderr, "%s: truncated after %u records\n", argv[1], i);
+            break;
+        }
+        if (i == 0)
+            first = prev = rec.nsec;
+        printf("%12.3f %+10.3f [%u] ", (rec.nsec - first) / 1000.0,
+                (rec.nsec - prev) / 1000.0, rec.port);
+        print_event(&rec);
+        printf("\n");
+        prev = rec.nsec;
+    }
+
+    fclose(f);
+    return 0;
+}